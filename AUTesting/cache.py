@@ -0,0 +1,105 @@
+import os
+import json
+import shutil
+import hashlib
+import tempfile
+import threading
+from dataclasses import dataclass
+
+
+# answers of the model, compiled tests and their runs, kept between runs of main.py
+CACHE_DIR = "./build/cache"
+
+
+@dataclass
+class KindStats:
+    hits: int = 0
+    misses: int = 0
+    # seconds the entries found took to make, in the run that stored them
+    saved: float = 0.0
+
+    def __str__(self) -> str:
+        lookups = self.hits + self.misses
+        rate = 100 * self.hits / lookups if lookups else 0.0
+        return f"{self.hits}/{lookups} hits ({rate:.0f} %), {self.saved:.2f} s saved"
+
+
+class Cache:
+    """
+    A content-addressed store: an entry is found by the hash of everything its content
+    depends on (see key), so it never needs to be invalidated; a change of any input
+    just misses. Entries are directories <kind>/<key[:2]>/<key> holding entry.json and
+    copies of files, written to a temporary directory and renamed, so that threads and
+    processes sharing the cache see whole entries or none.
+    """
+
+    def __init__(self, directory=CACHE_DIR):
+        self.directory = directory
+        self.stats = {}
+        self.lock = threading.Lock()
+
+    @staticmethod
+    def key(*parts) -> str:
+        return hashlib.sha256(json.dumps(parts, sort_keys=True).encode()).hexdigest()
+
+    @staticmethod
+    def file_hash(path: str) -> str:
+        digest = hashlib.sha256()
+        with open(path, "rb") as f:
+            for block in iter(lambda: f.read(1 << 20), b""):
+                digest.update(block)
+        return digest.hexdigest()
+
+    def path(self, kind: str, key: str) -> str:
+        return os.path.join(self.directory, kind, key[:2], key)
+
+    def count(self, kind: str, entry):
+        with self.lock:
+            stats = self.stats.setdefault(kind, KindStats())
+            if entry is None:
+                stats.misses += 1
+            else:
+                stats.hits += 1
+                stats.saved += entry.get("seconds", 0.0)
+
+    def get(self, kind: str, key: str):
+        """
+        Returns:
+        - dict: the entry stored with put, None if there is none
+        """
+        try:
+            with open(os.path.join(self.path(kind, key), "entry.json")) as f:
+                entry = json.load(f)
+        except (OSError, ValueError):
+            entry = None
+        self.count(kind, entry)
+        return entry
+
+    def put(self, kind: str, key: str, entry: dict, files=None):
+        """
+        Stores an entry with copies of the files, {name: path}; entry["seconds"] is the
+        time making it took, counted as saved by every hit.
+        """
+        final = self.path(kind, key)
+        if os.path.isdir(final):
+            return
+        os.makedirs(os.path.dirname(final), exist_ok=True)
+
+        tmp = tempfile.mkdtemp(dir=os.path.dirname(final))
+        try:
+            for name, path in (files or {}).items():
+                shutil.copy2(path, os.path.join(tmp, name))
+            with open(os.path.join(tmp, "entry.json"), "w") as f:
+                json.dump(entry, f)
+            os.replace(tmp, final)
+        except OSError:
+            # another thread or process stored the same entry first
+            shutil.rmtree(tmp, ignore_errors=True)
+
+    def restore(self, kind: str, key: str, name: str, dest: str):
+        # copy2 keeps the mode: a restored test stays executable
+        shutil.copy2(os.path.join(self.path(kind, key), name), dest)
+
+    def report(self) -> str:
+        with self.lock:
+            return "; ".join(f"{kind} {stats}" for kind, stats in sorted(self.stats.items())) or "not used"
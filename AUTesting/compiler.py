@@ -2,14 +2,66 @@ import os
 import subprocess
 import logging
 import shlex
+import hashlib
+import time
+import threading
+from dataclasses import dataclass
+
+from AUTesting.cache import Cache
+
+
+COVERAGE_FLAGS = ["-fprofile-arcs", "-ftest-coverage"]
+
+# the sources use POSIX threads (the concurrent container), and so may the tests
+THREAD_FLAGS = ["-pthread"]
+
+# instrumented objects of the sources under test, named by the hash of their contents
+OBJECTS_DIR = "./build/objects"
+
+
+@dataclass
+class CompileStats:
+    sources_built: int = 0
+    sources_reused: int = 0
+    tests_compiled: int = 0
+    sources_time: float = 0.0
+    compile_time: float = 0.0
+    link_time: float = 0.0
+
+    def add(self, **amounts):
+        # tests may be compiled in several threads at once
+        with _stats_lock:
+            for name, amount in amounts.items():
+                setattr(self, name, getattr(self, name) + amount)
+
+    def __str__(self) -> str:
+        return (
+            f"sources built {self.sources_built}, reused {self.sources_reused} "
+            f"({self.sources_time:.2f} s); tests compiled {self.tests_compiled} "
+            f"({self.compile_time:.2f} s), linked ({self.link_time:.2f} s)"
+        )
+
+
+_stats_lock = threading.Lock()
+
+# totals of the run
+stats = CompileStats()
+
+# objects built or found in this run: (compiler, flags, source, mtime, size) -> object;
+# built by one thread at a time
+_objects = {}
+_objects_lock = threading.Lock()
 
 
 class Compiler(Exception):
-    def __init__(self, file_code, include_file="", link_libraries=[], using_compiler = "gcc"):
+    def __init__(self, file_code, include_file="", link_libraries=[], using_compiler = "gcc", cache=None):
         self.file_code = file_code
         self.include_file = include_file
         self.link_libraries = link_libraries
         self.using_compiler = using_compiler
+        # compiled tests by content (see Cache); self.key is that of the last one
+        self.cache = cache
+        self.key = None
 
     def check_files(self):
         if self.file_code is None:
@@ -20,20 +72,116 @@ class Compiler(Exception):
             raise Compiler(self.include_file + " isn't exist")
         return True
 
+    def include_flags(self):
+        flags = ["-I", "./"]
+        if self.include_file != "":
+            flags += ["-I", self.include_file]
+        return flags
+
+    def build_object(self, src: str):
+        """
+        Compiles a source under test into an instrumented object, once: the object is
+        named by the hash of the preprocessed source, the compiler and the flags, so it
+        is reused by every test of the run and by later runs while nothing changes.
+
+        Returns:
+        - (str, None): the path to the object
+        - (None, CompletedProcess): the failed compiler run
+        """
+        with _objects_lock:
+            return self._build_object(src)
+
+    def _build_object(self, src: str):
+        flags = COVERAGE_FLAGS + THREAD_FLAGS + self.include_flags()
+        info = os.stat(src)
+        key = (self.using_compiler, tuple(flags), os.path.abspath(src), info.st_mtime_ns, info.st_size)
+        if key in _objects:
+            stats.add(sources_reused=1)
+            return _objects[key], None
+
+        start = time.perf_counter()
+        s = subprocess.run([self.using_compiler, "-E", src] + flags, capture_output=True, text=True)
+        if s.returncode != 0:
+            stats.add(sources_time=time.perf_counter() - start)
+            return None, s
+
+        digest = hashlib.sha256()
+        for part in [self.using_compiler, " ".join(flags), s.stdout]:
+            digest.update(part.encode())
+        name = os.path.splitext(os.path.basename(src))[0]
+        # absolute, for GCOV_PREFIX_STRIP (see executor.run_test)
+        obj = os.path.join(os.path.abspath(OBJECTS_DIR), f"{name}-{digest.hexdigest()[:16]}.o")
+        gcno = os.path.splitext(obj)[0] + ".gcno"
+
+        if os.path.isfile(obj) and os.path.isfile(gcno):
+            stats.add(sources_reused=1)
+        else:
+            os.makedirs(OBJECTS_DIR, exist_ok=True)
+            command_line = [self.using_compiler, "-c", src] + flags + ["-o", obj]
+            logging.info(f"Compile sources: {command_line}")
+            s = subprocess.run(command_line, capture_output=True, text=True)
+            if s.returncode != 0:
+                stats.add(sources_time=time.perf_counter() - start)
+                return None, s
+            stats.add(sources_built=1)
+
+        stats.add(sources_time=time.perf_counter() - start)
+        _objects[key] = obj
+        return obj, None
+
     def start(self, srcs: str, out_file: str):
-        command_line = (
-            self.using_compiler + " "
-            + self.file_code
-            + f" {srcs} "
-            + " -fprofile-arcs -ftest-coverage " # for code coverage
-            + " -o "
-            + out_file
+        objects = []
+        for src in shlex.split(srcs):
+            obj, failed = self.build_object(src)
+            if failed is not None:
+                return failed
+            objects.append(obj)
+
+        if self.cache is None:
+            return self.compile_and_link(objects, out_file)
+
+        # the objects are named by their contents; their directory is in the binary, as
+        # the place of the coverage data
+        self.key = Cache.key(
+            self.using_compiler, self.include_flags(), COVERAGE_FLAGS + THREAD_FLAGS,
+            Cache.file_hash(self.file_code),
+            [os.path.basename(obj) for obj in objects], os.path.abspath(OBJECTS_DIR),
         )
-        if self.include_file is not "":
-            command_line += " -I ./ -I " + self.include_file
-        command_line = shlex.split(command_line)
+        entry = self.cache.get("tests", self.key)
+        if entry is not None:
+            logging.info(f"Compiled test from the cache: {self.key}")
+            if entry["returncode"] == 0:
+                self.cache.restore("tests", self.key, "test", out_file)
+            return subprocess.CompletedProcess(entry["args"], entry["returncode"], entry["stdout"], entry["stderr"])
+
+        start = time.perf_counter()
+        s = self.compile_and_link(objects, out_file)
+        entry = {
+            "args": s.args, "returncode": s.returncode, "stdout": s.stdout, "stderr": s.stderr,
+            "seconds": time.perf_counter() - start,
+        }
+        # failures too: the same test fails the same way, and gets the same fix request
+        self.cache.put("tests", self.key, entry, {"test": out_file} if s.returncode == 0 else None)
+        return s
+
+    def compile_and_link(self, objects, out_file: str):
+        # only the test itself is compiled, without coverage: it is not under test
+        test_obj = out_file + ".o"
+        command_line = ([self.using_compiler, "-c", self.file_code] + THREAD_FLAGS + self.include_flags()
+                        + ["-o", test_obj])
         logging.info(f"Compile: {command_line}")
+        start = time.perf_counter()
+        s = subprocess.run(command_line, capture_output=True, text=True)
+        stats.add(compile_time=time.perf_counter() - start)
+        if s.returncode != 0:
+            return s
+        stats.add(tests_compiled=1)
+
+        command_line = [self.using_compiler, test_obj] + objects + COVERAGE_FLAGS + THREAD_FLAGS + ["-o", out_file]
+        logging.info(f"Link: {command_line}")
+        start = time.perf_counter()
         s = subprocess.run(command_line, capture_output=True, text=True)
+        stats.add(link_time=time.perf_counter() - start)
         return s
 
     def run(self, srcs: str, out_file):
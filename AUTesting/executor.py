@@ -0,0 +1,131 @@
+import os
+import glob
+import shutil
+import logging
+import subprocess
+import time
+from dataclasses import dataclass
+
+import AUTesting.compiler as compiler
+
+
+# coverage data of every test, in a directory of its own: build/gcov/<test>/*.gcda
+GCOV_DIR = "./build/gcov"
+
+
+@dataclass
+class TestResult:
+    name: str
+    # the signature of the function under test
+    function: str = None
+    generated: bool = False
+    # a passing test of an earlier run, of a function unchanged since
+    reused: bool = False
+    compiled: bool = False
+    passed: bool = False
+    # the content key of the compiled test, for the cache of runs (see run_test)
+    key: str = None
+    # seconds spent waiting for the model and compiling (fixes included) and running
+    generate_time: float = 0.0
+    compile_time: float = 0.0
+    run_time: float = 0.0
+
+    @property
+    def latency(self) -> float:
+        return self.generate_time + self.compile_time + self.run_time
+
+
+def coverage_dir(name: str) -> str:
+    return os.path.join(GCOV_DIR, name)
+
+
+def run_test(name: str, out_file: str, cache=None, key=None):
+    """
+    Runs a compiled test. Its .gcda files go to coverage_dir(name) instead of next to
+    the shared objects, so tests running at once do not write the same files.
+
+    With a cache, 'key' is the content key of the test (Compiler.key): a test run
+    before is not run again, its result and coverage come from the cache. Tests are
+    expected to be deterministic.
+
+    Returns:
+    - CompletedProcess: the run of the test
+    """
+    os.makedirs(coverage_dir(name), exist_ok=True)
+    if cache is not None and key is not None:
+        entry = cache.get("runs", key)
+        if entry is not None:
+            for gcda in entry["gcda"]:
+                cache.restore("runs", key, gcda, coverage_dir(name))
+            return subprocess.CompletedProcess(entry["args"], entry["returncode"], entry["stdout"], entry["stderr"])
+
+    # the objects are in OBJECTS_DIR, an absolute path of this many components
+    strip = len(os.path.abspath(compiler.OBJECTS_DIR).strip(os.sep).split(os.sep))
+    env = dict(os.environ, GCOV_PREFIX=coverage_dir(name), GCOV_PREFIX_STRIP=str(strip))
+    start = time.perf_counter()
+    s = subprocess.run([out_file], capture_output=True, text=True, env=env)
+
+    if cache is not None and key is not None:
+        files = {os.path.basename(gcda): gcda for gcda in glob.glob(os.path.join(coverage_dir(name), "*.gcda"))}
+        entry = {
+            "args": s.args, "returncode": s.returncode, "stdout": s.stdout, "stderr": s.stderr,
+            "gcda": list(files), "seconds": time.perf_counter() - start,
+        }
+        cache.put("runs", key, entry, files)
+    return s
+
+
+def reset_coverage():
+    """
+    Removes the coverage of earlier runs: the merged .gcda files next to the objects and
+    those of every test, so that merge_coverage adds up the tests of this run only.
+    """
+    for gcda in glob.glob(os.path.join(compiler.OBJECTS_DIR, "*.gcda")):
+        os.remove(gcda)
+    shutil.rmtree(GCOV_DIR, ignore_errors=True)
+
+
+def merge_coverage(names):
+    """
+    Adds the coverage of the tests to the .gcda files next to the objects, one test at
+    a time, with gcov-tool; lcov and gcov then see the coverage of all of them. Expects
+    reset_coverage at the start of the run, or counts of earlier runs are added again.
+    """
+    if shutil.which("gcov-tool") is None:
+        logging.warning(f"gcov-tool not found, the coverage of every test stays in {GCOV_DIR}")
+        return
+
+    into = os.path.abspath(compiler.OBJECTS_DIR)
+    for name in names:
+        test_dir = coverage_dir(name)
+        if not glob.glob(os.path.join(test_dir, "*.gcda")):
+            continue
+        if not glob.glob(os.path.join(into, "*.gcda")):
+            for gcda in glob.glob(os.path.join(test_dir, "*.gcda")):
+                shutil.copy(gcda, into)
+            continue
+
+        s = subprocess.run(["gcov-tool", "merge", test_dir, into, "-o", into], capture_output=True, text=True)
+        if s.returncode != 0:
+            logging.warning(f"Coverage of {name} not merged: {s.stderr}")
+
+
+def report(results, wall_time: float):
+    logging.info(f"Wall-clock time: {wall_time:.2f} s, {len(results)} tests")
+    if not results:
+        return
+
+    for r in sorted(results, key=lambda r: r.latency, reverse=True):
+        status = "passed" if r.passed else "failed" if r.compiled else "not compiled" if r.generated or r.reused else "not generated"
+        if r.reused:
+            status += ", reused"
+        logging.info(
+            f"  {r.name}: {r.latency:.2f} s (model {r.generate_time:.2f} s, compile {r.compile_time:.2f} s, "
+            f"run {r.run_time:.2f} s), {status}"
+        )
+
+    latencies = sorted(r.latency for r in results)
+    logging.info(
+        f"Latency: median {latencies[len(latencies) // 2]:.2f} s, max {latencies[-1]:.2f} s, "
+        f"sum {sum(latencies):.2f} s"
+    )
@@ -0,0 +1,208 @@
+import os
+import re
+import json
+import hashlib
+
+import AUTesting.parser as aup
+
+
+# fingerprints of the functions of the last run and their passing tests
+MANIFEST = "./build/functions.json"
+
+# first words of the lines Parser takes for declarations that are not functions
+NOT_FUNCTIONS = {"define", "if", "else", "return", "while", "for", "switch", "sizeof", "case", "do"}
+
+
+def function_name(signature: str) -> str:
+    match = re.search(r"([A-Za-z_][A-Za-z0-9_]*)\s*\(", signature)
+    return match.group(1) if match else signature
+
+
+def normalize(code: str) -> str:
+    # comments and spacing do not change what a function does
+    code = re.sub(r"//.*?$|/\*.*?\*/", "", code, flags=re.DOTALL | re.MULTILINE)
+    return " ".join(code.split())
+
+
+def digest(*parts) -> str:
+    return hashlib.sha256(json.dumps(parts).encode()).hexdigest()
+
+
+def function_bodies(source_file: str):
+    """
+    The definitions of the functions of a source file, found by Parser.get_body.
+
+    Returns:
+    - (dict, str): the definitions by function name, and the source without them: the
+      macros, types, variables and prototypes all functions may depend on
+    """
+    parser = aup.Parser(source_file)
+    parser.run()
+
+    bodies = {}
+    for signature, body in zip(parser.signatures, parser.functions):
+        words = signature.split()
+        if not words or words[0] in NOT_FUNCTIONS or "{" not in body:
+            continue
+        # e.g. "rely on (see bpLeafOf_)" of a comment: every mention of "on" would
+        # depend on the function after it
+        if body.lstrip().startswith(("//", "/*", "*")):
+            continue
+        # e.g. the variants of a function under #ifdef: all of them
+        name = function_name(signature)
+        bodies[name] = bodies.get(name, "") + body
+
+    with open(source_file, "r") as src:
+        rest = " ".join(src.readlines())
+    for body in bodies.values():
+        rest = rest.replace(body, "")
+    return bodies, rest
+
+
+def local_headers(source_file: str, seen=None):
+    """
+    Returns:
+    - str: the headers the source includes with quotes, e.g. a private header of the
+      translation units of a library, and those they include in turn
+    """
+    seen = set() if seen is None else seen
+    with open(source_file, "r") as src:
+        names = re.findall(r'^\s*#\s*include\s*"([^"]+)"', src.read(), flags=re.MULTILINE)
+
+    content = ""
+    for name in names:
+        path = os.path.normpath(os.path.join(os.path.dirname(source_file), name))
+        if path in seen or not os.path.isfile(path):
+            continue
+        seen.add(path)
+        with open(path, "r") as header:
+            content += header.read()
+        content += local_headers(path, seen)
+    return content
+
+
+# calls through a pointer: p->f(...), s.f(...) or (*p)(...)
+INDIRECT_CALL = re.compile(r"(?:->|\.)\s*[A-Za-z_][A-Za-z0-9_]*\s*\(|\(\s*\*\s*[A-Za-z_][A-Za-z0-9_]*\s*\)\s*\(")
+
+# a name not called right there, e.g. passed to pthread_create or put into a pointer
+NOT_CALLED = re.compile(r"\b([A-Za-z_][A-Za-z0-9_]*)\b(?!\s*\()")
+
+
+def address_taken(bodies, rest: str):
+    """
+    Returns:
+    - set: the functions of 'bodies' named anywhere but in a call, in a definition or in
+      the rest of the sources (e.g. tables of function pointers): those a call through a
+      pointer may reach
+    """
+    taken = set()
+    for code in [*bodies.values(), rest]:
+        taken |= set(NOT_CALLED.findall(normalize(code))) & bodies.keys()
+    return taken
+
+
+def callees(bodies, rest=""):
+    """
+    A function depends on every function it names, called or not, and one that calls
+    through a pointer on every function whose address is taken.
+
+    Returns:
+    - dict: the functions of 'bodies' every function may call, directly or not
+    """
+    taken = address_taken(bodies, rest)
+    direct = {}
+    for name, body in bodies.items():
+        named = set(re.findall(r"[A-Za-z_][A-Za-z0-9_]*", normalize(body)))
+        if INDIRECT_CALL.search(normalize(body)):
+            named |= taken
+        direct[name] = {f for f in named if f in bodies and f != name}
+
+    closure = {}
+    for name in bodies:
+        seen, stack = set(), [name]
+        while stack:
+            for f in direct[stack.pop()]:
+                if f not in seen:
+                    seen.add(f)
+                    stack.append(f)
+        seen.discard(name)
+        closure[name] = seen
+    return closure
+
+
+def fingerprints(source_files, header: str, signatures):
+    """
+    Fingerprints the functions under test: the hash of the signature, the definitions
+    of the function and of all functions it calls, directly or not, through pointers
+    too (see callees), and of the rest of the sources, the headers they include and
+    the header. A function not defined in the sources (e.g. a macro) depends on all
+    of them.
+
+    Args:
+    - source_files (list): the source files under test, e.g. the translation units of
+      one library
+
+    Returns:
+    - dict: the fingerprint by signature
+    """
+    bodies, rest, seen = {}, "", set()
+    for source_file in source_files:
+        rest += local_headers(source_file, seen)
+        file_bodies, file_rest = function_bodies(source_file)
+        for name, body in file_bodies.items():
+            bodies[name] = bodies.get(name, "") + body
+        rest += file_rest
+    graph = callees(bodies, rest)
+    context = digest(normalize(rest), normalize(header))
+
+    whole = ""
+    for source_file in source_files:
+        with open(source_file, "r") as src:
+            whole += normalize(src.read())
+
+    result = {}
+    for signature in signatures:
+        name = function_name(signature)
+        if name not in bodies:
+            result[signature] = digest(signature, context, whole)
+            continue
+        parts = [(f, normalize(bodies[f])) for f in sorted(graph[name] | {name})]
+        result[signature] = digest(signature, context, parts)
+    return result
+
+
+class Manifest:
+    """
+    The fingerprint of every function and its tests that passed, from the last run that
+    tested it; functions with the same fingerprint and a passing test are not tested
+    again.
+    """
+
+    def __init__(self, path=MANIFEST):
+        self.path = path
+        try:
+            with open(path, "r") as f:
+                self.functions = json.load(f)
+        except (OSError, ValueError):
+            self.functions = {}
+
+    def passing_tests(self, signature: str, fingerprint: str):
+        """
+        Returns:
+        - list: the passing tests of the function, empty if it changed since
+        """
+        entry = self.functions.get(signature)
+        if entry is None or entry["fingerprint"] != fingerprint:
+            return []
+        return [t for t in entry["passed"] if os.path.isfile(t)]
+
+    def record(self, signature: str, fingerprint: str, passed):
+        self.functions[signature] = {"fingerprint": fingerprint, "passed": list(passed)}
+
+    def save(self, signatures):
+        # functions no longer in the header are dropped
+        functions = {s: e for s, e in self.functions.items() if s in signatures}
+        os.makedirs(os.path.dirname(self.path) or ".", exist_ok=True)
+        with open(self.path + ".tmp", "w") as f:
+            json.dump(functions, f, indent=1)
+        os.replace(self.path + ".tmp", self.path)
@@ -20,8 +20,10 @@ class Parser(Exception):
         for line in lines:
             if "#include" in line:
                 self.includes.append(line + "\n")
+            # braces in strings, characters and comments do not count
+            code = re.sub(r'"(\\.|[^"\\])*"|\'(\\.|[^\'\\])*\'|//.*$', "", line)
             if inFunction:
-                numBracket = numBracket + line.count("{") - line.count("}")
+                numBracket = numBracket + code.count("{") - code.count("}")
                 cur_func = cur_func + line + "\n"
                 if numBracket == 0:
                     self.functions.append(cur_func)
@@ -36,8 +38,10 @@ class Parser(Exception):
                         elif "{" in line or ";" not in line:
                             inFunction = True
                             cur_func = line + "\n"
-                            numBracket = line.count("{")
+                            numBracket = code.count("{")
                             self.signatures.append(dec)
+                        # one function a line, or signatures and functions get out of step
+                        break
 
     def clear_bracket(self, a):
         lst = []
@@ -51,8 +55,8 @@ class Parser(Exception):
         return lst
 
     def find_function(self):
-        pattern_next = r"\b\w+\s+\w+\s*\([^)]*\)\s*(?:\n\s*)?\{"
-        pattern_c = r"\b\w+\s+\w+\s*\([^)]*\)\s*"
+        pattern_next = r"\b\w+[\s\*]+\w+\s*\([^)]*\)\s*(?:\n\s*)?\{"
+        pattern_c = r"\b\w+[\s\*]+\w+\s*\([^)]*\)\s*"
         pattern_method = r"\w+\s+\w+::\w+\([^)]*\)\s*{"
 
         with open(self.path, "r") as file:
@@ -0,0 +1,180 @@
+import asyncio
+import logging
+import random
+import time
+from dataclasses import dataclass, field
+
+from AUTesting.cache import Cache
+
+
+class RetryableError(Exception):
+    """Raised by a backend when the request may succeed if sent again later."""
+
+
+class OpenAIBackend:
+    """Chat completions of the OpenAI API, or of a server compatible with it."""
+
+    def __init__(self, base_url=None):
+        import openai
+
+        self.openai = openai
+        self.client = openai.AsyncOpenAI(base_url=base_url)
+
+    async def complete(self, model: str, messages):
+        """
+        Returns:
+        - (str, int): the content of the answer and the tokens used, 0 if unknown
+        """
+        try:
+            completion = await self.client.chat.completions.create(model=model, messages=messages)
+        except (
+            self.openai.RateLimitError,
+            self.openai.APIConnectionError,
+            self.openai.APITimeoutError,
+            self.openai.InternalServerError,
+        ) as e:
+            raise RetryableError(str(e)) from e
+
+        logging.info(f"Response: {completion}")
+        tokens = completion.usage.total_tokens if completion.usage else 0
+        return completion.choices[0].message.content, tokens
+
+
+class RateLimiter:
+    """
+    A token bucket that refills 'per_minute' units a minute, continuously, and holds
+    up to ten seconds' worth of them; a request takes units from it and waits while
+    there are not enough.
+    """
+
+    def __init__(self, per_minute: float):
+        self.per_minute = per_minute
+        self.capacity = per_minute / 6
+        self.units = self.capacity
+        self.updated = time.monotonic()
+        self.lock = asyncio.Lock()
+
+    def refill(self):
+        now = time.monotonic()
+        self.units = min(self.capacity, self.units + (now - self.updated) * self.per_minute / 60)
+        self.updated = now
+
+    async def acquire(self, units: float):
+        # more than the bucket holds waits for a full bucket and owes the rest
+        async with self.lock:
+            self.refill()
+            wanted = min(units, self.capacity)
+            while self.units < wanted:
+                await asyncio.sleep((wanted - self.units) * 60 / self.per_minute)
+                self.refill()
+            self.units -= units
+
+    def charge(self, units: float):
+        # units used beyond those acquired; later requests wait for them
+        self.refill()
+        self.units -= units
+
+
+@dataclass
+class SchedulerStats:
+    requests: int = 0
+    retries: int = 0
+    failures: int = 0
+    tokens: int = 0
+    max_in_flight: int = 0
+    # seconds from the call of complete to the answer, retries and waits included
+    latencies: list = field(default_factory=list)
+
+    def __str__(self) -> str:
+        latencies = sorted(self.latencies)
+        median = latencies[len(latencies) // 2] if latencies else 0.0
+        worst = latencies[-1] if latencies else 0.0
+        return (
+            f"requests {self.requests}, retries {self.retries}, failed {self.failures}, "
+            f"tokens {self.tokens}, at most {self.max_in_flight} in flight; "
+            f"latency median {median:.2f} s, max {worst:.2f} s"
+        )
+
+
+class Scheduler:
+    """
+    Sends requests to a backend with at most 'max_in_flight' of them at once, within
+    'requests_per_minute' and 'tokens_per_minute' (0 for no limit), and sends a request
+    again after a RetryableError, up to 'retries' times, with exponential backoff.
+
+    A backend is an object with 'async complete(model, messages)' returning the content
+    of the answer and the tokens used (see OpenAIBackend and standin.StandInBackend).
+    With a cache, the answer to the same model and messages is never asked for again.
+    """
+
+    def __init__(self, backend, max_in_flight=8, requests_per_minute=0, tokens_per_minute=0,
+                 retries=5, backoff=1.0, cache=None):
+        self.backend = backend
+        self.cache = cache
+        self.slots = asyncio.Semaphore(max_in_flight)
+        self.requests = RateLimiter(requests_per_minute) if requests_per_minute > 0 else None
+        self.tokens = RateLimiter(tokens_per_minute) if tokens_per_minute > 0 else None
+        self.retries = retries
+        self.backoff = backoff
+        self.in_flight = 0
+        self.stats = SchedulerStats()
+
+    @staticmethod
+    def estimate_tokens(messages) -> int:
+        # about 4 characters a token for English text and code
+        return sum(len(m["content"]) for m in messages) // 4 + 1
+
+    async def complete(self, model: str, messages) -> str:
+        """
+        Returns:
+        - str: the content of the answer
+
+        Raises:
+        - RetryableError: if the last retry failed too
+        """
+        start = time.monotonic()
+        if self.cache is not None:
+            key = Cache.key(model, messages)
+            entry = self.cache.get("completions", key)
+            if entry is not None:
+                return entry["content"]
+
+        estimate = self.estimate_tokens(messages)
+
+        for attempt in range(self.retries + 1):
+            if self.requests:
+                await self.requests.acquire(1)
+            if self.tokens:
+                await self.tokens.acquire(estimate)
+
+            async with self.slots:
+                self.in_flight += 1
+                self.stats.max_in_flight = max(self.stats.max_in_flight, self.in_flight)
+                self.stats.requests += 1
+                try:
+                    content, tokens = await self.backend.complete(model, messages)
+                except RetryableError as e:
+                    error = e
+                    content = None
+                finally:
+                    self.in_flight -= 1
+
+            if content is not None:
+                if self.tokens and tokens > estimate:
+                    self.tokens.charge(tokens - estimate)
+                self.stats.tokens += tokens
+                self.stats.latencies.append(time.monotonic() - start)
+                if self.cache is not None:
+                    entry = {"content": content, "tokens": tokens, "seconds": time.monotonic() - start}
+                    self.cache.put("completions", key, entry)
+                return content
+
+            if attempt < self.retries:
+                # full jitter: retries of requests that failed together spread out
+                delay = random.uniform(0, self.backoff * 2**attempt)
+                logging.warning(f"Request failed ({error}), retry in {delay:.1f} s")
+                self.stats.retries += 1
+                await asyncio.sleep(delay)
+
+        self.stats.failures += 1
+        raise error
@@ -0,0 +1,125 @@
+import argparse
+import asyncio
+import hashlib
+import json
+import logging
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+from AUTesting.scheduler import RetryableError
+
+
+class StandInBackend:
+    """
+    A local stand-in for the model, to measure the pipeline offline: it answers after
+    'latency' seconds (0.5 to 1.5 times that, by prompt) with a trivial test that always
+    passes. Everything depends only on the messages, never on timing or order:
+    - the first answer to every 'broken_every'-th prompt does not compile, so that the
+      prompt gets a fix request;
+    - the first attempt of every 'overload_every'-th request fails with a RetryableError,
+      as a rate limit of a real server would.
+    0 turns either off.
+    """
+
+    def __init__(self, latency=1.0, broken_every=4, overload_every=0):
+        self.latency = latency
+        self.broken_every = broken_every
+        self.overload_every = overload_every
+        self.attempts = {}
+        self.lock = threading.Lock()
+
+    def answer(self, messages):
+        """
+        Returns:
+        - (str, int, float): the answer, the tokens used and the delay before it
+        """
+        key = hashlib.sha256(json.dumps(messages, sort_keys=True).encode()).hexdigest()
+        number = int(key[:8], 16)
+        with self.lock:
+            attempt = self.attempts.get(key, 0)
+            self.attempts[key] = attempt + 1
+
+        delay = self.latency * (0.5 + (number % 101) / 100)
+        if self.overload_every and number % self.overload_every == 0 and attempt == 0:
+            raise RetryableError(f"stand-in overloaded, {delay:.2f} s")
+
+        # the first answer has the system prompt and the prompt before it
+        broken = self.broken_every and len(messages) <= 2 and number % self.broken_every == 0
+        content = (
+            "```c\n"
+            "int main(void) {\n"
+            f"    /* stand-in test {key[:8]} */\n"
+            "    assert(1);\n"
+            f"    return 0{'' if broken else ';'}\n"
+            "}\n"
+            "```\n"
+        )
+        tokens = (sum(len(m["content"]) for m in messages) + len(content)) // 4
+        return content, tokens, delay
+
+    async def complete(self, model: str, messages):
+        content, tokens, delay = self.answer(messages)
+        await asyncio.sleep(delay)
+        return content, tokens
+
+
+def serve(port: int, backend: StandInBackend):
+    """
+    Serves the stand-in as the chat completions endpoint of the OpenAI API, for
+    main.py --backend=openai --base-url=http://localhost:<port>/v1.
+    """
+
+    class Handler(BaseHTTPRequestHandler):
+        def do_POST(self):
+            if not self.path.endswith("/chat/completions"):
+                self.reply(404, {"error": {"message": f"no {self.path}"}})
+                return
+
+            request = json.loads(self.rfile.read(int(self.headers["Content-Length"])))
+            try:
+                content, tokens, delay = backend.answer(request["messages"])
+            except RetryableError as e:
+                self.reply(429, {"error": {"message": str(e), "type": "rate_limit_exceeded"}})
+                return
+
+            time.sleep(delay)
+            self.reply(200, {
+                "id": "chatcmpl-standin",
+                "object": "chat.completion",
+                "created": int(time.time()),
+                "model": request.get("model", "standin"),
+                "choices": [{
+                    "index": 0,
+                    "message": {"role": "assistant", "content": content},
+                    "finish_reason": "stop",
+                }],
+                "usage": {"prompt_tokens": tokens, "completion_tokens": 0, "total_tokens": tokens},
+            })
+
+        def reply(self, status, body):
+            data = json.dumps(body).encode()
+            self.send_response(status)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(data)))
+            self.end_headers()
+            self.wfile.write(data)
+
+        def log_message(self, format, *args):
+            logging.debug(format % args)
+
+    with ThreadingHTTPServer(("127.0.0.1", port), Handler) as server:
+        logging.info(f"Stand-in model at http://127.0.0.1:{port}/v1")
+        server.serve_forever()
+
+
+if __name__ == "__main__":
+    # example run: python3 -m AUTesting.standin --port=8000 --latency=2
+    parser = argparse.ArgumentParser(description="Local stand-in of the model for offline runs")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--latency", help="Seconds before an answer, on average", type=float, default=1.0)
+    parser.add_argument("--broken-every", type=int, default=4)
+    parser.add_argument("--overload-every", type=int, default=0)
+    args = parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+    serve(args.port, StandInBackend(args.latency, args.broken_every, args.overload_every))
@@ -0,0 +1,43 @@
+/****************************************************************************************
+ *
+ *   bench.h
+ *
+ *   Helpers shared by the stand-alone benchmarks of the examples library.
+ *
+ ***/
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+
+/// Monotonic time in seconds.
+static inline double benchNow (void) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+
+/// xorshift64 generator: fast and reproducible across runs and platforms.
+static inline uint64_t benchRand (uint64_t* state) {
+
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+
+/// Prints one result line in a format that is easy to grep and compare.
+/// \param name - name of the measurement
+/// \param ops  - the number of operations performed
+/// \param sec  - the time spent, in seconds
+static inline void benchReport (const char* name, double ops, double sec) {
+
+    printf("%-40s %10.3f s %12.2f Mops/s %10.1f ns/op\n",
+           name, sec, ops / sec * 1e-6, sec / ops * 1e9);
+}
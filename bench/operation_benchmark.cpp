@@ -0,0 +1,252 @@
+/****************************************************************************************
+ *
+ *   operation_benchmark.cpp
+ *
+ *   Google Benchmark suite of the kernels of examples/operation: add and sub of int,
+ *   float and double and square_distance, each applied to arrays of 2^10 to 2^16
+ *   elements, as the callers of the kernels use them, against the array kernels
+ *   add_arrays, sub_arrays and square_distance_many with every instruction set the CPU
+ *   supports (the "isa" argument, see OpIsa).
+ *
+ *   Before timing, every array kernel is checked against a plain loop; the distances
+ *   against (dx^2 + dy^2), not against square_distance, which adds the square of the x
+ *   delta twice. A mismatch stops the benchmark with an error.
+ *
+ *   Build: cmake --build build --target bench
+ *   Usage: build/bin/bench --benchmark_filter=BM_add
+ *
+ ***/
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <vector>
+
+#include "Operation.h"
+#include "bench.h"
+
+
+namespace {
+
+template <typename T>
+std::vector<T> makeValues(size_t n, uint64_t seed) {
+
+    std::vector<T> values(n);
+
+    for (size_t i = 0; i < n; ++i)
+        values[i] = (T) (benchRand(&seed) % 2001) - (T) 1000;
+
+    return values;
+}
+
+
+template <typename T>
+void BM_add(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    std::vector<T> a = makeValues<T>(n, 1), b = makeValues<T>(n, 2), out(n);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = add(a[i], b[i]);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed((int64_t) (state.iterations() * n));
+}
+
+
+template <typename T>
+void BM_sub(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    std::vector<T> a = makeValues<T>(n, 1), b = makeValues<T>(n, 2), out(n);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = sub(a[i], b[i]);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed((int64_t) (state.iterations() * n));
+}
+
+
+/// The distances from every point of an array to a fixed one.
+void BM_square_distance(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    std::vector<double> x = makeValues<double>(n, 1), y = makeValues<double>(n, 2), out(n);
+    std::vector<Point>  points(n);
+    Point               origin = {0.5, -0.5};
+
+    for (size_t i = 0; i < n; ++i)
+        points[i] = Point{x[i], y[i]};
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = square_distance(&points[i], &origin);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed((int64_t) (state.iterations() * n));
+}
+
+
+const char* const isaNames[] = {"scalar", "sse2", "avx2", "avx512"};
+
+
+/// Switches the array kernels to the instruction set of the benchmark.
+/// \return false, and the benchmark is skipped, if the CPU lacks it.
+bool useIsa(benchmark::State& state) {
+
+    OpIsa isa = (OpIsa) state.range(1);
+
+    if (!op_use_isa(isa)) {
+        state.SkipWithError("the CPU does not support the instruction set");
+        return false;
+    }
+
+    state.SetLabel(isaNames[isa]);
+    return true;
+}
+
+
+template <typename T>
+void BM_add_arrays(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    std::vector<T> a = makeValues<T>(n, 1), b = makeValues<T>(n, 2), out(n);
+
+    if (!useIsa(state))
+        return;
+
+    // the odd length leaves a tail to the scalar part of the kernel
+    add_arrays(a.data(), b.data(), out.data(), n - 1);
+    for (size_t i = 0; i + 1 < n; ++i)
+        if (out[i] != a[i] + b[i]) {
+            state.SkipWithError("add_arrays differs from a + b");
+            return;
+        }
+
+    for (auto _ : state) {
+        add_arrays(a.data(), b.data(), out.data(), n);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed((int64_t) (state.iterations() * n));
+}
+
+
+template <typename T>
+void BM_sub_arrays(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    std::vector<T> a = makeValues<T>(n, 1), b = makeValues<T>(n, 2), out(n);
+
+    if (!useIsa(state))
+        return;
+
+    sub_arrays(a.data(), b.data(), out.data(), n - 1);
+    for (size_t i = 0; i + 1 < n; ++i)
+        if (out[i] != a[i] - b[i]) {
+            state.SkipWithError("sub_arrays differs from a - b");
+            return;
+        }
+
+    for (auto _ : state) {
+        sub_arrays(a.data(), b.data(), out.data(), n);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed((int64_t) (state.iterations() * n));
+}
+
+
+/// Compares squared distances with dx^2 + dy^2; a fused multiply-add in a kernel may
+/// round differently in the last bit.
+bool sameDistance(double got, double dx, double dy) {
+
+    double expected = dx * dx + dy * dy;
+    return std::fabs(got - expected) <= 1e-12 * expected;
+}
+
+
+/// The distances from every point of a buffer to a fixed one, as BM_square_distance.
+void BM_square_distance_many(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    std::vector<double> x = makeValues<double>(n, 1), y = makeValues<double>(n, 2), out(n);
+    Point               origin = {0.5, -0.5};
+    PointBuffer         points, shifted;
+
+    if (!useIsa(state))
+        return;
+
+    if (!point_buffer_create(&points, n) || !point_buffer_create(&shifted, n - 1)) {
+        state.SkipWithError("no memory");
+        return;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        points.x[i] = x[i];
+        points.y[i] = y[i];
+    }
+
+    // between two buffers, the second one a point shorter and shifted by one
+    for (size_t i = 0; i + 1 < n; ++i) {
+        shifted.x[i] = x[i + 1];
+        shifted.y[i] = y[i + 1];
+    }
+
+    bool valid = true;
+
+    square_distance_many(&points, &shifted, out.data());
+    for (size_t i = 0; i + 1 < n; ++i)
+        valid &= sameDistance(out[i], x[i] - x[i + 1], y[i] - y[i + 1]);
+
+    square_distance_many(&points, &origin, out.data());
+    for (size_t i = 0; i < n; ++i)
+        valid &= sameDistance(out[i], x[i] - origin.x, y[i] - origin.y);
+
+    if (!valid)
+        state.SkipWithError("square_distance_many differs from dx^2 + dy^2");
+    else
+        for (auto _ : state) {
+            square_distance_many(&points, &origin, out.data());
+            benchmark::DoNotOptimize(out.data());
+            benchmark::ClobberMemory();
+        }
+
+    point_buffer_destroy(&points);
+    point_buffer_destroy(&shifted);
+    state.SetItemsProcessed((int64_t) (state.iterations() * n));
+}
+
+} // namespace
+
+
+#define OP_SIZES RangeMultiplier(8)->Range(1 << 10, 1 << 16)
+#define OP_ISAS  ArgsProduct({{1 << 10, 1 << 13, 1 << 16}, \
+                              {OP_ISA_SCALAR, OP_ISA_SSE2, OP_ISA_AVX2, OP_ISA_AVX512}}) \
+                 ->ArgNames({"n", "isa"})
+
+BENCHMARK_TEMPLATE(BM_add, int)->OP_SIZES;
+BENCHMARK_TEMPLATE(BM_add, float)->OP_SIZES;
+BENCHMARK_TEMPLATE(BM_add, double)->OP_SIZES;
+BENCHMARK_TEMPLATE(BM_sub, int)->OP_SIZES;
+BENCHMARK_TEMPLATE(BM_sub, float)->OP_SIZES;
+BENCHMARK_TEMPLATE(BM_sub, double)->OP_SIZES;
+BENCHMARK(BM_square_distance)->OP_SIZES;
+
+BENCHMARK_TEMPLATE(BM_add_arrays, int)->OP_ISAS;
+BENCHMARK_TEMPLATE(BM_add_arrays, float)->OP_ISAS;
+BENCHMARK_TEMPLATE(BM_add_arrays, double)->OP_ISAS;
+BENCHMARK_TEMPLATE(BM_sub_arrays, int)->OP_ISAS;
+BENCHMARK_TEMPLATE(BM_sub_arrays, float)->OP_ISAS;
+BENCHMARK_TEMPLATE(BM_sub_arrays, double)->OP_ISAS;
+BENCHMARK(BM_square_distance_many)->OP_ISAS;
@@ -0,0 +1,163 @@
+/****************************************************************************************
+ *
+ *   pointset_benchmark.cpp
+ *
+ *   Google Benchmark suite of PointSet: distances to a query, pairwise distances and
+ *   k-nearest-neighbor search by brute force and with the k-d tree, on 2^10 to 2^20
+ *   uniformly random points. Throughput is in points per second ("points" counter);
+ *   for nearest() these are the points of the set per query, so the k-d tree shows
+ *   how many points it saves from scanning.
+ *
+ *   Before timing, nearest() is checked against sorting all distances.
+ *
+ *   Build: cmake --build build --target bench
+ *   Usage: build/bin/bench --benchmark_filter=BM_PointSet
+ *
+ ***/
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "PointSet.h"
+#include "bench.h"
+
+
+namespace {
+
+std::vector<Point> makePoints(size_t n, uint64_t seed) {
+
+    std::vector<Point> points(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        points[i].x = (double) (benchRand(&seed) % 1000000) * 1e-3;
+        points[i].y = (double) (benchRand(&seed) % 1000000) * 1e-3;
+    }
+
+    return points;
+}
+
+
+void countPoints(benchmark::State& state, double points) {
+
+    state.counters["points"] = benchmark::Counter((double) state.iterations() * points,
+                                                  benchmark::Counter::kIsRate);
+}
+
+
+/// Checks nearest() against the first k of all points sorted by distance and number.
+bool checkNearest(const PointSet& set, const std::vector<Point>& queries, size_t k) {
+
+    std::vector<size_t> indices(k), expected(set.size());
+    std::vector<double> distances(set.size());
+
+    for (const Point& query : queries) {
+        set.square_distances(query, distances.data());
+        for (size_t i = 0; i < set.size(); ++i)
+            expected[i] = i;
+
+        std::sort(expected.begin(), expected.end(), [&](size_t a, size_t b) {
+            return distances[a] < distances[b] || (distances[a] == distances[b] && a < b);
+        });
+
+        size_t found = set.nearest(query, k, indices.data(), NULL);
+        if (found != std::min(k, set.size()))
+            return false;
+
+        for (size_t i = 0; i < found; ++i)
+            if (indices[i] != expected[i])
+                return false;
+    }
+
+    return true;
+}
+
+
+void BM_PointSet_square_distances(benchmark::State& state) {
+
+    size_t             n      = (size_t) state.range(0);
+    std::vector<Point> points = makePoints(n, 1);
+    std::vector<double> out(n);
+    PointSet           set(points.data(), n);
+    Point              query = {500, 500};
+
+    for (auto _ : state) {
+        set.square_distances(query, out.data());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+
+    countPoints(state, (double) n);
+}
+
+
+/// Distances from 64 points to every point of the set.
+void BM_PointSet_pairwise(benchmark::State& state) {
+
+    size_t              n      = (size_t) state.range(0);
+    std::vector<Point>  points = makePoints(n, 1), others = makePoints(64, 2);
+    std::vector<double> out(64 * n);
+    PointSet            set(points.data(), n), queries(others.data(), 64);
+
+    for (auto _ : state) {
+        queries.pairwise_square_distances(set, out.data());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+
+    countPoints(state, 64.0 * (double) n);
+}
+
+
+/// k nearest neighbors of random queries; range(2) non-zero to use the k-d tree.
+void BM_PointSet_nearest(benchmark::State& state) {
+
+    size_t              n       = (size_t) state.range(0);
+    size_t              k       = (size_t) state.range(1);
+    std::vector<Point>  points  = makePoints(n, 1);
+    std::vector<Point>  queries = makePoints(1024, 3);
+    std::vector<size_t> indices(k);
+    PointSet            set(points.data(), n);
+    size_t              q = 0;
+
+    if (state.range(2) != 0 && !set.index()) {
+        state.SkipWithError("no memory");
+        return;
+    }
+
+    std::vector<Point> check(queries.begin(), queries.begin() + 16);
+    if (!checkNearest(set, check, k)) {
+        state.SkipWithError("nearest() differs from sorting the distances");
+        return;
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(set.nearest(queries[q], k, indices.data(), NULL));
+        q = (q + 1) % queries.size();
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(state.range(2) != 0 ? "k-d tree" : "brute force");
+    countPoints(state, (double) n);
+}
+
+
+/// n, k and index of BM_PointSet_nearest; sets of up to PS_BRUTE_FORCE_MAX points are
+/// always scanned, so they are not measured with the k-d tree.
+void nearestArgs(benchmark::internal::Benchmark* b) {
+
+    for (int64_t n : {1 << 10, 1 << 15, 1 << 20})
+        for (int64_t k : {1, 10})
+            for (int64_t index : {0, 1})
+                if (index == 0 || n > PS_BRUTE_FORCE_MAX)
+                    b->Args({n, k, index});
+}
+
+} // namespace
+
+
+BENCHMARK(BM_PointSet_square_distances)->RangeMultiplier(32)->Range(1 << 10, 1 << 20);
+BENCHMARK(BM_PointSet_pairwise)->RangeMultiplier(32)->Range(1 << 10, 1 << 15);
+BENCHMARK(BM_PointSet_nearest)
+    ->Apply(nearestArgs)
+    ->ArgNames({"n", "k", "index"});
@@ -0,0 +1,91 @@
+/****************************************************************************************
+ *
+ *   rbtree_batch.c
+ *
+ *   Lookups per second of rbFindBatch against a loop of rbFind, for both engines, on
+ *   containers much larger than the last level cache.
+ *
+ *   Build: gcc -O2 -I examples/RBTree bench/rbtree_batch.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [keys] [lookups]
+ *
+ ***/
+#include <stdlib.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+static void run (rbEngine engine, const char* name, const int* keys, size_t n,
+                 const rb_key_type* queries, rbPair** out, size_t lookups) {
+
+    rbTree tree;
+    char   title[64];
+    long   sum = 0;
+
+    if (rbCreateWithEngine(NULL, 0, engine, &tree) != RB_SUCCESS)
+        exit(1);
+
+    // random insertion order scatters the red-black nodes over the heap
+    for (size_t i = 0; i < n; ++i) {
+        rbPair pair = {keys[i], (int) i};
+        rbInsert(tree, pair);
+    }
+
+    double start = benchNow();
+    for (size_t i = 0; i < lookups; ++i) {
+        rbPair* pair = rbFind(tree, queries[i]);
+        sum += pair ? pair->value : 0;
+    }
+    snprintf(title, sizeof(title), "%s, rbFind loop", name);
+    benchReport(title, (double) lookups, benchNow() - start);
+
+    start = benchNow();
+    rbFindBatch(tree, queries, lookups, out);
+    for (size_t i = 0; i < lookups; ++i)
+        sum -= out[i] ? out[i]->value : 0;
+    snprintf(title, sizeof(title), "%s, rbFindBatch", name);
+    benchReport(title, (double) lookups, benchNow() - start);
+
+    if (sum != 0) {
+        printf("results differ\n");
+        exit(1);
+    }
+
+    rbDestroy(tree);
+}
+
+
+int main (int argc, char** argv) {
+
+    size_t   n       = argc > 1 ? strtoull(argv[1], NULL, 10) : 8000000;
+    size_t   lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 8000000;
+    uint64_t seed    = 9;
+
+    int*         keys    = (int*) malloc(n * sizeof(int));
+    rb_key_type* queries = (rb_key_type*) malloc(lookups * sizeof(rb_key_type));
+    rbPair**     out     = (rbPair**) malloc(lookups * sizeof(rbPair*));
+
+    if (keys == NULL || queries == NULL || out == NULL || n == 0)
+        return 1;
+
+    for (size_t i = 0; i < n; ++i)
+        keys[i] = (int) i;
+    for (size_t i = n - 1; i > 0; --i) {
+        size_t j = benchRand(&seed) % (i + 1);
+        int tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+    for (size_t i = 0; i < lookups; ++i)
+        queries[i] = (rb_key_type) (benchRand(&seed) % n);
+
+    printf("%zu keys, %zu lookups\n", n, lookups);
+
+    run(RB_ENGINE_REDBLACK, "red-black", keys, n, queries, out, lookups);
+    run(RB_ENGINE_BPLUS, "B+", keys, n, queries, out, lookups);
+
+    free(keys);
+    free(queries);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,111 @@
+/****************************************************************************************
+ *
+ *   rbtree_batch_update.c
+ *
+ *   Per-element cost of rbInsertBatch and rbEraseBatch against loops of rbInsert and
+ *   rbErase, for both engines and batches from 1/1000 of the container to its size.
+ *
+ *   Build: gcc -O2 -I examples/RBTree bench/rbtree_batch_update.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [keys in the container]
+ *
+ ***/
+#include <stdlib.h>
+#include <string.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+/// Creates a container with every other key of [0, 2 * n).
+static rbTree fill (rbEngine engine, size_t n) {
+
+    rbTree  tree;
+    rbPair* data = (rbPair*) malloc(n * sizeof(rbPair));
+
+    if (data == NULL)
+        exit(1);
+
+    for (size_t i = 0; i < n; ++i) {
+        rbPair pair = {(int) (2 * i), 0};
+        memcpy(&data[i], &pair, sizeof(rbPair));
+    }
+
+    if (rbCreateWithEngine(data, n, engine, &tree) != RB_SUCCESS)
+        exit(1);
+
+    free(data);
+    return tree;
+}
+
+
+static void run (rbEngine engine, const char* name, size_t n, size_t batch, uint64_t* seed) {
+
+    rbPair*      pairs = (rbPair*) malloc(batch * sizeof(rbPair));
+    rb_key_type* keys  = (rb_key_type*) malloc(batch * sizeof(rb_key_type));
+    char         title[80];
+
+    if (pairs == NULL || keys == NULL)
+        exit(1);
+
+    // new (odd) keys to insert, then the same keys to erase
+    for (size_t i = 0; i < batch; ++i) {
+        rbPair pair = {(int) (2 * (benchRand(seed) % n) + 1), (int) i};
+        memcpy(&pairs[i], &pair, sizeof(rbPair));
+        keys[i] = pair.key;
+    }
+
+    rbTree tree = fill(engine, n);
+    double start = benchNow();
+    for (size_t i = 0; i < batch; ++i)
+        rbInsert(tree, pairs[i]);
+    snprintf(title, sizeof(title), "%s, %zu, rbInsert loop", name, batch);
+    benchReport(title, (double) batch, benchNow() - start);
+
+    start = benchNow();
+    for (size_t i = 0; i < batch; ++i)
+        rbErase(tree, keys[i]);
+    snprintf(title, sizeof(title), "%s, %zu, rbErase loop", name, batch);
+    benchReport(title, (double) batch, benchNow() - start);
+
+    size_t size = rbSize(tree);
+    rbDestroy(tree);
+
+    tree = fill(engine, n);
+    start = benchNow();
+    rbInsertBatch(tree, pairs, batch);
+    snprintf(title, sizeof(title), "%s, %zu, rbInsertBatch", name, batch);
+    benchReport(title, (double) batch, benchNow() - start);
+
+    start = benchNow();
+    rbEraseBatch(tree, keys, batch);
+    snprintf(title, sizeof(title), "%s, %zu, rbEraseBatch", name, batch);
+    benchReport(title, (double) batch, benchNow() - start);
+
+    if (rbSize(tree) != size) {
+        printf("results differ\n");
+        exit(1);
+    }
+
+    rbDestroy(tree);
+    free(pairs);
+    free(keys);
+}
+
+
+int main (int argc, char** argv) {
+
+    size_t   n    = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    uint64_t seed = 5;
+
+    if (n < 1000)
+        return 1;
+
+    printf("%zu keys in the container\n", n);
+
+    for (size_t batch = n / 1000; batch <= n; batch *= 10) {
+        run(RB_ENGINE_REDBLACK, "red-black", n, batch, &seed);
+        run(RB_ENGINE_BPLUS, "B+", n, batch, &seed);
+    }
+
+    return 0;
+}
@@ -0,0 +1,248 @@
+/****************************************************************************************
+ *
+ *   rbtree_benchmark.cpp
+ *
+ *   Google Benchmark suite of the RBTree container: rbInsert, rbFind, rbErase,
+ *   rbForeach and rbCreate on containers of 2^10 to 2^20 keys, with sequential, uniformly
+ *   random and Zipfian keys. The Zipfian keys repeat a few hot keys and scatter them over
+ *   the key range, as requests to a cache do.
+ *
+ *   Build: cmake --build build --target bench
+ *   Usage: build/bin/bench [--benchmark_filter=regex]
+ *          build/bin/bench --benchmark_out=bench.json --benchmark_out_format=json
+ *
+ ***/
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+namespace {
+
+enum Distribution {
+    SEQUENTIAL = 0, // 0, 1, 2, ...
+    RANDOM     = 1, // uniform over [0, 4n)
+    ZIPF       = 2  // Zipfian ranks (theta 0.99) hashed over [0, 4n)
+};
+
+const char* const distributionNames[] = {"sequential", "random", "zipf"};
+
+
+/// Zipfian ranks in [0, n) by the method of Gray et al. ("Quickly generating
+/// billion-record synthetic databases"), as in YCSB: O(n) set-up, O(1) per rank.
+class Zipf {
+public:
+    Zipf(size_t n, double theta) : n_(n), theta_(theta) {
+
+        double zetaN = 0;
+        for (size_t i = 1; i <= n; ++i)
+            zetaN += 1 / std::pow((double) i, theta);
+
+        double zeta2 = 1 + 1 / std::pow(2.0, theta);
+
+        zetaN_ = zetaN;
+        alpha_ = 1 / (1 - theta);
+        eta_   = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetaN);
+    }
+
+    size_t next(uint64_t* seed) const {
+
+        double u  = (double) (benchRand(seed) >> 11) * (1.0 / 9007199254740992.0);
+        double uz = u * zetaN_;
+
+        if (uz < 1)
+            return 0;
+        if (uz < 1 + std::pow(0.5, theta_))
+            return 1;
+
+        size_t rank = (size_t) ((double) n_ * std::pow(eta_ * u - eta_ + 1, alpha_));
+        return rank < n_ ? rank : n_ - 1;
+    }
+
+private:
+    size_t n_;
+    double theta_, zetaN_, alpha_, eta_;
+};
+
+
+/// Generates 'n' keys of the distribution; a different seed gives other keys.
+std::vector<rb_key_type> makeKeys(size_t n, int distribution, uint64_t seed) {
+
+    std::vector<rb_key_type> keys(n);
+    uint64_t range = 4 * (uint64_t) n;
+
+    switch (distribution) {
+    case SEQUENTIAL:
+        for (size_t i = 0; i < n; ++i)
+            keys[i] = (rb_key_type) i;
+        break;
+
+    case RANDOM:
+        for (size_t i = 0; i < n; ++i)
+            keys[i] = (rb_key_type) (benchRand(&seed) % range);
+        break;
+
+    default: {
+        Zipf zipf(n, 0.99);
+        for (size_t i = 0; i < n; ++i) {
+            // a multiplicative hash spreads the hot ranks over the key range
+            uint64_t rank = zipf.next(&seed);
+            keys[i] = (rb_key_type) (rank * 0x9E3779B97F4A7C15ull % range);
+        }
+        break;
+    }
+    }
+
+    return keys;
+}
+
+
+std::vector<rbPair> makePairs(const std::vector<rb_key_type>& keys) {
+
+    std::vector<rbPair> pairs;
+    pairs.reserve(keys.size());
+
+    for (size_t i = 0; i < keys.size(); ++i)
+        pairs.push_back(rbPair{keys[i], (rb_val_type) i});
+
+    return pairs;
+}
+
+
+rbTree makeTree(const std::vector<rb_key_type>& keys) {
+
+    rbTree tree;
+    if (rbCreate(NULL, 0, &tree) != RB_SUCCESS)
+        return NULL;
+
+    for (size_t i = 0; i < keys.size(); ++i)
+        rbInsert(tree, rbPair{keys[i], (rb_val_type) i});
+
+    return tree;
+}
+
+
+void sum(rbPair* pair, void* data) {
+
+    *(long*) data += pair->value;
+}
+
+
+void BM_rbInsert(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    std::vector<rb_key_type> keys = makeKeys(n, (int) state.range(1), 1);
+
+    for (auto _ : state) {
+        rbTree tree;
+        rbCreate(NULL, 0, &tree);
+
+        for (size_t i = 0; i < n; ++i)
+            rbInsert(tree, rbPair{keys[i], (rb_val_type) i});
+
+        state.PauseTiming();
+        rbDestroy(tree);
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed((int64_t) (state.iterations() * n));
+    state.SetLabel(distributionNames[state.range(1)]);
+}
+
+
+void BM_rbFind(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    std::vector<rb_key_type> keys   = makeKeys(n, (int) state.range(1), 1);
+    std::vector<rb_key_type> probes = makeKeys(n, (int) state.range(1), 2);
+    rbTree tree = makeTree(keys);
+    size_t i    = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(rbFind(tree, probes[i]));
+        if (++i == n)
+            i = 0;
+    }
+
+    rbDestroy(tree);
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(distributionNames[state.range(1)]);
+}
+
+
+void BM_rbErase(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    std::vector<rb_key_type> keys = makeKeys(n, (int) state.range(1), 1);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        rbTree tree = makeTree(keys);
+        state.ResumeTiming();
+
+        for (size_t i = 0; i < n; ++i)
+            rbErase(tree, keys[i]);
+
+        state.PauseTiming();
+        rbDestroy(tree);
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed((int64_t) (state.iterations() * n));
+    state.SetLabel(distributionNames[state.range(1)]);
+}
+
+
+void BM_rbForeach(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    rbTree tree = makeTree(makeKeys(n, (int) state.range(1), 1));
+
+    for (auto _ : state) {
+        long total = 0;
+        rbForeach(tree, sum, &total);
+        benchmark::DoNotOptimize(total);
+    }
+
+    state.SetItemsProcessed((int64_t) (state.iterations() * rbSize(tree)));
+    state.SetLabel(distributionNames[state.range(1)]);
+    rbDestroy(tree);
+}
+
+
+/// Sequential keys take the linear path of rbCreate, the others are sorted first.
+void BM_rbCreate(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    std::vector<rbPair> pairs = makePairs(makeKeys(n, (int) state.range(1), 1));
+
+    for (auto _ : state) {
+        rbTree tree;
+        rbCreate(pairs.data(), n, &tree);
+
+        state.PauseTiming();
+        rbDestroy(tree);
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed((int64_t) (state.iterations() * n));
+    state.SetLabel(distributionNames[state.range(1)]);
+}
+
+} // namespace
+
+
+#define RB_BENCHMARK(function) \
+    BENCHMARK(function)->ArgsProduct({{1 << 10, 1 << 15, 1 << 20}, {SEQUENTIAL, RANDOM, ZIPF}}) \
+                       ->ArgNames({"n", "dist"})
+
+RB_BENCHMARK(BM_rbInsert)->Unit(benchmark::kMicrosecond);
+RB_BENCHMARK(BM_rbFind);
+RB_BENCHMARK(BM_rbErase)->Unit(benchmark::kMicrosecond);
+RB_BENCHMARK(BM_rbForeach)->Unit(benchmark::kMicrosecond);
+RB_BENCHMARK(BM_rbCreate)->Unit(benchmark::kMicrosecond);
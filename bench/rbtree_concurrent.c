@@ -0,0 +1,134 @@
+/****************************************************************************************
+ *
+ *   rbtree_concurrent.c
+ *
+ *   Throughput of a concurrent container (rbCreateConcurrent) against a plain one
+ *   behind a global mutex, for 1 to 64 threads and several read/write mixes. Each
+ *   thread performs the same number of operations on random keys; a write is an
+ *   rbInsert or rbErase of a key from the same range.
+ *
+ *   Build: gcc -O2 -pthread -I examples/RBTree bench/rbtree_concurrent.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [keys] [operations per thread] [max threads]
+ *
+ ***/
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+struct job_t {
+    rbTree           tree;
+    pthread_mutex_t* lock;     // NULL for the concurrent container
+    size_t           keys;
+    size_t           ops;
+    unsigned         writePct; // the percentage of writes
+    uint64_t         seed;
+    long             found;
+};
+
+
+static void* worker (void* arg) {
+
+    struct job_t* job = (struct job_t*) arg;
+
+    for (size_t i = 0; i < job->ops; ++i) {
+
+        uint64_t    r   = benchRand(&job->seed);
+        rb_key_type key = (rb_key_type) ((r >> 8) % job->keys);
+
+        if (job->lock)
+            pthread_mutex_lock(job->lock);
+
+        if ((r & 0xFF) * 100 < job->writePct * 256u) {
+            if (r & 0x100) {
+                rbPair pair = {key, (int) i};
+                rbInsert(job->tree, pair);
+            }
+            else
+                rbErase(job->tree, key);
+        }
+        else
+            job->found += rbFind(job->tree, key) != NULL;
+
+        if (job->lock)
+            pthread_mutex_unlock(job->lock);
+    }
+
+    return NULL;
+}
+
+
+static void run (int concurrent, const char* name, const rbPair* data, size_t keys,
+                 size_t ops, unsigned writePct, int threads) {
+
+    rbTree          tree;
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_t*      ids  = (pthread_t*) malloc(threads * sizeof(pthread_t));
+    struct job_t*   jobs = (struct job_t*) calloc(threads, sizeof(struct job_t));
+    char            title[64];
+
+    // every other key is present at the start
+    rbResult res = concurrent ? rbCreateConcurrent(data, keys / 2, &tree)
+                              : rbCreate(data, keys / 2, &tree);
+
+    if (ids == NULL || jobs == NULL || res != RB_SUCCESS)
+        exit(1);
+
+    for (int t = 0; t < threads; ++t) {
+        jobs[t].tree     = tree;
+        jobs[t].lock     = concurrent ? NULL : &lock;
+        jobs[t].keys     = keys;
+        jobs[t].ops      = ops;
+        jobs[t].writePct = writePct;
+        jobs[t].seed     = 0x9E3779B97F4A7C15ull * (t + 1);
+    }
+
+    double start = benchNow();
+    for (int t = 0; t < threads; ++t)
+        pthread_create(&ids[t], NULL, worker, &jobs[t]);
+    for (int t = 0; t < threads; ++t)
+        pthread_join(ids[t], NULL);
+    double sec = benchNow() - start;
+
+    snprintf(title, sizeof(title), "%s, %u%% writes, %d threads", name, writePct, threads);
+    benchReport(title, (double) ops * threads, sec);
+
+    rbDestroy(tree);
+    free(ids);
+    free(jobs);
+}
+
+
+int main (int argc, char** argv) {
+
+    size_t   keys       = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t   ops        = argc > 2 ? strtoull(argv[2], NULL, 10) : 500000;
+    int      maxThreads = argc > 3 ? atoi(argv[3]) : 64;
+    unsigned mixes[]    = {0, 5, 50};
+
+    if (keys < 2 || maxThreads < 1)
+        return 1;
+
+    rbPair* data = (rbPair*) malloc(keys / 2 * sizeof(rbPair));
+    if (data == NULL)
+        return 1;
+
+    for (size_t i = 0; i < keys / 2; ++i) {
+        rbPair pair = {(int) (2 * i), (int) i};
+        memcpy(&data[i], &pair, sizeof(rbPair));
+    }
+
+    printf("%zu keys, %zu operations per thread\n", keys, ops);
+
+    for (size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); ++m)
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            run(0, "global mutex", data, keys, ops, mixes[m], threads);
+            run(1, "concurrent", data, keys, ops, mixes[m], threads);
+        }
+
+    free(data);
+    return 0;
+}
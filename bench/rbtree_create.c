@@ -0,0 +1,82 @@
+/****************************************************************************************
+ *
+ *   rbtree_create.c
+ *
+ *   Startup time of a filled red-black tree: rbCreate on sorted and on shuffled input
+ *   against a loop of rbInsert into an empty tree.
+ *
+ *   Build: gcc -O2 -I examples/RBTree bench/rbtree_create.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [pairs]
+ *
+ ***/
+#include <stdlib.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+static double createTime (const rbPair* data, size_t n) {
+
+    rbTree tree;
+    double start = benchNow();
+
+    if (rbCreate(data, n, &tree) != RB_SUCCESS)
+        exit(1);
+
+    double sec = benchNow() - start;
+    rbDestroy(tree);
+    return sec;
+}
+
+
+static double insertTime (const rbPair* data, size_t n) {
+
+    rbTree tree;
+    double start = benchNow();
+
+    if (rbCreate(NULL, 0, &tree) != RB_SUCCESS)
+        exit(1);
+
+    for (size_t i = 0; i < n; ++i)
+        rbInsert(tree, data[i]);
+
+    double sec = benchNow() - start;
+    rbDestroy(tree);
+    return sec;
+}
+
+
+int main (int argc, char** argv) {
+
+    size_t   n    = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    rbPair*  data = (rbPair*) malloc(n * sizeof(rbPair));
+    uint64_t seed = 7;
+
+    if (data == NULL || n == 0)
+        return 1;
+
+    printf("%zu pairs\n", n);
+
+    for (size_t i = 0; i < n; ++i) {
+        *((rb_key_type*)&data[i].key) = (rb_key_type) i;
+        data[i].value = (rb_val_type) i;
+    }
+
+    benchReport("sorted, rbCreate", (double) n, createTime(data, n));
+    benchReport("sorted, rbInsert loop", (double) n, insertTime(data, n));
+
+    for (size_t i = n - 1; i > 0; --i) {
+        size_t j = benchRand(&seed) % (i + 1);
+        rbPair tmp = data[i];
+        *((rb_key_type*)&data[i].key) = data[j].key;
+        data[i].value = data[j].value;
+        *((rb_key_type*)&data[j].key) = tmp.key;
+        data[j].value = tmp.value;
+    }
+
+    benchReport("shuffled, rbCreate", (double) n, createTime(data, n));
+    benchReport("shuffled, rbInsert loop", (double) n, insertTime(data, n));
+
+    free(data);
+    return 0;
+}
@@ -0,0 +1,132 @@
+/****************************************************************************************
+ *
+ *   rbtree_dump.c
+ *
+ *   Whole-tree walks on large trees: rbForeach, rbDumpTo in each format against the
+ *   recursive printf-per-node dump rbDump used to be, and rbDestroy of a tree whose
+ *   nodes were allocated one by one (so that every node is visited and freed).
+ *
+ *   Build: gcc -O2 -pthread -I examples/RBTree bench/rbtree_dump.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [keys] [output file]
+ *
+ ***/
+#include <stdlib.h>
+#include <string.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+struct order_t {
+    long sum;
+    int  last;
+    int  sorted;
+};
+
+
+static void visit (rbPair* pair, void* data) {
+
+    struct order_t* order = (struct order_t*) data;
+
+    order->sum += pair->value;
+    order->sorted &= pair->key > order->last;
+    order->last = pair->key;
+}
+
+
+/// The dump rbDump used to print: a printf call per node, recursively.
+static void printfDump (FILE* file, rbNode node, int indents) {
+
+    for (int i = 0; i < indents; ++i)
+        fprintf(file, "    |");
+
+    if (node == NULL) {
+        fprintf(file, "NULL(B)\n");
+        return;
+    }
+
+    fprintf(file, "[key: %d, value: %d]", node->pair.key, node->pair.value);
+    fprintf(file, node->color == RED ? "(R)\n" : "(B)\n");
+
+    printfDump(file, node->left, indents + 1);
+    printfDump(file, node->right, indents + 1);
+}
+
+
+static void dump (rbTree tree, const char* path, rbDumpFormat format, const char* name) {
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        exit(1);
+
+    double start = benchNow();
+    if (rbDumpTo(tree, file, format) != RB_SUCCESS)
+        exit(1);
+    double sec = benchNow() - start;
+
+    long bytes = ftell(file);
+    fclose(file);
+
+    benchReport(name, (double) rbSize(tree), sec);
+    printf("%-40s %10.1f MB/s\n", name, (double) bytes / sec * 1e-6);
+}
+
+
+int main (int argc, char** argv) {
+
+    size_t      n    = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    const char* path = argc > 2 ? argv[2] : "rbtree_dump.out";
+    uint64_t    seed = 9;
+    rbTree      tree;
+
+    rbPair* data = (rbPair*) malloc((n ? n : 1) * sizeof(rbPair));
+    if (data == NULL)
+        return 1;
+
+    for (size_t i = 0; i < n; ++i) {
+        rbPair pair = {(int) (2 * i), (int) (benchRand(&seed) % 1000)};
+        memcpy(&data[i], &pair, sizeof(rbPair));
+    }
+
+    if (rbCreate(data, n, &tree) != RB_SUCCESS)
+        return 1;
+
+    printf("%zu keys\n", n);
+
+    struct order_t order = {0, -1, 1};
+    double start = benchNow();
+    rbForeach(tree, visit, &order);
+    benchReport("rbForeach", (double) n, benchNow() - start);
+    if (!order.sorted)
+        return 1;
+
+    dump(tree, path, RB_DUMP_TEXT, "rbDumpTo, text");
+    dump(tree, path, RB_DUMP_DOT, "rbDumpTo, DOT");
+    dump(tree, path, RB_DUMP_JSON, "rbDumpTo, JSON");
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return 1;
+
+    start = benchNow();
+    printfDump(file, tree->treeRoot, 0);
+    fflush(file);
+    benchReport("printf per node, recursive", (double) n, benchNow() - start);
+    fclose(file);
+    remove(path);
+
+    rbDestroy(tree);
+
+    // nodes of their own: rbDestroy walks the tree and frees every node
+    if (rbCreate(NULL, 0, &tree) != RB_SUCCESS)
+        return 1;
+    for (size_t i = 0; i < n; ++i)
+        rbInsert(tree, data[i]);
+
+    start = benchNow();
+    rbDestroy(tree);
+    benchReport("rbDestroy, a node per allocation", (double) n, benchNow() - start);
+
+    free(data);
+    return 0;
+}
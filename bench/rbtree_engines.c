@@ -0,0 +1,85 @@
+/****************************************************************************************
+ *
+ *   rbtree_engines.c
+ *
+ *   Compares the engines behind the rbTree interface (see rbCreateWithEngine): insert,
+ *   lookup and scan throughput and bytes per key, for container sizes from 1K keys up
+ *   to the given maximum.
+ *
+ *   Build: gcc -O2 -I examples/RBTree bench/rbtree_engines.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [max keys]      (e.g. 100000000 for the full 1K-100M range)
+ *
+ ***/
+#include <stdlib.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+static void run (rbEngine engine, const char* name, const int* keys, size_t n) {
+
+    rbTree   tree;
+    char     title[64];
+    uint64_t seed = 11;
+    long     sum = 0;
+
+    if (rbCreateWithEngine(NULL, 0, engine, &tree) != RB_SUCCESS)
+        exit(1);
+
+    double start = benchNow();
+    for (size_t i = 0; i < n; ++i) {
+        rbPair pair = {keys[i], (int) i};
+        rbInsert(tree, pair);
+    }
+    snprintf(title, sizeof(title), "%-9s %9zu insert", name, n);
+    benchReport(title, (double) n, benchNow() - start);
+
+    size_t lookups = n < 1000000 ? 1000000 : n;
+    start = benchNow();
+    for (size_t i = 0; i < lookups; ++i) {
+        rbPair* pair = rbFind(tree, keys[benchRand(&seed) % n]);
+        sum += pair->value;
+    }
+    snprintf(title, sizeof(title), "%-9s %9zu lookup", name, n);
+    benchReport(title, (double) lookups, benchNow() - start);
+
+    start = benchNow();
+    for (rbPair* pair = rbBegin(tree); pair != NULL; pair = rbNext(tree, pair))
+        sum += pair->value;
+    snprintf(title, sizeof(title), "%-9s %9zu scan", name, n);
+    benchReport(title, (double) n, benchNow() - start);
+
+    printf("%-9s %9zu bytes/key %.1f  (checksum %ld)\n",
+           name, n, (double) rbMemoryUsage(tree) / (double) n, sum);
+
+    rbDestroy(tree);
+}
+
+
+int main (int argc, char** argv) {
+
+    size_t   max  = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    int*     keys = (int*) malloc(max * sizeof(int));
+    uint64_t seed = 5;
+
+    if (keys == NULL || max == 0)
+        return 1;
+
+    for (size_t n = 1000; n <= max; n *= 10) {
+        // a random permutation of distinct keys
+        for (size_t i = 0; i < n; ++i)
+            keys[i] = (int) (i * 2 + 1);
+        for (size_t i = n - 1; i > 0; --i) {
+            size_t j = benchRand(&seed) % (i + 1);
+            int tmp = keys[i];
+            keys[i] = keys[j];
+            keys[j] = tmp;
+        }
+
+        run(RB_ENGINE_REDBLACK, "red-black", keys, n);
+        run(RB_ENGINE_BPLUS, "B+", keys, n);
+    }
+
+    free(keys);
+    return 0;
+}
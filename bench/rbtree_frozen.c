@@ -0,0 +1,79 @@
+/****************************************************************************************
+ *
+ *   rbtree_frozen.c
+ *
+ *   Lookup throughput of a frozen snapshot (see rbFreeze) against rbFind on the
+ *   container it was made from. Every answer is checked against rbFind.
+ *
+ *   Build: gcc -O2 -I examples/RBTree bench/rbtree_frozen.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [keys] [lookups]
+ *
+ ***/
+#include <stdlib.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+int main (int argc, char** argv) {
+
+    size_t   n       = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    size_t   lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000;
+    uint64_t seed    = 3;
+    rbTree   tree;
+    rbFrozen frozen;
+
+    rbPair*        data    = (rbPair*) malloc(n * sizeof(rbPair));
+    rb_key_type*   queries = (rb_key_type*) malloc(lookups * sizeof(rb_key_type));
+    rbPair**       expect  = (rbPair**) malloc(lookups * sizeof(rbPair*));
+    const rbPair** found   = (const rbPair**) malloc(lookups * sizeof(rbPair*));
+
+    if (data == NULL || queries == NULL || expect == NULL || found == NULL || n == 0)
+        return 1;
+
+    // even keys are present, odd ones are misses
+    for (size_t i = 0; i < n; ++i) {
+        *((rb_key_type*)&data[i].key) = (rb_key_type) (2 * i);
+        data[i].value = (rb_val_type) i;
+    }
+    for (size_t i = 0; i < lookups; ++i)
+        queries[i] = (rb_key_type) (benchRand(&seed) % (2 * n));
+
+    if (rbCreate(data, n, &tree) != RB_SUCCESS || rbFreeze(tree, &frozen) != RB_SUCCESS)
+        return 1;
+
+    printf("%zu keys, %zu lookups (half of them misses)\n", n, lookups);
+
+    double start = benchNow();
+    for (size_t i = 0; i < lookups; ++i)
+        expect[i] = rbFind(tree, queries[i]);
+    benchReport("rbFind", (double) lookups, benchNow() - start);
+
+    start = benchNow();
+    for (size_t i = 0; i < lookups; ++i)
+        found[i] = rbFrozenFind(frozen, queries[i]);
+    benchReport("rbFrozenFind", (double) lookups, benchNow() - start);
+
+    size_t wrong = 0;
+    for (size_t i = 0; i < lookups; ++i)
+        wrong += (expect[i] == NULL) != (found[i] == NULL) ||
+                 (expect[i] != NULL && expect[i]->value != found[i]->value);
+
+    start = benchNow();
+    rbFrozenFindMany(frozen, queries, lookups, found);
+    benchReport("rbFrozenFindMany", (double) lookups, benchNow() - start);
+
+    for (size_t i = 0; i < lookups; ++i)
+        wrong += (expect[i] == NULL) != (found[i] == NULL) ||
+                 (expect[i] != NULL && expect[i]->value != found[i]->value);
+
+    printf("mismatches: %zu\n", wrong);
+
+    rbFrozenDestroy(frozen);
+    rbDestroy(tree);
+    free(data);
+    free(queries);
+    free(expect);
+    free(found);
+    return wrong != 0;
+}
@@ -0,0 +1,174 @@
+/****************************************************************************************
+ *
+ *   rbtree_generic.c
+ *
+ *   Insert, lookup and erase rates of a container generated by RB_DEFINE with int keys
+ *   and values against the int container of RBTree.c, plus 64-bit and string keys for
+ *   reference.
+ *
+ *   Build: gcc -O2 -I examples/RBTree bench/rbtree_generic.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [keys]
+ *
+ ***/
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "RBTree.h"
+#include "RBTreeGeneric.h"
+#include "bench.h"
+
+
+typedef struct { char s[24]; } name24;
+
+#define NAME_CMP(a, b) strcmp((a).s, (b).s)
+
+RB_DEFINE(rbInt, int, int, RB_CMP_NUMBER)
+RB_DEFINE(rbI64, int64_t, int64_t, RB_CMP_NUMBER)
+RB_DEFINE(rbName, name24, int, NAME_CMP)
+
+
+static void runInt (const int* keys, size_t n) {
+
+    rbTree tree;
+    long   sum = 0;
+
+    if (rbCreate(NULL, 0, &tree) != RB_SUCCESS)
+        exit(1);
+
+    double start = benchNow();
+    for (size_t i = 0; i < n; ++i) {
+        rbPair pair = {keys[i], (int) i};
+        rbInsert(tree, pair);
+    }
+    benchReport("int (RBTree.c), insert", (double) n, benchNow() - start);
+
+    start = benchNow();
+    for (size_t i = 0; i < n; ++i)
+        sum += rbFind(tree, keys[n - 1 - i])->value;
+    benchReport("int (RBTree.c), find", (double) n, benchNow() - start);
+
+    start = benchNow();
+    for (size_t i = 0; i < n; ++i)
+        rbErase(tree, keys[i]);
+    benchReport("int (RBTree.c), erase", (double) n, benchNow() - start);
+
+    if (sum != (long) n * (long) (n - 1) / 2 || !rbEmpty(tree))
+        exit(1);
+
+    rbDestroy(tree);
+}
+
+
+static void runGenericInt (const int* keys, size_t n) {
+
+    rbInt tree;
+    long  sum = 0;
+
+    if (rbIntCreate(&tree) != RB_SUCCESS)
+        exit(1);
+
+    double start = benchNow();
+    for (size_t i = 0; i < n; ++i)
+        rbIntInsert(tree, keys[i], (int) i);
+    benchReport("int (RB_DEFINE), insert", (double) n, benchNow() - start);
+
+    start = benchNow();
+    for (size_t i = 0; i < n; ++i)
+        sum += rbIntFind(tree, keys[n - 1 - i])->value;
+    benchReport("int (RB_DEFINE), find", (double) n, benchNow() - start);
+
+    start = benchNow();
+    for (size_t i = 0; i < n; ++i)
+        rbIntErase(tree, keys[i]);
+    benchReport("int (RB_DEFINE), erase", (double) n, benchNow() - start);
+
+    if (sum != (long) n * (long) (n - 1) / 2 || rbIntSize(tree) != 0)
+        exit(1);
+
+    rbIntDestroy(tree);
+}
+
+
+static void runI64 (const int* keys, size_t n) {
+
+    rbI64   tree;
+    int64_t sum = 0;
+
+    if (rbI64Create(&tree) != RB_SUCCESS)
+        exit(1);
+
+    double start = benchNow();
+    for (size_t i = 0; i < n; ++i)
+        rbI64Insert(tree, (int64_t) keys[i] << 32, (int64_t) i);
+    benchReport("int64_t (RB_DEFINE), insert", (double) n, benchNow() - start);
+
+    start = benchNow();
+    for (size_t i = 0; i < n; ++i)
+        sum += rbI64Find(tree, (int64_t) keys[n - 1 - i] << 32)->value;
+    benchReport("int64_t (RB_DEFINE), find", (double) n, benchNow() - start);
+
+    if (sum != (int64_t) n * (int64_t) (n - 1) / 2)
+        exit(1);
+
+    rbI64Destroy(tree);
+}
+
+
+static void runName (const int* keys, size_t n) {
+
+    rbName  tree;
+    name24* names = (name24*) malloc(n * sizeof(name24));
+    long    sum   = 0;
+
+    if (names == NULL || rbNameCreate(&tree) != RB_SUCCESS)
+        exit(1);
+
+    for (size_t i = 0; i < n; ++i)
+        snprintf(names[i].s, sizeof(names[i].s), "user-%d", keys[i]);
+
+    double start = benchNow();
+    for (size_t i = 0; i < n; ++i)
+        rbNameInsert(tree, names[i], (int) i);
+    benchReport("char[24] (RB_DEFINE), insert", (double) n, benchNow() - start);
+
+    start = benchNow();
+    for (size_t i = 0; i < n; ++i)
+        sum += rbNameFind(tree, names[n - 1 - i])->value;
+    benchReport("char[24] (RB_DEFINE), find", (double) n, benchNow() - start);
+
+    if (sum != (long) n * (long) (n - 1) / 2)
+        exit(1);
+
+    rbNameDestroy(tree);
+    free(names);
+}
+
+
+int main (int argc, char** argv) {
+
+    size_t   n    = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    uint64_t seed = 3;
+
+    int* keys = (int*) malloc(n * sizeof(int));
+    if (keys == NULL || n == 0)
+        return 1;
+
+    for (size_t i = 0; i < n; ++i)
+        keys[i] = (int) i;
+    for (size_t i = n - 1; i > 0; --i) {
+        size_t j = benchRand(&seed) % (i + 1);
+        int tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    printf("%zu keys in random order\n", n);
+
+    runInt(keys, n);
+    runGenericInt(keys, n);
+    runI64(keys, n);
+    runName(keys, n);
+
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,73 @@
+/****************************************************************************************
+ *
+ *   rbtree_insert.c
+ *
+ *   Insert throughput of the red-black tree on random and sequential key streams, for
+ *   fresh keys and for keys that are already in the tree (value replacement).
+ *
+ *   Build: gcc -O2 -I examples/RBTree bench/rbtree_insert.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [keys]
+ *
+ ***/
+#include <stdlib.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+/// Inserts all 'keys' into the tree twice: the first pass adds new nodes, the second one
+/// only replaces the values.
+static void run (const char* name, const int* keys, size_t n) {
+
+    rbTree tree;
+    char   title[64];
+
+    if (rbCreate(NULL, 0, &tree) != RB_SUCCESS)
+        exit(1);
+
+    double start = benchNow();
+    for (size_t i = 0; i < n; ++i) {
+        rbPair pair = {keys[i], (int) i};
+        rbInsert(tree, pair);
+    }
+    snprintf(title, sizeof(title), "%s, new keys", name);
+    benchReport(title, (double) n, benchNow() - start);
+
+    start = benchNow();
+    for (size_t i = 0; i < n; ++i) {
+        rbPair pair = {keys[i], (int) -i};
+        rbInsert(tree, pair);
+    }
+    snprintf(title, sizeof(title), "%s, existing keys", name);
+    benchReport(title, (double) n, benchNow() - start);
+
+    rbDestroy(tree);
+}
+
+
+int main (int argc, char** argv) {
+
+    size_t   n    = argc > 1 ? strtoull(argv[1], NULL, 10) : 4000000;
+    int*     keys = (int*) malloc(n * sizeof(int));
+    uint64_t seed = 42;
+
+    if (keys == NULL || n == 0)
+        return 1;
+
+    printf("%zu keys\n", n);
+
+    for (size_t i = 0; i < n; ++i)
+        keys[i] = (int) i;
+    run("sequential", keys, n);
+
+    for (size_t i = n - 1; i > 0; --i) {
+        size_t j = benchRand(&seed) % (i + 1);
+        int tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+    run("random", keys, n);
+
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,175 @@
+/****************************************************************************************
+ *
+ *   rbtree_persistent.c
+ *
+ *   Cost of keeping versions of a container: rbSnapshot of RB_ENGINE_PERSISTENT against
+ *   a deep copy (the pairs collected with rbForeach and passed to rbCreate), and the
+ *   price of the path copying. Writes are timed on a plain red-black tree, on a
+ *   persistent tree with no other versions (nothing is copied) and on one that is
+ *   snapshotted before every 1, 16 or 256 writes, with all versions kept; the heap growth
+ *   per write is the memory overhead of a version. Heap sizes come from mallinfo2
+ *   (glibc).
+ *
+ *   Build: gcc -O2 -pthread -I examples/RBTree bench/rbtree_persistent.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [keys] [writes]
+ *
+ ***/
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+struct collect_t {
+    rbPair* pairs;
+    size_t  n;
+};
+
+
+/// Bytes of the heap in use, large blocks mapped separately included.
+static double heapBytes (void) {
+
+    struct mallinfo2 info = mallinfo2();
+    return (double) (info.uordblks + info.hblkhd);
+}
+
+
+/// Creates a container with every other key of [0, 2 * n).
+static rbTree fill (rbEngine engine, size_t n) {
+
+    rbTree  tree;
+    rbPair* data = (rbPair*) malloc(n * sizeof(rbPair));
+
+    if (data == NULL)
+        exit(1);
+
+    for (size_t i = 0; i < n; ++i) {
+        rbPair pair = {(int) (2 * i), (int) i};
+        memcpy(&data[i], &pair, sizeof(rbPair));
+    }
+
+    if (rbCreateWithEngine(data, n, engine, &tree) != RB_SUCCESS)
+        exit(1);
+
+    free(data);
+    return tree;
+}
+
+
+static void collect (rbPair* pair, void* data) {
+
+    struct collect_t* all = (struct collect_t*) data;
+
+    memcpy(&all->pairs[all->n++], pair, sizeof(rbPair));
+}
+
+
+static void copies (size_t n) {
+
+    rbTree tree = fill(RB_ENGINE_PERSISTENT, n);
+    rbTree versions[64];
+    size_t count = sizeof(versions) / sizeof(versions[0]);
+
+    double heap  = heapBytes();
+    double start = benchNow();
+    for (size_t i = 0; i < count; ++i)
+        if (rbSnapshot(tree, &versions[i]) != RB_SUCCESS)
+            exit(1);
+    benchReport("rbSnapshot", (double) count, benchNow() - start);
+    printf("%-40s %10.0f bytes/version\n", "rbSnapshot", (heapBytes() - heap) / count);
+
+    for (size_t i = 0; i < count; ++i)
+        rbDestroy(versions[i]);
+
+    // rbForeach gives the pairs in key order, which rbCreate links in linear time
+    count = 4;
+    heap  = heapBytes();
+    start = benchNow();
+    for (size_t i = 0; i < count; ++i) {
+        struct collect_t all = {(rbPair*) malloc(n * sizeof(rbPair)), 0};
+        if (all.pairs == NULL)
+            exit(1);
+
+        rbForeach(tree, collect, &all);
+        if (rbCreate(all.pairs, all.n, &versions[i]) != RB_SUCCESS)
+            exit(1);
+        free(all.pairs);
+    }
+    benchReport("deep copy", (double) count, benchNow() - start);
+    printf("%-40s %10.0f bytes/version\n", "deep copy", (heapBytes() - heap) / count);
+
+    for (size_t i = 0; i < count; ++i)
+        rbDestroy(versions[i]);
+    rbDestroy(tree);
+}
+
+
+/// Performs random writes: an rbInsert of an odd key or an rbErase of an even one.
+/// \param every - take a snapshot before every 'every' writes, 0 for none
+static void writes (rbEngine engine, const char* name, size_t n, size_t ops, size_t every) {
+
+    rbTree   tree     = fill(engine, n);
+    size_t   count    = every ? (ops + every - 1) / every : 0;
+    rbTree*  versions = (rbTree*) malloc((count ? count : 1) * sizeof(rbTree));
+    uint64_t seed     = 17;
+    char     title[80];
+
+    if (versions == NULL)
+        exit(1);
+
+    double heap  = heapBytes();
+    double start = benchNow();
+    for (size_t i = 0, v = 0; i < ops; ++i) {
+
+        if (every != 0 && i % every == 0)
+            rbSnapshot(tree, &versions[v++]);
+
+        uint64_t r = benchRand(&seed);
+        rb_key_type key = (int) (r % (2 * n));
+
+        if (key & 1) {
+            rbPair pair = {key, (int) i};
+            rbInsert(tree, pair);
+        }
+        else
+            rbErase(tree, key);
+    }
+    double sec = benchNow() - start;
+
+    if (every != 0)
+        snprintf(title, sizeof(title), "%s, snapshot every %zu", name, every);
+    else
+        snprintf(title, sizeof(title), "%s", name);
+
+    benchReport(title, (double) ops, sec);
+    printf("%-40s %10.1f bytes/write\n", title, (heapBytes() - heap) / (double) ops);
+
+    for (size_t v = 0; v < count; ++v)
+        rbDestroy(versions[v]);
+    rbDestroy(tree);
+    free(versions);
+}
+
+
+int main (int argc, char** argv) {
+
+    size_t n   = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t ops = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000;
+
+    if (n == 0)
+        return 1;
+
+    printf("%zu keys, %zu bytes per node\n", n, sizeof(struct rbNode_t));
+
+    copies(n);
+
+    writes(RB_ENGINE_REDBLACK, "red-black", n, ops, 0);
+    writes(RB_ENGINE_PERSISTENT, "persistent", n, ops, 0);
+    writes(RB_ENGINE_PERSISTENT, "persistent", n, ops, 256);
+    writes(RB_ENGINE_PERSISTENT, "persistent", n, ops, 16);
+    writes(RB_ENGINE_PERSISTENT, "persistent", n, ops, 1);
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+/****************************************************************************************
+ *
+ *   rbtree_pool.c
+ *
+ *   Compares malloc-backed and pool-backed red-black trees (see rbCreateWithPool) on a
+ *   stream of mixed insert/erase/find operations.
+ *
+ *   Build: gcc -O2 -I examples/RBTree bench/rbtree_pool.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [operations] [key range]
+ *
+ ***/
+#include <stdlib.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+/// Runs 'ops' operations: 50% insert, 30% erase, 20% find of random keys.
+/// \return the time spent, including the destruction of the tree.
+static double run (rbTree tree, size_t ops, uint64_t range, long* found) {
+
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    double start = benchNow();
+
+    for (size_t i = 0; i < ops; ++i) {
+        uint64_t r = benchRand(&seed);
+        int key = (int) ((r >> 8) % range);
+
+        switch (r % 10) {
+            case 0: case 1: case 2: case 3: case 4: {
+                rbPair pair = {key, (int) i};
+                rbInsert(tree, pair);
+                break;
+            }
+            case 5: case 6: case 7:
+                rbErase(tree, key);
+                break;
+            default:
+                *found += rbFind(tree, key) != NULL;
+                break;
+        }
+    }
+
+    rbDestroy(tree);
+    return benchNow() - start;
+}
+
+
+int main (int argc, char** argv) {
+
+    size_t   ops   = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    uint64_t range = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000;
+    long     found = 0;
+    rbTree   tree;
+
+    printf("%zu mixed operations, keys in [0, %llu)\n", ops, (unsigned long long) range);
+
+    if (rbCreate(NULL, 0, &tree) != RB_SUCCESS)
+        return 1;
+    benchReport("malloc-backed tree", (double) ops, run(tree, ops, range, &found));
+
+    if (rbCreateWithPool(NULL, 0, 0, &tree) != RB_SUCCESS)
+        return 1;
+    benchReport("pool-backed tree", (double) ops, run(tree, ops, range, &found));
+
+    printf("(found %ld)\n", found);
+    return 0;
+}
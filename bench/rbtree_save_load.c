@@ -0,0 +1,117 @@
+/****************************************************************************************
+ *
+ *   rbtree_save_load.c
+ *
+ *   Start-up time of a container: rbLoad and rbFrozenLoad of a snapshot file against
+ *   parsing a text file of "key value" lines and inserting the pairs one by one. The
+ *   default 10^8 pairs need about 5 GB of memory; the text way is measured on at most
+ *   10^7 of them (it takes minutes beyond that), its per-pair time is comparable.
+ *
+ *   rbSave leaves the snapshot in the page cache. For a cold start, run the bench once
+ *   to write the files, drop the caches (as root: sync; echo 3 > /proc/sys/vm/drop_caches)
+ *   and run it again with 0 pairs to only load them.
+ *
+ *   Build: gcc -O2 -pthread -I examples/RBTree bench/rbtree_save_load.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [pairs, 0 to load existing files] [snapshot file] [text file]
+ *
+ ***/
+#include <stdlib.h>
+#include <string.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+#define TEXT_MAX_PAIRS 10000000
+
+
+static void save (size_t n, const char* snapshot, const char* text) {
+
+    rbTree   tree;
+    rbPair*  data = (rbPair*) malloc(n * sizeof(rbPair));
+    uint64_t seed = 11;
+
+    if (data == NULL)
+        exit(1);
+
+    // distinct keys in increasing order with random gaps
+    int key = 0;
+    for (size_t i = 0; i < n; ++i) {
+        key += 1 + (int) (benchRand(&seed) % 16);
+        rbPair pair = {key, (int) i};
+        memcpy(&data[i], &pair, sizeof(rbPair));
+    }
+
+    FILE* file = fopen(text, "w");
+    if (file == NULL)
+        exit(1);
+    for (size_t i = 0; i < n && i < TEXT_MAX_PAIRS; ++i)
+        fprintf(file, "%d %d\n", data[i].key, data[i].value);
+    fclose(file);
+
+    if (rbCreate(data, n, &tree) != RB_SUCCESS)
+        exit(1);
+    free(data);
+
+    double start = benchNow();
+    if (rbSave(tree, snapshot) != RB_SUCCESS)
+        exit(1);
+    benchReport("rbSave", (double) n, benchNow() - start);
+
+    rbDestroy(tree);
+}
+
+
+static void load (const char* snapshot, const char* text) {
+
+    rbTree   tree;
+    rbFrozen frozen;
+
+    double start = benchNow();
+    if (rbLoad(snapshot, &tree) != RB_SUCCESS)
+        exit(1);
+    double sec = benchNow() - start;
+
+    size_t n = rbSize(tree);
+    printf("%zu pairs in the snapshot\n", n);
+    benchReport("rbLoad", (double) n, sec);
+    rbDestroy(tree);
+
+    start = benchNow();
+    if (rbFrozenLoad(snapshot, &frozen) != RB_SUCCESS)
+        exit(1);
+    benchReport("rbFrozenLoad", (double) n, benchNow() - start);
+    rbFrozenDestroy(frozen);
+
+    FILE* file = fopen(text, "r");
+    if (file == NULL || rbCreate(NULL, 0, &tree) != RB_SUCCESS)
+        exit(1);
+
+    int    key, value;
+    size_t lines = 0;
+
+    start = benchNow();
+    while (fscanf(file, "%d %d", &key, &value) == 2) {
+        rbPair pair = {key, value};
+        rbInsert(tree, pair);
+        ++lines;
+    }
+    benchReport("text + rbInsert", (double) lines, benchNow() - start);
+
+    fclose(file);
+    rbDestroy(tree);
+}
+
+
+int main (int argc, char** argv) {
+
+    size_t      n        = argc > 1 ? strtoull(argv[1], NULL, 10) : 100000000;
+    const char* snapshot = argc > 2 ? argv[2] : "rbtree_snapshot.bin";
+    const char* text     = argc > 3 ? argv[3] : "rbtree_snapshot.txt";
+
+    if (n != 0)
+        save(n, snapshot, text);
+
+    load(snapshot, text);
+    return 0;
+}
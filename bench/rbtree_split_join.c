@@ -0,0 +1,142 @@
+/****************************************************************************************
+ *
+ *   rbtree_split_join.c
+ *
+ *   Repartitioning a container: rbSplit, rbJoin and rbUnion against copying the pairs
+ *   with rbForeach and rbInsert, for containers of 10^3 keys to the given size.
+ *
+ *   Build: gcc -O2 -pthread -I examples/RBTree bench/rbtree_split_join.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [max keys in the container]
+ *
+ ***/
+#include <stdlib.h>
+#include <string.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+struct copy_t {
+    rbTree      left;
+    rbTree      right;
+    rb_key_type key;
+};
+
+
+/// Creates a container with the keys 'first', 'first + step', ... ('n' keys).
+static rbTree fill (size_t n, int first, int step) {
+
+    rbTree  tree;
+    rbPair* data = (rbPair*) malloc((n ? n : 1) * sizeof(rbPair));
+
+    if (data == NULL)
+        exit(1);
+
+    for (size_t i = 0; i < n; ++i) {
+        rbPair pair = {first + (int) i * step, (int) i};
+        memcpy(&data[i], &pair, sizeof(rbPair));
+    }
+
+    if (rbCreate(data, n, &tree) != RB_SUCCESS)
+        exit(1);
+
+    free(data);
+    return tree;
+}
+
+
+static void copySplit (rbPair* pair, void* data) {
+
+    struct copy_t* copy = (struct copy_t*) data;
+
+    rbInsert(pair->key < copy->key ? copy->left : copy->right, *pair);
+}
+
+
+static void copyAll (rbPair* pair, void* data) {
+
+    rbInsert((rbTree) data, *pair);
+}
+
+
+static void run (size_t n) {
+
+    char title[80];
+
+    // split in the middle and join back
+    rbTree tree = fill(n, 0, 1);
+    rbTree left, right;
+
+    double start = benchNow();
+    rbSplit(tree, (int) (n / 2), &left, &right);
+    double split = benchNow() - start;
+
+    start = benchNow();
+    rbJoin(left, right);
+    double join = benchNow() - start;
+
+    if (rbSize(left) != n || rbSize(right) != 0)
+        exit(1);
+
+    snprintf(title, sizeof(title), "%zu keys, rbSplit", n);
+    benchReport(title, 1, split);
+    snprintf(title, sizeof(title), "%zu keys, rbJoin", n);
+    benchReport(title, 1, join);
+
+    rbDestroy(tree);
+    rbDestroy(right);
+
+    struct copy_t copy = {NULL, NULL, (int) (n / 2)};
+    rbCreate(NULL, 0, &copy.left);
+    rbCreate(NULL, 0, &copy.right);
+
+    start = benchNow();
+    rbForeach(left, copySplit, &copy);
+    snprintf(title, sizeof(title), "%zu keys, split by rbForeach + rbInsert", n);
+    benchReport(title, 1, benchNow() - start);
+
+    start = benchNow();
+    rbForeach(copy.right, copyAll, copy.left);
+    snprintf(title, sizeof(title), "%zu keys, join by rbForeach + rbInsert", n);
+    benchReport(title, 1, benchNow() - start);
+
+    rbDestroy(left);
+    rbDestroy(copy.left);
+    rbDestroy(copy.right);
+
+    // union of interleaved keys: even keys with odd ones and every third key
+    rbTree a = fill(n, 0, 2);
+    rbTree b = fill(n, 0, 3);
+
+    start = benchNow();
+    rbUnion(a, b);
+    snprintf(title, sizeof(title), "%zu + %zu keys, rbUnion", n, n);
+    benchReport(title, 1, benchNow() - start);
+
+    rbDestroy(b);
+    b = fill(n, 0, 3);
+    rbTree c = fill(n, 0, 2);
+
+    start = benchNow();
+    rbForeach(b, copyAll, c);
+    snprintf(title, sizeof(title), "%zu + %zu keys, union by rbForeach + rbInsert", n, n);
+    benchReport(title, 1, benchNow() - start);
+
+    if (rbSize(a) != rbSize(c))
+        exit(1);
+
+    rbDestroy(a);
+    rbDestroy(b);
+    rbDestroy(c);
+}
+
+
+int main (int argc, char** argv) {
+
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+
+    for (size_t size = 1000; size <= n; size *= 10)
+        run(size);
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+/****************************************************************************************
+ *
+ *   rbtree_stats.c
+ *
+ *   Cost of the operation counters: random rbInsert, rbFind and rbErase on a red-black
+ *   tree. Build it three times, without RB_STATS, with it and with RB_STATS_LATENCY as
+ *   well, and compare the times; the instrumented builds also print the counters as
+ *   JSON.
+ *
+ *   Build: gcc -O2 -pthread [-DRB_STATS [-DRB_STATS_LATENCY]] -I examples/RBTree bench/rbtree_stats.c examples/RBTree/RBTree*.c
+ *   Usage: ./a.out [keys]
+ *
+ ***/
+#include <stdlib.h>
+#include <string.h>
+
+#include "RBTree.h"
+#include "bench.h"
+
+
+int main (int argc, char** argv) {
+
+    size_t   n    = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    uint64_t seed = 13;
+    rbTree   tree;
+
+    rb_key_type* keys = (rb_key_type*) malloc((n ? n : 1) * sizeof(rb_key_type));
+    if (keys == NULL || rbCreate(NULL, 0, &tree) != RB_SUCCESS)
+        return 1;
+
+    for (size_t i = 0; i < n; ++i)
+        keys[i] = (int) (benchRand(&seed) % (4 * n));
+
+#if defined(RB_STATS_LATENCY)
+    const char* build = "RB_STATS_LATENCY";
+#elif defined(RB_STATS)
+    const char* build = "RB_STATS";
+#else
+    const char* build = "no counters";
+#endif
+    char title[80];
+
+    printf("%zu keys, %s\n", n, build);
+
+    double start = benchNow();
+    for (size_t i = 0; i < n; ++i) {
+        rbPair pair = {keys[i], (int) i};
+        rbInsert(tree, pair);
+    }
+    snprintf(title, sizeof(title), "rbInsert, %s", build);
+    benchReport(title, (double) n, benchNow() - start);
+
+    size_t found = 0;
+    start = benchNow();
+    for (size_t i = 0; i < n; ++i)
+        found += rbFind(tree, keys[n - 1 - i] + 1) != NULL;
+    snprintf(title, sizeof(title), "rbFind, %s", build);
+    benchReport(title, (double) n, benchNow() - start);
+
+    start = benchNow();
+    for (size_t i = 0; i < n; ++i)
+        rbErase(tree, keys[i]);
+    snprintf(title, sizeof(title), "rbErase, %s", build);
+    benchReport(title, (double) n, benchNow() - start);
+
+    printf("%zu found\n", found);
+
+    rbCounters stats;
+    if (rbStats(tree, &stats) == RB_SUCCESS)
+        rbStatsToJson(&stats, stdout);
+
+    rbDestroy(tree);
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,184 @@
+/****************************************************************************************
+ *
+ *   reduce_benchmark.cpp
+ *
+ *   Google Benchmark suite of the reductions of Reduce.h: reduce_sum, reduce_max and
+ *   reduce_minmax of int, float and double arrays of 2^10 to 2^30 elements, by the
+ *   calling thread only and by one thread per CPU (the "threads" argument, 0 for one per
+ *   CPU), next to the scalar loop of max in examples/point.cpp. By default the inputs
+ *   stop at 2^25 elements (256 MB of doubles); the 2^30 ones take 4 GB (8 GB of
+ *   doubles) and are registered only with BENCH_LARGE=1 in the environment.
+ *
+ *   Before timing, every reduction is checked against a plain loop: exactly for
+ *   integers and minimums and maximums, within the tolerance of Reduce.h for float
+ *   sums; and the result must not depend on the number of threads.
+ *
+ *   Build: cmake --build build --target bench
+ *   Usage: build/bin/bench --benchmark_filter=BM_reduce
+ *
+ ***/
+#include <benchmark/benchmark.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits>
+
+#include "Reduce.h"
+#include "bench.h"
+
+
+namespace {
+
+enum Op { SUM, MAX, MINMAX };
+
+// Values in [-1000, 1000], or NULL if there is no memory.
+template <typename T>
+T* makeValues(size_t n, uint64_t seed) {
+
+    T* values = (T*) malloc(n * sizeof(T));
+    if (values == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < n; ++i)
+        values[i] = (T) (benchRand(&seed) % 2001) - (T) 1000;
+
+    return values;
+}
+
+
+/// Checks one reduction against a plain loop and against the calling thread alone.
+template <typename T>
+bool checkReduce(const T* values, size_t n, Op op) {
+
+    // no elements to compare with: their sum is 0 and they have no extremes
+    T min = 0, max = 0;
+    if (n == 0) {
+        if (op == SUM)
+            return reduce_sum(values, n) == 0;
+        if (op == MAX)
+            return !reduce_max(values, n, &max);
+        return !reduce_minmax(values, n, &min, &max);
+    }
+
+    long double sum = 0, sumAbs = 0;
+    uint64_t    wrapped = 0;
+    T           lo = values[0], hi = values[0];
+
+    for (size_t i = 0; i < n; ++i) {
+        sum += values[i];
+        sumAbs += fabsl(values[i]);
+        wrapped += (uint64_t) (ReduceSum<T>) values[i];
+        lo = values[i] < lo ? values[i] : lo;
+        hi = values[i] > hi ? values[i] : hi;
+    }
+
+    if (op == SUM) {
+        ReduceSum<T> result = reduce_sum(values, n);
+
+        reduce_use_threads(1);
+        bool same = reduce_sum(values, n) == result;
+        reduce_use_threads(0);
+
+        if (!std::numeric_limits<T>::is_integer) {
+            long double u = std::numeric_limits<T>::epsilon() / 2;
+            long double m = REDUCE_BLOCK + n / REDUCE_BLOCK;
+            return same && fabsl((long double) result - sum) <= m * u * sumAbs;
+        }
+        return same && (uint64_t) result == wrapped;
+    }
+
+    if (op == MAX)
+        return reduce_max(values, n, &max) && max == hi;
+    return reduce_minmax(values, n, &min, &max) && min == lo && max == hi;
+}
+
+
+template <typename T, Op op>
+void BM_reduce(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    T* values = makeValues<T>(n, 1);
+
+    if (values == NULL) {
+        state.SkipWithError("no memory");
+        return;
+    }
+    if (!checkReduce(values, n, op)) {
+        state.SkipWithError("the reduction differs from a plain loop");
+        free(values);
+        return;
+    }
+
+    reduce_use_threads((unsigned) state.range(1));
+
+    T min, max;
+    for (auto _ : state) {
+        if (op == SUM)
+            benchmark::DoNotOptimize(reduce_sum(values, n));
+        else if (op == MAX)
+            benchmark::DoNotOptimize(reduce_max(values, n, &max));
+        else
+            benchmark::DoNotOptimize(reduce_minmax(values, n, &min, &max));
+    }
+
+    reduce_use_threads(0);
+    free(values);
+
+    state.SetItemsProcessed((int64_t) (state.iterations() * n));
+    state.SetBytesProcessed((int64_t) (state.iterations() * n * sizeof(T)));
+}
+
+
+/// The loop of max(std::vector<int>&) in examples/point.cpp.
+void BM_max_loop(benchmark::State& state) {
+
+    size_t n = (size_t) state.range(0);
+    int* values = makeValues<int>(n, 1);
+
+    if (values == NULL) {
+        state.SkipWithError("no memory");
+        return;
+    }
+
+    for (auto _ : state) {
+        int max = values[0];
+        for (size_t i = 0; i < n; ++i)
+            if (values[i] > max)
+                max = values[i];
+        benchmark::DoNotOptimize(max);
+    }
+
+    free(values);
+
+    state.SetItemsProcessed((int64_t) (state.iterations() * n));
+    state.SetBytesProcessed((int64_t) (state.iterations() * n * sizeof(int)));
+}
+
+
+/// The largest input: 2^25 elements, or 2^30 with BENCH_LARGE=1.
+int64_t maxElements() {
+
+    const char* large = getenv("BENCH_LARGE");
+    return large != NULL && strcmp(large, "1") == 0 ? 1 << 30 : 1 << 25;
+}
+
+} // namespace
+
+
+#define REDUCE_BENCHMARK(...)                                                        \
+    BENCHMARK(__VA_ARGS__)                                                           \
+        ->ArgsProduct({benchmark::CreateRange(1 << 10, maxElements(), 32), {1, 0}})  \
+        ->ArgNames({"n", "threads"})                                                 \
+        ->UseRealTime()
+
+REDUCE_BENCHMARK(BM_reduce<int, SUM>);
+REDUCE_BENCHMARK(BM_reduce<float, SUM>);
+REDUCE_BENCHMARK(BM_reduce<double, SUM>);
+REDUCE_BENCHMARK(BM_reduce<int, MAX>);
+REDUCE_BENCHMARK(BM_reduce<float, MAX>);
+REDUCE_BENCHMARK(BM_reduce<double, MAX>);
+REDUCE_BENCHMARK(BM_reduce<int, MINMAX>);
+REDUCE_BENCHMARK(BM_reduce<float, MINMAX>);
+REDUCE_BENCHMARK(BM_reduce<double, MINMAX>);
+BENCHMARK(BM_max_loop)->RangeMultiplier(32)->Range(1 << 10, maxElements());
@@ -31,7 +31,9 @@
 ///======================================================================================
 ///======================================================================================
 //
-#include "RBTree.h"
+#include "RBTreeInternal.h"
+
+
 
 /****************************************************************************************
  *
@@ -40,40 +42,52 @@
  ***/
 static void foreach_   (rbNode tree, void (*act)(rbPair*, void*), void* data);
 
-static void printTree_ (rbNode tree, int indents);
-static void printNode_ (rbNode node, int indents);
+static rbPair*  find_engine_   (rbTree tree, rb_key_type key);
+static rbResult insert_engine_ (rbTree tree, rbPair pair);
+static rbResult erase_engine_  (rbTree tree, rb_key_type key);
+
+static rbNode node_of_pair_ (rbPair* pair);
+static void   range_        (rbNode node, rb_key_type lo, rb_key_type hi,
+                             void (*act)(rbPair*, void*), void* data);
+static rbNode predecessor_  (rbNode node);
+static rbNode lower_bound_  (rbTree tree, rb_key_type key, int strict);
 
-static rbNode find_top_            (rbNode node);
-static rbNode find_parent_         (rbNode tree, rb_key_type key);
 static rbNode find_grandparent_    (rbNode node);
 static rbNode find_uncle_          (rbNode node);
 static rbNode find_brother_        (rbNode node);
-static rbNode find_node_with_key_(rbTree tree, rb_key_type key);
-
-
-static void leftRotation  (rbNode node);
-static void rightRotation (rbNode node);
-
-
-static void replaceWithChild  (rbNode node, rbNode child);
-
-static void   deleteTree      (rbNode tree);
-static rbNode deleteNode      (rbNode node);
-static void   delete_one_child(rbNode node);
-static void   delete_case1    (rbNode node);
-static void   delete_case2    (rbNode node);
-static void   delete_case3    (rbNode node);
-static void   delete_case4    (rbNode node);
-static void   delete_case5    (rbNode node);
-static void   delete_case6    (rbNode node);
-
-
-static void   insert       (rbNode parent, rbNode node);
-static void   insert_case1 (rbNode node);
-static void   insert_case2 (rbNode node);
-static void   insert_case3 (rbNode node);
-static void   insert_case4 (rbNode node);
-static void   insert_case5 (rbNode node);
+static void   find_batch_        (rbTree tree, const rb_key_type* keys, size_t n, rbPair** out);
+
+static rbResult build_     (rbTree tree, const rbPair* data, size_t size);
+
+static int      isSorted_  (const rbPair* data, size_t size);
+static void     sortIndices_(const rbPair* data, size_t* idx, size_t* tmp, size_t size);
+
+static void   freeNode_    (rbTree tree, rbNode node);
+static void   releasePool_ (struct rbPool_t* pool);
+static int    lockPool_    (struct rbPool_t* pool);
+static struct rbPool_t* createPool_ (size_t slabNodes);
+static size_t poolMemoryUsage_ (const struct rbPool_t* pool);
+
+static void leftRotation  (rbTree tree, rbNode node);
+static void rightRotation (rbTree tree, rbNode node);
+
+static void replaceWithChild  (rbTree tree, rbNode node, rbNode child);
+
+static void   deleteNode      (rbTree tree, rbNode node);
+static void   swap_with_successor_(rbTree tree, rbNode node, rbNode succ);
+static void   delete_one_child(rbTree tree, rbNode node);
+static void   delete_case1    (rbTree tree, rbNode node);
+static void   delete_case2    (rbTree tree, rbNode node);
+static void   delete_case3    (rbTree tree, rbNode node);
+static void   delete_case4    (rbTree tree, rbNode node);
+static void   delete_case5    (rbTree tree, rbNode node);
+static void   delete_case6    (rbTree tree, rbNode node);
+
+static void   insert       (rbTree tree, rbNode parent, rbNode node);
+static void   insert_case2 (rbTree tree, rbNode node);
+static void   insert_case3 (rbTree tree, rbNode node);
+static void   insert_case4 (rbTree tree, rbNode node);
+static void   insert_case5 (rbTree tree, rbNode node);
 /***
  *
  *   end of prototypes for helper functions
@@ -90,37 +104,44 @@ static void   insert_case5 (rbNode node);
  ***/
 rbResult rbCreate (const rbPair* data, size_t size, rbTree* tree)
 {
-    if (tree == NULL) {
-        return RB_INVALID_ARGS;
-    }
+    return rb_create_(data, size, 0, 0, RB_ENGINE_REDBLACK, tree);
+}
 
-    *tree = (struct rbTree_t*) calloc(1, sizeof(struct rbTree_t));
 
-    if (*tree == NULL) {
-        return RB_LACK_OF_MEMORY;
-    }
+rbResult rbCreateWithPool (const rbPair* data, size_t size, size_t slabNodes, rbTree* tree)
+{
+    return rb_create_(data, size, slabNodes, 1, RB_ENGINE_REDBLACK, tree);
+}
 
-    (*tree)->treeRoot = NULL;
 
-    if (data == NULL || size == 0) {
-        return RB_SUCCESS;
-    }
-
-    for (size_t i = 0; i < size; ++i) {
-        rbResult res = rbInsert(*tree, data[i]);
-        if (res != RB_SUCCESS) {
-            rbDestroy(*tree);
-            return res;
-        }
-    }
+rbResult rbCreateWithEngine (const rbPair* data, size_t size, rbEngine engine, rbTree* tree)
+{
+    if (engine != RB_ENGINE_REDBLACK && engine != RB_ENGINE_BPLUS &&
+        engine != RB_ENGINE_PERSISTENT)
+        return RB_INVALID_ARGS;
 
-    return RB_SUCCESS;
+    return rb_create_(data, size, 0, 0, engine, tree);
 }
 
 
 rbResult rbDestroy (rbTree tree)
 {
-    deleteTree(tree->treeRoot);
+    if (tree == NULL)
+        return RB_INVALID_ARGS;
+
+    if (tree->sync != NULL)
+        rb_destroySync_(tree);
+
+    if (tree->bplus != NULL) {
+        rb_bpClear_(tree->bplus);
+        free (tree->bplus);
+    }
+    else {
+        rb_dropNodes_(tree);
+        if (tree->pool != NULL)
+            rb_unrefPool_(tree->pool);
+    }
+
     free (tree);
     return RB_SUCCESS;
 }
@@ -131,15 +152,61 @@ rbResult rbClear (rbTree map) {
     if (map == NULL)
         return RB_INVALID_ARGS;
 
-    deleteTree(map->treeRoot);
+    // Readers may still walk the old nodes, so they are retired as a whole.
+    if (map->sync != NULL) {
+        rbResult res = rb_lockWriter_(map, 1);
+        if (res != RB_SUCCESS)
+            return res;
+
+        rbNode root = map->treeRoot;
+        size_t size = map->size;
+
+        rb_beginChange_(map->sync);
+        RB_STORE(map->treeRoot, NULL);
+        RB_STORE(map->size, 0);
+        rb_endChange_(map->sync);
+
+        if (root != NULL)
+            rb_retire_(map, root, size);
+
+        rb_unlockWriter_(map);
+        return RB_SUCCESS;
+    }
+
+    if (map->bplus != NULL)
+        rb_bpClear_(map->bplus);
+    else
+        rb_dropNodes_(map);
+
     map->treeRoot = NULL;
+    map->size = 0;
     return RB_SUCCESS;
 }
 
 
 rbPair* rbFind (rbTree tree, rb_key_type key)
 {
-    rbNode res = find_node_with_key_(tree, key);
+    RB_TIMER_START(start);
+    rbPair* res = find_engine_(tree, key);
+    RB_TIMER_STOP(tree, RB_STATS_FIND, start);
+
+    return res;
+}
+
+
+/// Finds the pair with the key with the engine of the container, see rbFind.
+static rbPair* find_engine_ (rbTree tree, rb_key_type key)
+{
+    if (tree == NULL)
+        return NULL;
+
+    if (tree->engine == RB_ENGINE_BPLUS)
+        return rb_bpFind_(tree->bplus, key);
+
+    if (tree->sync != NULL)
+        return rb_readSeek_(tree, key, RB_SEEK_EQUAL);
+
+    rbNode res = rb_find_node_with_key_(tree, key);
     if (res == NULL)
         return NULL;
 
@@ -147,80 +214,724 @@ rbPair* rbFind (rbTree tree, rb_key_type key)
 }
 
 
+rbResult rbFindBatch (rbTree tree, const rb_key_type* keys, size_t n, rbPair** out)
+{
+    if (tree == NULL || (n != 0 && (keys == NULL || out == NULL)))
+        return RB_INVALID_ARGS;
+
+    if (tree->engine == RB_ENGINE_BPLUS)
+        rb_bpFindBatch_(tree->bplus, keys, n, out);
+    else if (tree->sync != NULL) {
+        rbResult res = rb_readEnter_();
+        if (res != RB_SUCCESS)
+            return res;
+        for (size_t i = 0; i < n; ++i) {
+            rbNode node = rb_seek_(tree, keys[i], RB_SEEK_EQUAL);
+            out[i] = node ? &node->pair : NULL;
+        }
+        rb_readExit_();
+    }
+    else
+        find_batch_(tree, keys, n, out);
+
+    return RB_SUCCESS;
+}
+
+
 rbResult rbInsert (rbTree tree, rbPair pair) {
 
+    RB_TIMER_START(start);
+    rbResult res = insert_engine_(tree, pair);
+    RB_TIMER_STOP(tree, RB_STATS_INSERT, start);
+
+    return res;
+}
+
+
+/// Inserts a pair with the engine of the container, see rbInsert.
+static rbResult insert_engine_ (rbTree tree, rbPair pair) {
+
+    if (tree == NULL)
+        return RB_INVALID_ARGS;
+
+    if (tree->engine == RB_ENGINE_BPLUS) {
+        int added;
+        rbResult res = rb_bpInsert_(tree->bplus, pair, &added);
+        tree->size += added;
+        return res;
+    }
+
+    if (tree->engine == RB_ENGINE_PERSISTENT)
+        return rb_psInsert_(tree, pair);
+
+    if (tree->sync == NULL)
+        return rb_insert_pair_(tree, pair);
+
+    rbResult res = rb_lockWriter_(tree, 0);
+    if (res != RB_SUCCESS)
+        return res;
+
+    res = rb_insert_pair_(tree, pair);
+    rb_unlockWriter_(tree);
+    return res;
+}
+
+
+rbResult rbErase (rbTree tree, rb_key_type key) {
+
+    RB_TIMER_START(start);
+    rbResult res = erase_engine_(tree, key);
+    RB_TIMER_STOP(tree, RB_STATS_ERASE, start);
+
+    return res;
+}
+
+
+/// Removes the pair with the key with the engine of the container, see rbErase.
+static rbResult erase_engine_ (rbTree tree, rb_key_type key) {
+
     if (tree == NULL)
         return RB_INVALID_ARGS;
 
-    rbNode rNode = tree->treeRoot;
+    if (tree->engine == RB_ENGINE_BPLUS) {
+        tree->size -= rb_bpErase_(tree->bplus, key);
+        return RB_SUCCESS;
+    }
+
+    if (tree->engine == RB_ENGINE_PERSISTENT)
+        return rb_psErase_(tree, key);
 
-    rbNode node = find_node_with_key_(tree, pair.key);
-    if (node != NULL) {
-        node->pair.value = pair.value;
+    if (tree->sync == NULL) {
+        rb_erase_key_(tree, key);
         return RB_SUCCESS;
     }
-    else {
+
+    rbResult res = rb_lockWriter_(tree, 1);
+    if (res != RB_SUCCESS)
+        return res;
+
+    rb_erase_key_(tree, key);
+    rb_unlockWriter_(tree);
+    return RB_SUCCESS;
+}
+
+
+rbResult rbEmpty (rbTree tree) {
+
+    if (tree == NULL)
+        return RB_INVALID_ARGS;
+
+    return RB_LOAD(tree->size) == 0;
+}
+
+
+size_t rbSize (rbTree tree) {
+
+    if (tree == NULL)
+        return 0;
+
+    return RB_LOAD(tree->size);
+}
+
+
+size_t rbMemoryUsage (rbTree tree) {
+
+    if (tree == NULL)
+        return 0;
+
+    if (tree->engine == RB_ENGINE_BPLUS)
+        return rb_bpMemoryUsage_(tree->bplus);
+
+    if (tree->pool == NULL)
+        return tree->size * sizeof(struct rbNode_t);
+
+    return poolMemoryUsage_(tree->pool);
+}
+/***
+ *
+ *   end of interface functions
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   Node pool functions
+ *
+ ***/
+
+//
+/// Node pool
+///======================================================================================
+/// A pool-backed tree takes its nodes from slabs: contiguous arrays of 'slabNodes'
+/// nodes. New nodes are cut from the last slab one after another, and erased nodes are
+/// put on a free list (linked through the 'left' field) and handed out again before the
+/// slab is touched. So under insert/erase churn the nodes stay packed in a few blocks of
+/// memory and the system allocator is called once per slab instead of once per node.
+/// Clearing the tree does not walk it at all: the slabs are simply released.
+///
+/// rbSplit, rbJoin and rbUnion move nodes between trees, so a pool may end up shared by
+/// several trees. It counts them, and it is released with the last one. While it is
+/// shared, nodes are taken from it and returned to it under its lock, so the trees
+/// remain independent of each other; clearing such a tree walks it.
+///======================================================================================
+///======================================================================================
+//
+
+/// Gets memory for a new node of the tree.
+/// \param tree - the tree to which the node will belong
+/// \return pointer to the node or NULL if there is no memory.
+rbNode rb_allocNode_ (rbTree tree) {
+
+    struct rbPool_t* pool = tree->pool;
+    rbNode           node = NULL;
+
+    if (pool == NULL)
         node = (rbNode) calloc(1, sizeof(struct rbNode_t));
+    else {
+        int shared = lockPool_(pool);
+
+        if (pool->freeList != NULL) {
+            node = pool->freeList;
+            pool->freeList = node->left;
+        }
+        else if (pool->slabs != NULL && pool->used < pool->slabs->capacity)
+            node = &pool->slabs->nodes[pool->used++];
+        else if (rb_reserveNodes_(pool, pool->slabNodes) != NULL) {
+            pool->used = 1;
+            node = pool->slabs->nodes;
+        }
+
+        if (shared)
+            pthread_mutex_unlock(&pool->lock);
     }
 
-    if (node == NULL) {
+    if (node != NULL)
+        RB_COUNT(tree, allocations);
+
+    return node;
+}
+
+
+/// Adds a slab of the given size to the pool. The new slab becomes the newest one and
+/// all its nodes are considered used: the caller owns them.
+/// \param pool  - node pool
+/// \param count - the number of nodes in the slab
+/// \return pointer to the first node of the slab or NULL if there is no memory.
+rbNode rb_reserveNodes_ (struct rbPool_t* pool, size_t count) {
+
+    if (count > (SIZE_MAX - sizeof(struct rbSlab_t)) / sizeof(struct rbNode_t))
+        return NULL;
+
+    struct rbSlab_t* slab = (struct rbSlab_t*) malloc(sizeof(struct rbSlab_t) +
+                                                      count * sizeof(struct rbNode_t));
+    if (slab == NULL)
+        return NULL;
+
+    slab->next = pool->slabs;
+    slab->capacity = count;
+    pool->slabs = slab;
+    pool->used = count;
+
+    return slab->nodes;
+}
+
+
+/// Disposes of the node removed from the tree. In a concurrent container readers may
+/// still hold the node, so it is only retired.
+/// \param tree - the tree to which the node belonged
+/// \param node - removed node
+static void freeNode_ (rbTree tree, rbNode node) {
+
+    if (tree->sync != NULL) {
+        // readers on the node run into the end of the tree and retry
+        RB_STORE(node->left, NULL);
+        RB_STORE(node->right, NULL);
+        rb_retire_(tree, node, 1);
+        return;
+    }
+
+    rb_releaseNode_(tree, node);
+}
+
+
+/// Returns the memory of a node that nobody can access any more.
+/// \param tree - the tree to which the node belonged
+/// \param node - removed node
+void rb_releaseNode_ (rbTree tree, rbNode node) {
+
+    struct rbPool_t* pool = tree->pool;
+
+    RB_COUNT(tree, releases);
+
+    if (pool == NULL) {
+        free(node);
+        return;
+    }
+
+    int shared = lockPool_(pool);
+
+    node->left = pool->freeList;
+    pool->freeList = node;
+
+    if (shared)
+        pthread_mutex_unlock(&pool->lock);
+}
+
+
+/// Takes the lock of a pool if it is shared by several trees.
+/// \return non-zero if the lock is taken.
+static int lockPool_ (struct rbPool_t* pool) {
+
+    // A pool becomes shared only by the thread that owns all its trees.
+    if (atomic_load(&pool->refs) == 1)
+        return 0;
+
+    pthread_mutex_lock(&pool->lock);
+    return 1;
+}
+
+
+/// Creates an empty pool used by one tree.
+/// \param slabNodes - the number of nodes in a slab, 0 for the default
+/// \return pointer to the pool or NULL if there is no memory.
+static struct rbPool_t* createPool_ (size_t slabNodes) {
+
+    struct rbPool_t* pool = (struct rbPool_t*) calloc(1, sizeof(struct rbPool_t));
+
+    if (pool == NULL)
+        return NULL;
+
+    if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+        free(pool);
+        return NULL;
+    }
+
+    pool->slabNodes = slabNodes ? slabNodes : RB_POOL_DEFAULT_SLAB_NODES;
+    atomic_init(&pool->refs, 1);
+    return pool;
+}
+
+
+/// Drops a reference to the pool and frees the pool with the last one.
+void rb_unrefPool_ (struct rbPool_t* pool) {
+
+    if (atomic_fetch_sub(&pool->refs, 1) != 1)
+        return;
+
+    releasePool_(pool);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+
+/// Returns the memory of all nodes of a red-black tree, which nobody accesses any more.
+/// The slabs of a pool used by this tree alone are simply released; the nodes of any
+/// other tree are freed one by one, and those of a persistent tree only if no other
+/// version links to them.
+void rb_dropNodes_ (rbTree tree) {
+
+    if (tree->pool != NULL && atomic_load(&tree->pool->refs) == 1)
+        releasePool_(tree->pool);
+    else if (tree->engine == RB_ENGINE_PERSISTENT)
+        rb_psUnref_(tree, tree->treeRoot);
+    else
+        rb_deleteTree(tree, tree->treeRoot);
+}
+
+
+/// Releases all slabs of the pool. The pool itself stays usable.
+/// \param pool - node pool
+static void releasePool_ (struct rbPool_t* pool) {
+
+    struct rbSlab_t* slab = pool->slabs;
+
+    while (slab) {
+        struct rbSlab_t* next = slab->next;
+        free(slab);
+        slab = next;
+    }
+
+    pool->slabs = NULL;
+    pool->used = 0;
+    pool->freeList = NULL;
+}
+
+
+/// Counts the bytes of all slabs of the pool, used or not.
+static size_t poolMemoryUsage_ (const struct rbPool_t* pool) {
+
+    size_t nodes = 0;
+
+    for (const struct rbSlab_t* slab = pool->slabs; slab != NULL; slab = slab->next)
+        nodes += slab->capacity;
+
+    return nodes * sizeof(struct rbNode_t);
+}
+
+
+/// Moves the slabs of the pool of a tree, which no other tree uses, to another pool.
+/// \param to   - the pool that gets the slabs
+/// \param tree - the tree that is switched to 'to'
+void rb_mergePools_ (struct rbPool_t* to, rbTree tree) {
+
+    struct rbPool_t* from = tree->pool;
+
+    int shared = lockPool_(to);
+
+    // The newest slab of 'to' stays the newest one, so that 'used' still refers to it.
+    if (from->slabs != NULL) {
+        if (to->slabs == NULL) {
+            to->slabs = from->slabs;
+            to->used = from->used;
+        }
+        else {
+            struct rbSlab_t* last = from->slabs;
+            while (last->next != NULL)
+                last = last->next;
+
+            last->next = to->slabs->next;
+            to->slabs->next = from->slabs;
+        }
+    }
+
+    if (from->freeList != NULL) {
+        rbNode last = from->freeList;
+        while (last->left != NULL)
+            last = last->left;
+
+        last->left = to->freeList;
+        to->freeList = from->freeList;
+    }
+
+    atomic_fetch_add(&to->refs, 1);
+
+    if (shared)
+        pthread_mutex_unlock(&to->lock);
+
+    from->slabs = NULL;
+    from->used = 0;
+    from->freeList = NULL;
+
+    rb_unrefPool_(from);
+    tree->pool = to;
+}
+/***
+ *
+ *   end of Node pool functions
+ *
+ ****************************************************************************************/
+
+
+
+/****************************************************************************************
+ *
+ *   Creation functions
+ *
+ ***/
+
+/// Common part of rbCreate, rbCreateWithPool and rbCreateWithEngine.
+/// \param slabNodes - the number of nodes in a slab of the pool, 0 for the default
+/// \param usePool   - non-zero if the nodes of the tree are taken from a pool
+/// \param engine    - the data structure behind the container
+rbResult rb_create_ (const rbPair* data, size_t size, size_t slabNodes, int usePool,
+                     rbEngine engine, rbTree* tree)
+{
+    if (tree == NULL) {
+        return RB_INVALID_ARGS;
+    }
+
+    *tree = (struct rbTree_t*) calloc(1, sizeof(struct rbTree_t));
+
+    if (*tree == NULL) {
         return RB_LACK_OF_MEMORY;
     }
 
-    *((int*)&node->pair.key) = pair.key;
+    (*tree)->treeRoot = NULL;
+    (*tree)->size = 0;
+    (*tree)->pool = NULL;
+    (*tree)->engine = engine;
+    (*tree)->bplus = NULL;
+    (*tree)->sync = NULL;
+
+    if (engine == RB_ENGINE_BPLUS) {
+        (*tree)->bplus = rb_bpCreate_();
+        if ((*tree)->bplus == NULL) {
+            free(*tree);
+            return RB_LACK_OF_MEMORY;
+        }
+    }
+    // The initial nodes are placed in one slab, so a filled tree is always pool-backed.
+    else if (usePool || (data != NULL && size != 0)) {
+        (*tree)->pool = createPool_(slabNodes);
+        if ((*tree)->pool == NULL) {
+            free(*tree);
+            return RB_LACK_OF_MEMORY;
+        }
+    }
 
-    node->pair.value = pair.value;
-    node->color = RED;
-    node->parent = NULL;
-    node->left = NULL;
-    node->right = NULL;
+    if (data == NULL || size == 0) {
+        return RB_SUCCESS;
+    }
+
+    rbResult res = build_(*tree, data, size);
+    if (res != RB_SUCCESS) {
+        rbDestroy(*tree);
+        return res;
+    }
+
+    return RB_SUCCESS;
+}
+
+
+//
+/// Bulk construction
+///======================================================================================
+/// The initial elements are not inserted one by one. They are put in key order (input
+/// that is already sorted is detected in one pass, anything else is sorted first), then
+/// all nodes are taken from one slab and linked into a perfectly balanced tree in linear
+/// time: the middle element becomes the root and both halves are built the same way.
+///
+/// In such a tree all levels except the deepest one are full, so every path from the
+/// root to a leaf passes through the same number of nodes of the upper levels. Coloring
+/// them black and the nodes of an incomplete deepest level red satisfies all the
+/// properties of the red-black tree.
+///
+/// As with rbInsert, if a key occurs several times, the last value wins.
+///======================================================================================
+///======================================================================================
+//
+
+
+/// Fills an empty tree with the elements of 'data'.
+/// \param tree - empty pool-backed tree
+/// \param data - an array of elements to be placed in the tree
+/// \param size - the number of elements in the 'data' array, not zero
+/// \return an enum member from rbResult
+static rbResult build_ (rbTree tree, const rbPair* data, size_t size) {
+
+    size_t* idx;
+
+    rbResult res = rb_sortPairs_(data, size, &idx);
+    if (res != RB_SUCCESS)
+        return res;
+
+    size_t unique = rb_countUnique_(data, idx, size);
+
+    if (tree->engine == RB_ENGINE_BPLUS) {
+        res = rb_bpBuild_(tree->bplus, data, idx, size, unique);
+        free(idx);
+
+        if (res == RB_SUCCESS)
+            tree->size = unique;
+        return res;
+    }
+
+    rbNode nodes = rb_reserveNodes_(tree->pool, unique);
+    if (nodes == NULL) {
+        free(idx);
+        return RB_LACK_OF_MEMORY;
+    }
+
+    // nodes go in key order, the last of equal keys overwrites the previous ones
+    size_t n = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const rbPair* pair = pairAt_(data, idx, i);
+
+        if (n != 0 && nodes[n - 1].pair.key == pair->key) {
+            nodes[n - 1].pair.value = pair->value;
+            continue;
+        }
+
+        *((rb_key_type*)&nodes[n].pair.key) = pair->key;
+        nodes[n].pair.value = pair->value;
+        ++n;
+    }
+
+    free(idx);
+
+    tree->treeRoot = rb_link_(nodes, unique, NULL, 0, rb_redDepth_(unique));
+    tree->size = unique;
+
+    // the nodes of a persistent tree count their links instead of linking to the parents
+    if (tree->engine == RB_ENGINE_PERSISTENT)
+        for (size_t i = 0; i < unique; ++i)
+            nodes[i].refs = 1;
+
+    return RB_SUCCESS;
+}
+
+
+/// Finds the depth of the red level of a perfectly balanced tree: its deepest level
+/// unless that level is full. A full deepest level is black, as is the root of a
+/// single node tree.
+/// \param size - the number of nodes, not zero
+/// \return the depth of red nodes, -1 for none.
+int rb_redDepth_ (size_t size) {
+
+    int height = 0; // the depth of the deepest level
+    while (((size_t) 2 << height) - 1 < size)
+        ++height;
+
+    return (((size_t) 2 << height) - 1 == size) ? -1 : height;
+}
+
+
+/// Links sorted nodes into a perfectly balanced subtree.
+/// \param nodes    - nodes of the subtree in key order
+/// \param size     - the number of nodes
+/// \param parent   - the parent of the subtree
+/// \param depth    - the depth of the subtree root
+/// \param redDepth - the depth at which nodes are colored red, -1 for none
+/// \return the root of the subtree.
+rbNode rb_link_ (rbNode nodes, size_t size, rbNode parent, int depth, int redDepth) {
+
+    if (size == 0)
+        return NULL;
+
+    size_t mid  = size / 2;
+    rbNode root = &nodes[mid];
+
+    root->parent = parent;
+    root->color  = depth == redDepth ? RED : BLACK;
+#ifdef RB_ORDER_STATISTICS
+    root->count  = size;
+#endif
+    root->left   = rb_link_(nodes, mid, root, depth + 1, redDepth);
+    root->right  = rb_link_(nodes + mid + 1, size - mid - 1, root, depth + 1, redDepth);
+
+    return root;
+}
+
+
+/// Links nodes given by pointers in key order into a perfectly balanced subtree, like
+/// rb_link_.
+rbNode rb_relink_ (rbNode* nodes, size_t size, rbNode parent, int depth, int redDepth) {
+
+    if (size == 0)
+        return NULL;
+
+    size_t mid  = size / 2;
+    rbNode root = nodes[mid];
+
+    root->parent = parent;
+    root->color  = depth == redDepth ? RED : BLACK;
+#ifdef RB_ORDER_STATISTICS
+    root->count  = size;
+#endif
+    RB_STORE(root->left, rb_relink_(nodes, mid, root, depth + 1, redDepth));
+    RB_STORE(root->right, rb_relink_(nodes + mid + 1, size - mid - 1, root, depth + 1, redDepth));
+
+    return root;
+}
+
+
+/// Puts the elements in key order: sorts their indices unless the keys already do not
+/// decrease.
+/// \param data - elements
+/// \param size - the number of elements
+/// \param idx  - set to the sorted indices (to be freed by the caller) or to NULL if
+///               'data' is already in order
+/// \return an enum member from rbResult
+rbResult rb_sortPairs_ (const rbPair* data, size_t size, size_t** idx) {
+
+    *idx = NULL;
+
+    if (isSorted_(data, size))
+        return RB_SUCCESS;
 
-    rbNode parent = find_parent_(rNode, node->pair.key);
+    *idx = (size_t*) malloc(size * sizeof(size_t));
+    size_t* tmp = (size_t*) malloc(size * sizeof(size_t));
 
-    insert (parent, node);
+    if (*idx == NULL || tmp == NULL) {
+        free(*idx);
+        free(tmp);
+        *idx = NULL;
+        return RB_LACK_OF_MEMORY;
+    }
 
-    tree->treeRoot = find_top_(node);
+    for (size_t i = 0; i < size; ++i)
+        (*idx)[i] = i;
 
+    sortIndices_(data, *idx, tmp, size);
+    free(tmp);
     return RB_SUCCESS;
 }
 
 
-rbResult rbErase (struct rbTree_t* tree, int key) {
+/// Counts the distinct keys of elements in key order.
+size_t rb_countUnique_ (const rbPair* data, const size_t* idx, size_t size) {
 
-    if (tree == NULL)
-        return RB_INVALID_ARGS;
+    size_t unique = size != 0;
 
-    rbNode node = find_node_with_key_(tree, key);
+    for (size_t i = 1; i < size; ++i)
+        unique += pairAt_(data, idx, i - 1)->key != pairAt_(data, idx, i)->key;
 
-    if (node != NULL)
-        tree->treeRoot = deleteNode(node);
+    return unique;
+}
 
-    return RB_SUCCESS;
+
+/// Checks whether the keys of 'data' do not decrease.
+static int isSorted_ (const rbPair* data, size_t size) {
+
+    for (size_t i = 1; i < size; ++i)
+        if (data[i - 1].key > data[i].key)
+            return 0;
+
+    return 1;
 }
 
 
-rbResult rbEmpty (rbTree tree) {
+/// Stable bottom-up merge sort of element indices by key. Stability keeps equal keys in
+/// their input order, so the last one still wins.
+/// \param data - elements
+/// \param idx  - indices of the elements, sorted on return
+/// \param tmp  - buffer for 'size' indices
+/// \param size - the number of elements
+static void sortIndices_ (const rbPair* data, size_t* idx, size_t* tmp, size_t size) {
+
+    size_t* src = idx;
+    size_t* dst = tmp;
+
+    for (size_t width = 1; width < size; width *= 2) {
+        for (size_t lo = 0; lo < size; lo += 2 * width) {
+            size_t mid = lo + width < size ? lo + width : size;
+            size_t hi  = mid + width < size ? mid + width : size;
+            size_t i = lo, j = mid, k = lo;
+
+            while (i < mid && j < hi)
+                dst[k++] = data[src[j]].key < data[src[i]].key ? src[j++] : src[i++];
+            while (i < mid)
+                dst[k++] = src[i++];
+            while (j < hi)
+                dst[k++] = src[j++];
+        }
 
-    if (tree == NULL)
-        return RB_INVALID_ARGS;
+        size_t* swap = src;
+        src = dst;
+        dst = swap;
+    }
 
-    return tree->treeRoot == NULL;
+    if (src != idx)
+        for (size_t i = 0; i < size; ++i)
+            idx[i] = src[i];
 }
 /***
  *
- *   end of interface functions
+ *   end of Creation functions
  *
  ****************************************************************************************/
 
 
 
-
 /****************************************************************************************
  *
  *   Find functions
  *
  ***/
-static rbNode find_node_with_key_(rbTree tree, rb_key_type key)
+rbNode rb_find_node_with_key_(rbTree tree, rb_key_type key)
 {
     if (tree->treeRoot == NULL)
         return NULL;
@@ -228,60 +939,72 @@ static rbNode find_node_with_key_(rbTree tree, rb_key_type key)
     rbNode node = tree->treeRoot;
 
     rbNode tmp = node;
+    size_t nodes = 0;
 
     while (tmp) {
+        ++nodes;
         if (tmp->pair.key > key)
             tmp = tmp->left;
         else if (tmp->pair.key < key)
             tmp = tmp->right;
         else
-            return tmp;
+            break;
     }
 
-    return NULL;
+    RB_COUNT_DESCENT(tree, nodes);
+    return tmp;
 }
 
 
-/// Looking for a node that has no parent (root node).
-/// There is only one such node in the whole tree.
-/// \param node - current node
-/// \return pointer to root node.
-rbNode find_top_ (rbNode node) {
-
-    if (node == NULL)
-        return NULL;
+/// Interleaved descents of rbFindBatch: every lookup of a group takes one step down the
+/// tree in turn and prefetches the node it will compare with on its next step.
+static void find_batch_ (rbTree tree, const rb_key_type* keys, size_t n, rbPair** out)
+{
+    for (size_t base = 0; base < n; base += RB_BATCH_GROUP) {
+        size_t group = n - base < RB_BATCH_GROUP ? n - base : RB_BATCH_GROUP;
+        rbNode cur[RB_BATCH_GROUP];
+        size_t active = 0;
+        size_t nodes  = 0, rounds = 0;
+
+        for (size_t j = 0; j < group; ++j) {
+            cur[j] = tree->treeRoot;
+            out[base + j] = NULL;
+            active += cur[j] != NULL;
+        }
 
-    rbNode res = node;
+        while (active != 0) {
+            active = 0;
+            ++rounds;
 
-    while (res->parent)
-        res = res->parent;
+            for (size_t j = 0; j < group; ++j) {
+                rbNode node = cur[j];
+                if (node == NULL)
+                    continue;
 
-    return res;
-}
+                rb_key_type key = keys[base + j];
+                ++nodes;
 
+                if (node->pair.key == key) {
+                    out[base + j] = &node->pair;
+                    cur[j] = NULL;
+                    continue;
+                }
 
-///  Looks for a place where to attach a new node with the given key.
-/// \param tree - root node
-/// \param key  - the key to look for the parent
-/// \return a pointer to a node to which a new node with the given key can be attached.
-rbNode find_parent_ (rbNode  tree, int key) {
+                node = node->pair.key > key ? node->left : node->right;
+                cur[j] = node;
 
-    if (tree == NULL)
-        return NULL;
+                if (node != NULL) {
+                    RB_PREFETCH(&node->pair);
+                    ++active;
+                }
+            }
+        }
 
-    if (tree->pair.key > key) {
-        if (tree->left)
-            return find_parent_(tree->left, key);
-        else
-            return tree;
-    } else {
-        if (tree->right)
-            return find_parent_(tree->right, key);
-        else
-            return tree;
+        RB_COUNT_DESCENTS(tree, group, nodes, rounds);
     }
 }
 
+
 static rbNode find_grandparent_(rbNode node) {
 
     return node->parent->parent;
@@ -308,7 +1031,7 @@ static rbNode find_brother_ (rbNode node) {
         return node->parent->left;
 }
 
-rbNode findMax (rbNode tree) {
+rbNode rb_findMax (rbNode tree) {
 
     while (tree->right)
         tree = tree->right;
@@ -316,7 +1039,7 @@ rbNode findMax (rbNode tree) {
     return tree;
 }
 
-rbNode findMin (rbNode tree) {
+rbNode rb_findMin (rbNode tree) {
 
     while (tree->left)
         tree = tree->left;
@@ -325,7 +1048,7 @@ rbNode findMin (rbNode tree) {
 }
 /***
  *
- *   end of Rotate functions
+ *   end of Find functions
  *
  ****************************************************************************************/
 
@@ -337,45 +1060,63 @@ rbNode findMin (rbNode tree) {
  *   Rotate functions
  *
  ***/
-static void leftRotation (rbNode  node) {
+static void leftRotation (rbTree tree, rbNode  node) {
 
     rbNode  pivot = node->right;
 
+    RB_COUNT(tree, rotations);
+
     pivot->parent = node->parent; // and pivot can become the root of tree
     if (node->parent != NULL) {
         if (node->parent->left == node)
-            node->parent->left = pivot;
+            RB_STORE(node->parent->left, pivot);
         else
-            node->parent->right = pivot;
+            RB_STORE(node->parent->right, pivot);
     }
+    else
+        RB_STORE(tree->treeRoot, pivot);
 
-    node->right = pivot->left;
+    RB_STORE(node->right, pivot->left);
     if (pivot->left != NULL)
         pivot->left->parent = node;
 
     node->parent = pivot;
-    pivot->left = node;
+    RB_STORE(pivot->left, node);
+
+#ifdef RB_ORDER_STATISTICS
+    pivot->count = node->count;
+    node->count = 1 + count_(node->left) + count_(node->right);
+#endif
 }
 
-static void rightRotation(rbNode node) {
+static void rightRotation(rbTree tree, rbNode node) {
 
     rbNode  pivot = node->left;
 
+    RB_COUNT(tree, rotations);
+
     pivot->parent = node->parent; // and pivot can become the root of tree
     if (node->parent != NULL) {
         if (node->parent->left == node)
-            node->parent->left = pivot;
+            RB_STORE(node->parent->left, pivot);
         else
-            node->parent->right = pivot;
+            RB_STORE(node->parent->right, pivot);
     }
+    else
+        RB_STORE(tree->treeRoot, pivot);
 
-    node->left = pivot->right;
+    RB_STORE(node->left, pivot->right);
 
     if (pivot->right != NULL)
         pivot->right->parent = node;
 
     node->parent = pivot;
-    pivot->right = node;
+    RB_STORE(pivot->right, node);
+
+#ifdef RB_ORDER_STATISTICS
+    pivot->count = node->count;
+    node->count = 1 + count_(node->left) + count_(node->right);
+#endif
 }
 /***
  *
@@ -411,22 +1152,88 @@ static void rightRotation(rbNode node) {
 //
 
 
+/// Inserts a pair into a red-black tree, see rbInsert. The writer lock of a concurrent
+/// container is held by the caller.
+rbResult rb_insert_pair_ (rbTree tree, rbPair pair) {
+
+    // One descent finds either the node with the key or the place to attach a new one.
+    rbNode parent = NULL;
+    rbNode node = tree->treeRoot;
+    size_t nodes = 0;
+
+    while (node) {
+        ++nodes;
+        if (node->pair.key > pair.key) {
+            parent = node;
+            node = node->left;
+        }
+        else if (node->pair.key < pair.key) {
+            parent = node;
+            node = node->right;
+        }
+        else {
+            RB_COUNT_DESCENT(tree, nodes);
+            RB_STORE(node->pair.value, pair.value);
+            return RB_SUCCESS;
+        }
+    }
+
+    RB_COUNT_DESCENT(tree, nodes);
+
+    node = rb_allocNode_(tree);
+
+    if (node == NULL) {
+        return RB_LACK_OF_MEMORY;
+    }
+
+    *((rb_key_type*)&node->pair.key) = pair.key;
+
+    node->pair.value = pair.value;
+    node->color = RED;
+    node->parent = NULL;
+    node->left = NULL;
+    node->right = NULL;
+
+    // readers that reach the node see it filled in: insert links it with RB_STORE
+    if (tree->sync != NULL)
+        rb_beginChange_(tree->sync);
+
+    insert (tree, parent, node);
+    RB_STORE(tree->size, tree->size + 1);
+
+    if (tree->sync != NULL)
+        rb_endChange_(tree->sync);
+
+    return RB_SUCCESS;
+}
+
+
 /// Attaches a new node to an existing one without violating the red-black tree
 /// invariants.
-/// \param parent - parent of the new node
+/// \param tree   - container, its root is updated if necessary
+/// \param parent - parent of the new node, NULL if the tree is empty
 /// \param node   - new node
-static void insert (rbNode  parent, rbNode  node) {
+static void insert (rbTree tree, rbNode  parent, rbNode  node) {
 
     node->parent = parent;
 
     if (parent != NULL)
     {
         if (parent->pair.key > node->pair.key)
-            parent->left = node;
+            RB_STORE(parent->left, node);
         else
-            parent->right = node;
+            RB_STORE(parent->right, node);
     }
-    insert_case1(node);
+    else
+        RB_STORE(tree->treeRoot, node);
+
+#ifdef RB_ORDER_STATISTICS
+    node->count = 1;
+    for (rbNode p = parent; p != NULL; p = p->parent)
+        ++p->count;
+#endif
+
+    rb_insert_case1(tree, node);
 }
 
 /// Case 1: The current node N at the root of the tree. In this case, it is repainted
@@ -434,12 +1241,14 @@ static void insert (rbNode  parent, rbNode  node) {
 /// to each path, Property 5 (All paths from any given node to leaf nodes contain the
 /// same number of black nodes) is not violated.
 /// \param node - insert node
-static void insert_case1(rbNode  node) {
+void rb_insert_case1(rbTree tree, rbNode  node) {
 
-    if (node->parent == NULL)
+    if (node->parent == NULL) {
+        RB_COUNT(tree, insertCases[1]);
         node->color = BLACK;
+    }
     else
-        insert_case2(node);
+        insert_case2(tree, node);
 }
 
 /// Case 2: The ancestor P of the current node is black, that is, Property 4 (Both
@@ -450,12 +1259,14 @@ static void insert_case1(rbNode  node) {
 /// number of black ones. nodes as the path to the black sheet, which was replaced by the
 /// current node, so the property remains true.
 /// \param node - insert node
-static void insert_case2(rbNode  node) {
+static void insert_case2(rbTree tree, rbNode  node) {
 
-    if (node->parent->color == BLACK)
+    if (node->parent->color == BLACK) {
+        RB_COUNT(tree, insertCases[2]);
         return; /* Tree is still valid */
+    }
     else
-        insert_case3(node);
+        insert_case3(tree, node);
 }
 
 /// Case 3: If both parent P and uncle U are red, then they can both be repainted black,
@@ -467,21 +1278,22 @@ static void insert_case2(rbNode  node) {
 /// each red node are black) (property 4 can be violated, since the parent of G may be
 /// red). To fix this, the whole procedure is recursively executed on G from case 1.
 /// \param node - insert node
-static void insert_case3(rbNode node) {
+static void insert_case3(rbTree tree, rbNode node) {
 
     rbNode uncle = find_uncle_(node), grandpa;
 
     if ((uncle != NULL) && (uncle->color == RED)) {
 
+        RB_COUNT(tree, insertCases[3]);
         node->parent->color = BLACK;
         uncle->color = BLACK;
 
         grandpa = find_grandparent_(node);
         grandpa->color = RED;
 
-        insert_case1(grandpa);
+        rb_insert_case1(tree, grandpa);
     } else {
-        insert_case4(node);
+        insert_case4(tree, node);
     }
 }
 
@@ -497,21 +1309,23 @@ static void insert_case3(rbNode node) {
 /// number of black knots) is not broken during rotation. However Property 4 is still
 /// violated, but now the problem is reduced to Case 5.
 /// \param node - insert node
-static void insert_case4(rbNode node) {
+static void insert_case4(rbTree tree, rbNode node) {
 
     rbNode  grandpa = find_grandparent_(node);
 
     if ((node == node->parent->right) && (node->parent == grandpa->left)) {
 
-        leftRotation(node->parent);
+        RB_COUNT(tree, insertCases[4]);
+        leftRotation(tree, node->parent);
         node = node->left;
     } else if ((node == node->parent->left) && (node->parent == grandpa->right)) {
 
-        rightRotation(node->parent);
+        RB_COUNT(tree, insertCases[4]);
+        rightRotation(tree, node->parent);
         node = node->right;
     }
 
-    insert_case5(node);
+    insert_case5(tree, node);
 }
 
 
@@ -526,17 +1340,18 @@ static void insert_case4(rbNode node) {
 /// through any of these three nodes previously went through G, so now they all go
 /// through P. B in each case, of the three nodes, only one is colored black.
 /// \param node - insert node
-static void insert_case5(rbNode  node) {
+static void insert_case5(rbTree tree, rbNode  node) {
 
     rbNode  grandpa = find_grandparent_(node);
 
+    RB_COUNT(tree, insertCases[5]);
     node->parent->color = BLACK;
     grandpa->color = RED;
 
     if ((node == node->parent->left) && (node->parent == grandpa->left)) {
-        rightRotation(grandpa);
+        rightRotation(tree, grandpa);
     } else {
-        leftRotation(grandpa);
+        leftRotation(tree, grandpa);
     }
 }
 /***
@@ -554,32 +1369,109 @@ static void insert_case5(rbNode  node) {
  *
  ***/
 
+/// Removes the pair with the key from a red-black tree, see rbErase. The writer lock of
+/// a concurrent container is held by the caller.
+void rb_erase_key_ (rbTree tree, rb_key_type key) {
+
+    rbNode node = rb_find_node_with_key_(tree, key);
+
+    if (node == NULL)
+        return;
 
-rbNode  deleteNode (rbNode  node) {
+    if (tree->sync != NULL)
+        rb_beginChange_(tree->sync);
 
-    rbNode  M;
-    rbNode  tmp = node;
+    deleteNode(tree, node);
+    RB_STORE(tree->size, tree->size - 1);
 
-    if (node->right)
-        M = findMin (node->right);
-    else if (node->left)
-        M = findMax (node->left);
+    if (tree->sync != NULL)
+        rb_endChange_(tree->sync);
+}
+
+
+static void deleteNode (rbTree tree, rbNode  node) {
+
+    rb_detach_node_(tree, node);
+    freeNode_(tree, node);
+}
+
+
+/// Unlinks the node from the tree and rebalances the tree. The node is not freed.
+void rb_detach_node_ (rbTree tree, rbNode node) {
+
+    // A node with two children trades places with its successor, which has no left
+    // child. The nodes are relinked rather than their pairs copied, so pointers to the
+    // remaining pairs stay valid.
+    if (node->left && node->right)
+        swap_with_successor_(tree, node, rb_findMin(node->right));
+
+#ifdef RB_ORDER_STATISTICS
+    // The node is treated as gone from here on: rotations of the rebalancing below
+    // recompute subtree sizes from the children, where it counts as zero.
+    for (rbNode p = node; p != NULL; p = p->parent)
+        --p->count;
+#endif
+
+    delete_one_child(tree, node);
+}
+
+
+/// Puts the node and its successor in each other's place in the tree. Colors (and
+/// subtree sizes) stay with the places, so the tree remains valid apart from the order
+/// of the two keys.
+/// \param tree - container
+/// \param node - a node with two children
+/// \param succ - the leftmost node of its right subtree
+static void swap_with_successor_ (rbTree tree, rbNode node, rbNode succ) {
+
+    rbNode parent     = node->parent;
+    rbNode left       = node->left;
+    rbNode right      = node->right;
+    rbNode succParent = succ->parent;
+    rbNode succRight  = succ->right;
+
+    succ->parent = parent;
+
+    if (parent == NULL)
+        RB_STORE(tree->treeRoot, succ);
+    else if (node == parent->left)
+        RB_STORE(parent->left, succ);
+    else
+        RB_STORE(parent->right, succ);
+
+    RB_STORE(succ->left, left);
+    left->parent = succ;
+
+    if (succ == right) {
+        RB_STORE(succ->right, node);
+        node->parent = succ;
+    }
     else {
-        tmp = node->parent;
-        M = node;
+        RB_STORE(succ->right, right);
+        right->parent = succ;
+        RB_STORE(succParent->left, node);
+        node->parent = succParent;
     }
 
-    node->pair.value = M->pair.value;
+    RB_STORE(node->left, NULL);
+    RB_STORE(node->right, succRight);
 
-    *((int*)&node->pair.key) = M->pair.key;
+    if (succRight)
+        succRight->parent = node;
 
-    delete_one_child(M);
+    enum color_t color = node->color;
+    node->color = succ->color;
+    succ->color = color;
 
-    return find_top_(tmp);
+#ifdef RB_ORDER_STATISTICS
+    size_t count = node->count;
+    node->count = succ->count;
+    succ->count = count;
+#endif
 }
 
 
-static void delete_one_child(rbNode  node) {
+static void delete_one_child(rbTree tree, rbNode  node) {
 
     assert (node->left == NULL || node->right == NULL);
 
@@ -588,72 +1480,74 @@ static void delete_one_child(rbNode  node) {
     if (node->left == NULL && node->right == NULL) {
 
         if (node->color == BLACK)
-            delete_case1(node);
+            delete_case1(tree, node);
 
         if (node->parent == NULL) {
-            free(node);
+            RB_STORE(tree->treeRoot, NULL);
             return;
         }
 
         if (node == node->parent->left)
-            node->parent->left = NULL;
+            RB_STORE(node->parent->left, NULL);
         else
-            node->parent->right = NULL;
+            RB_STORE(node->parent->right, NULL);
 
-        free(node);
         return;
     }
 
-    child = node->right;
+    child = node->left ? node->left : node->right;
 
-    replaceWithChild (node, child);
+    replaceWithChild (tree, node, child);
 
     if (node->color == BLACK)//Cause node has only one child, child->color can be only RED
         child->color = BLACK;
-
-    free(node);
 }
 
 
-static void replaceWithChild (rbNode  node, rbNode  child) {
+static void replaceWithChild (rbTree tree, rbNode  node, rbNode  child) {
 
     assert (child && node);
 
     child->parent = node->parent;
 
-    if (node == node->parent->left)
-        node->parent->left = child;
+    if (node->parent == NULL)
+        RB_STORE(tree->treeRoot, child);
+    else if (node == node->parent->left)
+        RB_STORE(node->parent->left, child);
     else
-        node->parent->right = child;
+        RB_STORE(node->parent->right, child);
 }
 
 
-static void delete_case1 (rbNode  node)
+static void delete_case1 (rbTree tree, rbNode  node)
 {
     if (node->parent != NULL)
-        delete_case2(node);
+        delete_case2(tree, node);
+    else
+        RB_COUNT(tree, deleteCases[1]);
 }
 
 
-static void delete_case2 (rbNode  node) {
+static void delete_case2 (rbTree tree, rbNode  node) {
 
     rbNode  brother = find_brother_(node);
 
     if (brother->color == RED) {
+        RB_COUNT(tree, deleteCases[2]);
         node->parent->color = RED;
         brother->color = BLACK;
 
         if (node == node->parent->left)
-            leftRotation (node->parent);
+            leftRotation (tree, node->parent);
         else
-            rightRotation (node->parent);
+            rightRotation (tree, node->parent);
     }
 
-    delete_case3 (node);
+    delete_case3 (tree, node);
 }
 
 
-static void delete_case3 (rbNode  node) {
+static void delete_case3 (rbTree tree, rbNode  node) {
 
     rbNode brother = find_brother_(node);
 
@@ -662,14 +1556,15 @@ static void delete_case3 (rbNode  node) {
         (brother->left == NULL || brother->left->color == BLACK) &&
         (brother->right == NULL || brother->right->color == BLACK)) {
 
+        RB_COUNT(tree, deleteCases[3]);
         brother->color = RED;
-        delete_case1(node->parent);
+        delete_case1(tree, node->parent);
     } else
-        delete_case4(node);
+        delete_case4(tree, node);
 }
 
 
-static void delete_case4 (rbNode  node) {
+static void delete_case4 (rbTree tree, rbNode  node) {
 
     rbNode brother = find_brother_(node);
 
@@ -678,14 +1573,15 @@ static void delete_case4 (rbNode  node) {
         (brother->left == NULL  || brother->left->color == BLACK) &&
         (brother->right == NULL || brother->right->color == BLACK))  {
 
+        RB_COUNT(tree, deleteCases[4]);
         brother->color = RED;
         node->parent->color = BLACK;
     } else
-        delete_case5(node);
+        delete_case5(tree, node);
 }
 
 
-static void delete_case5 (rbNode  node) {
+static void delete_case5 (rbTree tree, rbNode  node) {
 
     rbNode brother = find_brother_(node);
 
@@ -695,52 +1591,63 @@ static void delete_case5 (rbNode  node) {
             (brother->right == NULL || brother->right->color == BLACK) &&
             (brother->left && brother->left->color == RED)) { /* this last test is trivial too due to cases 2-4. */
 
+            RB_COUNT(tree, deleteCases[5]);
             brother->color = RED;
             brother->left->color = BLACK;
-            rightRotation(brother);
+            rightRotation(tree, brother);
 
         } else if ((node == node->parent->right) &&
                    (brother->left == NULL || brother->left->color == BLACK) &&
                    (brother->right && brother->right->color == RED)) { /* this last test is trivial too due to cases 2-4. */
 
+            RB_COUNT(tree, deleteCases[5]);
             brother->color = RED;
             brother->right->color = BLACK;
-            leftRotation(brother);
+            leftRotation(tree, brother);
         }
     }
 
-    delete_case6(node);
+    delete_case6(tree, node);
 }
 
 
-static void delete_case6 (rbNode  node) {
+static void delete_case6 (rbTree tree, rbNode  node) {
 
     rbNode  brother = find_brother_(node);
 
+    RB_COUNT(tree, deleteCases[6]);
     brother->color = node->parent->color;
     node->parent->color = BLACK;
 
     if (node == node->parent->left) {
         brother->right->color = BLACK;
-        leftRotation (node->parent);
+        leftRotation (tree, node->parent);
     } else {
         brother->left->color = BLACK;
-        rightRotation (node->parent);
+        rightRotation (tree, node->parent);
     }
 }
 
 
-static void deleteTree (rbNode  tree) {
+/// Releases all nodes of a subtree nobody accesses any more. A node with a left child is
+/// rotated right until it has none, and then released: the subtree unrolls into a chain
+/// as it goes, so neither recursion nor a stack is needed, whatever its shape.
+void rb_deleteTree (rbTree tree, rbNode  node) {
 
-    if (tree == NULL)
-        return;
+    while (node != NULL) {
+        rbNode left = node->left;
 
-    if (tree->left)
-        deleteTree(tree->left);
-    if (tree->right)
-        deleteTree(tree->right);
+        if (left != NULL) {
+            node->left = left->right;
+            left->right = node;
+            node = left;
+            continue;
+        }
 
-    free (tree);
+        rbNode right = node->right;
+        rb_releaseNode_(tree, node);
+        node = right;
+    }
 }
 /***
  *
@@ -761,19 +1668,44 @@ rbResult rbForeach (struct rbTree_t* tree, void (*act)(rbPair*, void*), void* da
     if (tree == NULL || act == NULL)
         return RB_INVALID_ARGS;
 
+    if (tree->engine == RB_ENGINE_BPLUS) {
+        for (rbPair* pair = rbBegin(tree); pair != NULL; pair = rb_bpNext_(pair))
+            act (pair, data);
+        return RB_SUCCESS;
+    }
+
+    // Writers may run meanwhile, so every step is a new descent.
+    if (tree->sync != NULL) {
+        rbResult res = rb_readEnter_();
+        if (res != RB_SUCCESS)
+            return res;
+        for (rbPair* pair = rb_readSeek_(tree, 0, RB_SEEK_FIRST); pair != NULL;
+             pair = rb_readSeek_(tree, pair->key, RB_SEEK_UPPER))
+            act (pair, data);
+        rb_readExit_();
+        return RB_SUCCESS;
+    }
+
     foreach_(tree->treeRoot, act, data);
     return RB_SUCCESS;
 }
 
 
+/// Calls 'act' for the pairs of the subtree in key order. The nodes whose left subtrees
+/// are being walked wait on a stack, at most one per level.
 static void foreach_ (rbNode  tree, void (*act)(rbPair*, void*), void* data) {
 
-    if (tree == NULL)
-        return;
+    rbNode stack[RB_MAX_DEPTH];
+    int    n = 0;
 
-    foreach_(tree->left, act, data);
-    foreach_(tree->right, act, data);
-    act (&tree->pair, data);
+    while (tree != NULL || n > 0) {
+        for (; tree != NULL; tree = tree->left)
+            stack[n++] = tree;
+
+        tree = stack[--n];
+        act (&tree->pair, data);
+        tree = tree->right;
+    }
 }
 /***
  *
@@ -786,57 +1718,321 @@ static void foreach_ (rbNode  tree, void (*act)(rbPair*, void*), void* data) {
 
 /****************************************************************************************
  *
- *   dump functions
+ *   Iteration functions
  *
  ***/
-rbResult rbDump (rbTree tree) {
+rbPair* rbBegin (rbTree tree) {
+
+    if (tree == NULL)
+        return NULL;
+
+    if (tree->sync != NULL)
+        return rb_readSeek_(tree, 0, RB_SEEK_FIRST);
+
+    if (tree->size == 0)
+        return NULL;
+
+    if (tree->engine == RB_ENGINE_BPLUS)
+        return rb_bpFirst_(tree->bplus);
+
+    return &rb_findMin(tree->treeRoot)->pair;
+}
+
+
+rbPair* rbLast (rbTree tree) {
+
+    if (tree == NULL)
+        return NULL;
+
+    if (tree->sync != NULL)
+        return rb_readSeek_(tree, 0, RB_SEEK_LAST);
+
+    if (tree->size == 0)
+        return NULL;
+
+    if (tree->engine == RB_ENGINE_BPLUS)
+        return rb_bpLast_(tree->bplus);
+
+    return &rb_findMax(tree->treeRoot)->pair;
+}
+
+
+rbPair* rbNext (rbTree tree, rbPair* pair) {
+
+    if (tree == NULL || pair == NULL)
+        return NULL;
+
+    if (tree->engine == RB_ENGINE_BPLUS)
+        return rb_bpNext_(pair);
+
+    if (tree->sync != NULL || tree->engine == RB_ENGINE_PERSISTENT)
+        return rb_readSeek_(tree, pair->key, RB_SEEK_UPPER);
+
+    rbNode next = rb_successor_(node_of_pair_(pair));
+    return next ? &next->pair : NULL;
+}
+
+
+rbPair* rbPrev (rbTree tree, rbPair* pair) {
+
+    if (tree == NULL || pair == NULL)
+        return NULL;
+
+    if (tree->engine == RB_ENGINE_BPLUS)
+        return rb_bpPrev_(pair);
+
+    if (tree->sync != NULL || tree->engine == RB_ENGINE_PERSISTENT)
+        return rb_readSeek_(tree, pair->key, RB_SEEK_BELOW);
+
+    rbNode prev = predecessor_(node_of_pair_(pair));
+    return prev ? &prev->pair : NULL;
+}
+
+
+rbPair* rbLowerBound (rbTree tree, rb_key_type key) {
+
+    if (tree == NULL)
+        return NULL;
+
+    if (tree->engine == RB_ENGINE_BPLUS)
+        return rb_bpLowerBound_(tree->bplus, key, 0);
+
+    if (tree->sync != NULL)
+        return rb_readSeek_(tree, key, RB_SEEK_LOWER);
+
+    rbNode node = lower_bound_(tree, key, 0);
+    return node ? &node->pair : NULL;
+}
+
+
+rbPair* rbUpperBound (rbTree tree, rb_key_type key) {
 
     if (tree == NULL)
+        return NULL;
+
+    if (tree->engine == RB_ENGINE_BPLUS)
+        return rb_bpLowerBound_(tree->bplus, key, 1);
+
+    if (tree->sync != NULL)
+        return rb_readSeek_(tree, key, RB_SEEK_UPPER);
+
+    rbNode node = lower_bound_(tree, key, 1);
+    return node ? &node->pair : NULL;
+}
+
+
+rbResult rbRange (rbTree tree, rb_key_type lo, rb_key_type hi,
+                  void (*act)(rbPair*, void*), void* data) {
+
+    if (tree == NULL || act == NULL)
         return RB_INVALID_ARGS;
 
-    printTree_(tree->treeRoot, 0);
+    if (tree->engine == RB_ENGINE_BPLUS) {
+        for (rbPair* pair = rb_bpLowerBound_(tree->bplus, lo, 0);
+             pair != NULL && pair->key <= hi;
+             pair = rb_bpNext_(pair))
+            act (pair, data);
+        return RB_SUCCESS;
+    }
+
+    if (tree->sync != NULL) {
+        rbResult res = rb_readEnter_();
+        if (res != RB_SUCCESS)
+            return res;
+        for (rbPair* pair = rb_readSeek_(tree, lo, RB_SEEK_LOWER);
+             pair != NULL && pair->key <= hi;
+             pair = rb_readSeek_(tree, pair->key, RB_SEEK_UPPER))
+            act (pair, data);
+        rb_readExit_();
+        return RB_SUCCESS;
+    }
+
+    if (tree->engine == RB_ENGINE_PERSISTENT) {
+        range_(tree->treeRoot, lo, hi, act, data);
+        return RB_SUCCESS;
+    }
+
+    for (rbNode node = lower_bound_(tree, lo, 0);
+         node != NULL && node->pair.key <= hi;
+         node = rb_successor_(node))
+        act (&node->pair, data);
 
     return RB_SUCCESS;
 }
 
 
-/// prints the current node and then the children indented one more.
-/// \param tree - current node
-/// \param indents - отступ
-static void printTree_ (rbNode tree, int indents) {
+/// Calls 'act' for the pairs of the subtree with keys in [lo, hi] in key order, visiting
+/// only the subtrees that may hold such keys: O(log n + k) without parent links. As in
+/// foreach_, the nodes whose left subtrees are being walked wait on a stack; those with
+/// keys below lo are skipped with their left subtrees.
+static void range_ (rbNode node, rb_key_type lo, rb_key_type hi,
+                    void (*act)(rbPair*, void*), void* data) {
+
+    rbNode stack[RB_MAX_DEPTH];
+    int    n = 0;
+
+    while (node != NULL || n > 0) {
+        while (node != NULL) {
+            if (node->pair.key < lo)
+                node = node->right;
+            else {
+                stack[n++] = node;
+                node = node->left;
+            }
+        }
 
-    printNode_(tree, indents);
+        node = stack[--n];
+        // the keys of the rest of the walk are greater still
+        if (node->pair.key > hi)
+            return;
 
-    if (tree == NULL)
-        return;
+        act (&node->pair, data);
+        node = node->right;
+    }
+}
+
+
+/// Gets the node that contains the given pair.
+static rbNode node_of_pair_ (rbPair* pair) {
 
-    printTree_(tree->left, indents + 1);
-    printTree_(tree->right, indents + 1);
+    return (rbNode) ((char*) pair - offsetof(struct rbNode_t, pair));
 }
 
 
-/// prints the contents of the node indented appropriately.
-/// \param node    - print node
-/// \param indents - отступ
-static void printNode_ (rbNode node, int indents)
-{
-    for (int i = 0; i < indents; ++i)
-        printf("    |");
+/// Finds the next node in key order: the leftmost node of the right subtree or, if
+/// there is none, the first ancestor reached from its left subtree.
+/// \param node - current node
+/// \return pointer to the next node or NULL if 'node' is the last one.
+rbNode rb_successor_ (rbNode node) {
 
-    if (node == NULL) {
-        printf("NULL(B)\n");
+    if (node->right)
+        return rb_findMin(node->right);
+
+    while (node->parent && node == node->parent->right)
+        node = node->parent;
+
+    return node->parent;
+}
+
+
+/// Finds the previous node in key order, mirror of rb_successor_.
+/// \param node - current node
+/// \return pointer to the previous node or NULL if 'node' is the first one.
+static rbNode predecessor_ (rbNode node) {
+
+    if (node->left)
+        return rb_findMax(node->left);
+
+    while (node->parent && node == node->parent->left)
+        node = node->parent;
+
+    return node->parent;
+}
+
+
+/// Finds the first node with a key not less (or, if 'strict', greater) than 'key'.
+/// \param tree   - container
+/// \param key    - the bound
+/// \param strict - non-zero to skip a node with a key equal to the bound
+/// \return pointer to the node or NULL if there is no such node.
+static rbNode lower_bound_ (rbTree tree, rb_key_type key, int strict) {
+
+    rbNode node  = tree->treeRoot;
+    rbNode res   = NULL;
+    size_t nodes = 0;
+
+    while (node) {
+        ++nodes;
+        if (node->pair.key > key || (!strict && node->pair.key == key)) {
+            res = node;
+            node = node->left;
+        }
+        else
+            node = node->right;
+    }
+
+    RB_COUNT_DESCENT(tree, nodes);
+    return res;
+}
+/***
+ *
+ *   end of Iteration functions
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   Order statistics functions
+ *
+ ***/
+rbPair* rbSelect (rbTree tree, size_t k) {
+
+    if (tree == NULL || k >= tree->size)
+        return NULL;
+
+    if (tree->engine == RB_ENGINE_BPLUS)
+        return rb_bpSelect_(tree->bplus, k);
+
+#ifdef RB_ORDER_STATISTICS
+    rbNode node = tree->treeRoot;
+
+    while (node) {
+        size_t left = count_(node->left);
+
+        if (k < left)
+            node = node->left;
+        else if (k > left) {
+            k -= left + 1;
+            node = node->right;
+        }
+        else
+            return &node->pair;
     }
-    else{
-        printf("[key: %d, value: %d]", node->pair.key, node->pair.value);
 
-        if (node->color == RED)
-            printf("(R)\n");
+    return NULL;
+#else
+    rbPair* pair = rbBegin(tree);
+    while (k--)
+        pair = rbNext(tree, pair);
+
+    return pair;
+#endif
+}
+
+
+size_t rbRank (rbTree tree, rb_key_type key) {
+
+    if (tree == NULL)
+        return 0;
+
+    if (tree->engine == RB_ENGINE_BPLUS)
+        return rb_bpRank_(tree->bplus, key);
+
+    size_t rank = 0;
+
+#ifdef RB_ORDER_STATISTICS
+    rbNode node = tree->treeRoot;
+
+    while (node) {
+        if (node->pair.key < key) {
+            rank += count_(node->left) + 1;
+            node = node->right;
+        }
         else
-            printf("(B)\n");
+            node = node->left;
     }
+#else
+    for (rbPair* pair = rbBegin(tree); pair != NULL && pair->key < key; pair = rbNext(tree, pair))
+        ++rank;
+#endif
+
+    return rank;
 }
 /***
  *
- *   end of dump functions
+ *   end of Order statistics functions
  *
- ****************************************************************************************/
\ No newline at end of file
+ ****************************************************************************************/
@@ -20,6 +20,9 @@
 ///
 /// Due to encapsulation, the user has access only to a pointer to the tree itself and,
 /// through functions, to a pointer to a key-value pair.
+///
+/// Keys and values here are int; RBTreeGeneric.h generates the container for other
+/// types.
 ///======================================================================================
 ///======================================================================================
 //
@@ -29,6 +32,10 @@
 #include <stdio.h>
 #include <assert.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 
 
 /****************************************************************************************
@@ -44,7 +51,9 @@ enum rbResult_enum_t {
     RB_SUCCESS = 0,
 
     RB_LACK_OF_MEMORY = -10,
-    RB_INVALID_ARGS   = -11
+    RB_INVALID_ARGS   = -11,
+    RB_IO_ERROR       = -12, // a file could not be opened, read or written
+    RB_BAD_FILE       = -13  // a file is not a valid snapshot of this build
 };
 
 
@@ -52,11 +61,56 @@ typedef struct rbTree_t*      rbTree;
 
 typedef enum rbResult_enum_t rbResult;
 
+
+/// The data structure behind the interface, chosen when the container is created.
+enum rbEngine_enum_t {
+    RB_ENGINE_REDBLACK   = 0, // red-black tree: a node per pair, stable pair pointers
+    RB_ENGINE_BPLUS      = 1, // B+ tree: many pairs per cache-line-aligned node, for
+                              // read-heavy workloads and scans
+    RB_ENGINE_PERSISTENT = 2  // red-black tree whose versions share nodes, see
+                              // rbSnapshot
+};
+
+typedef enum rbEngine_enum_t rbEngine;
+
+
+/// Output formats of rbDumpTo.
+enum rbDumpFormat_enum_t {
+    RB_DUMP_TEXT = 0, // the layout of rbDump: a line per node, children indented
+    RB_DUMP_DOT  = 1, // a Graphviz digraph, red-black nodes filled with their colors
+    RB_DUMP_JSON = 2  // nested objects: key, value, color, left and right of every node
+};
+
+typedef enum rbDumpFormat_enum_t rbDumpFormat;
+
+
+/// Operations whose latency a container with RB_STATS_LATENCY records, see rbStats.
+enum rbStatsOp_enum_t {
+    RB_STATS_FIND   = 0, // rbFind
+    RB_STATS_INSERT = 1, // rbInsert
+    RB_STATS_ERASE  = 2, // rbErase
+    RB_STATS_OPS    = 3  // the number of operations
+};
+
+typedef enum rbStatsOp_enum_t rbStatsOp;
+
 typedef struct rbPair_t      rbPair;
 typedef int                  rb_key_type;
 typedef int                  rb_val_type;
 
 
+/// The number of nodes in one slab of a pool-backed tree, if the user does not specify it.
+#define RB_POOL_DEFAULT_SLAB_NODES 1024
+
+/// The number of buckets of a latency histogram: bucket i counts the operations that
+/// took [2^i, 2^(i+1)) nanoseconds, the last one all longer operations too.
+#define RB_STATS_BUCKETS 40
+
+/// The number of threads that can read concurrent containers at once, see
+/// rbCreateConcurrent.
+#define RB_MAX_READERS 256
+
+
 /// Structure that defines the data in the container node.
 /// \note Changing the key value will violate the container invariant.
 ///       At the same time, you can change the value field.
@@ -79,18 +133,67 @@ struct rbPair_t {
 /// An attribute of every node in the tree. Used for balancing of tree.
 enum color_t { BLACK, RED };
 
+/// With RB_ORDER_STATISTICS defined (for the library and all its users alike) every node
+/// also stores the size of its subtree, and rbSelect/rbRank take O(log n) instead of a
+/// walk over the tree.
+///
+/// The nodes of RB_ENGINE_PERSISTENT may be shared by several versions, so they have no
+/// parent link; the same word counts the links to the node instead.
 struct rbNode_t {
-  struct rbNode_t *parent;
+  union {
+    struct rbNode_t *parent;
+    size_t refs; // the number of links to the node, RB_ENGINE_PERSISTENT only
+  };
   struct rbNode_t *left;
   struct rbNode_t *right;
 
   enum color_t color;
+#ifdef RB_ORDER_STATISTICS
+  size_t count; // the number of nodes in the subtree rooted at this node
+#endif
   rbPair pair;
 };
 typedef struct rbNode_t *rbNode;
 
+/// Node allocator of a pool-backed tree (see rbCreateWithPool). Nodes are cut from
+/// contiguous slabs and erased nodes are recycled through a free list.
+struct rbPool_t;
+
+/// The B+ tree of the RB_ENGINE_BPLUS engine.
+struct bpTree_t;
+
+/// Writer lock, sequence counter and retired nodes of a concurrent container (see
+/// rbCreateConcurrent).
+struct rbSync_t;
+
+/// Counters of a container, see rbStats. Only the red-black engines (RB_ENGINE_REDBLACK,
+/// RB_ENGINE_PERSISTENT) count descents, rebalancing and nodes; the latencies are
+/// recorded for every engine.
+struct rbCounters_t {
+    size_t descents;       // walks down from the root: lookups, bounds, insertions, removals
+    size_t comparisons;    // nodes whose keys the descents compared with the key
+    size_t maxDepth;       // the most nodes a single descent visited
+    size_t rotations;      // leftRotation and rightRotation, or their persistent analogue
+    size_t insertCases[6]; // [i]: how often insert_case<i> applied (1 - 5; [0] is unused):
+                           // 1 - the root turned black, 2 - nothing to do, 3 - recolored,
+                           // 4 and 5 - rotated
+    size_t deleteCases[7]; // [i]: how often delete_case<i> applied (1 - 6; [0] is unused)
+    size_t allocations;    // nodes allocated one at a time, for insertions and copies
+    size_t releases;       // nodes released one at a time
+    size_t latency[RB_STATS_OPS][RB_STATS_BUCKETS]; // [op][i]: see RB_STATS_BUCKETS
+};
+typedef struct rbCounters_t rbCounters;
+
 struct rbTree_t {
   rbNode treeRoot;
+  size_t size;             // the number of elements
+  struct rbPool_t *pool;   // NULL if nodes are allocated with calloc/free
+  rbEngine engine;
+  struct bpTree_t *bplus;  // used instead of treeRoot by RB_ENGINE_BPLUS
+  struct rbSync_t *sync;   // NULL unless created with rbCreateConcurrent
+#ifdef RB_STATS
+  rbCounters stats;        // see rbStats
+#endif
 };
 /***
  *
@@ -106,6 +209,10 @@ struct rbTree_t {
 
 
 /// Creates an instance of red-black tree
+/// The initial elements are linked into a balanced tree in linear time if their keys do
+/// not decrease, and sorted first otherwise. Their nodes occupy a single block of memory,
+/// so a tree created with elements is pool-backed (see rbCreateWithPool). If a key occurs
+/// several times, the last value wins, as with rbInsert.
 /// \param data - an array of elements to be placed in the tree
 /// \param size - the number of elements in the 'data' array
 /// \param tree - if successful, a pointer to a variable where to place the created
@@ -113,13 +220,36 @@ struct rbTree_t {
 /// \return an enum member from rbResult
 rbResult rbCreate (const rbPair* data, size_t size, rbTree* tree);
 
+/// Creates an instance of red-black tree whose nodes are taken from a per-tree pool.
+/// Nodes are allocated from contiguous slabs, erased nodes are reused, and rbClear and
+/// rbDestroy release the whole tree in O(slabs) instead of freeing node by node.
+/// \param data      - an array of elements to be placed in the tree
+/// \param size      - the number of elements in the 'data' array
+/// \param slabNodes - the number of nodes in one slab, 0 for the default
+///                    (RB_POOL_DEFAULT_SLAB_NODES)
+/// \param tree      - if successful, a pointer to a variable where to place the created
+///                    container
+/// \return an enum member from rbResult
+rbResult rbCreateWithPool (const rbPair* data, size_t size, size_t slabNodes, rbTree* tree);
+
+/// Creates a container backed by the given engine. All interface functions work for every
+/// engine, but with RB_ENGINE_BPLUS and RB_ENGINE_PERSISTENT any rbInsert or rbErase
+/// invalidates pointers to pairs (and iterators) of the container.
+/// \param data   - an array of elements to be placed in the container
+/// \param size   - the number of elements in the 'data' array
+/// \param engine - a member of rbEngine
+/// \param tree   - if successful, a pointer to a variable where to place the created
+///                 container
+/// \return an enum member from rbResult
+rbResult rbCreateWithEngine (const rbPair* data, size_t size, rbEngine engine, rbTree* tree);
+
 /// Removes the container instance
 /// \param tree - the container instance to be deleted.
 /// \return an enum member from rbResult
 rbResult rbDestroy (rbTree tree);
 
 
-/// Function to perform some kind of action on all elements of the container
+/// Function to perform some kind of action on all elements of the container, in key order
 /// \param tree - container
 /// \param act  - pointer to a function that is called for each element of the container.
 ///               Prototype: void (* act) (rbPair *, void *)
@@ -131,6 +261,82 @@ rbResult rbDestroy (rbTree tree);
 rbResult rbForeach (rbTree tree, void (*act)(rbPair*, void*), void* data);
 
 
+/// Iteration in key order
+///======================================================================================
+/// An iterator is a pointer to a key-value pair of the tree; NULL marks the end of the
+/// sequence. Each step follows the parent links of the nodes (or the leaf links of the
+/// B+ engine), so no recursion or extra memory is involved: a walk over k elements from
+/// a found position costs O(log n + k). In a red-black tree only erasing a pair
+/// invalidates the iterators pointing to it; with RB_ENGINE_BPLUS any rbInsert or
+/// rbErase invalidates all iterators of the container. Nodes of RB_ENGINE_PERSISTENT
+/// have no usable parent links, so there every step is a descent from the root and
+/// takes O(log n).
+///
+///     for (rbPair* it = rbBegin(tree); it != NULL; it = rbNext(tree, it))
+///         ...
+///======================================================================================
+
+/// Returns the pair with the smallest key.
+/// \param tree - container
+/// \return pointer to the pair or NULL if the container is empty or invalid.
+rbPair* rbBegin (rbTree tree);
+
+/// Returns the pair with the largest key.
+/// \param tree - container
+/// \return pointer to the pair or NULL if the container is empty or invalid.
+rbPair* rbLast (rbTree tree);
+
+/// Returns the pair that follows the given one in key order.
+/// \param tree - container
+/// \param pair - pointer to a pair of this container
+/// \return pointer to the next pair or NULL if 'pair' is the last one.
+rbPair* rbNext (rbTree tree, rbPair* pair);
+
+/// Returns the pair that precedes the given one in key order.
+/// \param tree - container
+/// \param pair - pointer to a pair of this container
+/// \return pointer to the previous pair or NULL if 'pair' is the first one.
+rbPair* rbPrev (rbTree tree, rbPair* pair);
+
+/// Finds the first pair whose key is not less than the given one.
+/// \param tree - container
+/// \param key  - the bound
+/// \return pointer to the pair or NULL if all keys are less than 'key'.
+rbPair* rbLowerBound (rbTree tree, rb_key_type key);
+
+/// Finds the first pair whose key is greater than the given one.
+/// \param tree - container
+/// \param key  - the bound
+/// \return pointer to the pair or NULL if no key is greater than 'key'.
+rbPair* rbUpperBound (rbTree tree, rb_key_type key);
+
+/// Calls 'act' for every pair with a key in [lo, hi], in key order.
+/// \param tree - container
+/// \param lo   - the smallest key of the range
+/// \param hi   - the largest key of the range
+/// \param act  - the function called for each element, as in rbForeach
+/// \param data - passed as the second parameter when calling the 'act' function
+/// \return an enum member from rbResult
+rbResult rbRange (rbTree tree, rb_key_type lo, rb_key_type hi,
+                  void (*act)(rbPair*, void*), void* data);
+
+
+/// Finds the k-th smallest key.
+/// O(log n) if compiled with RB_ORDER_STATISTICS, O(k) otherwise.
+/// \param tree - container
+/// \param k    - position in key order, 0 for the smallest key
+/// \return pointer to the pair or NULL if k >= rbSize(tree).
+rbPair* rbSelect (rbTree tree, size_t k);
+
+/// Counts the keys that are less than the given one, i.e. the position 'key' has or
+/// would have in key order.
+/// O(log n) if compiled with RB_ORDER_STATISTICS, O(rank) otherwise.
+/// \param tree - container
+/// \param key  - the bound
+/// \return the number of keys less than 'key', 0 for an invalid container.
+size_t rbRank (rbTree tree, rb_key_type key);
+
+
 /// Tries to find a value in the tree with the given key.
 /// \param map - container to search in
 /// \param key - required key
@@ -139,6 +345,17 @@ rbResult rbForeach (rbTree tree, void (*act)(rbPair*, void*), void* data);
 ///         then NULL is returned.
 rbPair* rbFind (rbTree tree, rb_key_type key);
 
+/// Looks up many keys at once. out[i] is set to what rbFind(tree, keys[i]) returns, but
+/// the descents of a group of keys are interleaved and prefetch their next nodes, so the
+/// cache misses of the group overlap instead of following each other. Pays off on
+/// containers much larger than the CPU cache.
+/// \param tree - container to search in
+/// \param keys - required keys
+/// \param n    - the number of keys
+/// \param out  - array of 'n' results
+/// \return an enum member from rbResult
+rbResult rbFindBatch (rbTree tree, const rb_key_type* keys, size_t n, rbPair** out);
+
 
 /// Adds a new unique key to the container. If such a key already exists,
 /// then the value that is stored under this key is simply replaced.
@@ -153,11 +370,80 @@ rbResult rbInsert (rbTree tree, rbPair pair);
 /// \return an enum member from rbResult
 rbResult rbErase (rbTree tree, rb_key_type key);
 
+/// Inserts many pairs at once, with the result of a loop of rbInsert (if a key occurs
+/// several times, the last value wins). The batch is sorted and applied in key order; a
+/// batch of at least 1/8 of the container is merged with it in linear time, without
+/// rebalancing. For a red-black tree, pointers to pairs stay valid. If there is no
+/// memory, a part of the batch may have been inserted.
+/// \param tree - container
+/// \param data - an array of elements to be inserted
+/// \param n    - the number of elements in the 'data' array
+/// \return an enum member from rbResult
+rbResult rbInsertBatch (rbTree tree, const rbPair* data, size_t n);
+
+/// Removes the pairs with the given keys, with the result of a loop of rbErase. Like
+/// rbInsertBatch, a large batch is merged with the container in linear time.
+/// \param tree - container
+/// \param keys - keys of the pairs to be removed, absent keys are ignored
+/// \param n    - the number of keys
+/// \return an enum member from rbResult
+rbResult rbEraseBatch (rbTree tree, const rb_key_type* keys, size_t n);
+
+
+//
+/// Repartitioning
+///======================================================================================
+/// rbSplit, rbJoin and rbUnion relink the nodes of red-black trees instead of copying
+/// their pairs: splitting and joining take O(log n), a union of trees of m <= n elements
+/// takes O(m log(n/m + 1)) and runs in several threads for large trees. Without
+/// RB_ORDER_STATISTICS rbSplit also walks the smaller part to count it. Pointers to the
+/// pairs that remain stay valid. The resulting trees may share the pool of their nodes,
+/// and rbMemoryUsage of each of them then counts the whole pool. With the other engines
+/// the pairs are copied, in linear time. Concurrent containers are not supported.
+///======================================================================================
+//
+
+/// Splits a container into the pairs with keys less than the given one and the rest.
+/// The container is left empty, but it still has to be destroyed.
+/// \param tree  - container
+/// \param key   - the first key of the right part
+/// \param left  - if successful, a pointer to a variable where to place the container
+///                of the keys less than 'key'
+/// \param right - if successful, a pointer to a variable where to place the container
+///                of the keys not less than 'key'
+/// \return an enum member from rbResult
+rbResult rbSplit (rbTree tree, rb_key_type key, rbTree* left, rbTree* right);
+
+/// Moves all pairs of the right container to the left one. Every key of the left
+/// container must be less than every key of the right one.
+/// \param left  - container that gets the pairs
+/// \param right - container that is left empty
+/// \return an enum member from rbResult, RB_INVALID_ARGS if the keys overlap.
+rbResult rbJoin (rbTree left, rbTree right);
+
+/// Moves all pairs of 'b' to 'a'. If a key is in both containers, the value of 'b'
+/// wins, as with rbInsert.
+/// \param a - container that gets the pairs
+/// \param b - container that is left empty
+/// \return an enum member from rbResult
+rbResult rbUnion (rbTree a, rbTree b);
+
 /// Checks if the container is empty.
 /// \param map - container
 /// \return 'true' if empty and 'false' if there is at least one element
 rbResult rbEmpty (rbTree tree);
 
+/// Returns the number of elements in the container, in O(1).
+/// \param tree - container
+/// \return the number of elements, 0 for an invalid container.
+size_t rbSize (rbTree tree);
+
+/// Returns the number of bytes taken by the nodes of the container (without the
+/// bookkeeping of the system allocator).
+/// \param tree - container
+/// \return the number of bytes, 0 for an invalid container.
+size_t rbMemoryUsage (rbTree tree);
+
 /// Removes all items from the container.
 /// After the call to rbEmpty will return true.
 /// \param map - container
@@ -169,8 +455,323 @@ rbResult rbClear (rbTree tree);
 /// \param tree - container
 /// \return an enum member from rbResult
 rbResult rbDump (rbTree tree);
+
+/// Writes the structure of the container to a file, through a large buffer and without
+/// recursion, so that trees of many millions of nodes are dumped at disk speed. The
+/// nodes of the B+ engine are written with all their keys.
+/// \param tree   - container
+/// \param file   - a file open for writing, left open
+/// \param format - a member of rbDumpFormat
+/// \return an enum member from rbResult, RB_IO_ERROR if the file could not be written.
+rbResult rbDumpTo (rbTree tree, FILE* file, rbDumpFormat format);
 /***
  *
  *   end of interface functions
  *
- ****************************************************************************************/
\ No newline at end of file
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   read-only snapshot
+ *
+ ***/
+
+//
+/// Frozen container
+///======================================================================================
+/// A container that is built once and then only queried can be frozen: rbFreeze copies
+/// its pairs into a static search layout, a contiguous array of 64-byte blocks of 16
+/// sorted keys each (a 17-ary search tree stored implicitly, without pointers). A lookup
+/// reads one cache line per level, compares the key with a whole block at once (AVX2 or
+/// SSE2, chosen at run time, with a scalar fallback) and has no data-dependent branches.
+/// rbFrozenFindMany runs several lookups in lockstep and prefetches the next blocks to
+/// hide memory latency.
+///
+/// The snapshot is independent of the container: later changes of the container are not
+/// visible in it, and the container may be destroyed.
+///======================================================================================
+///======================================================================================
+//
+struct rbFrozen_t;
+
+typedef struct rbFrozen_t* rbFrozen;
+
+
+/// Lookup kernels of frozen snapshots, see rbFrozenUseKernel.
+enum rbFrozenKernel_enum_t {
+    RB_FROZEN_SCALAR = 0,
+    RB_FROZEN_SSE2   = 1, // x86 only
+    RB_FROZEN_AVX2   = 2  // x86 only
+};
+
+typedef enum rbFrozenKernel_enum_t rbFrozenKernel;
+
+
+/// Creates a read-only snapshot of the container.
+/// \param tree   - container
+/// \param frozen - if successful, a pointer to a variable where to place the snapshot
+/// \return an enum member from rbResult
+rbResult rbFreeze (rbTree tree, rbFrozen* frozen);
+
+/// Removes the snapshot.
+/// \param frozen - the snapshot to be deleted
+/// \return an enum member from rbResult
+rbResult rbFrozenDestroy (rbFrozen frozen);
+
+/// Tries to find a pair with the given key in the snapshot, like rbFind.
+/// \param frozen - snapshot
+/// \param key    - required key
+/// \return pointer to the pair inside the snapshot or NULL if the key is not found or
+///         the snapshot is invalid.
+const rbPair* rbFrozenFind (rbFrozen frozen, rb_key_type key);
+
+/// Looks up many keys at once. out[i] is set to what rbFrozenFind(frozen, keys[i])
+/// returns, but the lookups overlap their memory accesses.
+/// \param frozen - snapshot
+/// \param keys   - required keys
+/// \param n      - the number of keys
+/// \param out    - array of 'n' results
+/// \return an enum member from rbResult
+rbResult rbFrozenFindMany (rbFrozen frozen, const rb_key_type* keys, size_t n,
+                           const rbPair** out);
+
+/// Switches the snapshot to another lookup kernel, e.g. to compare the kernels. A
+/// snapshot starts with the fastest one the CPU supports.
+/// \param frozen - snapshot
+/// \param kernel - a member of rbFrozenKernel
+/// \return an enum member from rbResult, RB_INVALID_ARGS if the CPU or the key type does
+///         not allow the kernel.
+rbResult rbFrozenUseKernel (rbFrozen frozen, rbFrozenKernel kernel);
+/***
+ *
+ *   end of read-only snapshot
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   snapshot files
+ *
+ ***/
+
+//
+/// Snapshot files
+///======================================================================================
+/// rbSave writes the pairs of a container in key order to a compact binary file, and
+/// rbLoad restores the container from it in linear time: the file is mapped into
+/// memory and its pairs are linked into a balanced tree without any rebalancing. A
+/// service that only reads can use rbFrozenLoad and skip the tree altogether.
+///
+/// The file records a format version, the byte order and the sizes of the types of the
+/// saving build, and a checksum of the pairs. A file that fails any of the checks is
+/// rejected with RB_BAD_FILE.
+///======================================================================================
+///======================================================================================
+//
+
+/// Writes the pairs of the container to a file. The file is replaced only when it is
+/// completely written, by a file readable and writable by its owner only (mkstemp). A
+/// concurrent container may be saved while writers run, and then it is saved as rbNext
+/// walks it.
+/// \param tree - container
+/// \param path - the file
+/// \return an enum member from rbResult
+rbResult rbSave (rbTree tree, const char* path);
+
+/// Creates a red-black tree from a file written by rbSave. The tree is pool-backed, as
+/// if created by rbCreate.
+/// \param path - the file
+/// \param tree - if successful, a pointer to a variable where to place the created
+///               container
+/// \return an enum member from rbResult
+rbResult rbLoad (const char* path, rbTree* tree);
+
+/// Creates a read-only snapshot (see rbFreeze) from a file written by rbSave.
+/// \param path   - the file
+/// \param frozen - if successful, a pointer to a variable where to place the snapshot
+/// \return an enum member from rbResult
+rbResult rbFrozenLoad (const char* path, rbFrozen* frozen);
+/***
+ *
+ *   end of snapshot files
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   persistent versions
+ *
+ ***/
+
+//
+/// Persistent containers
+///======================================================================================
+/// A container of RB_ENGINE_PERSISTENT keeps its old versions cheaply. rbSnapshot takes
+/// O(1): the new version shares all nodes with the container, and every node counts the
+/// links to it. rbInsert and rbErase then copy only the nodes they change, the path
+/// from the root and the nodes recolored or rotated while rebalancing: O(log n) new
+/// nodes per write. Each version is a container of its own that may be changed,
+/// snapshotted and destroyed in any order; the others do not see its changes.
+///
+/// Versions are used like containers created separately: different versions may be used
+/// by different threads at once, one version by one thread at a time.
+///
+/// Pairs are shared by the versions, so change values only with rbInsert, never through
+/// a pointer to a pair. rbMemoryUsage of every version counts the shared nodes too.
+///======================================================================================
+///======================================================================================
+//
+
+/// Creates a new version of a persistent container in O(1). It holds the pairs the
+/// container holds now and uses the same allocator.
+/// \param tree     - container created with RB_ENGINE_PERSISTENT
+/// \param snapshot - if successful, a pointer to a variable where to place the new
+///                   version, to be destroyed with rbDestroy
+/// \return an enum member from rbResult, RB_INVALID_ARGS for other engines.
+rbResult rbSnapshot (rbTree tree, rbTree* snapshot);
+/***
+ *
+ *   end of persistent versions
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   concurrent access
+ *
+ ***/
+
+//
+/// Concurrent container
+///======================================================================================
+/// A container created with rbCreateConcurrent may be used from many threads at once.
+///
+/// Writers (rbInsert, rbErase, rbClear) take a per-container lock, so they run one at a
+/// time. Readers (rbFind, rbFindBatch, the iteration functions, rbRange, rbForeach,
+/// rbSize, rbEmpty) take no lock and never wait for each other. Each read descends the
+/// tree optimistically and is repeated if a writer changed the tree meanwhile, which a
+/// sequence counter reveals (a seqlock). Readers are not lock-free, though: one that
+/// meets a writer in the middle of a change waits for the change to end.
+///
+/// Erased nodes are not freed at once. They are retired and freed only after every
+/// thread that might still see them has left its read section (epoch-based
+/// reclamation), so a reader never touches freed or reused memory.
+///
+/// A pair pointer returned by a read function stays valid only while the thread is in
+/// a read section. So bracket the work with the pointers in rbReadBegin/rbReadEnd:
+///
+///     rbReadBegin(tree);
+///     for (rbPair* it = rbBegin(tree); it != NULL; it = rbNext(tree, it))
+///         ...
+///     rbReadEnd(tree);
+///
+/// Inside a section the iteration tolerates concurrent writers. Every step returns the
+/// next key present at that moment, so a walk sees the keys in increasing order, but
+/// not necessarily a single state of the container.
+///
+/// rbSelect, rbRank, rbDump, rbFreeze and rbMemoryUsage must not run concurrently with
+/// writers, and rbDestroy with anything at all. Only the red-black engine is supported.
+///======================================================================================
+///======================================================================================
+//
+
+/// Creates a red-black tree that allows concurrent readers alongside a writer.
+/// A thread that reads a concurrent container takes one of RB_MAX_READERS reader slots,
+/// shared by all concurrent containers, and keeps it until it exits. While all slots
+/// are taken, other threads cannot enter read sections: rbReadBegin, rbFindBatch,
+/// rbForeach, rbRange and rbSave return RB_LACK_OF_MEMORY, and the other read functions
+/// take the writer lock instead.
+/// \param data - an array of elements to be placed in the tree
+/// \param size - the number of elements in the 'data' array
+/// \param tree - if successful, a pointer to a variable where to place the created
+///               container
+/// \return an enum member from rbResult
+rbResult rbCreateConcurrent (const rbPair* data, size_t size, rbTree* tree);
+
+/// Enters a read section of the calling thread. Pairs of a concurrent container are not
+/// freed until the section ends. Sections may nest.
+/// \param tree - container
+/// \return an enum member from rbResult, RB_LACK_OF_MEMORY if the thread has no reader
+///         slot and all RB_MAX_READERS are taken
+rbResult rbReadBegin (rbTree tree);
+
+/// Leaves a read section entered with rbReadBegin.
+/// \param tree - container
+/// \return an enum member from rbResult
+rbResult rbReadEnd (rbTree tree);
+/***
+ *
+ *   end of concurrent access
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   statistics
+ *
+ ***/
+
+//
+/// Operation counters
+///======================================================================================
+/// Built with RB_STATS defined (for the library and all its users alike), every
+/// container counts what its operations do: the descents and the nodes they compare,
+/// the deepest descent, rotations, the cases of rebalancing after insertions and
+/// removals, and single-node allocations. They tell whether an operation is slow because
+/// of the depth of the tree, the rebalancing or the allocator. Without RB_STATS nothing
+/// is counted and the operations cost exactly what they did before.
+///
+/// RB_STATS_LATENCY (which needs RB_STATS) also times every rbFind, rbInsert and rbErase
+/// with the monotonic clock and records the time in a histogram per operation. The
+/// clock costs tens of nanoseconds a call, so it is a separate switch.
+///
+/// The counters are updated with relaxed atomic operations, so concurrent readers and
+/// versions of a persistent container used by several threads may count at once.
+///======================================================================================
+///======================================================================================
+//
+
+/// Copies the counters of a container.
+/// \param tree - container
+/// \param out  - where to copy the counters; zeroed if RB_STATS is not defined
+/// \return an enum member from rbResult, RB_INVALID_ARGS without RB_STATS.
+rbResult rbStats (rbTree tree, rbCounters* out);
+
+/// Zeroes the counters of a container.
+/// \param tree - container
+/// \return an enum member from rbResult, RB_INVALID_ARGS without RB_STATS.
+rbResult rbStatsReset (rbTree tree);
+
+/// Writes counters as a JSON object: the counters by their names, the cases as arrays
+/// indexed from case 1, and "latency" with an array of RB_STATS_BUCKETS per operation
+/// ("find", "insert", "erase").
+/// \param stats - counters taken with rbStats
+/// \param file  - output stream
+/// \return an enum member from rbResult, RB_IO_ERROR if the output failed.
+rbResult rbStatsToJson (const rbCounters* stats, FILE* file);
+/***
+ *
+ *   end of statistics
+ *
+ ****************************************************************************************/
+
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,972 @@
+/****************************************************************************************
+ *
+ *   RBTreeBPlus.c
+ *
+ *   The engine RB_ENGINE_BPLUS: a B+ tree with nodes of a few cache lines and the pairs
+ *   in its linked leaves.
+ *
+ ***/
+#include "RBTreeInternal.h"
+
+
+
+/****************************************************************************************
+ *
+ *   prototypes for helper functions
+ *
+ ***/
+struct bpLeaf_t;
+struct bpInner_t;
+
+static void              bpFreeNode_   (void* node, int height);
+static void*             bpAllocNode_  (struct bpTree_t* bp);
+static void              bpFreeOne_    (struct bpTree_t* bp, void* node);
+static struct bpLeaf_t*  bpLeafOf_     (rbPair* pair);
+static int               bpChildIndex_ (const struct bpInner_t* in, rb_key_type key);
+static int               bpPairIndex_  (const struct bpLeaf_t* leaf, rb_key_type key, int strict);
+static struct bpLeaf_t*  bpFindLeaf_   (const struct bpTree_t* bp, rb_key_type key,
+                                        struct bpInner_t** path, int* pos);
+static void              bpLeafInsertAt_ (struct bpLeaf_t* leaf, int i, rbPair pair);
+static void              bpLeafRemoveAt_ (struct bpLeaf_t* leaf, int i);
+static void              bpInnerInsertAt_(struct bpInner_t* in, int i, rb_key_type key, void* child);
+static void              bpInnerRemoveAt_(struct bpInner_t* in, int i);
+static int               bpDump_       (struct rbWriter_t* w, void* node, int height, int indents,
+                                        rbDumpFormat format, int* ids);
+static void              bpPrefetch_   (const void* node);
+static rbResult          bpRebuild_    (rbTree tree, const rbPair* pairs, size_t size);
+/***
+ *
+ *   end of prototypes for helper functions
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   B+ tree engine
+ *
+ ***/
+
+//
+/// B+ tree
+///======================================================================================
+/// The RB_ENGINE_BPLUS engine keeps the pairs in the leaves of a B+ tree. A leaf is a
+/// block of BP_NODE_BYTES bytes with up to BP_LEAF_CAP pairs in key order, so a lookup
+/// touches a few cache-line-aligned blocks instead of ~log2(n) scattered nodes, and a
+/// pair costs little more than its own size. Inner nodes hold only separators and child
+/// pointers: keys[i] is not greater than any key of the subtree child[i + 1] and greater
+/// than every key of child[i]. Leaves are linked in both directions for scans.
+///
+/// Every node except the root is at least half full: an overflowing node is split in
+/// two, an underflowing one borrows from a sibling or is merged with it.
+///
+/// Leaves are aligned to their size, so the leaf of a pair is found from the address of
+/// the pair alone, and rbNext/rbPrev take O(1). Note that rbInsert and rbErase move pairs
+/// inside the leaves: with this engine any modification invalidates pointers to pairs.
+///======================================================================================
+///======================================================================================
+//
+#define BP_NODE_BYTES 512
+
+enum {
+    BP_LEAF_CAP  = (BP_NODE_BYTES - 3 * sizeof(void*)) / sizeof(rbPair),
+    BP_LEAF_MIN  = BP_LEAF_CAP / 2,
+    BP_INNER_CAP = (BP_NODE_BYTES - 2 * sizeof(void*)) / (sizeof(rb_key_type) + sizeof(void*)) - 1,
+    BP_INNER_MIN = BP_INNER_CAP / 2,
+
+    BP_MAX_HEIGHT = 32
+};
+
+struct bpLeaf_t {
+    struct bpLeaf_t *next;
+    struct bpLeaf_t *prev;
+    int              n;  // the number of pairs
+    rbPair           pairs[BP_LEAF_CAP];
+};
+
+struct bpInner_t {
+    int          n;      // the number of keys, there are n + 1 children
+    rb_key_type  keys[BP_INNER_CAP];
+    void        *child[BP_INNER_CAP + 1];
+};
+
+struct bpTree_t {
+    void            *root;   // a leaf if height is 0, an inner node otherwise
+    int              height; // the number of inner levels
+    struct bpLeaf_t *first;
+    struct bpLeaf_t *last;
+    size_t           nodes;  // the number of allocated nodes
+};
+
+
+/// Allocates an empty tree.
+struct bpTree_t* rb_bpCreate_ (void) {
+
+    return (struct bpTree_t*) calloc(1, sizeof(struct bpTree_t));
+}
+
+
+/// Frees all nodes of the tree, the tree stays usable.
+void rb_bpClear_ (struct bpTree_t* bp) {
+
+    if (bp->root != NULL)
+        bpFreeNode_(bp->root, bp->height);
+
+    bp->root = NULL;
+    bp->height = 0;
+    bp->first = bp->last = NULL;
+    bp->nodes = 0;
+}
+
+
+static void bpFreeNode_ (void* node, int height) {
+
+    if (height > 0) {
+        struct bpInner_t* in = (struct bpInner_t*) node;
+        for (int i = 0; i <= in->n; ++i)
+            bpFreeNode_(in->child[i], height - 1);
+    }
+
+    free(node);
+}
+
+
+/// Allocates a node of the tree. Both kinds of nodes take BP_NODE_BYTES aligned to the
+/// same value, which leaves rely on (see bpLeafOf_).
+static void* bpAllocNode_ (struct bpTree_t* bp) {
+
+    void* node = aligned_alloc(BP_NODE_BYTES, BP_NODE_BYTES);
+    if (node != NULL)
+        ++bp->nodes;
+
+    return node;
+}
+
+
+static void bpFreeOne_ (struct bpTree_t* bp, void* node) {
+
+    free(node);
+    --bp->nodes;
+}
+
+
+size_t rb_bpMemoryUsage_ (const struct bpTree_t* bp) {
+
+    return bp->nodes * BP_NODE_BYTES;
+}
+
+
+/// Gets the leaf that contains the given pair.
+static struct bpLeaf_t* bpLeafOf_ (rbPair* pair) {
+
+    return (struct bpLeaf_t*) ((uintptr_t) pair & ~(uintptr_t) (BP_NODE_BYTES - 1));
+}
+
+
+/// Looks for the child of an inner node to descend to: the number of keys not greater
+/// than 'key'.
+static int bpChildIndex_ (const struct bpInner_t* in, rb_key_type key) {
+
+    int lo = 0, n = in->n;
+
+    while (n > 0) {
+        int half = n / 2;
+        if (in->keys[lo + half] <= key) {
+            lo += half + 1;
+            n -= half + 1;
+        }
+        else
+            n = half;
+    }
+
+    return lo;
+}
+
+
+/// Looks for the position of a key in a leaf: the number of pairs with a key less (or,
+/// if 'strict', not greater) than 'key'.
+static int bpPairIndex_ (const struct bpLeaf_t* leaf, rb_key_type key, int strict) {
+
+    int lo = 0, n = leaf->n;
+
+    while (n > 0) {
+        int half = n / 2;
+        rb_key_type k = leaf->pairs[lo + half].key;
+
+        if (k < key || (strict && k == key)) {
+            lo += half + 1;
+            n -= half + 1;
+        }
+        else
+            n = half;
+    }
+
+    return lo;
+}
+
+
+/// Descends to the leaf where 'key' is or should be.
+/// \param path - if not NULL, receives the inner nodes passed, from the root down
+/// \param pos  - if not NULL, receives the index of the child taken in every node of 'path'
+/// \return the leaf or NULL if the tree is empty.
+static struct bpLeaf_t* bpFindLeaf_ (const struct bpTree_t* bp, rb_key_type key,
+                                     struct bpInner_t** path, int* pos) {
+
+    void* node = bp->root;
+
+    for (int d = 0; d < bp->height; ++d) {
+        struct bpInner_t* in = (struct bpInner_t*) node;
+        int i = bpChildIndex_(in, key);
+
+        if (path != NULL) {
+            path[d] = in;
+            pos[d] = i;
+        }
+
+        node = in->child[i];
+    }
+
+    return (struct bpLeaf_t*) node;
+}
+
+
+rbPair* rb_bpFind_ (const struct bpTree_t* bp, rb_key_type key) {
+
+    struct bpLeaf_t* leaf = bpFindLeaf_(bp, key, NULL, NULL);
+    if (leaf == NULL)
+        return NULL;
+
+    int i = bpPairIndex_(leaf, key, 0);
+    if (i < leaf->n && leaf->pairs[i].key == key)
+        return &leaf->pairs[i];
+
+    return NULL;
+}
+
+
+/// Finds the first pair with a key not less (or, if 'strict', greater) than 'key'.
+rbPair* rb_bpLowerBound_ (const struct bpTree_t* bp, rb_key_type key, int strict) {
+
+    struct bpLeaf_t* leaf = bpFindLeaf_(bp, key, NULL, NULL);
+    if (leaf == NULL)
+        return NULL;
+
+    int i = bpPairIndex_(leaf, key, strict);
+    if (i < leaf->n)
+        return &leaf->pairs[i];
+
+    return leaf->next ? &leaf->next->pairs[0] : NULL;
+}
+
+
+rbPair* rb_bpNext_ (rbPair* pair) {
+
+    struct bpLeaf_t* leaf = bpLeafOf_(pair);
+
+    if (pair + 1 < leaf->pairs + leaf->n)
+        return pair + 1;
+
+    return leaf->next ? &leaf->next->pairs[0] : NULL;
+}
+
+
+rbPair* rb_bpPrev_ (rbPair* pair) {
+
+    struct bpLeaf_t* leaf = bpLeafOf_(pair);
+
+    if (pair > leaf->pairs)
+        return pair - 1;
+
+    return leaf->prev ? &leaf->prev->pairs[leaf->prev->n - 1] : NULL;
+}
+
+
+/// The pair with the smallest key of a non-empty tree.
+rbPair* rb_bpFirst_ (const struct bpTree_t* bp) {
+
+    return &bp->first->pairs[0];
+}
+
+
+/// The pair with the largest key of a non-empty tree.
+rbPair* rb_bpLast_ (const struct bpTree_t* bp) {
+
+    return &bp->last->pairs[bp->last->n - 1];
+}
+
+
+/// Puts a pair into a leaf that has room for it.
+static void bpLeafInsertAt_ (struct bpLeaf_t* leaf, int i, rbPair pair) {
+
+    memmove(&leaf->pairs[i + 1], &leaf->pairs[i], (size_t) (leaf->n - i) * sizeof(rbPair));
+    memcpy(&leaf->pairs[i], &pair, sizeof(rbPair));
+    ++leaf->n;
+}
+
+
+static void bpLeafRemoveAt_ (struct bpLeaf_t* leaf, int i) {
+
+    memmove(&leaf->pairs[i], &leaf->pairs[i + 1], (size_t) (leaf->n - i - 1) * sizeof(rbPair));
+    --leaf->n;
+}
+
+
+/// Puts a key and the child to its right into an inner node that has room for them.
+static void bpInnerInsertAt_ (struct bpInner_t* in, int i, rb_key_type key, void* child) {
+
+    memmove(&in->keys[i + 1], &in->keys[i], (size_t) (in->n - i) * sizeof(rb_key_type));
+    memmove(&in->child[i + 2], &in->child[i + 1], (size_t) (in->n - i) * sizeof(void*));
+    in->keys[i] = key;
+    in->child[i + 1] = child;
+    ++in->n;
+}
+
+
+/// Removes a key and the child to its right from an inner node.
+static void bpInnerRemoveAt_ (struct bpInner_t* in, int i) {
+
+    memmove(&in->keys[i], &in->keys[i + 1], (size_t) (in->n - i - 1) * sizeof(rb_key_type));
+    memmove(&in->child[i + 1], &in->child[i + 2], (size_t) (in->n - i - 1) * sizeof(void*));
+    --in->n;
+}
+
+
+/// Adds a new key or replaces the value of an existing one.
+/// \param added - set to 1 if a new pair was added and to 0 otherwise
+rbResult rb_bpInsert_ (struct bpTree_t* bp, rbPair pair, int* added) {
+
+    struct bpInner_t* path[BP_MAX_HEIGHT];
+    int               pos[BP_MAX_HEIGHT];
+
+    *added = 0;
+
+    if (bp->root == NULL) {
+        struct bpLeaf_t* leaf = (struct bpLeaf_t*) bpAllocNode_(bp);
+        if (leaf == NULL)
+            return RB_LACK_OF_MEMORY;
+
+        leaf->next = leaf->prev = NULL;
+        leaf->n = 0;
+        bp->root = bp->first = bp->last = leaf;
+    }
+
+    struct bpLeaf_t* leaf = bpFindLeaf_(bp, pair.key, path, pos);
+    int i = bpPairIndex_(leaf, pair.key, 0);
+
+    if (i < leaf->n && leaf->pairs[i].key == pair.key) {
+        leaf->pairs[i].value = pair.value;
+        return RB_SUCCESS;
+    }
+
+    *added = 1;
+
+    if (leaf->n < BP_LEAF_CAP) {
+        bpLeafInsertAt_(leaf, i, pair);
+        return RB_SUCCESS;
+    }
+
+    // The leaf is full and has to be split, as well as every full inner node above it.
+    // All new nodes are allocated first, so a lack of memory leaves the tree intact.
+    void* spare[BP_MAX_HEIGHT + 2];
+    int   need = 1, used = 0;
+
+    int d = bp->height;
+    while (d > 0 && path[d - 1]->n == BP_INNER_CAP) {
+        ++need;
+        --d;
+    }
+    if (d == 0)
+        ++need; // a new root
+
+    for (int k = 0; k < need; ++k) {
+        spare[k] = bpAllocNode_(bp);
+        if (spare[k] == NULL) {
+            while (k-- > 0)
+                bpFreeOne_(bp, spare[k]);
+            *added = 0;
+            return RB_LACK_OF_MEMORY;
+        }
+    }
+
+    struct bpLeaf_t* right = (struct bpLeaf_t*) spare[used++];
+    int half = (BP_LEAF_CAP + 1) / 2;
+
+    if (i < half) {
+        right->n = BP_LEAF_CAP - half + 1;
+        memcpy(right->pairs, &leaf->pairs[half - 1], (size_t) right->n * sizeof(rbPair));
+        leaf->n = half - 1;
+        bpLeafInsertAt_(leaf, i, pair);
+    }
+    else {
+        right->n = BP_LEAF_CAP - half;
+        memcpy(right->pairs, &leaf->pairs[half], (size_t) right->n * sizeof(rbPair));
+        leaf->n = half;
+        bpLeafInsertAt_(right, i - half, pair);
+    }
+
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (right->next != NULL)
+        right->next->prev = right;
+    else
+        bp->last = right;
+    leaf->next = right;
+
+    rb_key_type sep   = right->pairs[0].key;
+    void*       child = right;
+
+    for (d = bp->height - 1; d >= 0; --d) {
+        struct bpInner_t* in = path[d];
+        int p = pos[d];
+
+        if (in->n < BP_INNER_CAP) {
+            bpInnerInsertAt_(in, p, sep, child);
+            return RB_SUCCESS;
+        }
+
+        // split a full inner node: of BP_INNER_CAP + 1 keys the middle one goes up
+        rb_key_type keys[BP_INNER_CAP + 1];
+        void*       kids[BP_INNER_CAP + 2];
+
+        memcpy(keys, in->keys, (size_t) p * sizeof(rb_key_type));
+        keys[p] = sep;
+        memcpy(keys + p + 1, in->keys + p, (size_t) (BP_INNER_CAP - p) * sizeof(rb_key_type));
+
+        memcpy(kids, in->child, (size_t) (p + 1) * sizeof(void*));
+        kids[p + 1] = child;
+        memcpy(kids + p + 2, in->child + p + 1, (size_t) (BP_INNER_CAP - p) * sizeof(void*));
+
+        struct bpInner_t* rin = (struct bpInner_t*) spare[used++];
+        int mid = (BP_INNER_CAP + 1) / 2;
+
+        in->n = mid;
+        memcpy(in->keys, keys, (size_t) mid * sizeof(rb_key_type));
+        memcpy(in->child, kids, (size_t) (mid + 1) * sizeof(void*));
+
+        rin->n = BP_INNER_CAP - mid;
+        memcpy(rin->keys, keys + mid + 1, (size_t) rin->n * sizeof(rb_key_type));
+        memcpy(rin->child, kids + mid + 1, (size_t) (rin->n + 1) * sizeof(void*));
+
+        sep = keys[mid];
+        child = rin;
+    }
+
+    struct bpInner_t* root = (struct bpInner_t*) spare[used++];
+    root->n = 1;
+    root->keys[0] = sep;
+    root->child[0] = bp->root;
+    root->child[1] = child;
+
+    bp->root = root;
+    ++bp->height;
+
+    return RB_SUCCESS;
+}
+
+
+/// Removes the pair with the given key, if any.
+/// \return 1 if a pair was removed and 0 otherwise.
+int rb_bpErase_ (struct bpTree_t* bp, rb_key_type key) {
+
+    struct bpInner_t* path[BP_MAX_HEIGHT];
+    int               pos[BP_MAX_HEIGHT];
+
+    struct bpLeaf_t* leaf = bpFindLeaf_(bp, key, path, pos);
+    if (leaf == NULL)
+        return 0;
+
+    int i = bpPairIndex_(leaf, key, 0);
+    if (i == leaf->n || leaf->pairs[i].key != key)
+        return 0;
+
+    bpLeafRemoveAt_(leaf, i);
+
+    if (bp->height == 0) {
+        if (leaf->n == 0)
+            rb_bpClear_(bp);
+        return 1;
+    }
+
+    if (leaf->n >= BP_LEAF_MIN)
+        return 1;
+
+    // the leaf underflows: borrow a pair from a sibling or merge with it
+    int d = bp->height - 1;
+    struct bpInner_t* parent = path[d];
+    int p = pos[d];
+
+    if (p > 0) {
+        struct bpLeaf_t* left = (struct bpLeaf_t*) parent->child[p - 1];
+
+        if (left->n > BP_LEAF_MIN) {
+            bpLeafInsertAt_(leaf, 0, left->pairs[left->n - 1]);
+            --left->n;
+            parent->keys[p - 1] = leaf->pairs[0].key;
+            return 1;
+        }
+
+        memcpy(&left->pairs[left->n], leaf->pairs, (size_t) leaf->n * sizeof(rbPair));
+        left->n += leaf->n;
+        left->next = leaf->next;
+        if (leaf->next != NULL)
+            leaf->next->prev = left;
+        else
+            bp->last = left;
+
+        bpFreeOne_(bp, leaf);
+        bpInnerRemoveAt_(parent, p - 1);
+    }
+    else {
+        struct bpLeaf_t* right = (struct bpLeaf_t*) parent->child[1];
+
+        if (right->n > BP_LEAF_MIN) {
+            bpLeafInsertAt_(leaf, leaf->n, right->pairs[0]);
+            bpLeafRemoveAt_(right, 0);
+            parent->keys[0] = right->pairs[0].key;
+            return 1;
+        }
+
+        memcpy(&leaf->pairs[leaf->n], right->pairs, (size_t) right->n * sizeof(rbPair));
+        leaf->n += right->n;
+        leaf->next = right->next;
+        if (right->next != NULL)
+            right->next->prev = leaf;
+        else
+            bp->last = leaf;
+
+        bpFreeOne_(bp, right);
+        bpInnerRemoveAt_(parent, 0);
+    }
+
+    // path[d] has lost a key, the same fix is repeated for the inner nodes above
+    for (; d > 0; --d) {
+        struct bpInner_t* in = path[d];
+
+        if (in->n >= BP_INNER_MIN)
+            return 1;
+
+        parent = path[d - 1];
+        p = pos[d - 1];
+
+        if (p > 0) {
+            struct bpInner_t* left = (struct bpInner_t*) parent->child[p - 1];
+
+            if (left->n > BP_INNER_MIN) {
+                memmove(&in->keys[1], &in->keys[0], (size_t) in->n * sizeof(rb_key_type));
+                memmove(&in->child[1], &in->child[0], (size_t) (in->n + 1) * sizeof(void*));
+                in->keys[0] = parent->keys[p - 1];
+                in->child[0] = left->child[left->n];
+                ++in->n;
+
+                parent->keys[p - 1] = left->keys[left->n - 1];
+                --left->n;
+                return 1;
+            }
+
+            left->keys[left->n] = parent->keys[p - 1];
+            memcpy(&left->keys[left->n + 1], in->keys, (size_t) in->n * sizeof(rb_key_type));
+            memcpy(&left->child[left->n + 1], in->child, (size_t) (in->n + 1) * sizeof(void*));
+            left->n += in->n + 1;
+
+            bpFreeOne_(bp, in);
+            bpInnerRemoveAt_(parent, p - 1);
+        }
+        else {
+            struct bpInner_t* right = (struct bpInner_t*) parent->child[1];
+
+            if (right->n > BP_INNER_MIN) {
+                in->keys[in->n] = parent->keys[0];
+                in->child[in->n + 1] = right->child[0];
+                ++in->n;
+
+                parent->keys[0] = right->keys[0];
+                memmove(&right->keys[0], &right->keys[1], (size_t) (right->n - 1) * sizeof(rb_key_type));
+                memmove(&right->child[0], &right->child[1], (size_t) right->n * sizeof(void*));
+                --right->n;
+                return 1;
+            }
+
+            in->keys[in->n] = parent->keys[0];
+            memcpy(&in->keys[in->n + 1], right->keys, (size_t) right->n * sizeof(rb_key_type));
+            memcpy(&in->child[in->n + 1], right->child, (size_t) (right->n + 1) * sizeof(void*));
+            in->n += right->n + 1;
+
+            bpFreeOne_(bp, right);
+            bpInnerRemoveAt_(parent, 0);
+        }
+    }
+
+    // the root may be left with a single child
+    struct bpInner_t* root = (struct bpInner_t*) bp->root;
+    if (root->n == 0) {
+        bp->root = root->child[0];
+        --bp->height;
+        bpFreeOne_(bp, root);
+    }
+
+    return 1;
+}
+
+
+/// Fills an empty tree with sorted pairs: the leaves are filled evenly and the inner
+/// levels are built bottom-up, in linear time.
+/// \param data   - elements
+/// \param idx    - the order of the elements, NULL if 'data' itself is sorted
+/// \param size   - the number of elements
+/// \param unique - the number of distinct keys among them
+rbResult rb_bpBuild_ (struct bpTree_t* bp, const rbPair* data, const size_t* idx,
+                      size_t size, size_t unique) {
+
+    // the number of nodes on every level, from the leaves up
+    size_t levels[BP_MAX_HEIGHT + 1];
+    size_t total = 0;
+    int    height = 0;
+
+    levels[0] = (unique + BP_LEAF_CAP - 1) / BP_LEAF_CAP;
+    total = levels[0];
+    while (levels[height] > 1) {
+        levels[height + 1] = (levels[height] + BP_INNER_CAP) / (BP_INNER_CAP + 1);
+        total += levels[++height];
+    }
+
+    void**       nodes = (void**) malloc(total * sizeof(void*));
+    rb_key_type* mins  = (rb_key_type*) malloc(levels[0] * sizeof(rb_key_type));
+
+    if (nodes == NULL || mins == NULL) {
+        free(nodes);
+        free(mins);
+        return RB_LACK_OF_MEMORY;
+    }
+
+    for (size_t k = 0; k < total; ++k) {
+        nodes[k] = bpAllocNode_(bp);
+        if (nodes[k] == NULL) {
+            while (k-- > 0)
+                bpFreeOne_(bp, nodes[k]);
+            free(nodes);
+            free(mins);
+            return RB_LACK_OF_MEMORY;
+        }
+    }
+
+    // leaves: the first 'levels[0]' nodes, in key order
+    struct bpLeaf_t** leaves = (struct bpLeaf_t**) nodes;
+    size_t leaf = 0;
+    rbPair* last = NULL;
+
+    for (size_t k = 0; k < levels[0]; ++k) {
+        leaves[k]->n = 0;
+        leaves[k]->prev = k > 0 ? leaves[k - 1] : NULL;
+        leaves[k]->next = k + 1 < levels[0] ? leaves[k + 1] : NULL;
+    }
+
+    for (size_t k = 0; k < size; ++k) {
+        const rbPair* pair = idx ? &data[idx[k]] : &data[k];
+
+        if (last != NULL && last->key == pair->key) {
+            last->value = pair->value;
+            continue;
+        }
+
+        size_t quota = unique / levels[0] + (leaf < unique % levels[0]);
+        if ((size_t) leaves[leaf]->n == quota)
+            ++leaf;
+
+        last = &leaves[leaf]->pairs[leaves[leaf]->n++];
+        memcpy(last, pair, sizeof(rbPair));
+    }
+
+    for (size_t k = 0; k < levels[0]; ++k)
+        mins[k] = leaves[k]->pairs[0].key;
+
+    // inner levels: the children of a level are the nodes of the level below
+    void** below = nodes;
+    for (int h = 1; h <= height; ++h) {
+        void** level = below + levels[h - 1];
+        size_t child = 0;
+
+        for (size_t k = 0; k < levels[h]; ++k) {
+            struct bpInner_t* node = (struct bpInner_t*) level[k];
+            size_t kids = levels[h - 1] / levels[h] + (k < levels[h - 1] % levels[h]);
+
+            node->n = (int) kids - 1;
+            for (size_t c = 0; c < kids; ++c, ++child) {
+                node->child[c] = below[child];
+                if (c > 0)
+                    node->keys[c - 1] = mins[child];
+            }
+            mins[k] = mins[child - kids];
+        }
+
+        below = level;
+    }
+
+    bp->root   = below[0];
+    bp->height = height;
+    bp->first  = leaves[0];
+    bp->last   = leaves[levels[0] - 1];
+
+    free(nodes);
+    free(mins);
+    return RB_SUCCESS;
+}
+
+
+/// Prefetches a whole node of the B+ tree, one cache line after another.
+static void bpPrefetch_ (const void* node) {
+
+    for (size_t offset = 0; offset < BP_NODE_BYTES; offset += 64)
+        RB_PREFETCH((const char*) node + offset);
+}
+
+
+/// Interleaved descents of rbFindBatch. All leaves are at the same depth, so the
+/// lookups of a group go down level by level together.
+void rb_bpFindBatch_ (const struct bpTree_t* bp, const rb_key_type* keys, size_t n,
+                      rbPair** out) {
+
+    for (size_t base = 0; base < n; base += RB_BATCH_GROUP) {
+        size_t group = n - base < RB_BATCH_GROUP ? n - base : RB_BATCH_GROUP;
+        void*  cur[RB_BATCH_GROUP];
+
+        if (bp->root == NULL) {
+            for (size_t j = 0; j < group; ++j)
+                out[base + j] = NULL;
+            continue;
+        }
+
+        for (size_t j = 0; j < group; ++j)
+            cur[j] = bp->root;
+
+        for (int d = 0; d < bp->height; ++d) {
+            for (size_t j = 0; j < group; ++j) {
+                struct bpInner_t* in = (struct bpInner_t*) cur[j];
+                cur[j] = in->child[bpChildIndex_(in, keys[base + j])];
+                bpPrefetch_(cur[j]);
+            }
+        }
+
+        for (size_t j = 0; j < group; ++j) {
+            struct bpLeaf_t* leaf = (struct bpLeaf_t*) cur[j];
+            rb_key_type key = keys[base + j];
+            int i = bpPairIndex_(leaf, key, 0);
+
+            out[base + j] = (i < leaf->n && leaf->pairs[i].key == key) ? &leaf->pairs[i] : NULL;
+        }
+    }
+}
+
+
+/// rbSelect of the B+ tree: whole leaves are skipped.
+/// \param k - less than the number of pairs
+rbPair* rb_bpSelect_ (const struct bpTree_t* bp, size_t k) {
+
+    struct bpLeaf_t* leaf = bp->first;
+
+    while (k >= (size_t) leaf->n) {
+        k -= leaf->n;
+        leaf = leaf->next;
+    }
+
+    return &leaf->pairs[k];
+}
+
+
+/// rbRank of the B+ tree: whole leaves are counted at once.
+size_t rb_bpRank_ (const struct bpTree_t* bp, rb_key_type key) {
+
+    struct bpLeaf_t* leaf = bp->first;
+    size_t           rank = 0;
+
+    while (leaf != NULL && leaf->n > 0 && leaf->pairs[leaf->n - 1].key < key) {
+        rank += leaf->n;
+        leaf = leaf->next;
+    }
+
+    if (leaf != NULL)
+        rank += bpPairIndex_(leaf, key, 0);
+
+    return rank;
+}
+
+
+/// Writes a subtree of the B+ tree for rbDumpTo: in the text layout a line per node with
+/// the children indented one more, in DOT a record per node, in JSON the keys and the
+/// children of inner nodes and the pairs of leaves.
+/// \param ids - the number of DOT nodes named so far
+/// \return the DOT name (number) of the node.
+static int bpDump_ (struct rbWriter_t* w, void* node, int height, int indents,
+                    rbDumpFormat format, int* ids) {
+
+    int id = (*ids)++;
+
+    if (format == RB_DUMP_TEXT)
+        for (int i = 0; i < indents; ++i)
+            rb_wrText_(w, "    |");
+
+    if (node == NULL) {
+        if (format != RB_DUMP_DOT)
+            rb_wrText_(w, format == RB_DUMP_TEXT ? "EMPTY\n" : "null");
+        return id;
+    }
+
+    if (format == RB_DUMP_DOT) {
+        rb_wrText_(w, "  b");
+        rb_wrInt_(w, id);
+        rb_wrText_(w, " [label=\"");
+    }
+
+    if (height == 0) {
+        struct bpLeaf_t* leaf = (struct bpLeaf_t*) node;
+
+        rb_wrText_(w, format == RB_DUMP_TEXT ? "leaf:" : format == RB_DUMP_JSON ? "{\"pairs\": [" : "");
+
+        for (int i = 0; i < leaf->n; ++i) {
+            if (format == RB_DUMP_TEXT)
+                rb_wrText_(w, " [key: ");
+            else if (i != 0)
+                rb_wrText_(w, format == RB_DUMP_DOT ? "|" : ", ");
+
+            if (format == RB_DUMP_JSON)
+                rb_wrText_(w, "[");
+
+            rb_wrInt_(w, leaf->pairs[i].key);
+            rb_wrText_(w, format == RB_DUMP_TEXT ? ", value: " : format == RB_DUMP_DOT ? ":" : ", ");
+            rb_wrInt_(w, leaf->pairs[i].value);
+            rb_wrText_(w, format == RB_DUMP_TEXT ? "]" : format == RB_DUMP_DOT ? "" : "]");
+        }
+
+        rb_wrText_(w, format == RB_DUMP_TEXT ? "\n" : format == RB_DUMP_DOT ? "\"];\n" : "]}");
+        return id;
+    }
+
+    struct bpInner_t* in = (struct bpInner_t*) node;
+
+    rb_wrText_(w, format == RB_DUMP_TEXT ? "keys:" : format == RB_DUMP_JSON ? "{\"keys\": [" : "");
+
+    for (int i = 0; i < in->n; ++i) {
+        if (format == RB_DUMP_TEXT)
+            rb_wrText_(w, " ");
+        else if (i != 0)
+            rb_wrText_(w, format == RB_DUMP_DOT ? "|" : ", ");
+        rb_wrInt_(w, in->keys[i]);
+    }
+
+    rb_wrText_(w, format == RB_DUMP_TEXT ? "\n" : format == RB_DUMP_DOT ? "\"];\n" : "], \"children\": [");
+
+    for (int i = 0; i <= in->n; ++i) {
+        if (format == RB_DUMP_JSON && i != 0)
+            rb_wrText_(w, ", ");
+
+        int child = bpDump_(w, in->child[i], height - 1, indents + 1, format, ids);
+
+        if (format == RB_DUMP_DOT) {
+            rb_wrText_(w, "  b");
+            rb_wrInt_(w, id);
+            rb_wrText_(w, " -> b");
+            rb_wrInt_(w, child);
+            rb_wrText_(w, ";\n");
+        }
+    }
+
+    if (format == RB_DUMP_JSON)
+        rb_wrText_(w, "]}");
+
+    return id;
+}
+
+
+/// Writes the whole B+ tree for rbDumpTo, see bpDump_.
+void rb_bpDumpTree_ (struct rbWriter_t* w, const struct bpTree_t* bp, rbDumpFormat format) {
+
+    int ids = 0;
+    bpDump_(w, bp->root, bp->height, 0, format, &ids);
+}
+
+
+/// Replaces the B+ tree of the container with one built from the given pairs.
+/// \param pairs - pairs with distinct keys in key order
+/// \param size  - the number of pairs
+static rbResult bpRebuild_ (rbTree tree, const rbPair* pairs, size_t size)
+{
+    struct bpTree_t* bp = rb_bpCreate_();
+    if (bp == NULL)
+        return RB_LACK_OF_MEMORY;
+
+    if (size != 0) {
+        rbResult res = rb_bpBuild_(bp, pairs, NULL, size, size);
+        if (res != RB_SUCCESS) {
+            free(bp);
+            return res;
+        }
+    }
+
+    rb_bpClear_(tree->bplus);
+    free(tree->bplus);
+    tree->bplus = bp;
+    tree->size = size;
+    return RB_SUCCESS;
+}
+
+
+/// Merges elements in key order with the pairs of a B+ tree into a new B+ tree.
+rbResult rb_bpMergeInsert_ (rbTree tree, const rbPair* data, const size_t* idx, size_t n)
+{
+    rbPair* merged = (rbPair*) malloc((tree->size + n) * sizeof(rbPair));
+    if (merged == NULL)
+        return RB_LACK_OF_MEMORY;
+
+    size_t  w = 0;
+    rbPair* pair = rbBegin(tree);
+
+    for (size_t i = 0; i < n; ++i) {
+        const rbPair* cur = pairAt_(data, idx, i);
+
+        if (i + 1 < n && pairAt_(data, idx, i + 1)->key == cur->key)
+            continue;
+
+        for (; pair != NULL && pair->key < cur->key; pair = rb_bpNext_(pair))
+            memcpy(&merged[w++], pair, sizeof(rbPair));
+        if (pair != NULL && pair->key == cur->key)
+            pair = rb_bpNext_(pair);
+
+        memcpy(&merged[w++], cur, sizeof(rbPair));
+    }
+
+    for (; pair != NULL; pair = rb_bpNext_(pair))
+        memcpy(&merged[w++], pair, sizeof(rbPair));
+
+    rbResult res = bpRebuild_(tree, merged, w);
+    free(merged);
+    return res;
+}
+
+
+/// Builds a new B+ tree from the pairs whose keys are not among the sorted keys.
+rbResult rb_bpMergeErase_ (rbTree tree, const rb_key_type* keys, size_t n)
+{
+    rbPair* kept = (rbPair*) malloc((tree->size + 1) * sizeof(rbPair));
+    if (kept == NULL)
+        return RB_LACK_OF_MEMORY;
+
+    size_t w = 0;
+    size_t k = 0;
+
+    for (rbPair* pair = rbBegin(tree); pair != NULL; pair = rb_bpNext_(pair)) {
+        while (k < n && keys[k] < pair->key)
+            ++k;
+        if (k == n || keys[k] != pair->key)
+            memcpy(&kept[w++], pair, sizeof(rbPair));
+    }
+
+    rbResult res = bpRebuild_(tree, kept, w);
+    free(kept);
+    return res;
+}
+/***
+ *
+ *   end of B+ tree engine
+ *
+ ****************************************************************************************/
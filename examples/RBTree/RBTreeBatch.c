@@ -0,0 +1,331 @@
+/****************************************************************************************
+ *
+ *   RBTreeBatch.c
+ *
+ *   rbInsertBatch and rbEraseBatch: sorted batches merged into the tree, or the tree
+ *   rebuilt for large ones.
+ *
+ ***/
+#include "RBTreeInternal.h"
+
+#include <stdlib.h>
+
+
+/// rbInsertBatch and rbEraseBatch rebuild the tree for batches of at least
+/// 1/RB_BATCH_REBUILD of its size.
+#define RB_BATCH_REBUILD 8
+
+
+
+/****************************************************************************************
+ *
+ *   prototypes for helper functions
+ *
+ ***/
+static int      compareKeys_   (const void* a, const void* b);
+static rbResult insert_batch_  (rbTree tree, const rbPair* data, const size_t* idx, size_t n);
+static rbResult merge_insert_  (rbTree tree, const rbPair* data, const size_t* idx, size_t n);
+static rbResult erase_batch_   (rbTree tree, const rb_key_type* keys, size_t n, int rebuild);
+/***
+ *
+ *   end of prototypes for helper functions
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   Batch update functions
+ *
+ ***/
+
+//
+/// Batch updates
+///======================================================================================
+/// A batch is put in key order first (stable, so the last of equal keys wins). Then:
+///
+/// - a batch that is small next to the container is applied element by element in key
+///   order. Consecutive descents follow nearly the same path, so most of the nodes they
+///   touch are already in the cache;
+/// - a batch of at least 1/RB_BATCH_REBUILD of the container is merged with the
+///   container in one pass over its nodes in key order, and the nodes are relinked into
+///   a perfectly balanced tree, as rbCreate builds it. No rotations, and every node is
+///   visited once. The nodes themselves stay in place, so pointers to the pairs that
+///   remain stay valid. A B+ tree is built anew from the merged pairs.
+///======================================================================================
+///======================================================================================
+//
+rbResult rbInsertBatch (rbTree tree, const rbPair* data, size_t n)
+{
+    if (tree == NULL || (n != 0 && data == NULL))
+        return RB_INVALID_ARGS;
+
+    if (n == 0)
+        return RB_SUCCESS;
+
+    size_t* idx;
+    rbResult res = rb_sortPairs_(data, n, &idx);
+    if (res != RB_SUCCESS)
+        return res;
+
+    if (tree->sync == NULL)
+        res = insert_batch_(tree, data, idx, n);
+    else if ((res = rb_lockWriter_(tree, 0)) == RB_SUCCESS) {
+        res = insert_batch_(tree, data, idx, n);
+        rb_unlockWriter_(tree);
+    }
+
+    free(idx);
+    return res;
+}
+
+
+rbResult rbEraseBatch (rbTree tree, const rb_key_type* keys, size_t n)
+{
+    if (tree == NULL || (n != 0 && keys == NULL))
+        return RB_INVALID_ARGS;
+
+    if (n == 0)
+        return RB_SUCCESS;
+
+    rb_key_type* sorted = (rb_key_type*) malloc(n * sizeof(rb_key_type));
+    if (sorted == NULL)
+        return RB_LACK_OF_MEMORY;
+
+    memcpy(sorted, keys, n * sizeof(rb_key_type));
+    qsort(sorted, n, sizeof(rb_key_type), compareKeys_);
+
+    // The way is chosen before the lock is taken, to know how many subtrees to retire.
+    int rebuild = n * RB_BATCH_REBUILD >= RB_LOAD(tree->size);
+    rbResult res = RB_SUCCESS;
+
+    if (tree->sync == NULL)
+        res = erase_batch_(tree, sorted, n, rebuild);
+    else if ((res = rb_lockWriter_(tree, rebuild ? 1 : n)) == RB_SUCCESS) {
+        res = erase_batch_(tree, sorted, n, rebuild);
+        rb_unlockWriter_(tree);
+    }
+
+    free(sorted);
+    return res;
+}
+
+
+static int compareKeys_ (const void* a, const void* b) {
+
+    rb_key_type x = *(const rb_key_type*) a;
+    rb_key_type y = *(const rb_key_type*) b;
+
+    return (x > y) - (x < y);
+}
+
+
+/// Inserts elements in key order, see rbInsertBatch.
+/// \param tree - container, locked if concurrent
+/// \param data - elements
+/// \param idx  - the order of the elements, see rb_sortPairs_
+/// \param n    - the number of elements, not zero
+/// \return an enum member from rbResult
+static rbResult insert_batch_ (rbTree tree, const rbPair* data, const size_t* idx, size_t n)
+{
+    if (tree->engine == RB_ENGINE_BPLUS) {
+        if (n * RB_BATCH_REBUILD >= tree->size)
+            return rb_bpMergeInsert_(tree, data, idx, n);
+
+        for (size_t i = 0; i < n; ++i) {
+            int added;
+            rbResult res = rb_bpInsert_(tree->bplus, *pairAt_(data, idx, i), &added);
+            if (res != RB_SUCCESS)
+                return res;
+            tree->size += added;
+        }
+        return RB_SUCCESS;
+    }
+
+    // the nodes of a persistent tree may be shared, so they are never relinked
+    int persistent = tree->engine == RB_ENGINE_PERSISTENT;
+
+    if (!persistent && n * RB_BATCH_REBUILD >= tree->size)
+        return merge_insert_(tree, data, idx, n);
+
+    for (size_t i = 0; i < n; ++i) {
+        const rbPair* pair = pairAt_(data, idx, i);
+        rbResult res = persistent ? rb_psInsert_(tree, *pair) : rb_insert_pair_(tree, *pair);
+        if (res != RB_SUCCESS)
+            return res;
+    }
+
+    return RB_SUCCESS;
+}
+
+
+/// Merges elements in key order into a red-black tree and relinks all nodes into a
+/// balanced tree. Either all elements are inserted or, if there is no memory, none.
+static rbResult merge_insert_ (rbTree tree, const rbPair* data, const size_t* idx, size_t n)
+{
+    size_t unique = rb_countUnique_(data, idx, n);
+    size_t old    = tree->size;
+
+    // the nodes of the tree go to the tail, the merged sequence is written from the head
+    rbNode* nodes = (rbNode*) malloc((old + unique) * sizeof(rbNode));
+    if (nodes == NULL)
+        return RB_LACK_OF_MEMORY;
+
+    rbNode* tail = nodes + unique;
+    size_t  o = 0;
+    rbNode first = old ? rb_findMin(tree->treeRoot) : NULL;
+    for (rbNode node = first; node; node = rb_successor_(node))
+        tail[o++] = node;
+
+    // the keys not in the tree yet get new nodes before anything changes
+    size_t added = 0;
+    o = 0;
+    for (size_t i = 0; i < n; ++i) {
+        rb_key_type key = pairAt_(data, idx, i)->key;
+
+        if (i + 1 < n && pairAt_(data, idx, i + 1)->key == key)
+            continue;
+        while (o < old && tail[o]->pair.key < key)
+            ++o;
+        added += o == old || tail[o]->pair.key != key;
+    }
+
+    rbNode* fresh = (rbNode*) malloc((added ? added : 1) * sizeof(rbNode));
+    size_t  made  = 0;
+
+    while (fresh != NULL && made < added && (fresh[made] = rb_allocNode_(tree)) != NULL)
+        ++made;
+
+    if (fresh == NULL || made < added) {
+        while (made > 0)
+            rb_releaseNode_(tree, fresh[--made]);
+        free(fresh);
+        free(nodes);
+        return RB_LACK_OF_MEMORY;
+    }
+
+    if (tree->sync != NULL)
+        rb_beginChange_(tree->sync);
+
+    size_t w = 0;
+    size_t f = 0;
+    o = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        const rbPair* pair = pairAt_(data, idx, i);
+
+        if (i + 1 < n && pairAt_(data, idx, i + 1)->key == pair->key)
+            continue;
+
+        while (o < old && tail[o]->pair.key < pair->key)
+            nodes[w++] = tail[o++];
+
+        if (o < old && tail[o]->pair.key == pair->key) {
+            RB_STORE(tail[o]->pair.value, pair->value);
+            nodes[w++] = tail[o++];
+        }
+        else {
+            rbNode node = fresh[f++];
+            *((rb_key_type*)&node->pair.key) = pair->key;
+            node->pair.value = pair->value;
+            nodes[w++] = node;
+        }
+    }
+
+    while (o < old)
+        nodes[w++] = tail[o++];
+
+    RB_STORE(tree->treeRoot, rb_relink_(nodes, w, NULL, 0, rb_redDepth_(w)));
+    RB_STORE(tree->size, w);
+
+    if (tree->sync != NULL)
+        rb_endChange_(tree->sync);
+
+    free(fresh);
+    free(nodes);
+    return RB_SUCCESS;
+}
+
+
+/// Erases sorted keys, see rbEraseBatch.
+/// \param tree    - container, locked if concurrent
+/// \param keys    - sorted keys
+/// \param n       - the number of keys, not zero
+/// \param rebuild - non-zero to merge the keys with the tree instead of erasing them
+///                  one by one
+/// \return an enum member from rbResult
+static rbResult erase_batch_ (rbTree tree, const rb_key_type* keys, size_t n, int rebuild)
+{
+    if (tree->engine == RB_ENGINE_BPLUS) {
+        // a new B+ tree needs memory; if there is none, the keys are erased one by one
+        if (!rebuild || rb_bpMergeErase_(tree, keys, n) != RB_SUCCESS)
+            for (size_t i = 0; i < n; ++i)
+                tree->size -= rb_bpErase_(tree->bplus, keys[i]);
+        return RB_SUCCESS;
+    }
+
+    // the nodes of a persistent tree may be shared, so they are never relinked
+    if (tree->engine == RB_ENGINE_PERSISTENT) {
+        for (size_t i = 0; i < n; ++i) {
+            rbResult res = rb_psErase_(tree, keys[i]);
+            if (res != RB_SUCCESS)
+                return res;
+        }
+        return RB_SUCCESS;
+    }
+
+    rbNode* nodes = rebuild ? (rbNode*) malloc((tree->size + 1) * sizeof(rbNode)) : NULL;
+
+    if (nodes == NULL) {
+        for (size_t i = 0; i < n; ++i)
+            rb_erase_key_(tree, keys[i]);
+        return RB_SUCCESS;
+    }
+
+    // the nodes that stay are packed at the head, the erased ones at the tail
+    size_t kept = 0;
+    size_t gone = tree->size;
+    size_t k = 0;
+
+    rbNode node = tree->size ? rb_findMin(tree->treeRoot) : NULL;
+
+    for (; node != NULL; node = rb_successor_(node)) {
+        while (k < n && keys[k] < node->pair.key)
+            ++k;
+
+        if (k < n && keys[k] == node->pair.key)
+            nodes[--gone] = node;
+        else
+            nodes[kept++] = node;
+    }
+
+    size_t erased = tree->size - gone;
+
+    if (tree->sync != NULL)
+        rb_beginChange_(tree->sync);
+
+    RB_STORE(tree->treeRoot, rb_relink_(nodes, kept, NULL, 0, rb_redDepth_(kept ? kept : 1)));
+    RB_STORE(tree->size, kept);
+
+    // Readers may still walk the erased nodes. They are linked into a subtree of their
+    // own (the colors do not matter) and retired as a whole.
+    rbNode garbage = rb_relink_(nodes + gone, erased, NULL, 0, -1);
+
+    if (tree->sync != NULL) {
+        rb_endChange_(tree->sync);
+        if (garbage != NULL)
+            rb_retire_(tree, garbage, erased);
+    }
+    else
+        rb_deleteTree(tree, garbage);
+
+    free(nodes);
+    return RB_SUCCESS;
+}
+/***
+ *
+ *   end of Batch update functions
+ *
+ ****************************************************************************************/
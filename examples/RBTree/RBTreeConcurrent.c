@@ -0,0 +1,452 @@
+/****************************************************************************************
+ *
+ *   RBTreeConcurrent.c
+ *
+ *   The concurrent container of rbCreateConcurrent: readers that take no lock and are
+ *   validated by a sequence lock, one writer at a time, and the epochs that keep retired
+ *   nodes alive while readers may still see them.
+ *
+ ***/
+#include "RBTreeInternal.h"
+
+#include <sched.h>
+
+
+/// The number of retired nodes after which a writer tries to release them.
+#define RB_RETIRE_BATCH 64
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RB_PAUSE() __builtin_ia32_pause()
+#else
+#define RB_PAUSE() ((void) 0)
+#endif
+
+
+
+/****************************************************************************************
+ *
+ *   prototypes for helper functions
+ *
+ ***/
+struct rbReader_t;
+struct rbLimbo_t;
+
+static struct rbReader_t* acquireReader_   (void);
+static void               releaseReader_   (void* slot);
+static void               createReaderKey_ (void);
+static rbNode             descend_         (rbTree tree, rbNode node, rb_key_type key,
+                                            enum rbSeek_t mode);
+static void               tryAdvance_      (void);
+static void               flushLimbo_      (rbTree tree, struct rbLimbo_t* limbo);
+/***
+ *
+ *   end of prototypes for helper functions
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   Concurrency functions
+ *
+ ***/
+
+//
+/// Concurrent access
+///======================================================================================
+/// Writers are serialized by a mutex. While a writer changes the shape of the tree it
+/// keeps the sequence counter of the container odd (a seqlock). A reader notes the
+/// counter, descends without any lock and accepts the result only if the counter is
+/// unchanged afterwards; otherwise the descent is repeated. A reader that finds the
+/// counter odd waits for the writer to finish, so readers are not lock-free: a writer
+/// stopped in the middle of a change holds them up. A descent that
+/// overlaps a rotation may take a wrong turn, but it always walks through nodes that
+/// were linked in the tree not long ago: readers use only the 'left' and 'right'
+/// links, and keys of nodes never change.
+///
+/// That needs the nodes to stay allocated while a reader can hold them, which is what
+/// the epochs are for. All concurrent containers share a global epoch and a table of
+/// reader slots. A thread in a read section publishes in its slot the epoch it saw on
+/// entry. An erased node (or a whole cleared tree) is put in the limbo list of the
+/// current epoch. A writer moves the global epoch forward only when every active reader
+/// has seen the current one. So once the epoch has advanced twice since a node was
+/// retired, no reader can hold it and the node is released for real.
+///
+/// A thread keeps its slot from its first read section until it exits. When all
+/// RB_MAX_READERS slots are taken, rb_readEnter_ fails; rb_readSeek_ then reads under
+/// the writer lock instead.
+///======================================================================================
+///======================================================================================
+//
+struct rbReader_t {
+    _Alignas(64) atomic_size_t epoch; // the epoch seen on entry, 0 outside a read section
+    atomic_int                 taken; // non-zero while the slot belongs to a thread
+};
+
+struct rbLimbo_t {
+    size_t  epoch;     // the global epoch in which the entries were retired
+    rbNode* entries;   // roots of detached subtrees
+    size_t  count;
+    size_t  capacity;
+    size_t  nodes;     // the number of nodes in all subtrees
+};
+
+struct rbSync_t {
+    pthread_mutex_t  writer;
+    atomic_size_t    seq;       // odd while a writer changes the tree
+    struct rbLimbo_t limbo[3];  // indexed by epoch % 3
+    size_t           pending;   // retired nodes not released yet
+};
+
+
+static struct rbReader_t readers_[RB_MAX_READERS];
+static atomic_size_t     epoch_ = 1;
+
+static pthread_once_t    readerOnce_ = PTHREAD_ONCE_INIT;
+static pthread_key_t     readerKey_;
+
+static _Thread_local struct rbReader_t* self_;  // the slot of the calling thread
+static _Thread_local unsigned           depth_; // nesting of its read sections
+
+
+rbResult rbCreateConcurrent (const rbPair* data, size_t size, rbTree* tree)
+{
+    rbResult res = rb_create_(data, size, 0, 0, RB_ENGINE_REDBLACK, tree);
+    if (res != RB_SUCCESS)
+        return res;
+
+    struct rbSync_t* sync = (struct rbSync_t*) calloc(1, sizeof(struct rbSync_t));
+
+    if (sync == NULL || pthread_mutex_init(&sync->writer, NULL) != 0) {
+        free(sync);
+        rbDestroy(*tree);
+        return RB_LACK_OF_MEMORY;
+    }
+
+    atomic_init(&sync->seq, 0);
+    (*tree)->sync = sync;
+    return RB_SUCCESS;
+}
+
+
+rbResult rbReadBegin (rbTree tree)
+{
+    if (tree == NULL)
+        return RB_INVALID_ARGS;
+
+    return rb_readEnter_();
+}
+
+
+rbResult rbReadEnd (rbTree tree)
+{
+    if (tree == NULL || depth_ == 0)
+        return RB_INVALID_ARGS;
+
+    rb_readExit_();
+    return RB_SUCCESS;
+}
+
+
+/// Frees the limbo lists and the lock of a container that nobody else uses any more.
+void rb_destroySync_ (rbTree tree) {
+
+    struct rbSync_t* sync = tree->sync;
+
+    for (int i = 0; i < 3; ++i) {
+        flushLimbo_(tree, &sync->limbo[i]);
+        free(sync->limbo[i].entries);
+    }
+
+    pthread_mutex_destroy(&sync->writer);
+    free(sync);
+    tree->sync = NULL;
+}
+
+
+/// Gives the reader slot back when its thread exits.
+static void releaseReader_ (void* slot) {
+
+    atomic_store(&((struct rbReader_t*) slot)->taken, 0);
+}
+
+
+static void createReaderKey_ (void) {
+
+    pthread_key_create(&readerKey_, releaseReader_);
+}
+
+
+/// Takes a free reader slot for the calling thread.
+/// \return the slot or NULL if all RB_MAX_READERS slots are taken.
+static struct rbReader_t* acquireReader_ (void) {
+
+    pthread_once(&readerOnce_, createReaderKey_);
+
+    for (int i = 0; i < RB_MAX_READERS; ++i) {
+        int expected = 0;
+
+        if (atomic_load_explicit(&readers_[i].taken, memory_order_relaxed) == 0 &&
+            atomic_compare_exchange_strong(&readers_[i].taken, &expected, 1)) {
+            pthread_setspecific(readerKey_, &readers_[i]);
+            return &readers_[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/// Enters a read section: the nodes the thread can reach are not released until it
+/// leaves the outermost section.
+/// \return RB_SUCCESS, or RB_LACK_OF_MEMORY if the thread has no reader slot and all
+///         are taken; the thread is not in a read section then.
+rbResult rb_readEnter_ (void) {
+
+    if (depth_ != 0) {
+        ++depth_;
+        return RB_SUCCESS;
+    }
+
+    if (self_ == NULL && (self_ = acquireReader_()) == NULL)
+        return RB_LACK_OF_MEMORY;
+
+    depth_ = 1;
+
+    // The slot must be visible to writers before the first node is read: a sequentially
+    // consistent exchange is ordered with the loads of the slots in tryAdvance_.
+    atomic_exchange(&self_->epoch, atomic_load(&epoch_));
+    return RB_SUCCESS;
+}
+
+
+void rb_readExit_ (void) {
+
+    if (--depth_ == 0)
+        atomic_store_explicit(&self_->epoch, 0, memory_order_release);
+}
+
+
+/// Finds a node the way 'mode' says, repeating the descent until no writer interferes
+/// with it: while a writer is in the middle of a change, the reader waits for it. The
+/// caller must be in a read section.
+/// \param tree - concurrent container
+/// \param key  - the key or the bound, unused for RB_SEEK_FIRST and RB_SEEK_LAST
+/// \param mode - what to look for
+/// \return pointer to the node or NULL if there is no such node.
+rbNode rb_seek_ (rbTree tree, rb_key_type key, enum rbSeek_t mode) {
+
+    struct rbSync_t* sync = tree->sync;
+
+    for (unsigned spins = 0;; ++spins) {
+
+        size_t seq = atomic_load_explicit(&sync->seq, memory_order_acquire);
+
+        if (seq & 1) {
+            // a writer is in the middle of a change, and it may be off the CPU
+            if (spins % 64 == 63)
+                sched_yield();
+            else
+                RB_PAUSE();
+            continue;
+        }
+
+        rbNode res = descend_(tree, RB_LOAD(tree->treeRoot), key, mode);
+
+        // The links were loaded with acquire, so this load is not done before them. If
+        // one of them was stored by a change, it sees the counter that change made odd.
+        if (atomic_load_explicit(&sync->seq, memory_order_acquire) == seq)
+            return res;
+    }
+}
+
+
+/// Descends from the given node to the node rb_seek_ looks for. The links are read as
+/// they may change meanwhile, and a descent longer than any red-black tree is cut off.
+/// \return the node or NULL if there is none.
+static rbNode descend_ (rbTree tree, rbNode node, rb_key_type key, enum rbSeek_t mode) {
+
+    rbNode res   = NULL;
+    int    depth = 0;
+
+    while (node != NULL && depth < RB_MAX_DEPTH) {
+
+        rb_key_type k = node->pair.key;
+        int take, left;
+
+        ++depth;
+
+        switch (mode) {
+        case RB_SEEK_EQUAL: take = k == key; left = k > key; break;
+        case RB_SEEK_LOWER: take = left = k >= key;          break;
+        case RB_SEEK_UPPER: take = left = k > key;           break;
+        case RB_SEEK_BELOW: take = k < key;  left = !take;   break;
+        case RB_SEEK_FIRST: take = left = 1;                 break;
+        default:            take = 1;        left = 0;       break;
+        }
+
+        if (take) {
+            res = node;
+            if (mode == RB_SEEK_EQUAL)
+                break;
+        }
+
+        node = left ? RB_LOAD(node->left) : RB_LOAD(node->right);
+    }
+
+    RB_COUNT_DESCENT(tree, depth);
+    return res;
+}
+
+
+/// rb_seek_ in its own read section, for the interface functions. The nodes of a
+/// persistent tree are not shared with writers of the same version, so a plain descent
+/// is enough for them, as it is under the writer lock for a thread without a reader
+/// slot.
+rbPair* rb_readSeek_ (rbTree tree, rb_key_type key, enum rbSeek_t mode) {
+
+    rbNode node;
+
+    if (tree->sync == NULL)
+        node = descend_(tree, tree->treeRoot, key, mode);
+    else if (rb_readEnter_() == RB_SUCCESS) {
+        node = rb_seek_(tree, key, mode);
+        rb_readExit_();
+    }
+    else {
+        pthread_mutex_lock(&tree->sync->writer);
+        node = descend_(tree, tree->treeRoot, key, mode);
+        pthread_mutex_unlock(&tree->sync->writer);
+    }
+
+    return node ? &node->pair : NULL;
+}
+
+
+/// Takes the writer lock of the container. Every limbo list must have room for the
+/// subtrees the writer is going to retire, so that nothing can fail in the middle of a
+/// change.
+/// \param tree   - concurrent container
+/// \param retire - the largest number of subtrees the writer may retire
+/// \return an enum member from rbResult, the lock is not held on failure.
+rbResult rb_lockWriter_ (rbTree tree, size_t retire) {
+
+    struct rbSync_t* sync = tree->sync;
+
+    pthread_mutex_lock(&sync->writer);
+
+    for (int i = 0; i < 3; ++i) {
+        struct rbLimbo_t* limbo = &sync->limbo[i];
+
+        if (limbo->capacity - limbo->count >= retire)
+            continue;
+
+        size_t capacity = limbo->capacity ? 2 * limbo->capacity : RB_RETIRE_BATCH;
+        if (capacity < limbo->count + retire)
+            capacity = limbo->count + retire;
+
+        rbNode* entries = (rbNode*) realloc(limbo->entries, capacity * sizeof(rbNode));
+
+        if (entries == NULL) {
+            pthread_mutex_unlock(&sync->writer);
+            return RB_LACK_OF_MEMORY;
+        }
+
+        limbo->entries = entries;
+        limbo->capacity = capacity;
+    }
+
+    return RB_SUCCESS;
+}
+
+
+/// Releases what became safe to release and the writer lock.
+void rb_unlockWriter_ (rbTree tree) {
+
+    struct rbSync_t* sync = tree->sync;
+
+    if (sync->pending >= RB_RETIRE_BATCH) {
+        tryAdvance_();
+
+        size_t epoch = atomic_load(&epoch_);
+
+        for (int i = 0; i < 3; ++i)
+            if (sync->limbo[i].count != 0 && sync->limbo[i].epoch + 2 <= epoch)
+                flushLimbo_(tree, &sync->limbo[i]);
+    }
+
+    pthread_mutex_unlock(&sync->writer);
+}
+
+
+/// Makes the sequence counter odd before the writer touches links of the tree. The
+/// links are stored with release after it, so a reader that loads one of them sees the
+/// odd counter when it checks it again (see rb_seek_).
+void rb_beginChange_ (struct rbSync_t* sync) {
+
+    atomic_fetch_add_explicit(&sync->seq, 1, memory_order_acq_rel);
+}
+
+
+/// Makes the sequence counter even again, after the writer's changes of the links.
+void rb_endChange_ (struct rbSync_t* sync) {
+
+    atomic_fetch_add_explicit(&sync->seq, 1, memory_order_release);
+}
+
+
+/// Moves the global epoch forward if every active reader has seen the current one.
+static void tryAdvance_ (void) {
+
+    size_t epoch = atomic_load(&epoch_);
+
+    for (int i = 0; i < RB_MAX_READERS; ++i) {
+        size_t seen = atomic_load(&readers_[i].epoch);
+        if (seen != 0 && seen != epoch)
+            return;
+    }
+
+    atomic_compare_exchange_strong(&epoch_, &epoch, epoch + 1);
+}
+
+
+/// Puts a subtree detached from the tree in the limbo list of the current epoch.
+/// rb_lockWriter_ has made room for it.
+/// \param tree  - concurrent container
+/// \param root  - the root of the subtree
+/// \param nodes - the number of nodes in the subtree
+void rb_retire_ (rbTree tree, rbNode root, size_t nodes) {
+
+    struct rbSync_t*  sync  = tree->sync;
+    size_t            epoch = atomic_load(&epoch_);
+    struct rbLimbo_t* limbo = &sync->limbo[epoch % 3];
+
+    // The list of an older epoch with the same index is at least three epochs old.
+    if (limbo->epoch != epoch) {
+        flushLimbo_(tree, limbo);
+        limbo->epoch = epoch;
+    }
+
+    limbo->entries[limbo->count++] = root;
+    limbo->nodes += nodes;
+    sync->pending += nodes;
+}
+
+
+/// Releases all subtrees of the limbo list.
+static void flushLimbo_ (rbTree tree, struct rbLimbo_t* limbo) {
+
+    for (size_t i = 0; i < limbo->count; ++i)
+        rb_deleteTree(tree, limbo->entries[i]);
+
+    tree->sync->pending -= limbo->nodes;
+    limbo->count = 0;
+    limbo->nodes = 0;
+}
+/***
+ *
+ *   end of Concurrency functions
+ *
+ ****************************************************************************************/
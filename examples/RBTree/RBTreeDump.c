@@ -0,0 +1,304 @@
+/****************************************************************************************
+ *
+ *   RBTreeDump.c
+ *
+ *   rbDumpTo: the tree as indented text, Graphviz dot or JSON, through a buffered
+ *   writer.
+ *
+ ***/
+#include "RBTreeInternal.h"
+
+#include <stdio.h>
+
+
+
+/****************************************************************************************
+ *
+ *   prototypes for helper functions
+ *
+ ***/
+static void dumpText_ (struct rbWriter_t* w, rbNode root);
+static void dumpDot_  (struct rbWriter_t* w, rbNode root);
+static void dumpJson_ (struct rbWriter_t* w, rbNode root);
+static void wrFlush_  (struct rbWriter_t* w);
+static void wrBytes_  (struct rbWriter_t* w, const char* bytes, size_t len);
+/***
+ *
+ *   end of prototypes for helper functions
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   dump functions
+ *
+ ***/
+
+//
+/// Dumps
+///======================================================================================
+/// rbDumpTo formats the tree itself: the output is collected in a buffer of
+/// RB_DUMP_BUFFER bytes that goes to the file with one fwrite when it is full, and the
+/// numbers are converted by hand rather than by printf. The red-black walks keep their
+/// pending nodes on a stack of RB_MAX_DEPTH entries, so a tree of any size is dumped
+/// without recursion.
+///======================================================================================
+///======================================================================================
+//
+#define RB_DUMP_BUFFER (1 << 16)
+
+struct rbWriter_t {
+    FILE*  file;
+    size_t used;     // the number of bytes in the buffer
+    int    failed;   // non-zero once a write has failed
+    char   buf[RB_DUMP_BUFFER];
+};
+
+
+rbResult rbDump (rbTree tree) {
+
+    return rbDumpTo(tree, stdout, RB_DUMP_TEXT);
+}
+
+
+rbResult rbDumpTo (rbTree tree, FILE* file, rbDumpFormat format) {
+
+    if (tree == NULL || file == NULL ||
+        (format != RB_DUMP_TEXT && format != RB_DUMP_DOT && format != RB_DUMP_JSON))
+        return RB_INVALID_ARGS;
+
+    struct rbWriter_t* w = (struct rbWriter_t*) malloc(sizeof(struct rbWriter_t));
+    if (w == NULL)
+        return RB_LACK_OF_MEMORY;
+
+    w->file = file;
+    w->used = 0;
+    w->failed = 0;
+
+    int bplus = tree->engine == RB_ENGINE_BPLUS;
+
+    if (format == RB_DUMP_DOT)
+        rb_wrText_(w, bplus ? "digraph rbTree {\n  node [shape=record];\n"
+                         : "digraph rbTree {\n  node [shape=circle, style=filled, fontcolor=white];\n");
+    else if (format == RB_DUMP_JSON) {
+        rb_wrText_(w, bplus ? "{\"engine\": \"B+\", \"size\": " : "{\"engine\": \"red-black\", \"size\": ");
+        rb_wrInt_(w, (long long) tree->size);
+        rb_wrText_(w, ", \"root\": ");
+    }
+
+    if (bplus)
+        rb_bpDumpTree_(w, tree->bplus, format);
+    else if (format == RB_DUMP_TEXT)
+        dumpText_(w, tree->treeRoot);
+    else if (format == RB_DUMP_DOT)
+        dumpDot_(w, tree->treeRoot);
+    else
+        dumpJson_(w, tree->treeRoot);
+
+    if (format != RB_DUMP_TEXT)
+        rb_wrText_(w, "}\n");
+
+    wrFlush_(w);
+    if (fflush(file) != 0)
+        w->failed = 1;
+
+    rbResult res = w->failed ? RB_IO_ERROR : RB_SUCCESS;
+    free(w);
+    return res;
+}
+
+
+/// Writes the tree in the layout of rbDump: every node, then its children indented one
+/// more, "NULL(B)" for a missing child. The walk keeps the pending nodes on a stack of
+/// its own, at most one per level.
+static void dumpText_ (struct rbWriter_t* w, rbNode root) {
+
+    struct { rbNode node; int depth; } stack[RB_MAX_DEPTH + 2];
+    int  n = 0;
+    char indents[5 * (RB_MAX_DEPTH + 2)];
+
+    for (size_t i = 0; i < sizeof(indents); i += 5)
+        memcpy(indents + i, "    |", 5);
+
+    stack[n].node = root;
+    stack[n++].depth = 0;
+
+    while (n > 0) {
+        rbNode node  = stack[--n].node;
+        int    depth = stack[n].depth;
+
+        wrBytes_(w, indents, 5 * (size_t) depth);
+
+        if (node == NULL) {
+            rb_wrText_(w, "NULL(B)\n");
+            continue;
+        }
+
+        rb_wrText_(w, "[key: ");
+        rb_wrInt_(w, node->pair.key);
+        rb_wrText_(w, ", value: ");
+        rb_wrInt_(w, node->pair.value);
+        rb_wrText_(w, node->color == RED ? "](R)\n" : "](B)\n");
+
+        stack[n].node = node->right;
+        stack[n++].depth = depth + 1;
+        stack[n].node = node->left;
+        stack[n++].depth = depth + 1;
+    }
+}
+
+
+/// Writes the nodes and edges of a Graphviz digraph. Nodes are named by their keys; a
+/// node with one child gets a point for the other, so left and right stay apart.
+static void dumpDot_ (struct rbWriter_t* w, rbNode root) {
+
+    rbNode stack[RB_MAX_DEPTH + 2];
+    int    n = 0;
+
+    if (root != NULL)
+        stack[n++] = root;
+
+    while (n > 0) {
+        rbNode node = stack[--n];
+
+        rb_wrText_(w, "  \"");
+        rb_wrInt_(w, node->pair.key);
+        rb_wrText_(w, "\" [label=\"");
+        rb_wrInt_(w, node->pair.key);
+        rb_wrText_(w, "\\n");
+        rb_wrInt_(w, node->pair.value);
+        rb_wrText_(w, node->color == RED ? "\", fillcolor=red];\n" : "\", fillcolor=black];\n");
+
+        for (int side = 0; side < 2; ++side) {
+            rbNode child = side ? node->right : node->left;
+
+            if (child == NULL && (node->left == NULL) == (node->right == NULL))
+                continue;
+
+            rb_wrText_(w, "  \"");
+            rb_wrInt_(w, node->pair.key);
+            rb_wrText_(w, "\" -> \"");
+
+            if (child == NULL) {
+                rb_wrText_(w, "nil");
+                rb_wrInt_(w, node->pair.key);
+                rb_wrText_(w, "\";\n  \"nil");
+                rb_wrInt_(w, node->pair.key);
+                rb_wrText_(w, "\" [shape=point];\n");
+                continue;
+            }
+
+            rb_wrInt_(w, child->pair.key);
+            rb_wrText_(w, "\";\n");
+        }
+
+        if (node->right != NULL)
+            stack[n++] = node->right;
+        if (node->left != NULL)
+            stack[n++] = node->left;
+    }
+}
+
+
+/// Writes the tree as nested JSON objects, null for a missing child. Each node on the
+/// stack remembers which of its parts is written next.
+static void dumpJson_ (struct rbWriter_t* w, rbNode root) {
+
+    struct { rbNode node; int part; } stack[RB_MAX_DEPTH + 2];
+    int n = 0;
+
+    stack[n].node = root;
+    stack[n++].part = 0;
+
+    while (n > 0) {
+        rbNode node = stack[n - 1].node;
+
+        if (node == NULL) {
+            rb_wrText_(w, "null");
+            --n;
+            continue;
+        }
+
+        switch (stack[n - 1].part++) {
+        case 0:
+            rb_wrText_(w, "{\"key\": ");
+            rb_wrInt_(w, node->pair.key);
+            rb_wrText_(w, ", \"value\": ");
+            rb_wrInt_(w, node->pair.value);
+            rb_wrText_(w, node->color == RED ? ", \"color\": \"red\", \"left\": "
+                                          : ", \"color\": \"black\", \"left\": ");
+            stack[n].node = node->left;
+            stack[n++].part = 0;
+            break;
+        case 1:
+            rb_wrText_(w, ", \"right\": ");
+            stack[n].node = node->right;
+            stack[n++].part = 0;
+            break;
+        default:
+            rb_wrText_(w, "}");
+            --n;
+            break;
+        }
+    }
+}
+
+
+/// Writes the buffered output to the file.
+static void wrFlush_ (struct rbWriter_t* w) {
+
+    if (w->used != 0 && fwrite(w->buf, 1, w->used, w->file) != w->used)
+        w->failed = 1;
+
+    w->used = 0;
+}
+
+
+/// Appends a short string to the output.
+void rb_wrText_ (struct rbWriter_t* w, const char* text) {
+
+    wrBytes_(w, text, strlen(text));
+}
+
+
+/// Appends bytes to the output, no more than the buffer holds.
+static void wrBytes_ (struct rbWriter_t* w, const char* bytes, size_t len) {
+
+    if (w->used + len > sizeof(w->buf))
+        wrFlush_(w);
+
+    memcpy(w->buf + w->used, bytes, len);
+    w->used += len;
+}
+
+
+/// Appends a number in decimal to the output, without going through printf.
+void rb_wrInt_ (struct rbWriter_t* w, long long value) {
+
+    unsigned long long rest = value < 0 ? 0ull - (unsigned long long) value
+                                        : (unsigned long long) value;
+    char digits[24];
+    int  n = 0;
+
+    do {
+        digits[n++] = (char) ('0' + rest % 10);
+        rest /= 10;
+    } while (rest != 0);
+
+    if (value < 0)
+        digits[n++] = '-';
+
+    if (w->used + (size_t) n > sizeof(w->buf))
+        wrFlush_(w);
+
+    while (n > 0)
+        w->buf[w->used++] = digits[--n];
+}
+/***
+ *
+ *   end of dump functions
+ *
+ ****************************************************************************************/
@@ -0,0 +1,363 @@
+/****************************************************************************************
+ *
+ *   RBTreeFile.c
+ *
+ *   rbSave, rbLoad and rbFrozenLoad: snapshot files of the pairs with a header and a
+ *   checksum, read through mmap.
+ *
+ ***/
+#include "RBTreeInternal.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+/****************************************************************************************
+ *
+ *   prototypes for helper functions
+ *
+ ***/
+struct rbFileHeader_t;
+
+static rbResult mapFile_   (const char* path, const struct rbFileHeader_t** header,
+                            size_t* bytes);
+static uint64_t checksum_  (uint64_t hash, const void* data, size_t bytes);
+static rbResult writePairs_(rbTree tree, FILE* file, struct rbFileHeader_t* header);
+/***
+ *
+ *   end of prototypes for helper functions
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   Snapshot file functions
+ *
+ ***/
+
+//
+/// Snapshot file
+///======================================================================================
+/// A header followed by the pairs in key order, as they lie in memory:
+///
+///     struct rbFileHeader_t | pair 0 | pair 1 | ... | pair count - 1
+///
+/// The header records the format version, the byte order and the sizes of the key and
+/// of the pair of the saving machine, so a file from another build is rejected rather
+/// than misread, and a checksum of the pairs. A file is written next to the target, under
+/// a unique name from mkstemp, and renamed over it: a crash while saving leaves the
+/// previous snapshot intact, and threads or processes saving to the same path at once
+/// do not write into one another's files.
+///
+/// rbLoad maps the file and copies the pairs straight into one slab of nodes, verifying
+/// the checksum and the key order on the way; the nodes are then linked as rbCreate
+/// links them. Both passes go over the memory in order, so the load runs at the speed
+/// of a sequential read. rbFrozenLoad puts the pairs into the search layout of a frozen
+/// snapshot instead, without creating nodes at all.
+///======================================================================================
+///======================================================================================
+//
+#define RB_FILE_MAGIC      "RBTS"
+#define RB_FILE_VERSION    1
+#define RB_FILE_BYTE_ORDER 0x01020304u
+/// The number of pairs written or verified at once.
+#define RB_FILE_CHUNK      4096
+
+struct rbFileHeader_t {
+    char     magic[4];  // RB_FILE_MAGIC
+    uint32_t version;   // RB_FILE_VERSION
+    uint32_t byteOrder; // RB_FILE_BYTE_ORDER, as stored by the saving machine
+    uint16_t keyBytes;  // sizeof(rb_key_type)
+    uint16_t pairBytes; // sizeof(rbPair)
+    uint64_t count;     // the number of pairs
+    uint64_t checksum;  // of the pairs, see checksum_
+};
+
+
+rbResult rbSave (rbTree tree, const char* path)
+{
+    if (tree == NULL || path == NULL)
+        return RB_INVALID_ARGS;
+
+    size_t length = strlen(path);
+    char*  temp   = (char*) malloc(length + sizeof(".XXXXXX"));
+    if (temp == NULL)
+        return RB_LACK_OF_MEMORY;
+
+    memcpy(temp, path, length);
+    memcpy(temp + length, ".XXXXXX", sizeof(".XXXXXX"));
+
+    struct rbFileHeader_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RB_FILE_MAGIC, sizeof(header.magic));
+    header.version   = RB_FILE_VERSION;
+    header.byteOrder = RB_FILE_BYTE_ORDER;
+    header.keyBytes  = sizeof(rb_key_type);
+    header.pairBytes = sizeof(rbPair);
+
+    rbResult res  = RB_IO_ERROR;
+    int      fd   = mkstemp(temp);
+    FILE*    file = fd != -1 ? fdopen(fd, "wb") : NULL;
+
+    if (fd != -1 && file == NULL) {
+        close(fd);
+        remove(temp);
+    }
+
+    if (file != NULL) {
+        // the header is written again when the count and the checksum are known
+        if (fwrite(&header, sizeof(header), 1, file) == 1)
+            res = writePairs_(tree, file, &header);
+
+        if (res == RB_SUCCESS && (fseek(file, 0, SEEK_SET) != 0 ||
+                                  fwrite(&header, sizeof(header), 1, file) != 1 ||
+                                  fflush(file) != 0 || fsync(fileno(file)) != 0))
+            res = RB_IO_ERROR;
+
+        if (fclose(file) != 0 && res == RB_SUCCESS)
+            res = RB_IO_ERROR;
+
+        if (res == RB_SUCCESS && rename(temp, path) != 0)
+            res = RB_IO_ERROR;
+        if (res != RB_SUCCESS)
+            remove(temp);
+    }
+
+    free(temp);
+    return res;
+}
+
+
+rbResult rbLoad (const char* path, rbTree* tree)
+{
+    if (path == NULL || tree == NULL)
+        return RB_INVALID_ARGS;
+
+    const struct rbFileHeader_t* header;
+    size_t                       bytes;
+
+    rbResult res = mapFile_(path, &header, &bytes);
+    if (res != RB_SUCCESS)
+        return res;
+
+    size_t        count = (size_t) header->count;
+    const rbPair* pairs = (const rbPair*) (header + 1);
+    rbTree        loaded;
+
+    // the tree is handed out only once the file has proved valid
+    res = rb_create_(NULL, 0, 0, 1, RB_ENGINE_REDBLACK, &loaded);
+    if (res != RB_SUCCESS || count == 0) {
+        munmap((void*) header, bytes);
+        if (res == RB_SUCCESS)
+            *tree = loaded;
+        return res;
+    }
+
+    rbNode nodes = rb_reserveNodes_(loaded->pool, count);
+    if (nodes == NULL) {
+        munmap((void*) header, bytes);
+        rbDestroy(loaded);
+        return RB_LACK_OF_MEMORY;
+    }
+
+    // the checksum of a chunk is taken while the chunk is still in the cache
+    uint64_t hash    = checksum_(0, NULL, 0);
+    int      ordered = 1;
+
+    for (size_t base = 0; base < count; base += RB_FILE_CHUNK) {
+        size_t n = count - base < RB_FILE_CHUNK ? count - base : RB_FILE_CHUNK;
+
+        hash = checksum_(hash, pairs + base, n * sizeof(rbPair));
+
+        for (size_t i = base; i < base + n; ++i) {
+            ordered &= i == 0 || pairs[i - 1].key < pairs[i].key;
+            *((rb_key_type*)&nodes[i].pair.key) = pairs[i].key;
+            nodes[i].pair.value = pairs[i].value;
+        }
+    }
+
+    int valid = ordered && hash == header->checksum;
+    munmap((void*) header, bytes);
+
+    if (!valid) {
+        rbDestroy(loaded);
+        return RB_BAD_FILE;
+    }
+
+    loaded->treeRoot = rb_link_(nodes, count, NULL, 0, rb_redDepth_(count));
+    loaded->size = count;
+    *tree = loaded;
+    return RB_SUCCESS;
+}
+
+
+rbResult rbFrozenLoad (const char* path, rbFrozen* frozen)
+{
+    if (path == NULL || frozen == NULL)
+        return RB_INVALID_ARGS;
+
+    const struct rbFileHeader_t* header;
+    size_t                       bytes;
+
+    rbResult res = mapFile_(path, &header, &bytes);
+    if (res != RB_SUCCESS)
+        return res;
+
+    size_t        count = (size_t) header->count;
+    const rbPair* pairs = (const rbPair*) (header + 1);
+    int           valid = checksum_(checksum_(0, NULL, 0), pairs, count * sizeof(rbPair))
+                        == header->checksum;
+
+    for (size_t i = 1; valid && i < count; ++i)
+        valid = pairs[i - 1].key < pairs[i].key;
+
+    struct rbFrozen_t* fz = NULL;
+
+    if (!valid)
+        res = RB_BAD_FILE;
+    else
+        res = rb_fzFromPairs_(pairs, count, &fz);
+
+    munmap((void*) header, bytes);
+
+    if (res == RB_SUCCESS)
+        *frozen = fz;
+    return res;
+}
+
+
+/// Maps a snapshot file into memory and checks its header.
+/// \param path   - the file
+/// \param header - if successful, set to the mapping, which starts with the header
+/// \param bytes  - if successful, set to the size of the mapping
+/// \return an enum member from rbResult
+static rbResult mapFile_ (const char* path, const struct rbFileHeader_t** header,
+                          size_t* bytes)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return RB_IO_ERROR;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return RB_IO_ERROR;
+    }
+
+    if ((uint64_t) info.st_size < sizeof(struct rbFileHeader_t) ||
+        (uint64_t) info.st_size > SIZE_MAX) {
+        close(fd);
+        return RB_BAD_FILE;
+    }
+
+    *bytes = (size_t) info.st_size;
+    void* map = mmap(NULL, *bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return RB_IO_ERROR;
+
+    // the pairs are read once, from the first to the last
+    madvise(map, *bytes, MADV_SEQUENTIAL);
+
+    const struct rbFileHeader_t* head = (const struct rbFileHeader_t*) map;
+    uint64_t payload = *bytes - sizeof(struct rbFileHeader_t);
+
+    if (memcmp(head->magic, RB_FILE_MAGIC, sizeof(head->magic)) != 0 ||
+        head->version   != RB_FILE_VERSION    ||
+        head->byteOrder != RB_FILE_BYTE_ORDER ||
+        head->keyBytes  != sizeof(rb_key_type) ||
+        head->pairBytes != sizeof(rbPair)      ||
+        head->count     != payload / sizeof(rbPair) ||
+        payload % sizeof(rbPair) != 0) {
+        munmap(map, *bytes);
+        return RB_BAD_FILE;
+    }
+
+    *header = head;
+    return RB_SUCCESS;
+}
+
+
+/// Word-wise FNV-1a hash: fast enough to check gigabytes at memory speed, and a change
+/// of any single word of the data changes it. Data hashed in pieces gives the same
+/// result as at once if all pieces but the last are multiples of 8 bytes long.
+/// \param hash  - the hash of the preceding data
+/// \param data  - the next piece of data
+/// \param bytes - its length; checksum_(0, NULL, 0) gives the initial hash
+static uint64_t checksum_ (uint64_t hash, const void* data, size_t bytes) {
+
+    const unsigned char* p = (const unsigned char*) data;
+
+    if (data == NULL)
+        return 0xCBF29CE484222325ull;
+
+    for (; bytes >= 8; bytes -= 8, p += 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        hash = (hash ^ word) * 0x100000001B3ull;
+    }
+
+    for (; bytes != 0; --bytes, ++p)
+        hash = (hash ^ *p) * 0x100000001B3ull;
+
+    return hash;
+}
+
+
+/// Writes the pairs of a container in key order and counts them into the header.
+/// \param tree   - container
+/// \param file   - the file positioned after the header
+/// \param header - the header to be completed
+/// \return an enum member from rbResult
+static rbResult writePairs_ (rbTree tree, FILE* file, struct rbFileHeader_t* header)
+{
+    rbPair* chunk = (rbPair*) malloc(RB_FILE_CHUNK * sizeof(rbPair));
+    if (chunk == NULL)
+        return RB_LACK_OF_MEMORY;
+
+    rbResult res  = RB_SUCCESS;
+    uint64_t hash = checksum_(0, NULL, 0);
+    size_t   n    = 0;
+
+    // a concurrent container is walked inside a read section, see rbReadBegin
+    if (tree->sync != NULL && (res = rb_readEnter_()) != RB_SUCCESS) {
+        free(chunk);
+        return res;
+    }
+
+    for (rbPair* pair = rbBegin(tree); res == RB_SUCCESS; pair = rbNext(tree, pair)) {
+        if (pair != NULL)
+            memcpy(&chunk[n++], pair, sizeof(rbPair));
+
+        if (n == RB_FILE_CHUNK || (pair == NULL && n != 0)) {
+            hash = checksum_(hash, chunk, n * sizeof(rbPair));
+            header->count += n;
+            if (fwrite(chunk, sizeof(rbPair), n, file) != n)
+                res = RB_IO_ERROR;
+            n = 0;
+        }
+
+        if (pair == NULL)
+            break;
+    }
+
+    if (tree->sync != NULL)
+        rb_readExit_();
+
+    header->checksum = hash;
+    free(chunk);
+    return res;
+}
+/***
+ *
+ *   end of Snapshot file functions
+ *
+ ****************************************************************************************/
@@ -0,0 +1,400 @@
+/****************************************************************************************
+ *
+ *   RBTreeFrozen.c
+ *
+ *   Frozen snapshots of rbFreeze: the pairs in blocks of sorted keys, searched with
+ *   the SIMD kernel chosen for the CPU.
+ *
+ ***/
+#include "RBTreeInternal.h"
+
+
+
+/****************************************************************************************
+ *
+ *   prototypes for helper functions
+ *
+ ***/
+typedef void (*fzFindMany_t)(const struct rbFrozen_t* fz, const rb_key_type* keys,
+                             size_t n, const rbPair** out);
+
+static rbResult     fzCreate_       (size_t size, struct rbFrozen_t** frozen);
+static void         fzLayout_       (struct rbFrozen_t* fz, rbTree tree, const rbPair* end,
+                                     size_t block, rbPair** cursor);
+static fzFindMany_t fzSelectKernel_ (void);
+static fzFindMany_t fzKernel_       (rbFrozenKernel kernel);
+/***
+ *
+ *   end of prototypes for helper functions
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   Frozen snapshot functions
+ *
+ ***/
+
+//
+/// Static search layout
+///======================================================================================
+/// The keys are stored in blocks of FZ_BLOCK sorted keys; block k has FZ_BLOCK + 1
+/// children, numbered k * (FZ_BLOCK + 1) + i + 1 for i = 0..FZ_BLOCK, like the nodes of
+/// a B-tree laid out level by level. The keys are distributed over the slots in the
+/// order of an in-order walk of this implicit tree, and the slots left over at the end
+/// of the walk are padded with the largest key.
+///
+/// A lookup of x counts the keys less than x in a block (i), remembers slot i of the
+/// block as the best candidate if i < FZ_BLOCK, and goes on to child i. The last
+/// candidate is the first key not less than x. Keys greater than the largest one are
+/// rejected up front, which keeps the padding out of the answers.
+///
+/// The pairs are stored in the same layout as the keys, so an answer is read from the
+/// slot the search ended at.
+///======================================================================================
+///======================================================================================
+//
+#define FZ_BLOCK 16   // keys per block: 64 bytes, one cache line
+#define FZ_GROUP 16   // lookups that rbFrozenFindMany runs in lockstep
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FZ_X86
+#include <immintrin.h>
+#endif
+
+#ifdef __GNUC__
+#define FZ_INLINE static inline __attribute__((always_inline))
+#else
+#define FZ_INLINE static inline
+#endif
+
+struct rbFrozen_t {
+    rb_key_type  *keys;    // blocks * FZ_BLOCK keys in the search layout
+    rbPair       *pairs;   // the pairs in the same layout
+    size_t        blocks;
+    size_t        size;    // the number of real pairs
+    rb_key_type   maxKey;
+    fzFindMany_t  find;    // the lookup kernel chosen for this CPU
+};
+
+
+rbResult rbFreeze (rbTree tree, rbFrozen* frozen) {
+
+    if (tree == NULL || frozen == NULL)
+        return RB_INVALID_ARGS;
+
+    struct rbFrozen_t* fz;
+
+    rbResult res = fzCreate_(tree->size, &fz);
+    if (res != RB_SUCCESS)
+        return res;
+
+    if (fz->blocks != 0) {
+        rbPair* cursor = rbBegin(tree);
+        fz->maxKey = rbLast(tree)->key;
+        fzLayout_(fz, tree, NULL, 0, &cursor);
+    }
+
+    *frozen = fz;
+    return RB_SUCCESS;
+}
+
+
+rbResult rbFrozenDestroy (rbFrozen frozen) {
+
+    if (frozen == NULL)
+        return RB_INVALID_ARGS;
+
+    free(frozen->keys);
+    free(frozen->pairs);
+    free(frozen);
+    return RB_SUCCESS;
+}
+
+
+const rbPair* rbFrozenFind (rbFrozen frozen, rb_key_type key) {
+
+    const rbPair* res = NULL;
+
+    if (frozen != NULL)
+        frozen->find(frozen, &key, 1, &res);
+
+    return res;
+}
+
+
+rbResult rbFrozenFindMany (rbFrozen frozen, const rb_key_type* keys, size_t n,
+                           const rbPair** out) {
+
+    if (frozen == NULL || (n != 0 && (keys == NULL || out == NULL)))
+        return RB_INVALID_ARGS;
+
+    frozen->find(frozen, keys, n, out);
+    return RB_SUCCESS;
+}
+
+
+rbResult rbFrozenUseKernel (rbFrozen frozen, rbFrozenKernel kernel) {
+
+    if (frozen == NULL)
+        return RB_INVALID_ARGS;
+
+    fzFindMany_t find = fzKernel_(kernel);
+    if (find == NULL)
+        return RB_INVALID_ARGS;
+
+    frozen->find = find;
+    return RB_SUCCESS;
+}
+
+
+/// Creates a snapshot with room for the given number of pairs.
+/// \param size   - the number of pairs
+/// \param frozen - if successful, set to the snapshot
+/// \return an enum member from rbResult
+static rbResult fzCreate_ (size_t size, struct rbFrozen_t** frozen) {
+
+    struct rbFrozen_t* fz = (struct rbFrozen_t*) calloc(1, sizeof(struct rbFrozen_t));
+    if (fz == NULL)
+        return RB_LACK_OF_MEMORY;
+
+    fz->size   = size;
+    fz->blocks = (size + FZ_BLOCK - 1) / FZ_BLOCK;
+    fz->find   = fzSelectKernel_();
+
+    if (fz->blocks != 0) {
+        fz->keys  = (rb_key_type*) aligned_alloc(64, fz->blocks * FZ_BLOCK * sizeof(rb_key_type));
+        fz->pairs = (rbPair*) malloc(fz->blocks * FZ_BLOCK * sizeof(rbPair));
+
+        if (fz->keys == NULL || fz->pairs == NULL) {
+            rbFrozenDestroy(fz);
+            return RB_LACK_OF_MEMORY;
+        }
+    }
+
+    *frozen = fz;
+    return RB_SUCCESS;
+}
+
+
+/// Fills the subtree of the given block by an in-order walk of the container or of a
+/// sorted array.
+/// \param fz     - snapshot being built
+/// \param tree   - container, NULL to take the pairs from an array
+/// \param end    - the end of the array
+/// \param block  - the root block of the subtree
+/// \param cursor - the next pair, NULL when all are placed
+static void fzLayout_ (struct rbFrozen_t* fz, rbTree tree, const rbPair* end, size_t block,
+                       rbPair** cursor) {
+
+    for (size_t i = 0; i <= FZ_BLOCK; ++i) {
+        size_t child = block * (FZ_BLOCK + 1) + i + 1;
+        if (child < fz->blocks)
+            fzLayout_(fz, tree, end, child, cursor);
+
+        if (i == FZ_BLOCK)
+            break;
+
+        size_t slot = block * FZ_BLOCK + i;
+
+        if (*cursor != NULL) {
+            memcpy(&fz->pairs[slot], *cursor, sizeof(rbPair));
+
+            if (tree != NULL)
+                *cursor = rbNext(tree, *cursor);
+            else
+                *cursor = *cursor + 1 < end ? *cursor + 1 : NULL;
+        }
+        else {
+            *((rb_key_type*)&fz->pairs[slot].key) = fz->maxKey;
+            fz->pairs[slot].value = 0;
+        }
+
+        fz->keys[slot] = fz->pairs[slot].key;
+    }
+}
+
+
+/// Creates a snapshot of pairs sorted by key without duplicates, see rbFrozenLoad.
+/// \param pairs  - the pairs
+/// \param count  - the number of pairs
+/// \param frozen - if successful, set to the snapshot
+/// \return an enum member from rbResult
+rbResult rb_fzFromPairs_ (const rbPair* pairs, size_t count, struct rbFrozen_t** frozen) {
+
+    struct rbFrozen_t* fz;
+
+    rbResult res = fzCreate_(count, &fz);
+    if (res != RB_SUCCESS)
+        return res;
+
+    if (count != 0) {
+        rbPair* cursor = (rbPair*) pairs;
+        fz->maxKey = pairs[count - 1].key;
+        fzLayout_(fz, NULL, pairs + count, 0, &cursor);
+    }
+
+    *frozen = fz;
+    return RB_SUCCESS;
+}
+
+
+/// Counts the keys of a block that are less than x.
+FZ_INLINE int fzRankScalar_ (const rb_key_type* block, rb_key_type x) {
+
+    int rank = 0;
+
+    for (int i = 0; i < FZ_BLOCK; ++i)
+        rank += block[i] < x;
+
+    return rank;
+}
+
+
+/// Lookup loop shared by all kernels. The searches of a group advance one level at a
+/// time, and each of them prefetches its next block, so the cache misses of the group
+/// overlap instead of following each other.
+FZ_INLINE void fzFindMany_ (const struct rbFrozen_t* fz, const rb_key_type* keys, size_t n,
+                          const rbPair** out, int (*rank)(const rb_key_type*, rb_key_type)) {
+
+    for (size_t base = 0; base < n; base += FZ_GROUP) {
+        size_t group = n - base < FZ_GROUP ? n - base : FZ_GROUP;
+        size_t block[FZ_GROUP];
+        size_t slot[FZ_GROUP];
+        size_t active = 0;
+
+        for (size_t j = 0; j < group; ++j) {
+            block[j] = 0;
+            slot[j]  = SIZE_MAX;
+            active  += fz->blocks != 0;
+        }
+
+        while (active != 0) {
+            active = 0;
+
+            for (size_t j = 0; j < group; ++j) {
+                size_t k = block[j];
+                if (k >= fz->blocks)
+                    continue;
+
+                int i = rank(fz->keys + k * FZ_BLOCK, keys[base + j]);
+                if (i < FZ_BLOCK)
+                    slot[j] = k * FZ_BLOCK + i;
+
+                k = k * (FZ_BLOCK + 1) + i + 1;
+                block[j] = k;
+
+                if (k < fz->blocks) {
+                    RB_PREFETCH(fz->keys + k * FZ_BLOCK);
+                    ++active;
+                }
+            }
+        }
+
+        for (size_t j = 0; j < group; ++j) {
+            rb_key_type key = keys[base + j];
+            size_t      s   = slot[j];
+
+            out[base + j] = (s != SIZE_MAX && key <= fz->maxKey && fz->keys[s] == key)
+                          ? &fz->pairs[s] : NULL;
+        }
+    }
+}
+
+
+static void fzFindManyScalar_ (const struct rbFrozen_t* fz, const rb_key_type* keys,
+                               size_t n, const rbPair** out) {
+
+    fzFindMany_(fz, keys, n, out, fzRankScalar_);
+}
+
+
+#ifdef FZ_X86
+__attribute__((target("sse2")))
+static inline int fzRankSse2_ (const rb_key_type* block, rb_key_type x) {
+
+    __m128i xv = _mm_set1_epi32(x);
+    int     mask = 0;
+
+    for (int i = 0; i < FZ_BLOCK; i += 4) {
+        __m128i lt = _mm_cmpgt_epi32(xv, _mm_load_si128((const __m128i*) (block + i)));
+        mask |= _mm_movemask_ps(_mm_castsi128_ps(lt)) << i;
+    }
+
+    return __builtin_popcount((unsigned) mask);
+}
+
+
+__attribute__((target("sse2")))
+static void fzFindManySse2_ (const struct rbFrozen_t* fz, const rb_key_type* keys,
+                             size_t n, const rbPair** out) {
+
+    fzFindMany_(fz, keys, n, out, fzRankSse2_);
+}
+
+
+__attribute__((target("avx2,popcnt")))
+static inline int fzRankAvx2_ (const rb_key_type* block, rb_key_type x) {
+
+    __m256i xv = _mm256_set1_epi32(x);
+    __m256i lo = _mm256_cmpgt_epi32(xv, _mm256_load_si256((const __m256i*) block));
+    __m256i hi = _mm256_cmpgt_epi32(xv, _mm256_load_si256((const __m256i*) (block + 8)));
+
+    unsigned mask = (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(lo)) |
+                    (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(hi)) << 8;
+
+    return __builtin_popcount(mask);
+}
+
+
+__attribute__((target("avx2,popcnt")))
+static void fzFindManyAvx2_ (const struct rbFrozen_t* fz, const rb_key_type* keys,
+                             size_t n, const rbPair** out) {
+
+    fzFindMany_(fz, keys, n, out, fzRankAvx2_);
+}
+#endif // FZ_X86
+
+
+/// Picks the fastest lookup kernel the CPU supports.
+static fzFindMany_t fzSelectKernel_ (void) {
+
+    fzFindMany_t find = fzKernel_(RB_FROZEN_AVX2);
+
+    if (find == NULL)
+        find = fzKernel_(RB_FROZEN_SSE2);
+
+    return find ? find : fzFindManyScalar_;
+}
+
+
+/// Returns the given lookup kernel. The SIMD kernels compare 32-bit keys, other key
+/// types only have the scalar one.
+/// \param kernel - a member of rbFrozenKernel
+/// \return the kernel or NULL if the CPU or the key type does not allow it.
+static fzFindMany_t fzKernel_ (rbFrozenKernel kernel) {
+
+    if (kernel == RB_FROZEN_SCALAR)
+        return fzFindManyScalar_;
+
+#ifdef FZ_X86
+    if (sizeof(rb_key_type) == 4) {
+        __builtin_cpu_init();
+        if (kernel == RB_FROZEN_AVX2 &&
+            __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+            return fzFindManyAvx2_;
+        if (kernel == RB_FROZEN_SSE2 && __builtin_cpu_supports("sse2"))
+            return fzFindManySse2_;
+    }
+#endif
+
+    return NULL;
+}
+/***
+ *
+ *   end of Frozen snapshot functions
+ *
+ ****************************************************************************************/
@@ -0,0 +1,558 @@
+/****************************************************************************************
+ *
+ *   RBTreeGeneric.h
+ *
+ *   Created by dmitry
+ *   06.03.2021
+ *
+ ***/
+
+
+
+//
+/// Generic red-black tree
+///======================================================================================
+/// RBTree.h fixes the key and the value to int. This header generates the same kind of
+/// container for any key and value types:
+///
+///     RB_DEFINE(name, K, V, cmp)
+///
+/// defines the types 'name' (a pointer to the container, like rbTree) and 'namePair'
+/// (the key-value pair, like rbPair) and the functions nameCreate, nameDestroy,
+/// nameClear, nameFind, nameInsert, nameErase, nameSize, nameBegin, nameLast, nameNext,
+/// namePrev, nameLowerBound, nameUpperBound and nameForeach. They behave as their 'rb'
+/// counterparts and return rbResult codes.
+///
+/// Keys and values are stored in the node itself, so a 64-bit key, a fixed-size string
+/// or a struct value costs no extra allocation or indirection. 'cmp(a, b)' is an
+/// expression that is negative, zero or positive as key 'a' is less than, equal to or
+/// greater than key 'b'. It may be a macro or a static inline function; all generated
+/// functions are static inline, so the comparison is inlined into every descent.
+///
+///     RB_DEFINE(rbI64, int64_t, double, RB_CMP_NUMBER)
+///
+///     rbI64 tree;
+///     rbI64Create(&tree);
+///     rbI64Insert(tree, 1ll << 40, 0.5);
+///     rbI64Pair* pair = rbI64Find(tree, 1ll << 40);
+///
+/// Keys and values are copied with assignment, and nothing is done when a node is
+/// freed: a key or value that owns memory must be released by the user.
+///======================================================================================
+///======================================================================================
+//
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+#include "RBTree.h"
+
+
+/// Comparator for arithmetic keys.
+#define RB_CMP_NUMBER(a, b) (((a) > (b)) - ((a) < (b)))
+
+
+#define RB_DEFINE(name, K, V, cmp)                                                      \
+                                                                                        \
+typedef struct name##Pair_t {                                                           \
+    const K key;                                                                        \
+    V       value;                                                                      \
+} name##Pair;                                                                           \
+                                                                                        \
+struct name##Node_t {                                                                   \
+    struct name##Node_t *parent;                                                        \
+    struct name##Node_t *left;                                                          \
+    struct name##Node_t *right;                                                         \
+                                                                                        \
+    enum color_t color;                                                                 \
+    name##Pair   pair;                                                                  \
+};                                                                                      \
+                                                                                        \
+struct name##Tree_t {                                                                   \
+    struct name##Node_t *treeRoot;                                                      \
+    size_t               size;                                                          \
+};                                                                                      \
+                                                                                        \
+typedef struct name##Tree_t* name;                                                      \
+                                                                                        \
+                                                                                        \
+static inline rbResult name##Create (name* tree)                                        \
+{                                                                                       \
+    if (tree == NULL)                                                                   \
+        return RB_INVALID_ARGS;                                                         \
+                                                                                        \
+    *tree = (name) calloc(1, sizeof(struct name##Tree_t));                              \
+                                                                                        \
+    return *tree ? RB_SUCCESS : RB_LACK_OF_MEMORY;                                      \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+/* Frees the nodes bottom-up without recursion: a leaf is freed and the walk goes */    \
+/* back to its parent, which then has one child less. */                                \
+static inline rbResult name##Clear (name tree)                                          \
+{                                                                                       \
+    if (tree == NULL)                                                                   \
+        return RB_INVALID_ARGS;                                                         \
+                                                                                        \
+    struct name##Node_t* node = tree->treeRoot;                                         \
+                                                                                        \
+    while (node) {                                                                      \
+        if (node->left)                                                                 \
+            node = node->left;                                                          \
+        else if (node->right)                                                           \
+            node = node->right;                                                         \
+        else {                                                                          \
+            struct name##Node_t* parent = node->parent;                                 \
+                                                                                        \
+            if (parent && parent->left == node)                                         \
+                parent->left = NULL;                                                    \
+            else if (parent)                                                            \
+                parent->right = NULL;                                                   \
+                                                                                        \
+            free(node);                                                                 \
+            node = parent;                                                              \
+        }                                                                               \
+    }                                                                                   \
+                                                                                        \
+    tree->treeRoot = NULL;                                                              \
+    tree->size = 0;                                                                     \
+    return RB_SUCCESS;                                                                  \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline rbResult name##Destroy (name tree)                                        \
+{                                                                                       \
+    if (tree == NULL)                                                                   \
+        return RB_INVALID_ARGS;                                                         \
+                                                                                        \
+    name##Clear(tree);                                                                  \
+    free(tree);                                                                         \
+    return RB_SUCCESS;                                                                  \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline size_t name##Size (name tree)                                             \
+{                                                                                       \
+    return tree ? tree->size : 0;                                                       \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline name##Pair* name##Find (name tree, K key)                                 \
+{                                                                                       \
+    if (tree == NULL)                                                                   \
+        return NULL;                                                                    \
+                                                                                        \
+    struct name##Node_t* node = tree->treeRoot;                                         \
+                                                                                        \
+    while (node) {                                                                      \
+        int c = cmp(key, node->pair.key);                                               \
+                                                                                        \
+        if (c < 0)                                                                      \
+            node = node->left;                                                          \
+        else if (c > 0)                                                                 \
+            node = node->right;                                                         \
+        else                                                                            \
+            return &node->pair;                                                         \
+    }                                                                                   \
+                                                                                        \
+    return NULL;                                                                        \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline void name##RotateLeft_ (name tree, struct name##Node_t* node)             \
+{                                                                                       \
+    struct name##Node_t* pivot = node->right;                                           \
+                                                                                        \
+    node->right = pivot->left;                                                          \
+    if (pivot->left)                                                                    \
+        pivot->left->parent = node;                                                     \
+                                                                                        \
+    pivot->parent = node->parent;                                                       \
+    if (node->parent == NULL)                                                           \
+        tree->treeRoot = pivot;                                                         \
+    else if (node == node->parent->left)                                                \
+        node->parent->left = pivot;                                                     \
+    else                                                                                \
+        node->parent->right = pivot;                                                    \
+                                                                                        \
+    pivot->left = node;                                                                 \
+    node->parent = pivot;                                                               \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline void name##RotateRight_ (name tree, struct name##Node_t* node)            \
+{                                                                                       \
+    struct name##Node_t* pivot = node->left;                                            \
+                                                                                        \
+    node->left = pivot->right;                                                          \
+    if (pivot->right)                                                                   \
+        pivot->right->parent = node;                                                    \
+                                                                                        \
+    pivot->parent = node->parent;                                                       \
+    if (node->parent == NULL)                                                           \
+        tree->treeRoot = pivot;                                                         \
+    else if (node == node->parent->right)                                               \
+        node->parent->right = pivot;                                                    \
+    else                                                                                \
+        node->parent->left = pivot;                                                     \
+                                                                                        \
+    pivot->right = node;                                                                \
+    node->parent = pivot;                                                               \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+/* Restores the properties after a red node was attached: the same cases as */          \
+/* insert_case1..5 of RBTree.c, as one loop. */                                         \
+static inline void name##InsertFixup_ (name tree, struct name##Node_t* node)            \
+{                                                                                       \
+    while (node->parent && node->parent->color == RED) {                                \
+        struct name##Node_t* parent = node->parent;                                     \
+        struct name##Node_t* grand  = parent->parent;                                   \
+                                                                                        \
+        if (parent == grand->left) {                                                    \
+            struct name##Node_t* uncle = grand->right;                                  \
+                                                                                        \
+            if (uncle && uncle->color == RED) {                                         \
+                parent->color = BLACK;                                                  \
+                uncle->color  = BLACK;                                                  \
+                grand->color  = RED;                                                    \
+                node = grand;                                                           \
+                continue;                                                               \
+            }                                                                           \
+            if (node == parent->right) {                                                \
+                name##RotateLeft_(tree, parent);                                        \
+                node = parent;                                                          \
+                parent = node->parent;                                                  \
+            }                                                                           \
+            parent->color = BLACK;                                                      \
+            grand->color  = RED;                                                        \
+            name##RotateRight_(tree, grand);                                            \
+        }                                                                               \
+        else {                                                                          \
+            struct name##Node_t* uncle = grand->left;                                   \
+                                                                                        \
+            if (uncle && uncle->color == RED) {                                         \
+                parent->color = BLACK;                                                  \
+                uncle->color  = BLACK;                                                  \
+                grand->color  = RED;                                                    \
+                node = grand;                                                           \
+                continue;                                                               \
+            }                                                                           \
+            if (node == parent->left) {                                                 \
+                name##RotateRight_(tree, parent);                                       \
+                node = parent;                                                          \
+                parent = node->parent;                                                  \
+            }                                                                           \
+            parent->color = BLACK;                                                      \
+            grand->color  = RED;                                                        \
+            name##RotateLeft_(tree, grand);                                             \
+        }                                                                               \
+    }                                                                                   \
+                                                                                        \
+    tree->treeRoot->color = BLACK;                                                      \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline rbResult name##Insert (name tree, K key, V value)                         \
+{                                                                                       \
+    if (tree == NULL)                                                                   \
+        return RB_INVALID_ARGS;                                                         \
+                                                                                        \
+    struct name##Node_t* parent = NULL;                                                 \
+    struct name##Node_t* node   = tree->treeRoot;                                       \
+    int c = 0;                                                                          \
+                                                                                        \
+    while (node) {                                                                      \
+        c = cmp(key, node->pair.key);                                                   \
+                                                                                        \
+        if (c == 0) {                                                                   \
+            node->pair.value = value;                                                   \
+            return RB_SUCCESS;                                                          \
+        }                                                                               \
+                                                                                        \
+        parent = node;                                                                  \
+        node = c < 0 ? node->left : node->right;                                        \
+    }                                                                                   \
+                                                                                        \
+    node = (struct name##Node_t*) malloc(sizeof(struct name##Node_t));                  \
+    if (node == NULL)                                                                   \
+        return RB_LACK_OF_MEMORY;                                                       \
+                                                                                        \
+    memcpy((void*) &node->pair.key, &key, sizeof(K));                                   \
+    node->pair.value = value;                                                           \
+    node->color  = RED;                                                                 \
+    node->parent = parent;                                                              \
+    node->left   = NULL;                                                                \
+    node->right  = NULL;                                                                \
+                                                                                        \
+    if (parent == NULL)                                                                 \
+        tree->treeRoot = node;                                                          \
+    else if (c < 0)                                                                     \
+        parent->left = node;                                                            \
+    else                                                                                \
+        parent->right = node;                                                           \
+                                                                                        \
+    name##InsertFixup_(tree, node);                                                     \
+    ++tree->size;                                                                       \
+    return RB_SUCCESS;                                                                  \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+/* Restores the black height after a black node was removed: 'node' (possibly NULL) */  \
+/* has taken its place under 'parent' and carries an extra black. */                    \
+static inline void name##EraseFixup_ (name tree, struct name##Node_t* node,             \
+                                      struct name##Node_t* parent)                      \
+{                                                                                       \
+    while (parent && (node == NULL || node->color == BLACK)) {                          \
+        if (node == parent->left) {                                                     \
+            struct name##Node_t* brother = parent->right;                               \
+                                                                                        \
+            if (brother->color == RED) {                                                \
+                brother->color = BLACK;                                                 \
+                parent->color  = RED;                                                   \
+                name##RotateLeft_(tree, parent);                                        \
+                brother = parent->right;                                                \
+            }                                                                           \
+            if ((brother->left == NULL || brother->left->color == BLACK) &&             \
+                (brother->right == NULL || brother->right->color == BLACK)) {           \
+                brother->color = RED;                                                   \
+                node = parent;                                                          \
+                parent = node->parent;                                                  \
+                continue;                                                               \
+            }                                                                           \
+            if (brother->right == NULL || brother->right->color == BLACK) {             \
+                brother->left->color = BLACK;                                           \
+                brother->color = RED;                                                   \
+                name##RotateRight_(tree, brother);                                      \
+                brother = parent->right;                                                \
+            }                                                                           \
+            brother->color = parent->color;                                             \
+            parent->color  = BLACK;                                                     \
+            brother->right->color = BLACK;                                              \
+            name##RotateLeft_(tree, parent);                                            \
+        }                                                                               \
+        else {                                                                          \
+            struct name##Node_t* brother = parent->left;                                \
+                                                                                        \
+            if (brother->color == RED) {                                                \
+                brother->color = BLACK;                                                 \
+                parent->color  = RED;                                                   \
+                name##RotateRight_(tree, parent);                                       \
+                brother = parent->left;                                                 \
+            }                                                                           \
+            if ((brother->left == NULL || brother->left->color == BLACK) &&             \
+                (brother->right == NULL || brother->right->color == BLACK)) {           \
+                brother->color = RED;                                                   \
+                node = parent;                                                          \
+                parent = node->parent;                                                  \
+                continue;                                                               \
+            }                                                                           \
+            if (brother->left == NULL || brother->left->color == BLACK) {               \
+                brother->right->color = BLACK;                                          \
+                brother->color = RED;                                                   \
+                name##RotateLeft_(tree, brother);                                       \
+                brother = parent->left;                                                 \
+            }                                                                           \
+            brother->color = parent->color;                                             \
+            parent->color  = BLACK;                                                     \
+            brother->left->color = BLACK;                                               \
+            name##RotateRight_(tree, parent);                                           \
+        }                                                                               \
+        node = tree->treeRoot;                                                          \
+        break;                                                                          \
+    }                                                                                   \
+                                                                                        \
+    if (node)                                                                           \
+        node->color = BLACK;                                                            \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+/* Puts 'child' in the place of 'node' under the parent of 'node'. */                   \
+static inline void name##Replace_ (name tree, struct name##Node_t* node,                \
+                                   struct name##Node_t* child)                          \
+{                                                                                       \
+    if (node->parent == NULL)                                                           \
+        tree->treeRoot = child;                                                         \
+    else if (node == node->parent->left)                                                \
+        node->parent->left = child;                                                     \
+    else                                                                                \
+        node->parent->right = child;                                                    \
+                                                                                        \
+    if (child)                                                                          \
+        child->parent = node->parent;                                                   \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+/* A node with two children is replaced by its successor node, which is relinked, */    \
+/* so pointers to the other pairs stay valid, as in RBTree.c. */                        \
+static inline rbResult name##Erase (name tree, K key)                                   \
+{                                                                                       \
+    if (tree == NULL)                                                                   \
+        return RB_INVALID_ARGS;                                                         \
+                                                                                        \
+    name##Pair* pair = name##Find(tree, key);                                           \
+    if (pair == NULL)                                                                   \
+        return RB_SUCCESS;                                                              \
+                                                                                        \
+    struct name##Node_t* node =                                                         \
+        (struct name##Node_t*) ((char*) pair - offsetof(struct name##Node_t, pair));    \
+                                                                                        \
+    struct name##Node_t* child;                                                         \
+    struct name##Node_t* parent;                                                        \
+    enum color_t         color;                                                         \
+                                                                                        \
+    if (node->left && node->right) {                                                    \
+        struct name##Node_t* succ = node->right;                                        \
+        while (succ->left)                                                              \
+            succ = succ->left;                                                          \
+                                                                                        \
+        child  = succ->right;                                                           \
+        color  = succ->color;                                                           \
+                                                                                        \
+        if (succ->parent == node)                                                       \
+            parent = succ;                                                              \
+        else {                                                                          \
+            parent = succ->parent;                                                      \
+            parent->left = child;                                                       \
+            if (child)                                                                  \
+                child->parent = parent;                                                 \
+                                                                                        \
+            succ->right = node->right;                                                  \
+            node->right->parent = succ;                                                 \
+        }                                                                               \
+                                                                                        \
+        succ->left = node->left;                                                        \
+        node->left->parent = succ;                                                      \
+        succ->color = node->color;                                                      \
+        name##Replace_(tree, node, succ);                                               \
+    }                                                                                   \
+    else {                                                                              \
+        child  = node->left ? node->left : node->right;                                 \
+        parent = node->parent;                                                          \
+        color  = node->color;                                                           \
+        name##Replace_(tree, node, child);                                              \
+    }                                                                                   \
+                                                                                        \
+    if (color == BLACK)                                                                 \
+        name##EraseFixup_(tree, child, parent);                                         \
+                                                                                        \
+    free(node);                                                                         \
+    --tree->size;                                                                       \
+    return RB_SUCCESS;                                                                  \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline name##Pair* name##Begin (name tree)                                       \
+{                                                                                       \
+    struct name##Node_t* node = tree ? tree->treeRoot : NULL;                           \
+                                                                                        \
+    if (node == NULL)                                                                   \
+        return NULL;                                                                    \
+    while (node->left)                                                                  \
+        node = node->left;                                                              \
+                                                                                        \
+    return &node->pair;                                                                 \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline name##Pair* name##Last (name tree)                                        \
+{                                                                                       \
+    struct name##Node_t* node = tree ? tree->treeRoot : NULL;                           \
+                                                                                        \
+    if (node == NULL)                                                                   \
+        return NULL;                                                                    \
+    while (node->right)                                                                 \
+        node = node->right;                                                             \
+                                                                                        \
+    return &node->pair;                                                                 \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline name##Pair* name##Next (name tree, name##Pair* pair)                      \
+{                                                                                       \
+    if (tree == NULL || pair == NULL)                                                   \
+        return NULL;                                                                    \
+                                                                                        \
+    struct name##Node_t* node =                                                         \
+        (struct name##Node_t*) ((char*) pair - offsetof(struct name##Node_t, pair));    \
+                                                                                        \
+    if (node->right) {                                                                  \
+        node = node->right;                                                             \
+        while (node->left)                                                              \
+            node = node->left;                                                          \
+        return &node->pair;                                                             \
+    }                                                                                   \
+                                                                                        \
+    while (node->parent && node == node->parent->right)                                 \
+        node = node->parent;                                                            \
+                                                                                        \
+    return node->parent ? &node->parent->pair : NULL;                                   \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline name##Pair* name##Prev (name tree, name##Pair* pair)                      \
+{                                                                                       \
+    if (tree == NULL || pair == NULL)                                                   \
+        return NULL;                                                                    \
+                                                                                        \
+    struct name##Node_t* node =                                                         \
+        (struct name##Node_t*) ((char*) pair - offsetof(struct name##Node_t, pair));    \
+                                                                                        \
+    if (node->left) {                                                                   \
+        node = node->left;                                                              \
+        while (node->right)                                                             \
+            node = node->right;                                                         \
+        return &node->pair;                                                             \
+    }                                                                                   \
+                                                                                        \
+    while (node->parent && node == node->parent->left)                                  \
+        node = node->parent;                                                            \
+                                                                                        \
+    return node->parent ? &node->parent->pair : NULL;                                   \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+/* The first pair with a key not less (or, if 'strict', greater) than 'key'. */         \
+static inline name##Pair* name##Bound_ (name tree, K key, int strict)                   \
+{                                                                                       \
+    struct name##Node_t* node = tree ? tree->treeRoot : NULL;                           \
+    struct name##Node_t* res  = NULL;                                                   \
+                                                                                        \
+    while (node) {                                                                      \
+        int c = cmp(node->pair.key, key);                                               \
+                                                                                        \
+        if (c > 0 || (!strict && c == 0)) {                                             \
+            res = node;                                                                 \
+            node = node->left;                                                          \
+        }                                                                               \
+        else                                                                            \
+            node = node->right;                                                         \
+    }                                                                                   \
+                                                                                        \
+    return res ? &res->pair : NULL;                                                     \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline name##Pair* name##LowerBound (name tree, K key)                           \
+{                                                                                       \
+    return name##Bound_(tree, key, 0);                                                  \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline name##Pair* name##UpperBound (name tree, K key)                           \
+{                                                                                       \
+    return name##Bound_(tree, key, 1);                                                  \
+}                                                                                       \
+                                                                                        \
+                                                                                        \
+static inline rbResult name##Foreach (name tree, void (*act)(name##Pair*, void*), void* data) \
+{                                                                                       \
+    if (tree == NULL || act == NULL)                                                    \
+        return RB_INVALID_ARGS;                                                         \
+                                                                                        \
+    for (name##Pair* pair = name##Begin(tree); pair != NULL; pair = name##Next(tree, pair)) \
+        act(pair, data);                                                                \
+                                                                                        \
+    return RB_SUCCESS;                                                                  \
+}
@@ -0,0 +1,228 @@
+/****************************************************************************************
+ *
+ *   RBTreeInternal.h
+ *
+ *   What the translation units of the container share beyond RBTree.h:
+ *
+ *   RBTree.c           - the red-black tree, its node pool and the interface functions
+ *   RBTreeBPlus.c      - the engine RB_ENGINE_BPLUS
+ *   RBTreePersistent.c - the engine RB_ENGINE_PERSISTENT
+ *   RBTreeConcurrent.c - rbCreateConcurrent: the seqlock and the reclamation of nodes
+ *   RBTreeBatch.c      - rbInsertBatch and rbEraseBatch
+ *   RBTreeSplit.c      - rbSplit, rbJoin and rbUnion
+ *   RBTreeFrozen.c     - rbFreeze and the lookups of frozen snapshots
+ *   RBTreeFile.c       - rbSave and rbLoad
+ *   RBTreeDump.c       - rbDumpTo
+ *   RBTreeStats.c      - the counters of RB_STATS
+ *
+ *   Not for the users of the container.
+ *
+ ***/
+#pragma once
+
+#include "RBTree.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/// The number of descents rbFindBatch interleaves.
+#define RB_BATCH_GROUP 16
+
+#ifdef __GNUC__
+#define RB_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define RB_PREFETCH(addr) ((void) 0)
+#endif
+
+/// No red-black tree is deeper, so a longer descent can only be misled by a writer.
+#define RB_MAX_DEPTH    128
+
+/// A link (or a value, or the size) that readers load without a lock while a writer may
+/// change it. Writers store it with release and readers load it with acquire, so a
+/// reader that follows a link to a node sees the node filled in, its key above all.
+/// Parent links and colors are not read by the readers and are written plainly.
+#ifdef __GNUC__
+#define RB_LOAD(field)         __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#define RB_STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+#else
+#define RB_LOAD(field)         (field)
+#define RB_STORE(field, value) ((field) = (value))
+#endif
+
+/// The counters of RB_STATS, see rbStats. A descent passes the number of nodes it
+/// compared with the key; without RB_STATS the macros leave nothing behind.
+#ifdef RB_STATS
+#define RB_COUNT(tree, field)                       rb_statsAdd_(&(tree)->stats.field, 1)
+#define RB_COUNT_DESCENTS(tree, count, nodes, depth) \
+    rb_statsDescents_((tree), (count), (nodes), (depth))
+#else
+#define RB_COUNT(tree, field)                       ((void) (tree))
+#define RB_COUNT_DESCENTS(tree, count, nodes, depth) \
+    ((void) (tree), (void) (nodes), (void) (depth))
+#endif
+#define RB_COUNT_DESCENT(tree, nodes) RB_COUNT_DESCENTS(tree, 1, nodes, nodes)
+
+/// Timing of the operations of RB_STATS_LATENCY.
+#if defined(RB_STATS_LATENCY) && !defined(RB_STATS)
+#error "RB_STATS_LATENCY needs RB_STATS"
+#endif
+#ifdef RB_STATS_LATENCY
+#define RB_TIMER_START(start)          uint64_t start = rb_statsNow_()
+#define RB_TIMER_STOP(tree, op, start) rb_statsLatency_((tree), (op), (start))
+#else
+#define RB_TIMER_START(start)          ((void) 0)
+#define RB_TIMER_STOP(tree, op, start) ((void) 0)
+#endif
+
+
+/// What rb_seek_ looks for.
+enum rbSeek_t {
+    RB_SEEK_EQUAL, // the node with the key
+    RB_SEEK_LOWER, // the first node with a key not less than the key
+    RB_SEEK_UPPER, // the first node with a key greater than the key
+    RB_SEEK_BELOW, // the last node with a key less than the key
+    RB_SEEK_FIRST, // the node with the smallest key
+    RB_SEEK_LAST   // the node with the largest key
+};
+
+/// The node pool of a tree, see the Node pool functions of RBTree.c.
+struct rbSlab_t {
+    struct rbSlab_t *next;
+    size_t           capacity;  // the number of nodes in the slab
+    struct rbNode_t  nodes[];
+};
+
+struct rbPool_t {
+    struct rbSlab_t *slabs;     // the list of slabs, the newest one goes first
+    size_t           slabNodes; // the number of nodes in one regular slab
+    size_t           used;      // the number of nodes already cut from the newest slab
+    rbNode           freeList;  // erased nodes ready for reuse
+    atomic_size_t    refs;      // the number of trees that use the pool
+    pthread_mutex_t  lock;      // taken while the pool is shared
+};
+
+struct rbWriter_t;
+
+
+
+/****************************************************************************************
+ *
+ *   helper functions shared by the translation units
+ *
+ *   They are not static, so they are named rb_* like the interface, out of the way of
+ *   the functions of the programs that link the library.
+ *
+ ***/
+
+/// RBTree.c
+rbNode   rb_findMax            (rbNode tree);
+rbNode   rb_findMin            (rbNode tree);
+rbNode   rb_find_node_with_key_(rbTree tree, rb_key_type key);
+rbNode   rb_successor_         (rbNode node);
+
+rbResult rb_create_     (const rbPair* data, size_t size, size_t slabNodes, int usePool,
+                         rbEngine engine, rbTree* tree);
+rbNode   rb_link_       (rbNode nodes, size_t size, rbNode parent, int depth,
+                         int redDepth);
+rbNode   rb_relink_     (rbNode* nodes, size_t size, rbNode parent, int depth,
+                         int redDepth);
+int      rb_redDepth_   (size_t size);
+rbResult rb_sortPairs_  (const rbPair* data, size_t size, size_t** idx);
+size_t   rb_countUnique_(const rbPair* data, const size_t* idx, size_t size);
+
+rbNode   rb_allocNode_   (rbTree tree);
+rbNode   rb_reserveNodes_(struct rbPool_t* pool, size_t count);
+void     rb_releaseNode_ (rbTree tree, rbNode node);
+void     rb_unrefPool_   (struct rbPool_t* pool);
+void     rb_dropNodes_   (rbTree tree);
+void     rb_mergePools_  (struct rbPool_t* to, rbTree tree);
+
+rbResult rb_insert_pair_ (rbTree tree, rbPair pair);
+void     rb_insert_case1 (rbTree tree, rbNode node);
+void     rb_erase_key_   (rbTree tree, rb_key_type key);
+void     rb_detach_node_ (rbTree tree, rbNode node);
+void     rb_deleteTree   (rbTree tree, rbNode node);
+
+/// RBTreeBPlus.c
+struct bpTree_t* rb_bpCreate_     (void);
+void             rb_bpClear_      (struct bpTree_t* bp);
+size_t           rb_bpMemoryUsage_(const struct bpTree_t* bp);
+rbPair*          rb_bpFind_       (const struct bpTree_t* bp, rb_key_type key);
+rbPair*          rb_bpLowerBound_ (const struct bpTree_t* bp, rb_key_type key, int strict);
+rbPair*          rb_bpNext_       (rbPair* pair);
+rbPair*          rb_bpPrev_       (rbPair* pair);
+rbPair*          rb_bpFirst_      (const struct bpTree_t* bp);
+rbPair*          rb_bpLast_       (const struct bpTree_t* bp);
+rbResult         rb_bpInsert_     (struct bpTree_t* bp, rbPair pair, int* added);
+int              rb_bpErase_      (struct bpTree_t* bp, rb_key_type key);
+rbResult         rb_bpBuild_      (struct bpTree_t* bp, const rbPair* data,
+                                   const size_t* idx, size_t size, size_t unique);
+void             rb_bpFindBatch_  (const struct bpTree_t* bp, const rb_key_type* keys,
+                                   size_t n, rbPair** out);
+rbPair*          rb_bpSelect_     (const struct bpTree_t* bp, size_t k);
+size_t           rb_bpRank_       (const struct bpTree_t* bp, rb_key_type key);
+void             rb_bpDumpTree_   (struct rbWriter_t* w, const struct bpTree_t* bp,
+                                   rbDumpFormat format);
+rbResult         rb_bpMergeInsert_(rbTree tree, const rbPair* data, const size_t* idx,
+                                   size_t n);
+rbResult         rb_bpMergeErase_ (rbTree tree, const rb_key_type* keys, size_t n);
+
+/// RBTreePersistent.c
+rbResult rb_psInsert_ (rbTree tree, rbPair pair);
+rbResult rb_psErase_  (rbTree tree, rb_key_type key);
+void     rb_psUnref_  (rbTree tree, rbNode node);
+
+/// RBTreeConcurrent.c
+void     rb_destroySync_  (rbTree tree);
+rbResult rb_readEnter_    (void);
+void     rb_readExit_     (void);
+rbNode   rb_seek_         (rbTree tree, rb_key_type key, enum rbSeek_t mode);
+rbPair*  rb_readSeek_     (rbTree tree, rb_key_type key, enum rbSeek_t mode);
+rbResult rb_lockWriter_   (rbTree tree, size_t retire);
+void     rb_unlockWriter_ (rbTree tree);
+void     rb_beginChange_  (struct rbSync_t* sync);
+void     rb_endChange_    (struct rbSync_t* sync);
+void     rb_retire_       (rbTree tree, rbNode root, size_t nodes);
+
+/// RBTreeFrozen.c
+rbResult rb_fzFromPairs_ (const rbPair* pairs, size_t count, struct rbFrozen_t** frozen);
+
+/// RBTreeDump.c
+void     rb_wrText_   (struct rbWriter_t* w, const char* text);
+void     rb_wrInt_    (struct rbWriter_t* w, long long value);
+
+/// RBTreeStats.c
+#ifdef RB_STATS
+void     rb_statsAdd_      (size_t* counter, size_t n);
+void     rb_statsDescents_ (rbTree tree, size_t count, size_t nodes, size_t depth);
+#endif
+#ifdef RB_STATS_LATENCY
+uint64_t rb_statsNow_      (void);
+void     rb_statsLatency_  (rbTree tree, rbStatsOp op, uint64_t start);
+#endif
+/***
+ *
+ *   end of helper functions shared by the translation units
+ *
+ ****************************************************************************************/
+
+
+
+/// The i-th element in key order, see rb_sortPairs_.
+static inline const rbPair* pairAt_ (const rbPair* data, const size_t* idx, size_t i) {
+
+    return idx ? &data[idx[i]] : &data[i];
+}
+
+
+#ifdef RB_ORDER_STATISTICS
+/// Size of the subtree, 0 for an empty one.
+static inline size_t count_ (rbNode node) {
+
+    return node ? node->count : 0;
+}
+#endif
@@ -0,0 +1,562 @@
+/****************************************************************************************
+ *
+ *   RBTreePersistent.c
+ *
+ *   The engine RB_ENGINE_PERSISTENT: a red-black tree whose nodes are shared by the
+ *   versions of rbSnapshot and copied on the path of a change.
+ *
+ ***/
+#include "RBTreeInternal.h"
+
+
+/// The link counters of the nodes of a persistent tree, shared by versions that other
+/// threads may change.
+#ifdef __GNUC__
+#define RB_REFS(field)  __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#define RB_REF(field)   __atomic_add_fetch(&(field), 1, __ATOMIC_RELAXED)
+#define RB_UNREF(field) __atomic_sub_fetch(&(field), 1, __ATOMIC_ACQ_REL)
+#else
+#define RB_REFS(field)  (field)
+#define RB_REF(field)   (++(field))
+#define RB_UNREF(field) (--(field))
+#endif
+
+
+
+/****************************************************************************************
+ *
+ *   prototypes for helper functions
+ *
+ ***/
+struct psStash_t;
+static void     psEraseFix_  (rbTree tree, rbNode* path, int depth, int left,
+                              struct psStash_t* stash);
+static int      psEraseNeed_ (rbNode* path, int depth, int left);
+static int      psShared_    (rbNode node);
+static rbNode   psOwn_       (rbTree tree, rbNode* slot, struct psStash_t* stash);
+static rbNode*  psSlot_      (rbTree tree, rbNode* path, int depth);
+static void     psRotate_    (rbTree tree, rbNode* slot, int left);
+static rbResult psFill_      (rbTree tree, struct psStash_t* stash, int need);
+static void     psDrain_     (rbTree tree, struct psStash_t* stash);
+/***
+ *
+ *   end of prototypes for helper functions
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   Persistent engine functions
+ *
+ ***/
+
+//
+/// Persistent red-black tree
+///======================================================================================
+/// The RB_ENGINE_PERSISTENT engine is a red-black tree whose nodes may be shared by
+/// several versions of the container (see rbSnapshot). A node counts the links to it,
+/// from parent nodes and from the roots of the versions, and is released with the last
+/// one. A shared node cannot have a parent link, so the nodes of this engine do without
+/// them and keep the count in its place (see rbNode_t): insertion and removal remember
+/// the path from the root, and the cases of rb_insert_case1 - insert_case5 and
+/// delete_case1 - delete_case6 are applied along it.
+///
+/// A version changes only the nodes no other version reaches. Before a node is changed,
+/// psOwn_ replaces a shared one with a copy: the copy takes over the link, the children
+/// get one more link each and the original loses one. The descent owns the whole path,
+/// so the rebalancing finds the parents and grandparents owned; the uncles, brothers and
+/// nephews it recolors or rotates are owned on demand. The copies they may need are
+/// counted and allocated before anything changes, so a write that runs out of memory
+/// leaves the version as it was (a copied path is equivalent to the original one).
+///======================================================================================
+///======================================================================================
+//
+
+/// The nodes allocated in advance for the rebalancing of one write.
+struct psStash_t {
+    rbNode node[RB_MAX_DEPTH + 8];
+    int    n;
+};
+
+
+rbResult rbSnapshot (rbTree tree, rbTree* snapshot)
+{
+    if (tree == NULL || snapshot == NULL || tree->engine != RB_ENGINE_PERSISTENT)
+        return RB_INVALID_ARGS;
+
+    rbResult res = rb_create_(NULL, 0, 0, 0, RB_ENGINE_PERSISTENT, snapshot);
+    if (res != RB_SUCCESS)
+        return res;
+
+    if (tree->treeRoot != NULL)
+        RB_REF(tree->treeRoot->refs);
+
+    if (tree->pool != NULL)
+        atomic_fetch_add(&tree->pool->refs, 1);
+
+    (*snapshot)->treeRoot = tree->treeRoot;
+    (*snapshot)->size = tree->size;
+    (*snapshot)->pool = tree->pool;
+    return RB_SUCCESS;
+}
+
+
+/// Inserts a pair into a persistent tree, see rbInsert and rb_insert_pair_.
+rbResult rb_psInsert_ (rbTree tree, rbPair pair) {
+
+    rbNode  path[RB_MAX_DEPTH + 1];
+    rbNode* slot  = &tree->treeRoot;
+    int     depth = 0;
+
+    // The path is owned on the way down; the node with the key just gets the value.
+    while (*slot != NULL) {
+        rbNode node = psOwn_(tree, slot, NULL);
+        if (node == NULL)
+            return RB_LACK_OF_MEMORY;
+
+        if (node->pair.key == pair.key) {
+            RB_COUNT_DESCENT(tree, depth + 1);
+            node->pair.value = pair.value;
+            return RB_SUCCESS;
+        }
+
+        path[depth++] = node;
+        slot = node->pair.key > pair.key ? &node->left : &node->right;
+    }
+
+    RB_COUNT_DESCENT(tree, depth);
+
+    // the new node and the uncles that case 3 recolors
+    int need = 1;
+    for (int i = depth; i >= 2 && path[i - 1]->color == RED; i -= 2) {
+        rbNode grandpa = path[i - 2];
+        rbNode uncle   = grandpa->left == path[i - 1] ? grandpa->right : grandpa->left;
+
+        if (uncle == NULL || uncle->color == BLACK)
+            break;
+        need += psShared_(uncle);
+    }
+
+    struct psStash_t stash;
+    if (psFill_(tree, &stash, need) != RB_SUCCESS)
+        return RB_LACK_OF_MEMORY;
+
+    rbNode node = stash.node[--stash.n];
+
+    *((rb_key_type*)&node->pair.key) = pair.key;
+    node->pair.value = pair.value;
+    node->color = RED;
+    node->refs = 1;
+    node->left = NULL;
+    node->right = NULL;
+
+#ifdef RB_ORDER_STATISTICS
+    node->count = 1;
+    for (int i = 0; i < depth; ++i)
+        ++path[i]->count;
+#endif
+
+    *slot = node;
+    path[depth] = node;
+    ++tree->size;
+
+    // Cases 1 and 2 end the loop: the node is the root or its parent is black.
+    for (int i = depth;;) {
+
+        if (i == 0) {
+            RB_COUNT(tree, insertCases[1]);
+            break;
+        }
+        if (path[i - 1]->color == BLACK) {
+            RB_COUNT(tree, insertCases[2]);
+            break;
+        }
+
+        rbNode  parent  = path[i - 1];
+        rbNode  grandpa = path[i - 2];
+        int     left    = grandpa->left == parent;
+        rbNode* uncle   = left ? &grandpa->right : &grandpa->left;
+
+        if (*uncle != NULL && (*uncle)->color == RED) {
+            RB_COUNT(tree, insertCases[3]);
+            psOwn_(tree, uncle, &stash)->color = BLACK;
+            parent->color = BLACK;
+            grandpa->color = RED;
+            i -= 2;
+            continue;
+        }
+
+        // case 4: the node is an inner grandchild
+        if ((parent->right == path[i]) == left) {
+            RB_COUNT(tree, insertCases[4]);
+            psRotate_(tree, psSlot_(tree, path, i - 1), left);
+            parent = path[i];
+        }
+
+        // case 5
+        RB_COUNT(tree, insertCases[5]);
+        parent->color = BLACK;
+        grandpa->color = RED;
+        psRotate_(tree, psSlot_(tree, path, i - 2), !left);
+        break;
+    }
+
+    tree->treeRoot->color = BLACK;
+    psDrain_(tree, &stash);
+    return RB_SUCCESS;
+}
+
+
+/// Removes the pair with the key from a persistent tree, see rbErase and rb_detach_node_.
+rbResult rb_psErase_ (rbTree tree, rb_key_type key) {
+
+    if (rb_find_node_with_key_(tree, key) == NULL)
+        return RB_SUCCESS;
+
+    rbNode  path[RB_MAX_DEPTH + 2];
+    rbNode* slot  = &tree->treeRoot;
+    int     depth = 0;
+    rbNode  node;
+
+    for (;;) {
+        node = psOwn_(tree, slot, NULL);
+        if (node == NULL)
+            return RB_LACK_OF_MEMORY;
+
+        path[depth++] = node;
+        if (node->pair.key == key)
+            break;
+        slot = node->pair.key > key ? &node->left : &node->right;
+    }
+
+    RB_COUNT_DESCENT(tree, depth);
+
+    // A node with two children takes the pair of its successor, which goes instead.
+    // Pairs are not shared with other versions through pointers, so they may move.
+    if (node->left && node->right)
+        for (slot = &node->right; *slot != NULL; slot = &path[depth - 1]->left) {
+            rbNode next = psOwn_(tree, slot, NULL);
+            if (next == NULL)
+                return RB_LACK_OF_MEMORY;
+            path[depth++] = next;
+        }
+
+    int    d     = depth - 1;
+    rbNode gone  = path[d];
+    rbNode child = gone->left ? gone->left : gone->right;
+    int    left  = d > 0 && path[d - 1]->left == gone;
+    int    need  = 0;
+
+    if (gone->color == BLACK)
+        need = child ? psShared_(child) : psEraseNeed_(path, d, left);
+
+    struct psStash_t stash;
+    if (psFill_(tree, &stash, need) != RB_SUCCESS)
+        return RB_LACK_OF_MEMORY;
+
+    if (gone != node)
+        memcpy(&node->pair, &gone->pair, sizeof(rbPair));
+
+    slot = psSlot_(tree, path, d);
+    *slot = child;
+    --tree->size;
+
+#ifdef RB_ORDER_STATISTICS
+    for (int i = 0; i < d; ++i)
+        --path[i]->count;
+#endif
+
+    // the link to the child has moved to the parent
+    enum color_t color = gone->color;
+    rb_releaseNode_(tree, gone);
+
+    if (color == BLACK) {
+        if (child != NULL)
+            psOwn_(tree, slot, &stash)->color = BLACK;
+        else
+            psEraseFix_(tree, path, d, left, &stash);
+    }
+
+    psDrain_(tree, &stash);
+    return RB_SUCCESS;
+}
+
+
+/// Restores the black heights after a black leaf is removed, see delete_case1 -
+/// delete_case6.
+/// \param tree  - container
+/// \param path  - the owned nodes from the root to the parent of the place that lacks
+///                a black node; one more entry may be added
+/// \param depth - the depth of that place
+/// \param left  - non-zero if it is the left child of its parent
+/// \param stash - the nodes counted by psEraseNeed_
+static void psEraseFix_ (rbTree tree, rbNode* path, int depth, int left,
+                         struct psStash_t* stash) {
+
+    while (depth > 0) {
+
+        rbNode  parent  = path[depth - 1];
+        rbNode* brother = left ? &parent->right : &parent->left;
+
+        // case 2: the red brother goes up, and the parent gets a black brother
+        if ((*brother)->color == RED) {
+            rbNode up = psOwn_(tree, brother, stash);
+
+            RB_COUNT(tree, deleteCases[2]);
+            parent->color = RED;
+            up->color = BLACK;
+            psRotate_(tree, psSlot_(tree, path, depth - 1), left);
+
+            path[depth - 1] = up;
+            path[depth] = parent;
+            ++depth;
+            brother = left ? &parent->right : &parent->left;
+        }
+
+        rbNode b       = *brother;
+        rbNode nearest = left ? b->left : b->right;
+        rbNode farther = left ? b->right : b->left;
+        int    nearRed = nearest != NULL && nearest->color == RED;
+        int    farRed  = farther != NULL && farther->color == RED;
+
+        b = psOwn_(tree, brother, stash);
+
+        if (!nearRed && !farRed) {
+            b->color = RED;
+
+            // case 4: the red parent turns black instead
+            if (parent->color == RED) {
+                RB_COUNT(tree, deleteCases[4]);
+                parent->color = BLACK;
+                return;
+            }
+
+            // case 3: the parent lacks a black node now
+            RB_COUNT(tree, deleteCases[3]);
+            --depth;
+            left = depth > 0 && path[depth - 1]->left == parent;
+            continue;
+        }
+
+        // case 5: the near nephew goes up
+        if (!farRed) {
+            RB_COUNT(tree, deleteCases[5]);
+            psOwn_(tree, left ? &b->left : &b->right, stash)->color = BLACK;
+            b->color = RED;
+            psRotate_(tree, brother, !left);
+            b = *brother;
+        }
+
+        // case 6
+        RB_COUNT(tree, deleteCases[6]);
+        b->color = parent->color;
+        parent->color = BLACK;
+        psOwn_(tree, left ? &b->right : &b->left, stash)->color = BLACK;
+        psRotate_(tree, psSlot_(tree, path, depth - 1), left);
+        return;
+    }
+
+    // case 1: the root lacks a black node, which is one less on every path
+    RB_COUNT(tree, deleteCases[1]);
+}
+
+
+/// Counts the copies psEraseFix_ may make, without changing the tree.
+/// \return the number of nodes.
+static int psEraseNeed_ (rbNode* path, int depth, int left) {
+
+    int need = 0;
+
+    while (depth > 0) {
+
+        rbNode parent = path[depth - 1];
+        rbNode b      = left ? parent->right : parent->left;
+        int    shared = psShared_(b);
+
+        // case 2, then case 4, 5 or 6 with the near nephew as the brother
+        if (b->color == RED) {
+            rbNode next = left ? b->left : b->right;
+            int    copy = shared || psShared_(next);
+
+            need += shared + copy;
+            if (next->left != NULL)
+                need += copy || psShared_(next->left);
+            if (next->right != NULL)
+                need += copy || psShared_(next->right);
+            return need;
+        }
+
+        rbNode nearest = left ? b->left : b->right;
+        rbNode farther = left ? b->right : b->left;
+        int    nearRed = nearest != NULL && nearest->color == RED;
+        int    farRed  = farther != NULL && farther->color == RED;
+
+        need += shared;
+
+        if (!nearRed && !farRed) {
+            if (parent->color == RED)
+                return need;
+
+            --depth;
+            left = depth > 0 && path[depth - 1]->left == parent;
+            continue;
+        }
+
+        // case 5 owns the near nephew, case 6 alone the far one
+        need += shared || psShared_(farRed ? farther : nearest);
+        return need;
+    }
+
+    return need;
+}
+
+
+/// Checks if other links lead to the node, so that it has to be copied to be changed.
+static int psShared_ (rbNode node) {
+
+    return RB_REFS(node->refs) > 1;
+}
+
+
+/// Makes the node in the given link private to the version: a shared node is replaced
+/// with a copy.
+/// \param tree  - the version that changes the node
+/// \param slot  - the link to the node, in an owned node or the root of the tree
+/// \param stash - the nodes allocated in advance, NULL to allocate a new one
+/// \return the owned node or NULL if there is no memory.
+static rbNode psOwn_ (rbTree tree, rbNode* slot, struct psStash_t* stash) {
+
+    rbNode node = *slot;
+
+    if (!psShared_(node))
+        return node;
+
+    assert (stash == NULL || stash->n > 0);
+
+    rbNode copy = stash ? stash->node[--stash->n] : rb_allocNode_(tree);
+    if (copy == NULL)
+        return NULL;
+
+    // the fields are copied one by one: other versions may change 'refs' meanwhile
+    copy->left   = node->left;
+    copy->right  = node->right;
+    copy->color  = node->color;
+    copy->refs   = 1;
+#ifdef RB_ORDER_STATISTICS
+    copy->count  = node->count;
+#endif
+    memcpy(&copy->pair, &node->pair, sizeof(rbPair));
+
+    if (copy->left != NULL)
+        RB_REF(copy->left->refs);
+    if (copy->right != NULL)
+        RB_REF(copy->right->refs);
+
+    *slot = copy;
+    rb_psUnref_(tree, node);
+    return copy;
+}
+
+
+/// Finds the link to a node of the path.
+/// \param tree  - container
+/// \param path  - the nodes from the root
+/// \param depth - the index of the node in the path
+/// \return pointer to the link in the parent or to the root of the tree.
+static rbNode* psSlot_ (rbTree tree, rbNode* path, int depth) {
+
+    if (depth == 0)
+        return &tree->treeRoot;
+
+    rbNode parent = path[depth - 1];
+    return parent->left == path[depth] ? &parent->left : &parent->right;
+}
+
+
+/// Rotates an owned node and its owned child, like leftRotation and rightRotation. The
+/// links only move between owned nodes, so no node gains or loses a link.
+/// \param tree - container
+/// \param slot - the link to the node
+/// \param left - non-zero to rotate left (the right child goes up)
+static void psRotate_ (rbTree tree, rbNode* slot, int left) {
+
+    rbNode node  = *slot;
+    rbNode pivot = left ? node->right : node->left;
+
+    RB_COUNT(tree, rotations);
+
+    if (left) {
+        node->right = pivot->left;
+        pivot->left = node;
+    }
+    else {
+        node->left = pivot->right;
+        pivot->right = node;
+    }
+
+    *slot = pivot;
+
+#ifdef RB_ORDER_STATISTICS
+    pivot->count = node->count;
+    node->count = 1 + count_(node->left) + count_(node->right);
+#endif
+}
+
+
+/// Drops a link to the node. The node is released with its last link, and then its
+/// links to the children are dropped as well. The right children wait on a stack, at
+/// most one per level.
+void rb_psUnref_ (rbTree tree, rbNode node) {
+
+    rbNode stack[RB_MAX_DEPTH];
+    int    n = 0;
+
+    for (;;) {
+        if (node != NULL && RB_UNREF(node->refs) == 0) {
+            rbNode left = node->left;
+
+            if (node->right != NULL)
+                stack[n++] = node->right;
+
+            rb_releaseNode_(tree, node);
+            node = left;
+        }
+        else if (n > 0)
+            node = stack[--n];
+        else
+            return;
+    }
+}
+
+
+/// Allocates the nodes the rebalancing of a write may need.
+/// \param need - the number of nodes
+/// \return an enum member from rbResult
+static rbResult psFill_ (rbTree tree, struct psStash_t* stash, int need) {
+
+    for (stash->n = 0; stash->n < need; ++stash->n) {
+        stash->node[stash->n] = rb_allocNode_(tree);
+        if (stash->node[stash->n] == NULL) {
+            psDrain_(tree, stash);
+            return RB_LACK_OF_MEMORY;
+        }
+    }
+
+    return RB_SUCCESS;
+}
+
+
+/// Returns the nodes a write has not used.
+static void psDrain_ (rbTree tree, struct psStash_t* stash) {
+
+    while (stash->n > 0)
+        rb_releaseNode_(tree, stash->node[--stash->n]);
+}
+/***
+ *
+ *   end of Persistent engine functions
+ *
+ ****************************************************************************************/
@@ -0,0 +1,631 @@
+/****************************************************************************************
+ *
+ *   RBTreeSplit.c
+ *
+ *   rbSplit, rbJoin and rbUnion of red-black trees, in O(log n) by the black height, and
+ *   of the other engines by their pairs.
+ *
+ ***/
+#include "RBTreeInternal.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+
+/// rbUnion runs in several threads if the containers have this many elements in total,
+/// and the halves of at most RB_UNION_MAX_DEPTH levels of its recursion run in parallel.
+#define RB_UNION_PARALLEL  (1 << 16)
+#define RB_UNION_MAX_DEPTH 6
+
+
+
+/****************************************************************************************
+ *
+ *   prototypes for helper functions
+ *
+ ***/
+struct rbUnion_t;
+
+static rbNode   join_      (rbTree tree, rbNode left, int hl, rbNode mid, rbNode right,
+                            int hr, int* h);
+static rbNode   split_     (rbTree tree, rbNode node, int h, rb_key_type key, rbNode* left,
+                            int* hl, rbNode* right, int* hr);
+static void*    union_     (void* arg);
+static int      blackHeight_   (rbNode root);
+static rbNode   rootOf_        (rbNode root);
+static size_t   countLeft_     (rbNode left, rbNode right, size_t total);
+static rbResult shareAllocator_(rbTree a, rbTree b);
+static rbResult copyNodes_     (rbTree tree, rbTree other);
+static rbResult collectPairs_  (rbTree tree, rbPair** pairs);
+static rbResult splitPairs_    (rbTree tree, rb_key_type key, rbTree left, rbTree right);
+static rbResult movePairs_     (rbTree to, rbTree from);
+/***
+ *
+ *   end of prototypes for helper functions
+ *
+ ****************************************************************************************/
+
+
+
+
+/****************************************************************************************
+ *
+ *   Split and join functions
+ *
+ ***/
+
+//
+/// Split and join
+///======================================================================================
+/// All three operations are built on one primitive, join_: two red-black trees and a
+/// node whose key lies between theirs are linked into one tree. If the black heights of
+/// the trees differ, the node is attached on the spine of the higher tree (the right one
+/// of the left tree or the left one of the right tree) at the first black node of the
+/// same black height as the lower tree, colored red and fixed up as after an insertion.
+/// This costs O(1 + the difference of the black heights).
+///
+/// - rbSplit descends to the key and joins the subtrees it leaves on each side with the
+///   nodes of the path, bottom up: O(log n) in total. Without RB_ORDER_STATISTICS the
+///   size of the parts is not known, and the smaller part is walked to count it;
+/// - rbJoin detaches the largest node of the left tree and uses it to join both trees:
+///   O(log n);
+/// - rbUnion splits one tree by the root key of the other and unites the halves
+///   recursively: O(m log(n/m + 1)) for trees of m <= n elements. The halves are
+///   independent, so for large trees the upper levels of the recursion run in parallel
+///   threads.
+///
+/// The black heights of the pieces are passed along, so they are never recounted.
+///
+/// No node is copied or allocated while the trees are repartitioned: the resulting
+/// trees share the pool of their nodes (see the node pool). Only trees whose nodes come
+/// from different allocators are brought to one first, by copying the smaller of them.
+/// Containers of the B+ engine are repartitioned through their pairs, in linear time.
+///======================================================================================
+///======================================================================================
+//
+
+/// A union of two subtrees, see union_.
+struct rbUnion_t {
+    rbTree tree;       // the container whose counters the joins add to
+    rbNode a, b;       // the subtrees, 'b' wins on equal keys
+    int    ha, hb;     // their black heights
+    int    depth;      // the number of levels below whose halves run in parallel
+    rbNode root;       // the result
+    int    h;          // its black height
+    rbNode dups;       // the left over nodes of 'a', chained through 'left'
+    rbNode last;       // the last of them
+    size_t duplicates; // their number
+};
+
+
+rbResult rbSplit (rbTree tree, rb_key_type key, rbTree* left, rbTree* right)
+{
+    if (tree == NULL || left == NULL || right == NULL || tree->sync != NULL)
+        return RB_INVALID_ARGS;
+
+    rbResult res = rb_create_(NULL, 0, 0, 0, tree->engine, left);
+    if (res != RB_SUCCESS)
+        return res;
+
+    res = rb_create_(NULL, 0, 0, 0, tree->engine, right);
+    if (res != RB_SUCCESS) {
+        rbDestroy(*left);
+        return res;
+    }
+
+    if (tree->engine != RB_ENGINE_REDBLACK) {
+        res = splitPairs_(tree, key, *left, *right);
+        if (res != RB_SUCCESS) {
+            rbDestroy(*left);
+            rbDestroy(*right);
+        }
+        return res;
+    }
+
+    int    hl, hr;
+    rbNode l, r;
+    rbNode eq = split_(tree, tree->treeRoot, blackHeight_(tree->treeRoot), key, &l, &hl,
+                       &r, &hr);
+
+    if (eq != NULL)
+        r = join_(tree, NULL, 0, eq, r, hr, &hr);
+
+    (*left)->treeRoot = rootOf_(l);
+    (*right)->treeRoot = rootOf_(r);
+    (*left)->size = countLeft_(l, r, tree->size);
+    (*right)->size = tree->size - (*left)->size;
+
+    // the reference of the source tree to the pool passes to the left tree
+    (*left)->pool = tree->pool;
+    (*right)->pool = tree->pool;
+    if (tree->pool != NULL)
+        atomic_fetch_add(&tree->pool->refs, 1);
+
+    tree->pool = NULL;
+    tree->treeRoot = NULL;
+    tree->size = 0;
+    return RB_SUCCESS;
+}
+
+
+rbResult rbJoin (rbTree left, rbTree right)
+{
+    if (left == NULL || right == NULL || left == right ||
+        left->sync != NULL || right->sync != NULL)
+        return RB_INVALID_ARGS;
+
+    if (right->size == 0)
+        return RB_SUCCESS;
+
+    if (left->size != 0 && rbLast(left)->key >= rbBegin(right)->key)
+        return RB_INVALID_ARGS;
+
+    if (left->engine != RB_ENGINE_REDBLACK || right->engine != RB_ENGINE_REDBLACK)
+        return movePairs_(left, right);
+
+    rbResult res = shareAllocator_(left, right);
+    if (res != RB_SUCCESS)
+        return res;
+
+    if (left->size == 0)
+        left->treeRoot = right->treeRoot;
+    else {
+        rbNode mid = rb_findMax(left->treeRoot);
+        int    h;
+
+        rb_detach_node_(left, mid);
+        left->treeRoot = join_(left, left->treeRoot, blackHeight_(left->treeRoot), mid,
+                               right->treeRoot, blackHeight_(right->treeRoot), &h);
+    }
+
+    left->size += right->size;
+    right->treeRoot = NULL;
+    right->size = 0;
+    return RB_SUCCESS;
+}
+
+
+rbResult rbUnion (rbTree a, rbTree b)
+{
+    if (a == NULL || b == NULL || a == b || a->sync != NULL || b->sync != NULL)
+        return RB_INVALID_ARGS;
+
+    if (b->size == 0)
+        return RB_SUCCESS;
+
+    if (a->engine != RB_ENGINE_REDBLACK || b->engine != RB_ENGINE_REDBLACK)
+        return movePairs_(a, b);
+
+    rbResult res = shareAllocator_(a, b);
+    if (res != RB_SUCCESS)
+        return res;
+
+    struct rbUnion_t job = {0};
+
+    job.tree = a;
+    job.a = a->treeRoot;
+    job.ha = blackHeight_(a->treeRoot);
+    job.b = b->treeRoot;
+    job.hb = blackHeight_(b->treeRoot);
+
+    if (a->size + b->size >= RB_UNION_PARALLEL) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        while (job.depth < RB_UNION_MAX_DEPTH && (2L << job.depth) <= cpus)
+            ++job.depth;
+    }
+
+    union_(&job);
+
+    // the nodes of 'a' whose keys are also in 'b' are left over
+    for (rbNode node = job.dups; node != NULL; ) {
+        rbNode next = node->left;
+        rb_releaseNode_(a, node);
+        node = next;
+    }
+
+    a->treeRoot = rootOf_(job.root);
+    a->size += b->size - job.duplicates;
+    b->treeRoot = NULL;
+    b->size = 0;
+    return RB_SUCCESS;
+}
+
+
+/// Joins two red-black trees and a node whose key is greater than all keys of the left
+/// tree and less than all keys of the right one.
+/// \param tree  - the container the trees belong to, whose counters the fix-up adds to
+/// \param left  - root of the left tree or NULL
+/// \param hl    - black height of the left tree
+/// \param mid   - the node between the trees
+/// \param right - root of the right tree or NULL
+/// \param hr    - black height of the right tree
+/// \param h     - set to the black height of the result
+/// \return the root of the joined tree.
+static rbNode join_ (rbTree tree, rbNode left, int hl, rbNode mid, rbNode right, int hr,
+                     int* h) {
+
+    // the roots of the pieces of a split may be red
+    if (left != NULL) {
+        left->parent = NULL;
+        if (left->color == RED) {
+            left->color = BLACK;
+            ++hl;
+        }
+    }
+    if (right != NULL) {
+        right->parent = NULL;
+        if (right->color == RED) {
+            right->color = BLACK;
+            ++hr;
+        }
+    }
+
+    if (hl == hr) {
+        mid->parent = NULL;
+        mid->color  = BLACK;
+        mid->left   = left;
+        mid->right  = right;
+        if (left != NULL)
+            left->parent = mid;
+        if (right != NULL)
+            right->parent = mid;
+#ifdef RB_ORDER_STATISTICS
+        mid->count = 1 + count_(left) + count_(right);
+#endif
+        *h = hl + 1;
+        return mid;
+    }
+
+    // Descend the facing spine of the higher tree to the first black node (or leaf) of
+    // the black height of the lower tree. The node and the lower tree become the
+    // children of 'mid', which takes the place of the node.
+    int    toLeft = hl > hr;
+    int    hs     = toLeft ? hl : hr;
+    int    low    = toLeft ? hr : hl;
+    rbNode lower  = toLeft ? right : left;
+    rbNode parent = NULL;
+    rbNode spot   = toLeft ? left : right;
+
+    while (spot != NULL && (spot->color == RED || hs != low)) {
+        hs -= spot->color == BLACK;
+        parent = spot;
+        spot = toLeft ? spot->right : spot->left;
+    }
+
+    mid->parent = parent;
+    mid->color  = RED;
+    mid->left   = toLeft ? spot : lower;
+    mid->right  = toLeft ? lower : spot;
+    if (spot != NULL)
+        spot->parent = mid;
+    if (lower != NULL)
+        lower->parent = mid;
+
+    if (toLeft)
+        parent->right = mid;
+    else
+        parent->left = mid;
+
+#ifdef RB_ORDER_STATISTICS
+    mid->count = 1 + count_(spot) + count_(lower);
+    for (rbNode p = parent; p != NULL; p = p->parent)
+        p->count += 1 + count_(lower);
+#endif
+
+    // The fix-up may rotate at the root of the higher tree, which is not the root of
+    // 'tree', so it runs on a stand-in container whose counters are added to 'tree'.
+    struct rbTree_t higher = {0};
+    higher.treeRoot = toLeft ? left : right;
+    rb_insert_case1(&higher, mid);
+
+#ifdef RB_STATS
+    rb_statsAdd_(&tree->stats.rotations, higher.stats.rotations);
+    for (int i = 1; i < 6; ++i)
+        rb_statsAdd_(&tree->stats.insertCases[i], higher.stats.insertCases[i]);
+#else
+    (void) tree;
+#endif
+
+    // 'mid' is an outer grandchild all the way up, so the fix-up never rotates it and
+    // its children still have the black height of the lower tree.
+    *h = low;
+    for (rbNode p = mid; p != NULL; p = p->parent)
+        *h += p->color == BLACK;
+
+    return higher.treeRoot;
+}
+
+
+/// Splits a subtree by a key. The subtree is taken apart: its nodes go to the two
+/// resulting trees, except the node with the key.
+/// \param tree  - the container of the subtree, whose counters the joins add to
+/// \param node  - root of the subtree or NULL
+/// \param h     - its black height
+/// \param key   - the key to split by
+/// \param left  - set to the root of the tree of the keys less than 'key'
+/// \param hl    - set to its black height
+/// \param right - set to the root of the tree of the keys greater than 'key'
+/// \param hr    - set to its black height
+/// \return the node with the key (its links are stale) or NULL if there is none.
+static rbNode split_ (rbTree tree, rbNode node, int h, rb_key_type key, rbNode* left,
+                      int* hl, rbNode* right, int* hr) {
+
+    if (node == NULL) {
+        *left = *right = NULL;
+        *hl = *hr = 0;
+        return NULL;
+    }
+
+    int    hc = h - (node->color == BLACK);
+    rbNode l  = node->left;
+    rbNode r  = node->right;
+    rbNode m, eq;
+    int    hm;
+
+    if (key == node->pair.key) {
+        *left = l;
+        *hl = hc;
+        *right = r;
+        *hr = hc;
+        return node;
+    }
+
+    if (key < node->pair.key) {
+        eq = split_(tree, l, hc, key, left, hl, &m, &hm);
+        *right = join_(tree, m, hm, node, r, hc, hr);
+    }
+    else {
+        eq = split_(tree, r, hc, key, &m, &hm, right, hr);
+        *left = join_(tree, l, hc, node, m, hm, hl);
+    }
+
+    return eq;
+}
+
+
+/// Unites two subtrees, see rbUnion. Runs in a thread of its own for the halves of a
+/// large union.
+/// \param arg - struct rbUnion_t with the subtrees and the depth set
+/// \return NULL
+static void* union_ (void* arg) {
+
+    struct rbUnion_t* job = (struct rbUnion_t*) arg;
+
+    if (job->a == NULL || job->b == NULL) {
+        job->root = job->a ? job->a : job->b;
+        job->h    = job->a ? job->ha : job->hb;
+        return NULL;
+    }
+
+    rbNode           mid = job->b;
+    struct rbUnion_t lo  = {0};
+    struct rbUnion_t hi  = {0};
+
+    lo.b  = mid->left;
+    hi.b  = mid->right;
+    lo.hb = hi.hb = job->hb - (mid->color == BLACK);
+    lo.depth = hi.depth = job->depth > 0 ? job->depth - 1 : 0;
+    lo.tree = hi.tree = job->tree;
+
+    rbNode eq = split_(job->tree, job->a, job->ha, mid->pair.key, &lo.a, &lo.ha, &hi.a,
+                       &hi.ha);
+
+    // the value of 'b' wins
+    if (eq != NULL) {
+        eq->left = NULL;
+        job->dups = job->last = eq;
+        job->duplicates = 1;
+    }
+
+    pthread_t thread;
+    int parallel = job->depth > 0 && pthread_create(&thread, NULL, union_, &lo) == 0;
+
+    if (!parallel)
+        union_(&lo);
+    union_(&hi);
+    if (parallel)
+        pthread_join(thread, NULL);
+
+    job->root = join_(job->tree, lo.root, lo.h, mid, hi.root, hi.h, &job->h);
+
+    struct rbUnion_t* halves[] = {&lo, &hi};
+    for (int i = 0; i < 2; ++i) {
+        if (halves[i]->dups == NULL)
+            continue;
+        if (job->dups == NULL)
+            job->dups = halves[i]->dups;
+        else
+            job->last->left = halves[i]->dups;
+        job->last = halves[i]->last;
+        job->duplicates += halves[i]->duplicates;
+    }
+
+    return NULL;
+}
+
+
+/// Counts the black nodes on a path from the root of a red-black tree to a leaf.
+static int blackHeight_ (rbNode root) {
+
+    int h = 0;
+
+    for (rbNode node = root; node != NULL; node = node->left)
+        h += node->color == BLACK;
+
+    return h;
+}
+
+
+/// Makes the root of a split or joined tree a proper root: no parent, black.
+static rbNode rootOf_ (rbNode root) {
+
+    if (root != NULL) {
+        root->parent = NULL;
+        root->color = BLACK;
+    }
+
+    return root;
+}
+
+
+/// Counts the nodes of the left one of the two parts of a split.
+/// \param left  - root of the left part
+/// \param right - root of the right part
+/// \param total - the number of nodes in both parts
+static size_t countLeft_ (rbNode left, rbNode right, size_t total) {
+
+#ifdef RB_ORDER_STATISTICS
+    (void) right;
+    (void) total;
+    return count_(left);
+#else
+    // Both parts are walked in step until the smaller one ends: O(the smaller part).
+    rbNode l = left ? rb_findMin(left) : NULL;
+    rbNode r = right ? rb_findMin(right) : NULL;
+    size_t n = 0;
+
+    while (l != NULL && r != NULL) {
+        l = rb_successor_(l);
+        r = rb_successor_(r);
+        ++n;
+    }
+
+    return l == NULL ? n : total - n;
+#endif
+}
+
+
+/// Makes the nodes of two red-black trees belong to one allocator, so that they can be
+/// linked into one tree. Pools used by one tree only are merged; otherwise the smaller
+/// tree is copied into the allocator of the other one.
+/// \return an enum member from rbResult
+static rbResult shareAllocator_ (rbTree a, rbTree b) {
+
+    if (a->pool == b->pool)
+        return RB_SUCCESS;
+
+    if (a->pool != NULL && b->pool != NULL) {
+        if (atomic_load(&b->pool->refs) == 1) {
+            rb_mergePools_(a->pool, b);
+            return RB_SUCCESS;
+        }
+        if (atomic_load(&a->pool->refs) == 1) {
+            rb_mergePools_(b->pool, a);
+            return RB_SUCCESS;
+        }
+    }
+
+    return a->size < b->size ? copyNodes_(a, b) : copyNodes_(b, a);
+}
+
+
+/// Copies the nodes of a red-black tree into the allocator of another tree and frees
+/// the old ones. The copies are linked into a balanced tree.
+/// \param tree  - the tree to be copied
+/// \param other - the tree whose allocator is used
+/// \return an enum member from rbResult
+static rbResult copyNodes_ (rbTree tree, rbTree other) {
+
+    size_t  n     = tree->size;
+    rbNode* nodes = (rbNode*) malloc((n ? n : 1) * sizeof(rbNode));
+    size_t  made  = 0;
+
+    while (nodes != NULL && made < n && (nodes[made] = rb_allocNode_(other)) != NULL)
+        ++made;
+
+    if (nodes == NULL || made < n) {
+        while (made > 0)
+            rb_releaseNode_(other, nodes[--made]);
+        free(nodes);
+        return RB_LACK_OF_MEMORY;
+    }
+
+    size_t i = 0;
+    rbNode first = n ? rb_findMin(tree->treeRoot) : NULL;
+    for (rbNode node = first; node; node = rb_successor_(node)) {
+        *((rb_key_type*)&nodes[i]->pair.key) = node->pair.key;
+        nodes[i]->pair.value = node->pair.value;
+        ++i;
+    }
+
+    rb_dropNodes_(tree);
+    if (tree->pool != NULL)
+        rb_unrefPool_(tree->pool);
+
+    tree->pool = other->pool;
+    if (tree->pool != NULL)
+        atomic_fetch_add(&tree->pool->refs, 1);
+
+    tree->treeRoot = rb_relink_(nodes, n, NULL, 0, rb_redDepth_(n ? n : 1));
+
+    free(nodes);
+    return RB_SUCCESS;
+}
+
+
+/// Copies the pairs of a container into an array in key order.
+/// \param tree  - container
+/// \param pairs - set to the array (to be freed by the caller)
+/// \return an enum member from rbResult
+static rbResult collectPairs_ (rbTree tree, rbPair** pairs) {
+
+    *pairs = (rbPair*) malloc((tree->size ? tree->size : 1) * sizeof(rbPair));
+    if (*pairs == NULL)
+        return RB_LACK_OF_MEMORY;
+
+    size_t i = 0;
+    for (rbPair* pair = rbBegin(tree); pair != NULL; pair = rbNext(tree, pair))
+        memcpy(&(*pairs)[i++], pair, sizeof(rbPair));
+
+    return RB_SUCCESS;
+}
+
+
+/// Splits a container through its pairs, see rbSplit.
+/// \param left  - empty container for the keys less than 'key'
+/// \param right - empty container for the rest
+static rbResult splitPairs_ (rbTree tree, rb_key_type key, rbTree left, rbTree right) {
+
+    rbPair* pairs;
+
+    rbResult res = collectPairs_(tree, &pairs);
+    if (res != RB_SUCCESS)
+        return res;
+
+    size_t n = 0;
+    while (n < tree->size && pairs[n].key < key)
+        ++n;
+
+    res = rbInsertBatch(left, pairs, n);
+    if (res == RB_SUCCESS)
+        res = rbInsertBatch(right, pairs + n, tree->size - n);
+    if (res == RB_SUCCESS)
+        res = rbClear(tree);
+
+    free(pairs);
+    return res;
+}
+
+
+/// Moves all pairs of one container to another through a batch insertion, for the
+/// containers that do not both use the red-black engine. The values of 'from' win.
+static rbResult movePairs_ (rbTree to, rbTree from) {
+
+    rbPair* pairs;
+
+    rbResult res = collectPairs_(from, &pairs);
+    if (res != RB_SUCCESS)
+        return res;
+
+    res = rbInsertBatch(to, pairs, from->size);
+    if (res == RB_SUCCESS)
+        res = rbClear(from);
+
+    free(pairs);
+    return res;
+}
+/***
+ *
+ *   end of Split and join functions
+ *
+ ****************************************************************************************/
@@ -0,0 +1,178 @@
+/****************************************************************************************
+ *
+ *   RBTreeStats.c
+ *
+ *   The counters of RB_STATS and the latencies of RB_STATS_LATENCY, see rbStats.
+ *
+ ***/
+#include "RBTreeInternal.h"
+
+#include <time.h>
+
+
+
+
+/****************************************************************************************
+ *
+ *   Statistics functions
+ *
+ ***/
+
+/// The counters as an array, for copying and zeroing them one by one.
+#define RB_STATS_WORDS (sizeof(rbCounters) / sizeof(size_t))
+
+
+rbResult rbStats (rbTree tree, rbCounters* out)
+{
+    if (out != NULL)
+        memset(out, 0, sizeof(rbCounters));
+
+    if (tree == NULL || out == NULL)
+        return RB_INVALID_ARGS;
+
+#ifdef RB_STATS
+    const size_t* from = (const size_t*) &tree->stats;
+    size_t*       to   = (size_t*) out;
+
+    for (size_t i = 0; i < RB_STATS_WORDS; ++i)
+        to[i] = RB_LOAD(from[i]);
+
+    return RB_SUCCESS;
+#else
+    return RB_INVALID_ARGS;
+#endif
+}
+
+
+rbResult rbStatsReset (rbTree tree)
+{
+    if (tree == NULL)
+        return RB_INVALID_ARGS;
+
+#ifdef RB_STATS
+    size_t* counters = (size_t*) &tree->stats;
+
+    for (size_t i = 0; i < RB_STATS_WORDS; ++i)
+#ifdef __GNUC__
+        __atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+#else
+        counters[i] = 0;
+#endif
+
+    return RB_SUCCESS;
+#else
+    return RB_INVALID_ARGS;
+#endif
+}
+
+
+rbResult rbStatsToJson (const rbCounters* stats, FILE* file)
+{
+    static const char* const ops[RB_STATS_OPS] = {"find", "insert", "erase"};
+
+    if (stats == NULL || file == NULL)
+        return RB_INVALID_ARGS;
+
+    fprintf(file, "{\"descents\": %zu, \"comparisons\": %zu, \"maxDepth\": %zu, "
+                  "\"rotations\": %zu,\n", stats->descents, stats->comparisons,
+                  stats->maxDepth, stats->rotations);
+
+    fprintf(file, " \"insertCases\": [");
+    for (int i = 1; i < 6; ++i)
+        fprintf(file, i > 1 ? ", %zu" : "%zu", stats->insertCases[i]);
+
+    fprintf(file, "],\n \"deleteCases\": [");
+    for (int i = 1; i < 7; ++i)
+        fprintf(file, i > 1 ? ", %zu" : "%zu", stats->deleteCases[i]);
+
+    fprintf(file, "],\n \"allocations\": %zu, \"releases\": %zu,\n \"latency\": {",
+            stats->allocations, stats->releases);
+
+    for (int op = 0; op < RB_STATS_OPS; ++op) {
+        fprintf(file, op > 0 ? ",\n  \"%s\": [" : "\n  \"%s\": [", ops[op]);
+        for (int i = 0; i < RB_STATS_BUCKETS; ++i)
+            fprintf(file, i > 0 ? ", %zu" : "%zu", stats->latency[op][i]);
+        fprintf(file, "]");
+    }
+
+    fprintf(file, "}}\n");
+
+    if (fflush(file) != 0 || ferror(file))
+        return RB_IO_ERROR;
+
+    return RB_SUCCESS;
+}
+
+
+#ifdef RB_STATS
+/// Adds to a counter that other threads may update at the same time.
+void rb_statsAdd_ (size_t* counter, size_t n) {
+
+#ifdef __GNUC__
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+#else
+    *counter += n;
+#endif
+}
+
+
+/// Counts descents from the root.
+/// \param tree  - container
+/// \param count - the number of descents
+/// \param nodes - the number of nodes they compared with their keys
+/// \param depth - the most nodes one of them compared
+void rb_statsDescents_ (rbTree tree, size_t count, size_t nodes, size_t depth) {
+
+    rb_statsAdd_(&tree->stats.descents, count);
+    rb_statsAdd_(&tree->stats.comparisons, nodes);
+
+#ifdef __GNUC__
+    size_t max = __atomic_load_n(&tree->stats.maxDepth, __ATOMIC_RELAXED);
+    while (depth > max &&
+           !__atomic_compare_exchange_n(&tree->stats.maxDepth, &max, depth, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+#else
+    if (depth > tree->stats.maxDepth)
+        tree->stats.maxDepth = depth;
+#endif
+}
+#endif
+
+
+#ifdef RB_STATS_LATENCY
+/// \return the monotonic time in nanoseconds.
+uint64_t rb_statsNow_ (void) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+
+/// Records the time of an operation in its histogram.
+/// \param tree  - container, NULL if the operation was rejected
+/// \param op    - the operation
+/// \param start - rb_statsNow_ when it began
+void rb_statsLatency_ (rbTree tree, rbStatsOp op, uint64_t start) {
+
+    uint64_t ns     = rb_statsNow_() - start;
+    int      bucket = 0;
+
+    if (tree == NULL)
+        return;
+
+    while (ns > 1 && bucket < RB_STATS_BUCKETS - 1) {
+        ns >>= 1;
+        ++bucket;
+    }
+
+    rb_statsAdd_(&tree->stats.latency[op][bucket], 1);
+}
+#endif
+/***
+ *
+ *   end of Statistics functions
+ *
+ ****************************************************************************************/
@@ -1,5 +1,16 @@
 #include "Operation.h"
 
+#include <stdlib.h>
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OP_X86
+#include <immintrin.h>
+#endif
+
+// the alignment of the arrays of a PointBuffer: a cache line, and a full AVX-512 vector
+#define OP_ALIGN 64
+
 
 double add(double a, double b) {
     return a + b;
@@ -28,3 +39,264 @@ int sub(int a, int b) {
 double square_distance(struct Point* a, struct Point* b) {
     return (a->x - b->x) * (a->x - b->x) + (a->x - b->x) * (a->x - b->x);
 }
+
+
+// The array kernels. Each instruction set has its own kernels, compiled for it with a
+// target attribute, and the table of the best one the CPU supports is chosen at run
+// time: the library itself is built for the baseline CPU.
+
+struct OpKernels {
+    OpIsa isa;
+    void (*add_d)(const double* a, const double* b, double* out, size_t n);
+    void (*add_f)(const float* a, const float* b, float* out, size_t n);
+    void (*add_i)(const int* a, const int* b, int* out, size_t n);
+    void (*sub_d)(const double* a, const double* b, double* out, size_t n);
+    void (*sub_f)(const float* a, const float* b, float* out, size_t n);
+    void (*sub_i)(const int* a, const int* b, int* out, size_t n);
+    void (*distance)(const double* ax, const double* ay, const double* bx, const double* by,
+                     double* out, size_t n);
+    void (*distance_to)(const double* ax, const double* ay, double x, double y,
+                        double* out, size_t n);
+};
+
+
+template <typename T>
+static void add_scalar(const T* a, const T* b, T* out, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        out[i] = a[i] + b[i];
+}
+
+template <typename T>
+static void sub_scalar(const T* a, const T* b, T* out, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        out[i] = a[i] - b[i];
+}
+
+static void distance_scalar(const double* ax, const double* ay, const double* bx,
+                            const double* by, double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        double dx = ax[i] - bx[i], dy = ay[i] - by[i];
+        out[i] = dx * dx + dy * dy;
+    }
+}
+
+static void distance_to_scalar(const double* ax, const double* ay, double x, double y,
+                               double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        double dx = ax[i] - x, dy = ay[i] - y;
+        out[i] = dx * dx + dy * dy;
+    }
+}
+
+static const OpKernels scalar_kernels = {
+    OP_ISA_SCALAR,
+    add_scalar<double>, add_scalar<float>, add_scalar<int>,
+    sub_scalar<double>, sub_scalar<float>, sub_scalar<int>,
+    distance_scalar, distance_to_scalar
+};
+
+
+#ifdef OP_X86
+
+// out = a op b, 'step' elements at a time, the rest one by one
+#define OP_ARRAYS(name, isa, T, step, load, store, vop, op)                     \
+    __attribute__((target(isa)))                                                \
+    static void name(const T* a, const T* b, T* out, size_t n) {                \
+        size_t i = 0;                                                           \
+        for (; i + (step) <= n; i += (step))                                    \
+            store(out + i, vop(load(a + i), load(b + i)));                      \
+        for (; i < n; ++i)                                                      \
+            out[i] = a[i] op b[i];                                              \
+    }
+
+// squared distances between the points of two buffers and from the points to one point
+#define OP_DISTANCES(name, name_to, isa, V, step, load, store, set1, vsub, vmul, vadd) \
+    __attribute__((target(isa)))                                                \
+    static void name(const double* ax, const double* ay, const double* bx,      \
+                     const double* by, double* out, size_t n) {                 \
+        size_t i = 0;                                                           \
+        for (; i + (step) <= n; i += (step)) {                                  \
+            V dx = vsub(load(ax + i), load(bx + i));                            \
+            V dy = vsub(load(ay + i), load(by + i));                            \
+            store(out + i, vadd(vmul(dx, dx), vmul(dy, dy)));                   \
+        }                                                                       \
+        distance_scalar(ax + i, ay + i, bx + i, by + i, out + i, n - i);        \
+    }                                                                           \
+                                                                                \
+    __attribute__((target(isa)))                                                \
+    static void name_to(const double* ax, const double* ay, double x, double y, \
+                        double* out, size_t n) {                                \
+        V px = set1(x), py = set1(y);                                           \
+        size_t i = 0;                                                           \
+        for (; i + (step) <= n; i += (step)) {                                  \
+            V dx = vsub(load(ax + i), px);                                      \
+            V dy = vsub(load(ay + i), py);                                      \
+            store(out + i, vadd(vmul(dx, dx), vmul(dy, dy)));                   \
+        }                                                                       \
+        distance_to_scalar(ax + i, ay + i, x, y, out + i, n - i);              \
+    }
+
+#define OP_LOAD128I(p)     _mm_loadu_si128((const __m128i*) (p))
+#define OP_STORE128I(p, v) _mm_storeu_si128((__m128i*) (p), (v))
+#define OP_LOAD256I(p)     _mm256_loadu_si256((const __m256i*) (p))
+#define OP_STORE256I(p, v) _mm256_storeu_si256((__m256i*) (p), (v))
+
+OP_ARRAYS(add_sse2_d, "sse2", double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, +)
+OP_ARRAYS(add_sse2_f, "sse2", float, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, +)
+OP_ARRAYS(add_sse2_i, "sse2", int, 4, OP_LOAD128I, OP_STORE128I, _mm_add_epi32, +)
+OP_ARRAYS(sub_sse2_d, "sse2", double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_sub_pd, -)
+OP_ARRAYS(sub_sse2_f, "sse2", float, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_sub_ps, -)
+OP_ARRAYS(sub_sse2_i, "sse2", int, 4, OP_LOAD128I, OP_STORE128I, _mm_sub_epi32, -)
+OP_DISTANCES(distance_sse2, distance_to_sse2, "sse2", __m128d, 2, _mm_loadu_pd,
+             _mm_storeu_pd, _mm_set1_pd, _mm_sub_pd, _mm_mul_pd, _mm_add_pd)
+
+OP_ARRAYS(add_avx2_d, "avx2", double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_add_pd, +)
+OP_ARRAYS(add_avx2_f, "avx2", float, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, +)
+OP_ARRAYS(add_avx2_i, "avx2", int, 8, OP_LOAD256I, OP_STORE256I, _mm256_add_epi32, +)
+OP_ARRAYS(sub_avx2_d, "avx2", double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_sub_pd, -)
+OP_ARRAYS(sub_avx2_f, "avx2", float, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_sub_ps, -)
+OP_ARRAYS(sub_avx2_i, "avx2", int, 8, OP_LOAD256I, OP_STORE256I, _mm256_sub_epi32, -)
+OP_DISTANCES(distance_avx2, distance_to_avx2, "avx2", __m256d, 4, _mm256_loadu_pd,
+             _mm256_storeu_pd, _mm256_set1_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_add_pd)
+
+OP_ARRAYS(add_avx512_d, "avx512f", double, 8, _mm512_loadu_pd, _mm512_storeu_pd, _mm512_add_pd, +)
+OP_ARRAYS(add_avx512_f, "avx512f", float, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps, +)
+OP_ARRAYS(add_avx512_i, "avx512f", int, 16, _mm512_loadu_si512, _mm512_storeu_si512,
+          _mm512_add_epi32, +)
+OP_ARRAYS(sub_avx512_d, "avx512f", double, 8, _mm512_loadu_pd, _mm512_storeu_pd, _mm512_sub_pd, -)
+OP_ARRAYS(sub_avx512_f, "avx512f", float, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_sub_ps, -)
+OP_ARRAYS(sub_avx512_i, "avx512f", int, 16, _mm512_loadu_si512, _mm512_storeu_si512,
+          _mm512_sub_epi32, -)
+OP_DISTANCES(distance_avx512, distance_to_avx512, "avx512f", __m512d, 8, _mm512_loadu_pd,
+             _mm512_storeu_pd, _mm512_set1_pd, _mm512_sub_pd, _mm512_mul_pd, _mm512_add_pd)
+
+static const OpKernels sse2_kernels = {
+    OP_ISA_SSE2,
+    add_sse2_d, add_sse2_f, add_sse2_i, sub_sse2_d, sub_sse2_f, sub_sse2_i,
+    distance_sse2, distance_to_sse2
+};
+
+static const OpKernels avx2_kernels = {
+    OP_ISA_AVX2,
+    add_avx2_d, add_avx2_f, add_avx2_i, sub_avx2_d, sub_avx2_f, sub_avx2_i,
+    distance_avx2, distance_to_avx2
+};
+
+static const OpKernels avx512_kernels = {
+    OP_ISA_AVX512,
+    add_avx512_d, add_avx512_f, add_avx512_i, sub_avx512_d, sub_avx512_f, sub_avx512_i,
+    distance_avx512, distance_to_avx512
+};
+
+#endif // OP_X86
+
+
+// The kernels of the instruction set, NULL if the CPU does not support it.
+static const OpKernels* kernels_for(OpIsa isa) {
+    if (isa == OP_ISA_SCALAR)
+        return &scalar_kernels;
+#ifdef OP_X86
+    __builtin_cpu_init();
+    if (isa == OP_ISA_SSE2 && __builtin_cpu_supports("sse2"))
+        return &sse2_kernels;
+    if (isa == OP_ISA_AVX2 && __builtin_cpu_supports("avx2"))
+        return &avx2_kernels;
+    if (isa == OP_ISA_AVX512 && __builtin_cpu_supports("avx512f"))
+        return &avx512_kernels;
+#endif
+    return NULL;
+}
+
+static std::atomic<const OpKernels*> active_kernels(NULL);
+
+static const OpKernels* kernels() {
+    const OpKernels* k = active_kernels.load(std::memory_order_acquire);
+    if (k != NULL)
+        return k;
+
+    for (int isa = OP_ISA_AVX512; k == NULL; --isa)
+        k = kernels_for((OpIsa) isa);
+
+    active_kernels.store(k, std::memory_order_release);
+    return k;
+}
+
+OpIsa op_isa() {
+    return kernels()->isa;
+}
+
+bool op_use_isa(OpIsa isa) {
+    const OpKernels* k = kernels_for(isa);
+    if (k == NULL)
+        return false;
+
+    active_kernels.store(k, std::memory_order_release);
+    return true;
+}
+
+
+void add_arrays(const double* a, const double* b, double* out, size_t n) {
+    kernels()->add_d(a, b, out, n);
+}
+
+void add_arrays(const float* a, const float* b, float* out, size_t n) {
+    kernels()->add_f(a, b, out, n);
+}
+
+void add_arrays(const int* a, const int* b, int* out, size_t n) {
+    kernels()->add_i(a, b, out, n);
+}
+
+void sub_arrays(const double* a, const double* b, double* out, size_t n) {
+    kernels()->sub_d(a, b, out, n);
+}
+
+void sub_arrays(const float* a, const float* b, float* out, size_t n) {
+    kernels()->sub_f(a, b, out, n);
+}
+
+void sub_arrays(const int* a, const int* b, int* out, size_t n) {
+    kernels()->sub_i(a, b, out, n);
+}
+
+
+bool point_buffer_create(PointBuffer* buffer, size_t size) {
+    // aligned_alloc wants a multiple of the alignment
+    size_t bytes = (size * sizeof(double) + OP_ALIGN - 1) / OP_ALIGN * OP_ALIGN;
+    if (bytes == 0)
+        bytes = OP_ALIGN;
+
+    buffer->x = (double*) aligned_alloc(OP_ALIGN, bytes);
+    buffer->y = (double*) aligned_alloc(OP_ALIGN, bytes);
+    buffer->size = size;
+
+    if (buffer->x == NULL || buffer->y == NULL) {
+        point_buffer_destroy(buffer);
+        return false;
+    }
+    return true;
+}
+
+void point_buffer_fill(PointBuffer* buffer, const Point* points) {
+    for (size_t i = 0; i < buffer->size; ++i) {
+        buffer->x[i] = points[i].x;
+        buffer->y[i] = points[i].y;
+    }
+}
+
+void point_buffer_destroy(PointBuffer* buffer) {
+    free(buffer->x);
+    free(buffer->y);
+    buffer->x = NULL;
+    buffer->y = NULL;
+    buffer->size = 0;
+}
+
+void square_distance_many(const PointBuffer* a, const PointBuffer* b, double* out) {
+    size_t n = a->size < b->size ? a->size : b->size;
+    kernels()->distance(a->x, a->y, b->x, b->y, out, n);
+}
+
+void square_distance_many(const PointBuffer* a, const Point* to, double* out) {
+    kernels()->distance_to(a->x, a->y, to->x, to->y, out, a->size);
+}
@@ -1,4 +1,7 @@
+#pragma once
+
 #include <stdio.h>
+#include <stddef.h>
 
 double add(double a, double b);
 
@@ -18,3 +21,54 @@ struct Point {
 };
 
 double square_distance(Point* a, Point* b);
+
+// Array forms: out[i] = a[i] + b[i] (or -) for i < n. 'out' may be 'a' or 'b'.
+void add_arrays(const double* a, const double* b, double* out, size_t n);
+
+void add_arrays(const float* a, const float* b, float* out, size_t n);
+
+void add_arrays(const int* a, const int* b, int* out, size_t n);
+
+void sub_arrays(const double* a, const double* b, double* out, size_t n);
+
+void sub_arrays(const float* a, const float* b, float* out, size_t n);
+
+void sub_arrays(const int* a, const int* b, int* out, size_t n);
+
+// Points as a structure of arrays: the coordinates of point i are x[i] and y[i]. The
+// arrays are 64-byte aligned.
+struct PointBuffer {
+    double* x;
+    double* y;
+    size_t  size;
+};
+
+// Allocates a buffer of 'size' points; false if there is no memory.
+bool point_buffer_create(PointBuffer* buffer, size_t size);
+
+// Copies 'size' points of an array of structs into a buffer of the same size.
+void point_buffer_fill(PointBuffer* buffer, const Point* points);
+
+void point_buffer_destroy(PointBuffer* buffer);
+
+// out[i] = (a.x[i] - b.x[i])^2 + (a.y[i] - b.y[i])^2 for i < min(a.size, b.size).
+void square_distance_many(const PointBuffer* a, const PointBuffer* b, double* out);
+
+// out[i] = (a.x[i] - to.x)^2 + (a.y[i] - to.y)^2 for i < a.size.
+void square_distance_many(const PointBuffer* a, const Point* to, double* out);
+
+// Instruction sets of the array kernels. The best one the CPU supports is chosen at
+// the first call.
+enum OpIsa {
+    OP_ISA_SCALAR = 0,
+    OP_ISA_SSE2   = 1,
+    OP_ISA_AVX2   = 2,
+    OP_ISA_AVX512 = 3
+};
+
+// The instruction set of the kernels in use.
+OpIsa op_isa();
+
+// Switches the kernels to another instruction set, e.g. to compare them; false if the
+// CPU does not support it.
+bool op_use_isa(OpIsa isa);
@@ -0,0 +1,235 @@
+#include "PointSet.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+// distances computed at once by a brute-force scan: 8 KB, in the L1 cache
+#define PS_CHUNK 1024
+
+
+namespace {
+
+struct Candidate {
+    double distance;
+    size_t index;
+};
+
+// nearer first, then the lower number
+bool operator<(const Candidate& a, const Candidate& b) {
+    return a.distance < b.distance || (a.distance == b.distance && a.index < b.index);
+}
+
+// The k best candidates seen so far, the worst of them on top of a max-heap.
+class Nearest {
+public:
+    explicit Nearest(size_t k) : k_(k) { heap_.reserve(k); }
+
+    bool full() const { return heap_.size() == k_; }
+    double worst() const { return heap_.front().distance; }
+
+    void offer(double distance, size_t index) {
+        Candidate c = {distance, index};
+
+        if (heap_.size() < k_) {
+            heap_.push_back(c);
+            std::push_heap(heap_.begin(), heap_.end());
+        }
+        else if (c < heap_.front()) {
+            std::pop_heap(heap_.begin(), heap_.end());
+            heap_.back() = c;
+            std::push_heap(heap_.begin(), heap_.end());
+        }
+    }
+
+    size_t take(size_t* indices, double* distances) {
+        std::sort_heap(heap_.begin(), heap_.end());
+
+        for (size_t i = 0; i < heap_.size(); ++i) {
+            indices[i] = heap_[i].index;
+            if (distances != NULL)
+                distances[i] = heap_[i].distance;
+        }
+        return heap_.size();
+    }
+
+private:
+    size_t                 k_;
+    std::vector<Candidate> heap_;
+};
+
+struct KdBuild {
+    const PointBuffer* points;
+    size_t*            order;
+
+    void build(size_t lo, size_t hi, int depth) {
+        if (hi - lo <= PS_LEAF_SIZE)
+            return;
+
+        const double* axis = depth % 2 == 0 ? points->x : points->y;
+        size_t        mid  = lo + (hi - lo) / 2;
+
+        std::nth_element(order + lo, order + mid, order + hi, [axis](size_t a, size_t b) {
+            return axis[a] < axis[b] || (axis[a] == axis[b] && a < b);
+        });
+
+        build(lo, mid, depth + 1);
+        build(mid + 1, hi, depth + 1);
+    }
+};
+
+struct KdSearch {
+    const PointBuffer* tree;
+    const size_t*      order;
+    Point              query;
+    Nearest*           best;
+
+    void offer(size_t i) {
+        double dx = tree->x[i] - query.x, dy = tree->y[i] - query.y;
+        best->offer(dx * dx + dy * dy, order[i]);
+    }
+
+    void search(size_t lo, size_t hi, int depth) {
+        if (hi - lo <= PS_LEAF_SIZE) {
+            for (size_t i = lo; i < hi; ++i)
+                offer(i);
+            return;
+        }
+
+        size_t mid  = lo + (hi - lo) / 2;
+        double diff = depth % 2 == 0 ? query.x - tree->x[mid] : query.y - tree->y[mid];
+
+        offer(mid);
+
+        // the side of the query first; the other one only if it may hold a nearer
+        // point, or one as near with a lower number
+        if (diff < 0) {
+            search(lo, mid, depth + 1);
+            if (!best->full() || diff * diff <= best->worst())
+                search(mid + 1, hi, depth + 1);
+        }
+        else {
+            search(mid + 1, hi, depth + 1);
+            if (!best->full() || diff * diff <= best->worst())
+                search(lo, mid, depth + 1);
+        }
+    }
+};
+
+} // namespace
+
+
+PointSet::PointSet() : points_{NULL, NULL, 0}, capacity_(0), tree_{NULL, NULL, 0}, order_(NULL) {
+}
+
+PointSet::PointSet(const Point* points, size_t n) : PointSet() {
+    add(points, n);
+}
+
+PointSet::~PointSet() {
+    point_buffer_destroy(&points_);
+    point_buffer_destroy(&tree_);
+    free(order_);
+}
+
+bool PointSet::reserve(size_t capacity) {
+    PointBuffer grown;
+    if (!point_buffer_create(&grown, capacity))
+        return false;
+
+    std::copy(points_.x, points_.x + points_.size, grown.x);
+    std::copy(points_.y, points_.y + points_.size, grown.y);
+    grown.size = points_.size;
+
+    point_buffer_destroy(&points_);
+    points_   = grown;
+    capacity_ = capacity;
+    return true;
+}
+
+bool PointSet::add(Point point) {
+    return add(&point, 1);
+}
+
+bool PointSet::add(const Point* points, size_t n) {
+    if (points_.size + n > capacity_) {
+        size_t capacity = std::max(std::max(capacity_ * 2, points_.size + n), (size_t) 16);
+        if (!reserve(capacity))
+            return false;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        points_.x[points_.size + i] = points[i].x;
+        points_.y[points_.size + i] = points[i].y;
+    }
+    points_.size += n;
+    return true;
+}
+
+void PointSet::square_distances(const Point& query, double* out) const {
+    square_distance_many(&points_, &query, out);
+}
+
+void PointSet::pairwise_square_distances(const PointSet& other, double* out) const {
+    for (size_t i = 0; i < points_.size; ++i) {
+        Point point = at(i);
+        square_distance_many(&other.points_, &point, out + i * other.size());
+    }
+}
+
+bool PointSet::index() {
+    size_t      n = points_.size;
+    PointBuffer tree;
+    size_t*     order = (size_t*) malloc((n ? n : 1) * sizeof(size_t));
+
+    if (order == NULL || !point_buffer_create(&tree, n)) {
+        free(order);
+        return false;
+    }
+
+    for (size_t i = 0; i < n; ++i)
+        order[i] = i;
+
+    KdBuild kd = {&points_, order};
+    kd.build(0, n, 0);
+
+    for (size_t i = 0; i < n; ++i) {
+        tree.x[i] = points_.x[order[i]];
+        tree.y[i] = points_.y[order[i]];
+    }
+
+    point_buffer_destroy(&tree_);
+    free(order_);
+    tree_  = tree;
+    order_ = order;
+    return true;
+}
+
+size_t PointSet::nearest(const Point& query, size_t k, size_t* indices, double* distances) const {
+    k = std::min(k, points_.size);
+    if (k == 0)
+        return 0;
+
+    Nearest best(k);
+
+    if (indexed() && points_.size > PS_BRUTE_FORCE_MAX) {
+        KdSearch kd = {&tree_, order_, query, &best};
+        kd.search(0, tree_.size, 0);
+        return best.take(indices, distances);
+    }
+
+    double chunk[PS_CHUNK];
+
+    for (size_t base = 0; base < points_.size; base += PS_CHUNK) {
+        size_t      n    = std::min((size_t) PS_CHUNK, points_.size - base);
+        PointBuffer part = {points_.x + base, points_.y + base, n};
+
+        square_distance_many(&part, &query, chunk);
+
+        for (size_t i = 0; i < n; ++i)
+            if (!best.full() || chunk[i] <= best.worst())
+                best.offer(chunk[i], base + i);
+    }
+
+    return best.take(indices, distances);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "Operation.h"
+
+// Sets of at most this many points are searched by brute force even if indexed: a SIMD
+// scan of a few thousand points is faster than walking a tree.
+#define PS_BRUTE_FORCE_MAX 2048
+
+// Points of a k-d tree leaf, scanned together.
+#define PS_LEAF_SIZE 16
+
+// A set of 2D points stored as a structure of arrays (see PointBuffer), with batch
+// distances and k-nearest-neighbor search. Points are numbered in the order they were
+// added.
+//
+// nearest() scans all points with the SIMD kernels of Operation.h. For larger sets,
+// index() builds a k-d tree that nearest() then uses; adding a point drops the index.
+// The const methods may run in several threads at once.
+class PointSet {
+public:
+    PointSet();
+    PointSet(const Point* points, size_t n);
+    ~PointSet();
+
+    PointSet(const PointSet&) = delete;
+    PointSet& operator=(const PointSet&) = delete;
+
+    // false if there is no memory
+    bool add(Point point);
+    bool add(const Point* points, size_t n);
+
+    size_t size() const { return points_.size; }
+    Point  at(size_t i) const { return Point{points_.x[i], points_.y[i]}; }
+
+    // the coordinates as a PointBuffer, valid until the next add
+    const PointBuffer& buffer() const { return points_; }
+
+    // out[i] = the squared distance from point i to the query, for i < size()
+    void square_distances(const Point& query, double* out) const;
+
+    // out[i * other.size() + j] = the squared distance from point i to point j of 'other'
+    void pairwise_square_distances(const PointSet& other, double* out) const;
+
+    // Builds the k-d tree for nearest(); false if there is no memory.
+    bool index();
+    bool indexed() const { return tree_.size == points_.size && tree_.size != 0; }
+
+    // Finds the min(k, size()) points nearest to the query, nearest first; points at
+    // the same distance in the order of their numbers.
+    // indices   - their numbers
+    // distances - their squared distances to the query, may be NULL
+    // returns the number of points found
+    size_t nearest(const Point& query, size_t k, size_t* indices, double* distances) const;
+
+private:
+    bool reserve(size_t capacity);
+
+    PointBuffer points_;   // 'size' points of 'capacity_'
+    size_t      capacity_;
+
+    // the k-d tree: the points reordered so that every range [lo, hi) of the tree has
+    // its median at (lo + hi) / 2, splitting by x at even depths and by y at odd ones
+    PointBuffer tree_;
+    size_t*     order_;    // order_[i] - the number of the point at tree_ position i
+};
@@ -0,0 +1,431 @@
+#include "Reduce.h"
+#include "Operation.h"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define REDUCE_X86
+#endif
+
+
+namespace {
+
+// Integers are added in unsigned 64-bit lanes, which wrap instead of overflowing.
+template <typename T>
+using Acc = typename std::conditional<std::is_floating_point<T>::value, T, uint64_t>::type;
+
+// The kernels of an instruction set, reducing n > 0 elements. 'max' does not store the
+// minimum.
+template <typename T>
+struct Kernels {
+    Acc<T> (*sum)(const T* data, size_t n);
+    void (*max)(const T* data, size_t n, T* min, T* max);
+    void (*minmax)(const T* data, size_t n, T* min, T* max);
+};
+
+
+template <typename T>
+Acc<T> sum_scalar(const T* data, size_t n) {
+    Acc<T> sum = 0;
+    for (size_t i = 0; i < n; ++i)
+        sum += (Acc<T>) data[i];
+    return sum;
+}
+
+template <typename T, bool Min>
+void extremes_scalar(const T* data, size_t n, T* min, T* max) {
+    T lo = data[0], hi = data[0];
+
+    for (size_t i = 1; i < n; ++i) {
+        if (Min && data[i] < lo)
+            lo = data[i];
+        if (data[i] > hi)
+            hi = data[i];
+    }
+
+    if (Min)
+        *min = lo;
+    *max = hi;
+}
+
+
+#ifdef REDUCE_X86
+
+// The kernels for vectors of 'width' bytes, written with the vector extensions of GCC
+// and compiled for the instruction set with a target attribute, as in Operation.c. Four
+// vectors are reduced at a time, to hide the latency of the additions.
+//
+// The sum loads as many elements as its accumulator has lanes, widening integers to 64
+// bits; the lanes are added up in order at the end.
+#define REDUCE_KERNELS(name, isa, width)                                        \
+    template <typename T>                                                       \
+    __attribute__((target(isa)))                                                \
+    Acc<T> sum_##name(const T* data, size_t n) {                                \
+        typedef Acc<T> A;                                                       \
+        constexpr size_t L = (width) / sizeof(A);                               \
+        typedef T VT __attribute__((vector_size(L * sizeof(T))));               \
+        typedef A VA __attribute__((vector_size(width)));                       \
+                                                                                \
+        VA acc0 = {}, acc1 = {}, acc2 = {}, acc3 = {};                          \
+        VT v0, v1, v2, v3;                                                      \
+        size_t i = 0;                                                           \
+        for (; i + 4 * L <= n; i += 4 * L) {                                    \
+            memcpy(&v0, data + i, sizeof(VT));                                  \
+            memcpy(&v1, data + i + L, sizeof(VT));                              \
+            memcpy(&v2, data + i + 2 * L, sizeof(VT));                          \
+            memcpy(&v3, data + i + 3 * L, sizeof(VT));                          \
+            acc0 += __builtin_convertvector(v0, VA);                            \
+            acc1 += __builtin_convertvector(v1, VA);                            \
+            acc2 += __builtin_convertvector(v2, VA);                            \
+            acc3 += __builtin_convertvector(v3, VA);                            \
+        }                                                                       \
+                                                                                \
+        VA all = (acc0 + acc1) + (acc2 + acc3);                                 \
+        A  sum = all[0];                                                        \
+        for (size_t j = 1; j < L; ++j)                                          \
+            sum += all[j];                                                      \
+        for (; i < n; ++i)                                                      \
+            sum += (A) data[i];                                                 \
+        return sum;                                                             \
+    }                                                                           \
+                                                                                \
+    template <typename T, bool Min>                                             \
+    __attribute__((target(isa)))                                                \
+    void extremes_##name(const T* data, size_t n, T* min, T* max) {             \
+        constexpr size_t L = (width) / sizeof(T);                               \
+        typedef T V __attribute__((vector_size(width)));                        \
+                                                                                \
+        if (n < 4 * L) {                                                        \
+            extremes_scalar<T, Min>(data, n, min, max);                         \
+            return;                                                             \
+        }                                                                       \
+                                                                                \
+        V hi0, hi1, hi2, hi3, v0, v1, v2, v3;                                   \
+        memcpy(&hi0, data, sizeof(V));                                          \
+        memcpy(&hi1, data + L, sizeof(V));                                      \
+        memcpy(&hi2, data + 2 * L, sizeof(V));                                  \
+        memcpy(&hi3, data + 3 * L, sizeof(V));                                  \
+        V lo0 = hi0, lo1 = hi1, lo2 = hi2, lo3 = hi3;                           \
+                                                                                \
+        size_t i = 4 * L;                                                       \
+        for (; i + 4 * L <= n; i += 4 * L) {                                    \
+            memcpy(&v0, data + i, sizeof(V));                                   \
+            memcpy(&v1, data + i + L, sizeof(V));                               \
+            memcpy(&v2, data + i + 2 * L, sizeof(V));                           \
+            memcpy(&v3, data + i + 3 * L, sizeof(V));                           \
+            if (Min) {                                                          \
+                lo0 = v0 < lo0 ? v0 : lo0;                                      \
+                lo1 = v1 < lo1 ? v1 : lo1;                                      \
+                lo2 = v2 < lo2 ? v2 : lo2;                                      \
+                lo3 = v3 < lo3 ? v3 : lo3;                                      \
+            }                                                                   \
+            hi0 = v0 > hi0 ? v0 : hi0;                                          \
+            hi1 = v1 > hi1 ? v1 : hi1;                                          \
+            hi2 = v2 > hi2 ? v2 : hi2;                                          \
+            hi3 = v3 > hi3 ? v3 : hi3;                                          \
+        }                                                                       \
+                                                                                \
+        lo0 = lo1 < lo0 ? lo1 : lo0;                                            \
+        lo2 = lo3 < lo2 ? lo3 : lo2;                                            \
+        lo0 = lo2 < lo0 ? lo2 : lo0;                                            \
+        hi0 = hi1 > hi0 ? hi1 : hi0;                                            \
+        hi2 = hi3 > hi2 ? hi3 : hi2;                                            \
+        hi0 = hi2 > hi0 ? hi2 : hi0;                                            \
+                                                                                \
+        T lo = lo0[0], hi = hi0[0];                                             \
+        for (size_t j = 1; j < L; ++j) {                                        \
+            lo = lo0[j] < lo ? lo0[j] : lo;                                     \
+            hi = hi0[j] > hi ? hi0[j] : hi;                                     \
+        }                                                                       \
+        for (; i < n; ++i) {                                                    \
+            lo = data[i] < lo ? data[i] : lo;                                   \
+            hi = data[i] > hi ? data[i] : hi;                                   \
+        }                                                                       \
+                                                                                \
+        if (Min)                                                                \
+            *min = lo;                                                          \
+        *max = hi;                                                              \
+    }
+
+REDUCE_KERNELS(sse2, "sse2", 16)
+REDUCE_KERNELS(avx2, "avx2", 32)
+REDUCE_KERNELS(avx512, "avx512f", 64)
+
+#endif // REDUCE_X86
+
+
+// The kernels of the instruction set in use (see op_isa).
+template <typename T>
+const Kernels<T>* kernels() {
+    static const Kernels<T> scalar = {
+        sum_scalar<T>, extremes_scalar<T, false>, extremes_scalar<T, true>
+    };
+#ifdef REDUCE_X86
+    static const Kernels<T> sse2 = {
+        sum_sse2<T>, extremes_sse2<T, false>, extremes_sse2<T, true>
+    };
+    static const Kernels<T> avx2 = {
+        sum_avx2<T>, extremes_avx2<T, false>, extremes_avx2<T, true>
+    };
+    static const Kernels<T> avx512 = {
+        sum_avx512<T>, extremes_avx512<T, false>, extremes_avx512<T, true>
+    };
+
+    switch (op_isa()) {
+    case OP_ISA_SSE2:
+        return &sse2;
+    case OP_ISA_AVX2:
+        return &avx2;
+    case OP_ISA_AVX512:
+        return &avx512;
+    default:
+        break;
+    }
+#endif
+    return &scalar;
+}
+
+
+// Threads that run fn(ctx, b) for the blocks b of one reduction at a time, the calling
+// thread among them. Workers are started when a reduction first asks for them and wait
+// for the next reduction until the program exits.
+class Pool {
+public:
+    ~Pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& worker : workers_)
+            worker.join();
+    }
+
+    void run(void (*fn)(void*, size_t), void* ctx, size_t blocks, unsigned threads) {
+        std::lock_guard<std::mutex> serial(run_mutex_);
+
+        start(threads - 1);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            fn_      = fn;
+            ctx_     = ctx;
+            blocks_  = blocks;
+            helpers_ = std::min((size_t) threads - 1, workers_.size());
+            running_ = helpers_;
+            next_.store(0, std::memory_order_relaxed);
+            ++generation_;
+        }
+        wake_.notify_all();
+
+        drain();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return running_ == 0; });
+    }
+
+private:
+    // starts workers up to 'count'; fewer if no more threads can be created
+    void start(size_t count) {
+        while (workers_.size() < count) {
+            uint64_t generation;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                generation = generation_;
+            }
+            try {
+                unsigned id = (unsigned) workers_.size();
+                workers_.emplace_back([this, id, generation] { work(id, generation); });
+            }
+            catch (const std::system_error&) {
+                return;
+            }
+        }
+    }
+
+    void work(unsigned id, uint64_t seen) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        for (;;) {
+            wake_.wait(lock, [this, seen] { return stop_ || generation_ != seen; });
+            if (stop_)
+                return;
+
+            seen = generation_;
+            if (id >= helpers_)
+                continue;
+
+            lock.unlock();
+            drain();
+            lock.lock();
+
+            if (--running_ == 0)
+                done_.notify_one();
+        }
+    }
+
+    void drain() {
+        for (size_t b; (b = next_.fetch_add(1, std::memory_order_relaxed)) < blocks_; )
+            fn_(ctx_, b);
+    }
+
+    std::mutex               run_mutex_;    // one reduction at a time
+    std::mutex               mutex_;
+    std::condition_variable  wake_;
+    std::condition_variable  done_;
+    std::vector<std::thread> workers_;
+    bool                     stop_ = false;
+
+    // the reduction, changed under mutex_ with a new generation
+    uint64_t            generation_ = 0;
+    void              (*fn_)(void*, size_t) = NULL;
+    void*               ctx_     = NULL;
+    size_t              blocks_  = 0;
+    size_t              helpers_ = 0;   // workers taking part: those with id < helpers_
+    size_t              running_ = 0;   // helpers not done yet
+    std::atomic<size_t> next_{0};       // the next block to take
+};
+
+Pool& pool() {
+    static Pool pool;
+    return pool;
+}
+
+std::atomic<unsigned> use_threads(0);
+
+unsigned thread_count() {
+    unsigned threads = use_threads.load(std::memory_order_relaxed);
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    return threads;
+}
+
+
+enum Kind { SUM, MAX, MINMAX };
+
+template <typename T>
+struct Part {
+    T      min;
+    T      max;
+    Acc<T> sum;
+};
+
+template <typename T>
+struct Job {
+    const Kernels<T>* k;
+    const T*          data;
+    size_t            n;
+    Kind              kind;
+    Part<T>*          parts;   // of every block, if reduced by the pool
+
+    Part<T> block(size_t b) const {
+        size_t  lo = b * REDUCE_BLOCK;
+        size_t  len = std::min((size_t) REDUCE_BLOCK, n - lo);
+        Part<T> part;
+
+        if (kind == SUM)
+            part.sum = k->sum(data + lo, len);
+        else if (kind == MAX)
+            k->max(data + lo, len, &part.min, &part.max);
+        else
+            k->minmax(data + lo, len, &part.min, &part.max);
+        return part;
+    }
+
+    void fold(Part<T>* total, const Part<T>& part) const {
+        if (kind == SUM)
+            total->sum += part.sum;
+        if (kind == MINMAX && part.min < total->min)
+            total->min = part.min;
+        if (kind != SUM && part.max > total->max)
+            total->max = part.max;
+    }
+};
+
+template <typename T>
+void run_block(void* job, size_t b) {
+    Job<T>* j = (Job<T>*) job;
+    j->parts[b] = j->block(b);
+}
+
+// Reduces n > 0 elements block by block; the blocks are combined in order whoever
+// reduced them.
+template <typename T>
+Part<T> reduce(const T* data, size_t n, Kind kind) {
+    Job<T>   job     = {kernels<T>(), data, n, kind, NULL};
+    size_t   blocks  = (n + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+    unsigned threads = n >= REDUCE_PARALLEL_MIN ? thread_count() : 1;
+
+    if (threads > 1) {
+        std::vector<Part<T>> parts(blocks);
+        job.parts = parts.data();
+        pool().run(run_block<T>, &job, blocks, threads);
+
+        for (size_t b = 1; b < blocks; ++b)
+            job.fold(&parts[0], parts[b]);
+        return parts[0];
+    }
+
+    Part<T> total = job.block(0);
+    for (size_t b = 1; b < blocks; ++b)
+        job.fold(&total, job.block(b));
+    return total;
+}
+
+} // namespace
+
+
+template <typename T>
+ReduceSum<T> reduce_sum(const T* data, size_t n) {
+    if (n == 0)
+        return 0;
+    return (ReduceSum<T>) reduce(data, n, SUM).sum;
+}
+
+template <typename T>
+bool reduce_max(const T* data, size_t n, T* max) {
+    if (n == 0)
+        return false;
+
+    *max = reduce(data, n, MAX).max;
+    return true;
+}
+
+template <typename T>
+bool reduce_minmax(const T* data, size_t n, T* min, T* max) {
+    if (n == 0)
+        return false;
+
+    Part<T> part = reduce(data, n, MINMAX);
+    *min = part.min;
+    *max = part.max;
+    return true;
+}
+
+void reduce_use_threads(unsigned threads) {
+    use_threads.store(threads, std::memory_order_relaxed);
+}
+
+
+#define REDUCE_INSTANTIATE(T)                                                   \
+    template ReduceSum<T> reduce_sum<T>(const T* data, size_t n);               \
+    template bool reduce_max<T>(const T* data, size_t n, T* max);               \
+    template bool reduce_minmax<T>(const T* data, size_t n, T* min, T* max);
+
+REDUCE_INSTANTIATE(signed char)
+REDUCE_INSTANTIATE(unsigned char)
+REDUCE_INSTANTIATE(short)
+REDUCE_INSTANTIATE(unsigned short)
+REDUCE_INSTANTIATE(int)
+REDUCE_INSTANTIATE(unsigned int)
+REDUCE_INSTANTIATE(long)
+REDUCE_INSTANTIATE(unsigned long)
+REDUCE_INSTANTIATE(long long)
+REDUCE_INSTANTIATE(unsigned long long)
+REDUCE_INSTANTIATE(float)
+REDUCE_INSTANTIATE(double)
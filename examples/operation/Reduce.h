@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+// Reductions of arrays: sum, maximum, and minimum with maximum in one pass.
+//
+// Each block of REDUCE_BLOCK elements is reduced with the SIMD kernels of the
+// instruction set in use (see op_isa in Operation.h), and the results of the blocks are
+// combined in order. Inputs of at least REDUCE_PARALLEL_MIN elements have their blocks
+// shared by a pool of threads. The result depends only on the input and the instruction
+// set, never on the number of threads.
+//
+// Integer results are exact. A float sum is not the sum of the elements added one by
+// one: with u the unit roundoff of T (FLT_EPSILON / 2 for float) and
+// m = REDUCE_BLOCK + n / REDUCE_BLOCK,
+//     |reduce_sum - exact sum| <= m * u * (|x[0]| + ... + |x[n - 1]|)
+// to first order, the bound of adding m numbers one by one. The minimum and maximum of
+// floats are exact; with NaN among the elements they are unspecified.
+//
+// The functions are defined for the integer types from signed char to unsigned long
+// long, float and double, and may run in several threads at once.
+
+// Elements of a block, reduced by one thread.
+#define REDUCE_BLOCK (1 << 16)
+
+// Smaller inputs are reduced by the calling thread only.
+#define REDUCE_PARALLEL_MIN (1 << 20)
+
+// The type of a sum of T: T for floats, a 64-bit integer for integers. Integer sums wrap
+// modulo 2^64.
+template <typename T>
+using ReduceSum = typename std::conditional<
+    std::is_floating_point<T>::value, T,
+    typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type>::type;
+
+// The sum of the n elements; 0 if n is 0.
+template <typename T>
+ReduceSum<T> reduce_sum(const T* data, size_t n);
+
+// Stores the largest element to 'max'; false if n is 0.
+template <typename T>
+bool reduce_max(const T* data, size_t n, T* max);
+
+// Stores the smallest element to 'min' and the largest to 'max'; false if n is 0.
+template <typename T>
+bool reduce_minmax(const T* data, size_t n, T* min, T* max);
+
+template <typename T>
+ReduceSum<T> reduce_sum(const std::vector<T>& values) {
+    return reduce_sum(values.data(), values.size());
+}
+
+template <typename T>
+bool reduce_max(const std::vector<T>& values, T* max) {
+    return reduce_max(values.data(), values.size(), max);
+}
+
+template <typename T>
+bool reduce_minmax(const std::vector<T>& values, T* min, T* max) {
+    return reduce_minmax(values.data(), values.size(), min, max);
+}
+
+// Sets the number of threads reducing a large input, the caller included; 0 for one
+// per CPU, the default.
+void reduce_use_threads(unsigned threads);
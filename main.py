@@ -1,22 +1,31 @@
-from openai import OpenAI
+import glob
 import logging
 import re
+import shlex
 import uuid
 import os
 import subprocess
+import time
+import asyncio
+import concurrent.futures
 
 
 import AUTesting.PGenerator as pgen
 import AUTesting.parser as aup
 import AUTesting.compiler as compiler
+import AUTesting.executor as executor
+import AUTesting.scheduler as scheduler
+import AUTesting.standin as standin
+import AUTesting.cache as aucache
+import AUTesting.fingerprint as fingerprint
 
 import argparse
 
 # coverage:
-# lcov --capture --directory build/ --output-file build/coverage.info
+# lcov --capture --directory build/objects/ --output-file build/coverage.info
 # genhtml build/coverage.info --output-directory out
 
-#example run: python3 main.py --source-file="./examples/RBTree/RBTree.c" --include-file="./examples/RBTree/RBTree.h" --compiler=gcc --model-gpt=gpt-3.5-turbo
+#example run: python3 main.py --source-file="./examples/RBTree/RBTree*.c" --include-file="./examples/RBTree/RBTree.h" --compiler=gcc --model-gpt=gpt-3.5-turbo
 
 def extract_c_functions(header_content):
     """
@@ -34,6 +43,9 @@ def extract_c_functions(header_content):
         r"\b[A-Za-z_][A-Za-z0-9_]*[\s\*]+\**\s*[A-Za-z_][A-Za-z0-9_]*\s*\((?:[^()]|\([^()]*\))*\)"
     )
 
+    # preprocessor lines (#if defined(X), #define F(x) ...) are not declarations
+    header_content = re.sub(r"^\s*#.*?(?<!\\)$", "", header_content, flags=re.DOTALL | re.MULTILINE)
+
     # Find all matches
     return function_pattern.findall(header_content)
 
@@ -58,9 +70,19 @@ def remove_c_comments(code):
 
 def parseArguments():
     parser = argparse.ArgumentParser(description = 'Generator UnitTests for C/C++ code')
-    parser.add_argument("--source-file", help="path to file with sources", required=True)
+    parser.add_argument("--source-file", help="path to file with sources; several, or a pattern such as RBTree*.c, for a library of several files", required=True)
     parser.add_argument("--include-file", help="path to include file", required=True)
     parser.add_argument("--compiler", help="Using compiler", default="gcc")
+    parser.add_argument("--jobs", help="Tests compiled and run at once", type=int, default=os.cpu_count() or 1)
+    parser.add_argument("--backend", help="Model backend: openai, or standin for a local stand-in without network", choices=["openai", "standin"], default="openai")
+    parser.add_argument("--base-url", help="URL of an OpenAI-compatible server, e.g. of python3 -m AUTesting.standin", default=None)
+    parser.add_argument("--standin-latency", help="Seconds the stand-in backend takes to answer, on average", type=float, default=1.0)
+    parser.add_argument("--max-requests", help="Requests to the model in flight at once", type=int, default=8)
+    parser.add_argument("--requests-per-minute", help="Limit of requests to the model, 0 for none", type=float, default=0)
+    parser.add_argument("--tokens-per-minute", help="Limit of tokens of the model, 0 for none", type=float, default=0)
+    parser.add_argument("--cache-dir", help="Cache of answers of the model, compiled tests and their runs", default=aucache.CACHE_DIR)
+    parser.add_argument("--no-cache", help="Neither use nor fill the cache", action="store_true")
+    parser.add_argument("--full", help="Test all functions, also those unchanged since the last run", action="store_true")
     parser.add_argument("--model-gpt", help="Using version of chatGPT for generation tests, gpt-4-1106-preview recommend for the best results", default="gpt-4-1106-preview")
     return parser.parse_args()
 
@@ -72,7 +94,8 @@ if __name__ == "__main__":
 
     include_to_test = args.include_file
     includes = args.include_file
-    sources = args.source_file
+    source_files = [f for s in shlex.split(args.source_file) for f in sorted(glob.glob(s)) or [s]]
+    sources = " ".join(shlex.quote(f) for f in source_files)
 
     with open(include_to_test, "r") as header:
         content = header.read()
@@ -83,23 +106,53 @@ if __name__ == "__main__":
     logging.info(f"Signatures num: {signatures_num}")
     logging.info(f"Signatures: {functions}")
 
+    # only functions changed since the last run, with their callees, are tested again
+    with open(include_to_test, "r") as header:
+        fingerprints = fingerprint.fingerprints(source_files, header.read(), functions)
+    manifest = fingerprint.Manifest()
+    reused = {}
+    for sig in functions:
+        tests = [] if args.full else manifest.passing_tests(sig, fingerprints[sig])
+        if tests:
+            reused[sig] = tests
+    logging.info(f"Unchanged, with passing tests ({len(reused)}): {list(reused)}")
+
     # test first function
     # func = func_s[0]
     prompts = []
+    prompt_functions = []
     for sig in functions:
-        prompts.extend(pgen.generate(sig))
+        if sig in reused:
+            continue
+        for pr in pgen.generate(sig):
+            prompts.append(pr)
+            prompt_functions.append(sig)
+
+    # a prompt shows the files that define the function, not the whole library; a
+    # function none of them defines (e.g. a macro) gets all of them
+    contents = {}
+    defined = {}
+    for source_file in source_files:
+        with open(source_file, "r") as src:
+            contents[source_file] = remove_c_comments(src.read())
+        defined[source_file] = fingerprint.function_bodies(source_file)[0].keys()
 
-    # FIXME: multi file project?
     prompts_str = []
-    with open(sources, "r") as src:
-        content = src.read()
-        content = remove_c_comments(content)
-        for pr in prompts:
-            header = f"I have header '{include_to_test}' with all function prototypes. C code with functions definitions: {content}\n."
-            prompts_str.append(header + pr.generate())
+    for sig, pr in zip(prompt_functions, prompts):
+        name = fingerprint.function_name(sig)
+        files = [f for f in source_files if name in defined[f]] or source_files
+        content = "\n".join(contents[f] for f in files)
+        header = f"I have header '{include_to_test}' with all function prototypes. C code with functions definitions: {content}\n."
+        prompts_str.append(header + pr.generate())
+
+    # answers, compiled tests and runs of earlier runs
+    cache = None if args.no_cache else aucache.Cache(args.cache_dir)
 
     # use LLM to generate tests
-    client = OpenAI()
+    if args.backend == "standin":
+        backend = standin.StandInBackend(latency=args.standin_latency)
+    else:
+        backend = scheduler.OpenAIBackend(base_url=args.base_url)
 
     # generate initial chats
     messages_s = []
@@ -116,93 +169,131 @@ if __name__ == "__main__":
         ]
         messages_s.append(messages)
 
-    for prompt in messages_s:
-        logging.info(f"Prompt: {prompt}")
-        completion = client.chat.completions.create(
-            model=args.model_gpt, messages=prompt
-        )
-        logging.info(f"Response: {completion}")
-        prompt.append(
-            {"role": "assistant", "content": completion.choices[0].message.content}
-        )
-        # break
-
     # NOTE: assume that there is only once code section in a response
-    generated = 0
-    compiled = []
-    passed = []
-    failed = []
-    for compl in messages_s:
-        if len(compl) <= 2:
-            continue
-
-        test = aup.extract_code_from_chatgpt_response(compl[-1]["content"])
+    def extract_test(content):
+        test = aup.extract_code_from_chatgpt_response(content)
         if len(test) == 0:
-            test = compl[-1]["content"]
-        else:
-            test = test[0]
-
-        logging.info(f"Tests:")
+            return content
+        return test[0]
 
-        test_src = "./build/" + str(uuid.uuid4()) + ".c"
-        test_out = test_src + ".out"
+    def compile_test(result, test, note):
+        test_src = "./build/" + result.name + ".c"
         with open(test_src, "w") as cpp:
-            code = "/* file autogenerated */" + compiler.fixErrors(test)
+            code = f"/* file {note} */" + compiler.fixErrors(test)
             print(code, file=cpp)
         logging.info(f"--------------------------------------------------")
         logging.info(f"  Test:\n{test}")
-        logging.info(f"Launch compiler")
-        stat = compiler.Compiler(test_src, include_file=includes, using_compiler=args.compiler).run(sources, test_out)
+        return build_test(result)
 
+    def build_test(result):
+        test_src = "./build/" + result.name + ".c"
+        logging.info(f"Launch compiler")
+        start = time.perf_counter()
+        c = compiler.Compiler(test_src, include_file=includes, using_compiler=args.compiler, cache=cache)
+        stat = c.run(sources, test_src + ".out")
+        result.key = c.key
+        result.compile_time += time.perf_counter() - start
         logging.info(f"Compiler result: {stat}")
-        if stat.returncode == 0:
-            compiled.append(test_out)
-            command_line = f"{test_out}"
-            stat = subprocess.run(command_line, capture_output=True, text=True)
-            logging.info(f"Run result: {stat}")
-            is_passed = stat.returncode == 0
-            if stat.returncode == 0:
-                passed.append(test_out)
-            else:
-                failed.append(test_out)
-        else:
-            compl.append(
+        return stat
+
+    def run_test(result):
+        start = time.perf_counter()
+        stat = executor.run_test(result.name, "./build/" + result.name + ".c.out", cache, result.key)
+        result.run_time = time.perf_counter() - start
+        logging.info(f"Run result: {stat}")
+        return stat
+
+    async def ask(llm, result, messages):
+        logging.info(f"Prompt: {messages}")
+        start = time.perf_counter()
+        try:
+            return await llm.complete(args.model_gpt, messages)
+        except scheduler.RetryableError as e:
+            logging.error(f"No answer for {result.name}: {e}")
+            return None
+        finally:
+            result.generate_time += time.perf_counter() - start
+
+    # every test compiles and runs as soon as its answer comes, while the model works on
+    # the other prompts
+    async def generate_and_test(llm, pool, function, messages):
+        loop = asyncio.get_running_loop()
+        result = executor.TestResult(str(uuid.uuid4()), function)
+
+        content = await ask(llm, result, messages)
+        if content is None:
+            return result
+        result.generated = True
+        messages.append({"role": "assistant", "content": content})
+
+        stat = await loop.run_in_executor(pool, compile_test, result, extract_test(content), "autogenerated")
+        if stat.returncode != 0:
+            messages.append(
                 {
                     "role": "user",
                     "content": f"Compilation of tests above failed with error: {stat.stderr}. Generate fixed test.",
                 }
             )
-            logging.info(f"Recompile prompt: {compl}")
-            compl = client.chat.completions.create(
-                model=args.model_gpt, messages=compl
-            )
-            logging.info(f"Response: {compl}")
+            content = await ask(llm, result, messages)
+            if content is None:
+                return result
+            stat = await loop.run_in_executor(pool, compile_test, result, extract_test(content), "re-autogenerated")
 
-            test = aup.extract_code_from_chatgpt_response(
-                compl.choices[0].message.content
-            )
-            if len(test) == 0:
-                test = compl.choices[0].message.content
-            else:
-                test = test[0]
-
-            with open(test_src, "w") as cpp:
-                code = "/* file re-autogenerated */" + compiler.fixErrors(test)
-                print(code, file=cpp)
-            stat = compiler.Compiler(test_src, include_file=includes, using_compiler=args.compiler).run(
-                sources, test_out
+        if stat.returncode == 0:
+            result.compiled = True
+            stat = await loop.run_in_executor(pool, run_test, result)
+            result.passed = stat.returncode == 0
+        return result
+
+    # a reused test is linked against the objects of this run and run again: cheap next
+    # to generating it, and its coverage is that of the current sources
+    def rerun_test(function, test_src):
+        name = os.path.splitext(os.path.basename(test_src))[0]
+        result = executor.TestResult(name, function, reused=True)
+        stat = build_test(result)
+        if stat.returncode == 0:
+            result.compiled = True
+            result.passed = run_test(result).returncode == 0
+        return result
+
+    async def generate_all():
+        llm = scheduler.Scheduler(
+            backend,
+            max_in_flight=args.max_requests,
+            requests_per_minute=args.requests_per_minute,
+            tokens_per_minute=args.tokens_per_minute,
+            cache=cache,
+        )
+        loop = asyncio.get_running_loop()
+        with concurrent.futures.ThreadPoolExecutor(max_workers=max(args.jobs, 1)) as pool:
+            reruns = [
+                loop.run_in_executor(pool, rerun_test, f, t) for f, tests in reused.items() for t in tests
+            ]
+            results = await asyncio.gather(
+                *(generate_and_test(llm, pool, f, m) for f, m in zip(prompt_functions, messages_s)), *reruns
             )
-            logging.info(f"Compiler result: {stat}")
-            if stat.returncode == 0:
-                compiled.append(test_out)
-                command_line = f"{test_out}"
-                stat = subprocess.run(command_line, capture_output=True, text=True)
-                logging.info(f"Run result: {stat}")
-                is_passed = stat.returncode == 0
-                if stat.returncode == 0:
-                    passed.append(test_out)
-                else:
-                    failed.append(test_out)
+        return results, llm.stats
+
+    # the merged coverage is that of this run only, cached results included
+    executor.reset_coverage()
+
+    start = time.perf_counter()
+    results, llm_stats = asyncio.run(generate_all())
+    wall_time = time.perf_counter() - start
+    executor.merge_coverage([r.name for r in results if r.compiled])
+
+    # a reused test that fails now is dropped, and its function is tested again next run
+    for sig in functions:
+        tests = ["./build/" + r.name + ".c" for r in results if r.function == sig and r.passed]
+        manifest.record(sig, fingerprints[sig], tests)
+    manifest.save(functions)
+
+    rerun = [r for r in results if r.reused]
+    results = [r for r in results if not r.reused]
+    generated = len([r for r in results if r.generated])
+    compiled = ["./build/" + r.name + ".c.out" for r in results if r.compiled]
+    passed = ["./build/" + r.name + ".c.out" for r in results if r.passed]
+    failed = ["./build/" + r.name + ".c.out" for r in results if r.compiled and not r.passed]
 
     logging.info("=-----------------------------------------------")
     logging.info("Stats:")
@@ -210,3 +301,8 @@ if __name__ == "__main__":
     logging.info(f"Compiled ({len(compiled)}): {compiled}")
     logging.info(f"Passed ({len(passed)}): {passed}")
     logging.info(f"Failed ({len(failed)}): {failed}")
+    logging.info(f"Reused and run again ({len(rerun)}), passed {len([r for r in rerun if r.passed])}: {reused}")
+    logging.info(f"Model: {llm_stats}")
+    logging.info(f"Compilation: {compiler.stats}")
+    logging.info(f"Cache: {cache.report() if cache else 'off'}")
+    executor.report(results + rerun, wall_time)
@@ -0,0 +1,201 @@
+/****************************************************************************************
+ *
+ *   operation_test.cpp
+ *
+ *   The array kernels of every instruction set the CPU supports against scalar loops:
+ *   add_arrays and sub_arrays of every type and square_distance_many of both forms, for
+ *   every length of the tail after the last full vector, unaligned arrays and output
+ *   over an input.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Operation.h"
+
+
+namespace {
+
+const OpIsa ISAS[] = {OP_ISA_SCALAR, OP_ISA_SSE2, OP_ISA_AVX2, OP_ISA_AVX512};
+
+const char* const ISA_NAMES[] = {"scalar", "sse2", "avx2", "avx512"};
+
+/// Lengths around the widths of the vectors, 2 to 16 elements, and a long array.
+const size_t LENGTHS[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65,
+                          1000};
+
+
+/// Switches to the kernels of each supported instruction set in turn and back to those
+/// chosen at the start.
+class Operation : public ::testing::TestWithParam<OpIsa> {
+protected:
+    void SetUp() override {
+
+        initial = op_isa();
+        if (!op_use_isa(GetParam()))
+            GTEST_SKIP() << "the CPU does not support instruction set " << GetParam();
+        ASSERT_EQ(op_isa(), GetParam());
+    }
+
+    void TearDown() override {
+
+        op_use_isa(initial);
+    }
+
+    OpIsa initial = OP_ISA_SCALAR;
+};
+
+
+/// Values whose sums and differences do not overflow an int.
+template <typename T>
+std::vector<T> randomValues(std::mt19937& random, size_t n) {
+
+    std::vector<T> values(n);
+    for (T& v : values)
+        v = (T) ((int) (random() % 2000001) - 1000000) / (T) 8;
+    return values;
+}
+
+
+/// Checks add_arrays and sub_arrays of the type against scalar loops, starting at every
+/// offset within a vector, and with the output over either input.
+template <typename T>
+void checkArrays() {
+
+    std::mt19937 random(26);
+
+    for (size_t n : LENGTHS)
+        for (size_t offset : {0, 1, 3}) {
+            std::vector<T> a = randomValues<T>(random, n + offset);
+            std::vector<T> b = randomValues<T>(random, n + offset);
+            std::vector<T> sum(n + offset + 1, (T) 7), difference(n + offset + 1, (T) 7);
+
+            add_arrays(a.data() + offset, b.data() + offset, sum.data() + offset, n);
+            sub_arrays(a.data() + offset, b.data() + offset, difference.data() + offset, n);
+
+            for (size_t i = 0; i < n; ++i) {
+                size_t j = i + offset;
+                ASSERT_EQ(sum[j], (T) (a[j] + b[j])) << n << " elements, element " << i;
+                ASSERT_EQ(difference[j], (T) (a[j] - b[j])) << n << " elements, element " << i;
+            }
+            EXPECT_EQ(sum[n + offset], (T) 7) << "written past " << n << " elements";
+            EXPECT_EQ(difference[n + offset], (T) 7) << "written past " << n << " elements";
+
+            // in place: a = a + b, then b = a - b gives back the old a
+            std::vector<T> old = a;
+            add_arrays(a.data() + offset, b.data() + offset, a.data() + offset, n);
+            sub_arrays(a.data() + offset, b.data() + offset, b.data() + offset, n);
+            for (size_t i = offset; i < n + offset; ++i) {
+                ASSERT_EQ(a[i], sum[i]) << n << " elements in place, element " << i;
+                ASSERT_EQ(b[i], old[i]) << n << " elements in place, element " << i;
+            }
+        }
+}
+
+
+PointBuffer randomBuffer(std::mt19937& random, size_t n) {
+
+    std::vector<Point> points(n);
+    for (Point& p : points)
+        p = Point{(double) random() / 1e3 - 2e6, (double) random() / 1e5};
+
+    PointBuffer buffer;
+    EXPECT_TRUE(point_buffer_create(&buffer, n));
+    point_buffer_fill(&buffer, points.data());
+    return buffer;
+}
+
+} // namespace
+
+
+TEST_P(Operation, AddAndSubIntArrays) {
+
+    checkArrays<int>();
+}
+
+
+TEST_P(Operation, AddAndSubFloatArrays) {
+
+    checkArrays<float>();
+}
+
+
+TEST_P(Operation, AddAndSubDoubleArrays) {
+
+    checkArrays<double>();
+}
+
+
+TEST_P(Operation, SquareDistanceMany) {
+
+    std::mt19937 random(27);
+
+    for (size_t n : LENGTHS) {
+        PointBuffer a = randomBuffer(random, n);
+        PointBuffer b = randomBuffer(random, n + 5); // only the first n points count
+        Point       to = {12.5, -3.25};
+
+        std::vector<double> between(n + 1, -1.0), from(n + 1, -1.0);
+        square_distance_many(&a, &b, between.data());
+        square_distance_many(&a, &to, from.data());
+
+        for (size_t i = 0; i < n; ++i) {
+            double dx = a.x[i] - b.x[i], dy = a.y[i] - b.y[i];
+            ASSERT_EQ(between[i], dx * dx + dy * dy) << n << " points, point " << i;
+
+            dx = a.x[i] - to.x;
+            dy = a.y[i] - to.y;
+            ASSERT_EQ(from[i], dx * dx + dy * dy) << n << " points, point " << i;
+        }
+        EXPECT_EQ(between[n], -1.0);
+        EXPECT_EQ(from[n], -1.0);
+
+        point_buffer_destroy(&a);
+        point_buffer_destroy(&b);
+    }
+}
+
+
+INSTANTIATE_TEST_SUITE_P(EveryIsa, Operation, ::testing::ValuesIn(ISAS),
+                         [](const ::testing::TestParamInfo<OpIsa>& info) {
+                             return std::string(ISA_NAMES[info.param]);
+                         });
+
+
+TEST(OperationIsa, BestSupportedByDefaultAndScalarAlways) {
+
+    OpIsa initial = op_isa();
+
+    EXPECT_TRUE(op_use_isa(OP_ISA_SCALAR));
+    EXPECT_EQ(op_isa(), OP_ISA_SCALAR);
+
+    // no supported instruction set is better than the one chosen at the start
+    for (OpIsa isa : ISAS)
+        if (isa > initial) {
+            EXPECT_FALSE(op_use_isa(isa)) << "instruction set " << isa;
+        }
+
+    EXPECT_FALSE(op_use_isa((OpIsa) 7));
+    EXPECT_TRUE(op_use_isa(initial));
+    EXPECT_EQ(op_isa(), initial);
+}
+
+
+TEST(OperationIsa, PointBuffersAreAligned) {
+
+    for (size_t n : {0, 1, 9, 1000}) {
+        PointBuffer buffer;
+        ASSERT_TRUE(point_buffer_create(&buffer, n));
+        EXPECT_EQ(buffer.size, n);
+        EXPECT_EQ((uintptr_t) buffer.x % 64, 0u);
+        EXPECT_EQ((uintptr_t) buffer.y % 64, 0u);
+
+        point_buffer_destroy(&buffer);
+        EXPECT_EQ(buffer.x, nullptr);
+        EXPECT_EQ(buffer.size, 0u);
+    }
+}
@@ -0,0 +1,225 @@
+/****************************************************************************************
+ *
+ *   pointset_test.cpp
+ *
+ *   PointSet against brute force: nearest() by scanning and with the k-d tree, for
+ *   every k up to more than the set holds, ties at equal distances, points added after
+ *   the index, searches from several threads and every instruction set of the kernels;
+ *   and the batch distances against scalar loops.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Operation.h"
+#include "PointSet.h"
+
+
+namespace {
+
+const OpIsa ISAS[] = {OP_ISA_SCALAR, OP_ISA_SSE2, OP_ISA_AVX2, OP_ISA_AVX512};
+
+
+double squareDistance(const Point& a, const Point& b) {
+
+    double dx = a.x - b.x, dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+
+
+/// Points in a square of the given side; with integer coordinates many of them are at
+/// the same distance from a query, and some coincide.
+std::vector<Point> randomPoints(std::mt19937& random, size_t n, int side, bool integer) {
+
+    std::vector<Point> points(n);
+    for (Point& p : points)
+        if (integer)
+            p = Point{(double) (random() % side), (double) (random() % side)};
+        else
+            p = Point{(double) random() / random.max() * side,
+                      (double) random() / random.max() * side};
+    return points;
+}
+
+
+/// The numbers of the points sorted by their distance to the query, then by number.
+std::vector<size_t> byDistance(const std::vector<Point>& points, const Point& query) {
+
+    std::vector<double> distances(points.size());
+    std::vector<size_t> order(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        distances[i] = squareDistance(points[i], query);
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return distances[a] < distances[b] || (distances[a] == distances[b] && a < b);
+    });
+    return order;
+}
+
+
+/// Checks nearest() of the query against the points sorted by byDistance.
+void checkNearest(const PointSet& set, const std::vector<Point>& points, const Point& query,
+                  const std::vector<size_t>& expected, size_t k) {
+
+    std::vector<size_t> indices(k + 1, (size_t) -1);
+    std::vector<double> distances(k + 1, -1.0);
+    size_t              found = set.nearest(query, k, indices.data(), distances.data());
+
+    ASSERT_EQ(found, std::min(k, points.size()));
+    for (size_t i = 0; i < found; ++i) {
+        ASSERT_EQ(indices[i], expected[i]) << "neighbor " << i << " of " << k;
+        ASSERT_EQ(distances[i], squareDistance(points[expected[i]], query)) << "neighbor " << i;
+    }
+    EXPECT_EQ(indices[found], (size_t) -1);
+}
+
+
+void checkNearest(const PointSet& set, const std::vector<Point>& points, const Point& query,
+                  size_t k) {
+
+    checkNearest(set, points, query, byDistance(points, query), k);
+}
+
+} // namespace
+
+
+TEST(PointSet, NearestMatchesBruteForce) {
+
+    std::mt19937 random(28);
+
+    // below and above PS_BRUTE_FORCE_MAX, where the k-d tree takes over
+    for (size_t n : {0, 1, 2, 17, 500, 2048, 2049, 20000})
+        for (bool integer : {false, true}) {
+            std::vector<Point> points = randomPoints(random, n, integer ? 60 : 1000, integer);
+            PointSet           set(points.data(), n);
+
+            for (bool indexed : {false, true}) {
+                if (indexed) {
+                    ASSERT_TRUE(set.index() || n == 0);
+                    EXPECT_EQ(set.indexed(), n != 0);
+                }
+
+                std::vector<Point> queries = randomPoints(random, 20, integer ? 60 : 1000,
+                                                          integer);
+                queries.push_back(Point{-500, -500}); // outside the points
+                if (n != 0)
+                    queries.push_back(points[n / 2]); // on a point
+
+                for (const Point& query : queries) {
+                    std::vector<size_t> expected = byDistance(points, query);
+                    for (size_t k : {0, 1, 2, 15, 16, 17, 100, 3000}) {
+                        SCOPED_TRACE(testing::Message() << n << " points, indexed " << indexed
+                                                        << ", query " << query.x << ", "
+                                                        << query.y << ", k " << k);
+                        checkNearest(set, points, query, expected, k);
+                    }
+                }
+            }
+        }
+}
+
+
+TEST(PointSet, AddingPointsDropsTheIndex) {
+
+    std::mt19937       random(29);
+    std::vector<Point> points = randomPoints(random, 5000, 1000, false);
+    PointSet           set(points.data(), points.size());
+
+    ASSERT_TRUE(set.index());
+    EXPECT_TRUE(set.indexed());
+
+    std::vector<Point> more = randomPoints(random, 3000, 1000, false);
+    ASSERT_TRUE(set.add(more[0]));
+    ASSERT_TRUE(set.add(more.data() + 1, more.size() - 1));
+    points.insert(points.end(), more.begin(), more.end());
+
+    EXPECT_FALSE(set.indexed());
+    ASSERT_EQ(set.size(), points.size());
+    for (size_t i = 0; i < points.size(); i += 97) {
+        EXPECT_EQ(set.at(i).x, points[i].x);
+        EXPECT_EQ(set.at(i).y, points[i].y);
+    }
+
+    for (const Point& query : randomPoints(random, 10, 1000, false)) {
+        checkNearest(set, points, query, 10);
+        ASSERT_TRUE(set.index());
+        checkNearest(set, points, query, 10);
+        ASSERT_TRUE(set.add(query));
+        points.push_back(query);
+    }
+}
+
+
+TEST(PointSet, SearchesFromSeveralThreads) {
+
+    std::mt19937       random(30);
+    std::vector<Point> points = randomPoints(random, 30000, 1000, false);
+    PointSet           set(points.data(), points.size());
+    ASSERT_TRUE(set.index());
+
+    const int                        threads = 4;
+    std::vector<std::vector<Point>>  queries;
+    std::vector<std::vector<size_t>> results(threads);
+    for (int t = 0; t < threads; ++t)
+        queries.push_back(randomPoints(random, 200, 1000, false));
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back([&, t] {
+            size_t indices[8];
+            for (const Point& query : queries[t]) {
+                size_t found = set.nearest(query, 8, indices, NULL);
+                results[t].insert(results[t].end(), indices, indices + found);
+            }
+        });
+    for (auto& worker : workers)
+        worker.join();
+
+    for (int t = 0; t < threads; ++t)
+        for (size_t q = 0; q < queries[t].size(); ++q) {
+            size_t indices[8];
+            ASSERT_EQ(set.nearest(queries[t][q], 8, indices, NULL), 8u);
+            for (size_t i = 0; i < 8; ++i)
+                ASSERT_EQ(results[t][q * 8 + i], indices[i]) << "thread " << t;
+        }
+}
+
+
+TEST(PointSet, EveryInstructionSet) {
+
+    std::mt19937       random(31);
+    std::vector<Point> points = randomPoints(random, 1500, 40, true);
+    PointSet           set(points.data(), points.size());
+    PointSet           other(points.data() + 1000, 37);
+    OpIsa              initial = op_isa();
+
+    for (OpIsa isa : ISAS) {
+        if (!op_use_isa(isa))
+            continue;
+        SCOPED_TRACE(testing::Message() << "instruction set " << isa);
+
+        for (const Point& query : randomPoints(random, 10, 40, true))
+            checkNearest(set, points, query, 33);
+
+        Point               query = {3.5, 17.25};
+        std::vector<double> distances(set.size());
+        set.square_distances(query, distances.data());
+        for (size_t i = 0; i < points.size(); ++i)
+            ASSERT_EQ(distances[i], squareDistance(points[i], query)) << "point " << i;
+
+        std::vector<double> pairwise(set.size() * other.size());
+        set.pairwise_square_distances(other, pairwise.data());
+        for (size_t i = 0; i < set.size(); ++i)
+            for (size_t j = 0; j < other.size(); ++j)
+                ASSERT_EQ(pairwise[i * other.size() + j],
+                          squareDistance(points[i], points[1000 + j]))
+                    << "points " << i << " and " << j;
+    }
+
+    op_use_isa(initial);
+}
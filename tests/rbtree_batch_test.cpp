@@ -0,0 +1,118 @@
+/****************************************************************************************
+ *
+ *   rbtree_batch_test.cpp
+ *
+ *   rbInsertBatch and rbEraseBatch against loops of rbInsert and rbErase into
+ *   std::map, for every engine, with batches small enough to be applied one pair at a
+ *   time and large enough to be merged with the container.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+const rbEngine ENGINES[] = {RB_ENGINE_REDBLACK, RB_ENGINE_BPLUS, RB_ENGINE_PERSISTENT};
+
+} // namespace
+
+
+TEST(Batch, MatchesLoopsOfSingleChanges) {
+
+    for (rbEngine engine : ENGINES) {
+        rbTree tree = NULL;
+        ASSERT_EQ(rbCreateWithEngine(NULL, 0, engine, &tree), RB_SUCCESS);
+
+        std::map<int, int> reference;
+        std::mt19937       random(15 + engine);
+
+        // batches of 1 to 20000 pairs, so the container is from much smaller than a
+        // batch to much larger
+        for (size_t n : {1, 5, 20000, 3, 100, 1000, 7000, 50, 2}) {
+            std::vector<rbPair> pairs;
+            for (size_t i = 0; i < n; ++i) {
+                int key = (int) (random() % 40000);
+                pairs.push_back(rbPair{key, (int) random()});
+                reference[key] = pairs.back().value; // the last value wins
+            }
+            ASSERT_EQ(rbInsertBatch(tree, pairs.data(), n), RB_SUCCESS);
+            ASSERT_EQ(contents(tree), reference) << "engine " << engine << ", insert " << n;
+
+            std::vector<rb_key_type> keys;
+            for (size_t i = 0; i < n / 2; ++i) {
+                keys.push_back((int) (random() % 40000)); // present or not
+                reference.erase(keys.back());
+            }
+            ASSERT_EQ(rbEraseBatch(tree, keys.data(), keys.size()), RB_SUCCESS);
+            ASSERT_EQ(contents(tree), reference) << "engine " << engine << ", erase " << n;
+
+            ASSERT_EQ(rbSize(tree), reference.size());
+            if (engine != RB_ENGINE_BPLUS) {
+                ASSERT_TRUE(isRedBlack(tree)) << "engine " << engine;
+            }
+        }
+
+        // a batch of everything empties the container
+        std::vector<rb_key_type> all;
+        for (int key = 0; key < 40000; ++key)
+            all.push_back(key);
+        ASSERT_EQ(rbEraseBatch(tree, all.data(), all.size()), RB_SUCCESS);
+        EXPECT_EQ(rbSize(tree), 0u);
+        EXPECT_EQ(rbBegin(tree), nullptr);
+
+        rbDestroy(tree);
+    }
+}
+
+
+TEST(Batch, RedBlackPairsStayInPlace) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+
+    for (int key = 0; key < 1000; key += 10)
+        ASSERT_EQ(rbInsert(tree, rbPair{key, key}), RB_SUCCESS);
+    rbPair* pair = rbFind(tree, 500);
+
+    // a batch much larger than the container is merged with it
+    std::vector<rbPair> pairs;
+    for (int key = 0; key < 5000; ++key)
+        if (key % 10 != 0 || key == 500)
+            pairs.push_back(rbPair{key, -key});
+    ASSERT_EQ(rbInsertBatch(tree, pairs.data(), pairs.size()), RB_SUCCESS);
+
+    std::vector<rb_key_type> keys;
+    for (int key = 1; key < 5000; key += 2)
+        keys.push_back(key);
+    ASSERT_EQ(rbEraseBatch(tree, keys.data(), keys.size()), RB_SUCCESS);
+
+    EXPECT_EQ(rbFind(tree, 500), pair);
+    EXPECT_EQ(pair->value, -500);
+    EXPECT_TRUE(isRedBlack(tree));
+
+    rbDestroy(tree);
+}
+
+
+TEST(Batch, EmptyBatchesAndInvalidArguments) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+
+    EXPECT_EQ(rbInsertBatch(tree, NULL, 0), RB_SUCCESS);
+    EXPECT_EQ(rbEraseBatch(tree, NULL, 0), RB_SUCCESS);
+    EXPECT_EQ(rbSize(tree), 0u);
+
+    EXPECT_EQ(rbInsertBatch(tree, NULL, 3), RB_INVALID_ARGS);
+    EXPECT_EQ(rbEraseBatch(tree, NULL, 3), RB_INVALID_ARGS);
+    EXPECT_EQ(rbInsertBatch(NULL, NULL, 0), RB_INVALID_ARGS);
+
+    rbDestroy(tree);
+}
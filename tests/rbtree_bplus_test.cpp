@@ -0,0 +1,185 @@
+/****************************************************************************************
+ *
+ *   rbtree_bplus_test.cpp
+ *
+ *   The engine RB_ENGINE_BPLUS behind the rbTree interface: random insertions and
+ *   removals, lookups, walks, bounds, ranges and order statistics against std::map, on
+ *   trees of several levels that grow and shrink again.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+/// Compares every read function of the container with the reference.
+void checkReads(rbTree tree, const std::map<int, int>& reference, int lo, int hi) {
+
+    ASSERT_EQ(rbSize(tree), reference.size());
+    EXPECT_EQ(contents(tree), reference);
+
+    std::vector<int> forward, backward, expected;
+    for (rbPair* it = rbBegin(tree); it != NULL; it = rbNext(tree, it))
+        forward.push_back(it->key);
+    for (rbPair* it = rbLast(tree); it != NULL; it = rbPrev(tree, it))
+        backward.push_back(it->key);
+    for (auto& kv : reference)
+        expected.push_back(kv.first);
+    EXPECT_EQ(forward, expected);
+    EXPECT_EQ(backward, std::vector<int>(expected.rbegin(), expected.rend()));
+
+    for (int key = lo; key <= hi; ++key) {
+        auto    it    = reference.find(key);
+        rbPair* found = rbFind(tree, key);
+        ASSERT_EQ(found == NULL, it == reference.end()) << "key " << key;
+        if (found != NULL) {
+            EXPECT_EQ(found->value, it->second) << "key " << key;
+        }
+
+        auto    lower = reference.lower_bound(key);
+        rbPair* lb    = rbLowerBound(tree, key);
+        ASSERT_EQ(lb == NULL, lower == reference.end()) << "lower bound of " << key;
+        if (lb != NULL) {
+            EXPECT_EQ(lb->key, lower->first) << "lower bound of " << key;
+        }
+
+        auto    upper = reference.upper_bound(key);
+        rbPair* ub    = rbUpperBound(tree, key);
+        ASSERT_EQ(ub == NULL, upper == reference.end()) << "upper bound of " << key;
+        if (ub != NULL) {
+            EXPECT_EQ(ub->key, upper->first) << "upper bound of " << key;
+        }
+
+        auto rank = std::lower_bound(expected.begin(), expected.end(), key) - expected.begin();
+        EXPECT_EQ(rbRank(tree, key), (size_t) rank) << "key " << key;
+    }
+
+    size_t k = 0;
+    for (auto& kv : reference) {
+        rbPair* pair = rbSelect(tree, k++);
+        ASSERT_NE(pair, nullptr);
+        EXPECT_EQ(pair->key, kv.first);
+    }
+    EXPECT_EQ(rbSelect(tree, k), nullptr);
+
+    std::vector<int> inRange, expectedRange;
+    rbRange(tree, lo / 2, hi / 2, [](rbPair* pair, void* data) {
+        ((std::vector<int>*) data)->push_back(pair->key);
+    }, &inRange);
+    auto end = reference.upper_bound(hi / 2);
+    for (auto it = reference.lower_bound(lo / 2); it != reference.end() && it != end; ++it)
+        expectedRange.push_back(it->first);
+    EXPECT_EQ(inRange, expectedRange);
+}
+
+} // namespace
+
+
+TEST(BPlus, GrowsAndShrinksLikeStdMap) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreateWithEngine(NULL, 0, RB_ENGINE_BPLUS, &tree), RB_SUCCESS);
+
+    std::map<int, int> reference;
+    std::mt19937       random(8);
+    const int          KEYS = 40000;
+
+    // grows to several levels
+    for (int i = 0; i < 60000; ++i) {
+        int key = (int) (random() % KEYS);
+        ASSERT_EQ(rbInsert(tree, rbPair{key, i}), RB_SUCCESS);
+        reference[key] = i;
+    }
+    checkReads(tree, reference, -1, KEYS);
+    EXPECT_GT(rbMemoryUsage(tree), reference.size() * sizeof(rbPair));
+
+    // mixed changes
+    for (int i = 0; i < 60000; ++i) {
+        int key = (int) (random() % KEYS);
+        if (random() % 2) {
+            ASSERT_EQ(rbErase(tree, key), RB_SUCCESS);
+            reference.erase(key);
+        }
+        else {
+            ASSERT_EQ(rbInsert(tree, rbPair{key, -i}), RB_SUCCESS);
+            reference[key] = -i;
+        }
+    }
+    checkReads(tree, reference, -1, KEYS);
+
+    // shrinks to a few keys, nodes merging on the way
+    for (int key = 0; key < KEYS; ++key)
+        if (key % 1000 != 0) {
+            rbErase(tree, key);
+            reference.erase(key);
+        }
+    checkReads(tree, reference, -1, KEYS);
+
+    ASSERT_EQ(rbClear(tree), RB_SUCCESS);
+    checkReads(tree, {}, -1, 1);
+    ASSERT_EQ(rbInsert(tree, rbPair{3, 4}), RB_SUCCESS);
+    checkReads(tree, {{3, 4}}, 0, 5);
+
+    rbDestroy(tree);
+}
+
+
+TEST(BPlus, CreatedFromPairsLikeStdMap) {
+
+    std::mt19937 random(9);
+
+    for (size_t size : {1, 2, 15, 16, 17, 100, 5000}) {
+        std::vector<rbPair> data;
+        std::map<int, int>  reference;
+        for (size_t i = 0; i < size; ++i) {
+            int key = (int) (random() % (size * 2));
+            data.push_back(rbPair{key, (int) i});
+            reference[key] = (int) i;
+        }
+
+        rbTree tree = NULL;
+        ASSERT_EQ(rbCreateWithEngine(data.data(), data.size(), RB_ENGINE_BPLUS, &tree), RB_SUCCESS);
+        checkReads(tree, reference, -1, (int) size * 2);
+
+        // sorted input is taken as it is
+        std::vector<rbPair> sorted = pairsOf(reference);
+        rbTree fromSorted = NULL;
+        ASSERT_EQ(rbCreateWithEngine(sorted.data(), sorted.size(), RB_ENGINE_BPLUS, &fromSorted),
+                  RB_SUCCESS);
+        checkReads(fromSorted, reference, -1, (int) size * 2);
+
+        rbDestroy(tree);
+        rbDestroy(fromSorted);
+    }
+}
+
+
+TEST(BPlus, SameAnswersAsTheRedBlackEngine) {
+
+    rbTree bplus = NULL, redblack = NULL;
+    ASSERT_EQ(rbCreateWithEngine(NULL, 0, RB_ENGINE_BPLUS, &bplus), RB_SUCCESS);
+    ASSERT_EQ(rbCreateWithEngine(NULL, 0, RB_ENGINE_REDBLACK, &redblack), RB_SUCCESS);
+
+    std::mt19937 random(10);
+    for (int i = 0; i < 20000; ++i) {
+        int key = (int) (random() % 3000) - 1500;
+        if (random() % 3 == 0)
+            EXPECT_EQ(rbErase(bplus, key), rbErase(redblack, key));
+        else
+            EXPECT_EQ(rbInsert(bplus, rbPair{key, i}), rbInsert(redblack, rbPair{key, i}));
+    }
+
+    EXPECT_EQ(contents(bplus), contents(redblack));
+    EXPECT_EQ(rbSize(bplus), rbSize(redblack));
+
+    rbDestroy(bplus);
+    rbDestroy(redblack);
+}
@@ -0,0 +1,266 @@
+/****************************************************************************************
+ *
+ *   rbtree_concurrent_test.cpp
+ *
+ *   The concurrent container (rbCreateConcurrent): readers look up and walk the
+ *   container while writers insert, replace and erase keys, one at a time and in
+ *   batches. The even keys are never erased, so every read must find them; the odd ones
+ *   belong to the writers, which keep a reference of their own. Threads beyond the
+ *   RB_MAX_READERS reader slots still find keys, under the writer lock. Built also with
+ *   ThreadSanitizer (target rbtree_concurrent_tsan), where a data race fails the test.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "RBTree.h"
+
+
+namespace {
+
+const int    KEYS    = 4096; // keys [0, KEYS), the even ones stay in the container
+const int    WRITERS = 2;
+const int    READERS = 4;
+const size_t WRITES  = 4000; // operations of every writer
+
+
+/// A container of the even keys, every value equal to its key.
+rbTree evenTree() {
+
+    std::vector<rbPair> data;
+    for (int key = 0; key < KEYS; key += 2)
+        data.push_back(rbPair{key, key});
+
+    rbTree tree = NULL;
+    EXPECT_EQ(rbCreateConcurrent(data.data(), data.size(), &tree), RB_SUCCESS);
+    return tree;
+}
+
+
+/// Writer w owns the odd keys k with k / 2 % WRITERS == w. A key is inserted with the
+/// value key or -key, replaced or erased; 'owned' follows every change.
+void write(rbTree tree, int w, std::map<int, int>& owned) {
+
+    std::mt19937 random(w + 1);
+    std::uniform_int_distribution<int> keys(0, KEYS / 2 / WRITERS - 1);
+
+    auto keyOf = [w](int i) { return (i * WRITERS + w) * 2 + 1; };
+
+    for (size_t i = 0; i < WRITES; ++i) {
+        int key = keyOf(keys(random));
+
+        switch (random() % 8) {
+        case 0: {
+            std::vector<rbPair> batch;
+            for (int j = 0; j < 16; ++j) {
+                int k = keyOf(keys(random));
+                batch.push_back(rbPair{k, -k});
+                owned[k] = -k;
+            }
+            ASSERT_EQ(rbInsertBatch(tree, batch.data(), batch.size()), RB_SUCCESS);
+            break;
+        }
+        case 1: {
+            std::vector<rb_key_type> batch;
+            for (int j = 0; j < 16; ++j) {
+                batch.push_back(keyOf(keys(random)));
+                owned.erase(batch.back());
+            }
+            ASSERT_EQ(rbEraseBatch(tree, batch.data(), batch.size()), RB_SUCCESS);
+            break;
+        }
+        case 2: case 3: case 4:
+            ASSERT_EQ(rbInsert(tree, rbPair{key, i % 2 ? key : -key}), RB_SUCCESS);
+            owned[key] = i % 2 ? key : -key;
+            break;
+        default:
+            rbErase(tree, key);
+            owned.erase(key);
+        }
+    }
+}
+
+
+/// Looks up and walks the container until 'done'; returns the number of reads that saw
+/// a pair they should not have.
+size_t read(rbTree tree, int r, const std::atomic<bool>& done) {
+
+    std::mt19937 random(100 + r);
+    std::uniform_int_distribution<int> keys(0, KEYS - 1);
+    size_t wrong = 0;
+
+    do {
+        int key = keys(random);
+
+        rbReadBegin(tree);
+
+        rbPair* pair = rbFind(tree, key);
+        if (key % 2 == 0)
+            wrong += pair == NULL || pair->key != key || pair->value != key;
+        else if (pair != NULL) {
+            // a writer may replace the value meanwhile
+            int value = __atomic_load_n(&pair->value, __ATOMIC_RELAXED);
+            wrong += pair->key != key || (value != key && value != -key);
+        }
+
+        rb_key_type batch[8];
+        rbPair*     found[8];
+        for (int j = 0; j < 8; ++j)
+            batch[j] = keys(random) & ~1;
+        rbFindBatch(tree, batch, 8, found);
+        for (int j = 0; j < 8; ++j)
+            wrong += found[j] == NULL || found[j]->key != batch[j];
+
+        // a walk returns the keys in increasing order and skips no even key
+        int from = key;
+        pair = rbLowerBound(tree, key);
+        for (int j = 0; j < 32 && pair != NULL; ++j, pair = rbNext(tree, pair)) {
+            wrong += pair->key < from || pair->key > from + from % 2;
+            from = pair->key + 1;
+        }
+
+        rbReadEnd(tree);
+    } while (!done.load());
+
+    return wrong;
+}
+
+} // namespace
+
+
+TEST(ConcurrentTree, ReadersSeeConsistentPairsWhileWritersChangeThem) {
+
+    rbTree tree = evenTree();
+    ASSERT_NE(tree, nullptr);
+
+    std::map<int, int>       owned[WRITERS];
+    std::atomic<bool>        done(false);
+    std::atomic<size_t>      wrong(0);
+    std::vector<std::thread> readers, writers;
+
+    for (int r = 0; r < READERS; ++r)
+        readers.emplace_back([&, r] { wrong += read(tree, r, done); });
+    for (int w = 0; w < WRITERS; ++w)
+        writers.emplace_back([&, w] { write(tree, w, owned[w]); });
+
+    for (auto& t : writers)
+        t.join();
+    done = true;
+    for (auto& t : readers)
+        t.join();
+
+    EXPECT_EQ(wrong.load(), 0u);
+
+    // the container is the even keys and what the writers left
+    std::map<int, int> expected;
+    for (int key = 0; key < KEYS; key += 2)
+        expected[key] = key;
+    for (auto& keys : owned)
+        expected.insert(keys.begin(), keys.end());
+
+    std::map<int, int> actual;
+    for (rbPair* pair = rbBegin(tree); pair != NULL; pair = rbNext(tree, pair))
+        actual[pair->key] = pair->value;
+
+    EXPECT_EQ(actual, expected);
+    EXPECT_EQ(rbSize(tree), expected.size());
+
+    rbDestroy(tree);
+}
+
+
+TEST(ConcurrentTree, WalksStayOrderedWhileTheContainerIsCleared) {
+
+    rbTree tree = evenTree();
+    ASSERT_NE(tree, nullptr);
+
+    std::atomic<bool>   done(false);
+    std::atomic<size_t> wrong(0);
+
+    std::thread reader([&] {
+        do {
+            rbReadBegin(tree);
+            int last = -1;
+            for (rbPair* pair = rbBegin(tree); pair != NULL; pair = rbNext(tree, pair)) {
+                wrong += pair->key <= last || pair->value != pair->key;
+                last = pair->key;
+            }
+            rbReadEnd(tree);
+        } while (!done.load());
+    });
+
+    std::vector<rbPair> data;
+    for (int key = 0; key < KEYS; key += 2)
+        data.push_back(rbPair{key, key});
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(rbClear(tree), RB_SUCCESS);
+        EXPECT_EQ(rbInsertBatch(tree, data.data(), data.size()), RB_SUCCESS);
+    }
+
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(wrong.load(), 0u);
+    EXPECT_EQ(rbSize(tree), data.size());
+
+    rbDestroy(tree);
+}
+
+
+TEST(ConcurrentTree, ThreadsBeyondTheReaderSlotsReadUnderTheWriterLock) {
+
+    rbTree tree = evenTree();
+    ASSERT_NE(tree, nullptr);
+
+    // every thread holds a read section until 'release'; the main thread may hold a slot
+    // of its own already
+    std::promise<void>       release;
+    std::shared_future<void> released = release.get_future().share();
+    std::vector<std::thread> holders;
+    rbResult                 res = RB_SUCCESS;
+
+    while (res == RB_SUCCESS && holders.size() <= RB_MAX_READERS) {
+        std::promise<rbResult> entered;
+        std::future<rbResult>  result = entered.get_future();
+
+        holders.emplace_back([&, entered = std::move(entered)]() mutable {
+            rbResult r = rbReadBegin(tree);
+            if (r != RB_SUCCESS) {
+                // no slot: the lookups still work, the read sections fail; checked before
+                // the holders are released and their slots are free again
+                rbPair* pair = rbFind(tree, 42);
+                EXPECT_TRUE(pair != NULL && pair->value == 42);
+                EXPECT_EQ(rbFind(tree, 43), nullptr);
+                EXPECT_EQ(rbReadEnd(tree), RB_INVALID_ARGS);
+                EXPECT_EQ(rbForeach(tree, [](rbPair*, void*) {}, NULL), RB_LACK_OF_MEMORY);
+                entered.set_value(r);
+                return;
+            }
+            entered.set_value(r);
+            released.wait();
+            EXPECT_EQ(rbReadEnd(tree), RB_SUCCESS);
+        });
+        res = result.get();
+    }
+
+    EXPECT_EQ(res, RB_LACK_OF_MEMORY);
+    EXPECT_GE(holders.size(), RB_MAX_READERS);
+
+    release.set_value();
+    for (auto& t : holders)
+        t.join();
+
+    // the slots of the threads that exited are free again
+    std::thread([&] {
+        EXPECT_EQ(rbReadBegin(tree), RB_SUCCESS);
+        EXPECT_EQ(rbReadEnd(tree), RB_SUCCESS);
+    }).join();
+
+    rbDestroy(tree);
+}
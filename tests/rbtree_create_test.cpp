@@ -0,0 +1,119 @@
+/****************************************************************************************
+ *
+ *   rbtree_create_test.cpp
+ *
+ *   The linear construction of rbCreate: sorted, reversed and shuffled input of every
+ *   size up to a few hundred elements and with repeated keys must give a valid red-black
+ *   tree with the pairs a loop of rbInsert would leave.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+/// Creates a tree of the pairs and compares it with a loop of insertions into std::map.
+void checkCreate(const std::vector<rbPair>& data) {
+
+    std::map<int, int> reference;
+    for (auto& pair : data)
+        reference[pair.key] = pair.value;
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(data.data(), data.size(), &tree), RB_SUCCESS);
+
+    EXPECT_TRUE(isRedBlack(tree)) << data.size() << " pairs";
+    EXPECT_EQ(contents(tree), reference) << data.size() << " pairs";
+
+    // the created tree goes on as any other
+    ASSERT_EQ(rbInsert(tree, rbPair{-1, -1}), RB_SUCCESS);
+    reference[-1] = -1;
+    if (!data.empty()) {
+        ASSERT_EQ(rbErase(tree, data[0].key), RB_SUCCESS);
+        reference.erase(data[0].key);
+    }
+    EXPECT_TRUE(isRedBlack(tree)) << data.size() << " pairs";
+    EXPECT_EQ(contents(tree), reference) << data.size() << " pairs";
+
+    rbDestroy(tree);
+}
+
+} // namespace
+
+
+TEST(Create, SortedInputOfEverySize) {
+
+    for (int size = 0; size <= 300; ++size) {
+        std::vector<rbPair> data;
+        for (int key = 0; key < size; ++key)
+            data.push_back(rbPair{key * 2, key});
+        checkCreate(data);
+    }
+}
+
+
+TEST(Create, ReversedInputOfEverySize) {
+
+    for (int size = 1; size <= 300; ++size) {
+        std::vector<rbPair> data;
+        for (int key = size; key > 0; --key)
+            data.push_back(rbPair{key, -key});
+        checkCreate(data);
+    }
+}
+
+
+TEST(Create, ShuffledInput) {
+
+    std::mt19937 random(3);
+
+    for (int size : {1, 2, 3, 17, 1000, 65537}) {
+        std::vector<int> keys;
+        for (int key = 0; key < size; ++key)
+            keys.push_back(key);
+        std::shuffle(keys.begin(), keys.end(), random);
+
+        std::vector<rbPair> data;
+        for (int key : keys)
+            data.push_back(rbPair{key, key + 1});
+        checkCreate(data);
+    }
+}
+
+
+TEST(Create, RepeatedKeysKeepTheLastValue) {
+
+    std::mt19937 random(4);
+
+    // sorted with runs of equal keys, then in any order
+    std::vector<rbPair> sorted, shuffled;
+    for (int i = 0; i < 5000; ++i)
+        sorted.push_back(rbPair{i / 3, i});
+    for (int i = 0; i < 5000; ++i)
+        shuffled.push_back(rbPair{(int) (random() % 700), i});
+
+    checkCreate(sorted);
+    checkCreate(shuffled);
+    checkCreate(std::vector<rbPair>(100, rbPair{7, 7}));
+}
+
+
+TEST(Create, EmptyTree) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+    EXPECT_EQ(rbSize(tree), 0u);
+    EXPECT_EQ(rbEmpty(tree), 1);
+    EXPECT_EQ(rbBegin(tree), nullptr);
+    rbDestroy(tree);
+
+    EXPECT_EQ(rbCreate(NULL, 0, NULL), RB_INVALID_ARGS);
+}
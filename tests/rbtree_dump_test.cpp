@@ -0,0 +1,269 @@
+/****************************************************************************************
+ *
+ *   rbtree_dump_test.cpp
+ *
+ *   rbDumpTo against recursive formatters of the same layouts, for trees from empty to
+ *   many times the size of its buffer and keys and values of any sign; the dumps of the
+ *   B+ engine; output that fails; and walks and destruction of large trees.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+const rbDumpFormat FORMATS[] = {RB_DUMP_TEXT, RB_DUMP_DOT, RB_DUMP_JSON};
+
+
+/// The output of rbDumpTo, through a temporary file.
+std::string dump(rbTree tree, rbDumpFormat format) {
+
+    FILE* file = tmpfile();
+    EXPECT_NE(file, nullptr);
+    if (file == NULL)
+        return std::string();
+
+    EXPECT_EQ(rbDumpTo(tree, file, format), RB_SUCCESS);
+
+    std::string text;
+    char        buf[4096];
+    rewind(file);
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), file)) != 0;)
+        text.append(buf, n);
+
+    fclose(file);
+    return text;
+}
+
+
+void textOf(rbNode node, int depth, std::string* out) {
+
+    for (int i = 0; i < depth; ++i)
+        *out += "    |";
+    if (node == NULL) {
+        *out += "NULL(B)\n";
+        return;
+    }
+    *out += "[key: " + std::to_string(node->pair.key) + ", value: " +
+            std::to_string(node->pair.value) + (node->color == RED ? "](R)\n" : "](B)\n");
+    textOf(node->left, depth + 1, out);
+    textOf(node->right, depth + 1, out);
+}
+
+
+void dotOf(rbNode node, std::string* out) {
+
+    if (node == NULL)
+        return;
+
+    std::string key = std::to_string(node->pair.key);
+    *out += "  \"" + key + "\" [label=\"" + key + "\\n" + std::to_string(node->pair.value) +
+            (node->color == RED ? "\", fillcolor=red];\n" : "\", fillcolor=black];\n");
+
+    if (node->left != NULL || node->right != NULL) {
+        for (rbNode child : {node->left, node->right})
+            if (child != NULL)
+                *out += "  \"" + key + "\" -> \"" + std::to_string(child->pair.key) + "\";\n";
+            else
+                *out += "  \"" + key + "\" -> \"nil" + key + "\";\n  \"nil" + key +
+                        "\" [shape=point];\n";
+    }
+
+    dotOf(node->left, out);
+    dotOf(node->right, out);
+}
+
+
+void jsonOf(rbNode node, std::string* out) {
+
+    if (node == NULL) {
+        *out += "null";
+        return;
+    }
+    *out += "{\"key\": " + std::to_string(node->pair.key) + ", \"value\": " +
+            std::to_string(node->pair.value) +
+            (node->color == RED ? ", \"color\": \"red\"" : ", \"color\": \"black\"");
+    *out += ", \"left\": ";
+    jsonOf(node->left, out);
+    *out += ", \"right\": ";
+    jsonOf(node->right, out);
+    *out += "}";
+}
+
+
+/// The dump of a red-black tree as the recursive formatters write it.
+std::string expectedDump(rbTree tree, rbDumpFormat format) {
+
+    std::string out;
+
+    if (format == RB_DUMP_TEXT)
+        textOf(tree->treeRoot, 0, &out);
+    else if (format == RB_DUMP_DOT) {
+        out = "digraph rbTree {\n  node [shape=circle, style=filled, fontcolor=white];\n";
+        dotOf(tree->treeRoot, &out);
+        out += "}\n";
+    }
+    else {
+        out = "{\"engine\": \"red-black\", \"size\": " + std::to_string(tree->size) +
+              ", \"root\": ";
+        jsonOf(tree->treeRoot, &out);
+        out += "}\n";
+    }
+    return out;
+}
+
+
+/// Whether the brackets and braces of the text pair up.
+bool balanced(const std::string& text) {
+
+    std::string open;
+    for (char c : text)
+        if (c == '{' || c == '[')
+            open += c;
+        else if (c == '}' || c == ']') {
+            if (open.empty() || open.back() != (c == '}' ? '{' : '['))
+                return false;
+            open.pop_back();
+        }
+    return open.empty();
+}
+
+} // namespace
+
+
+TEST(Dump, MatchesRecursiveFormatters) {
+
+    std::mt19937 random(23);
+
+    for (size_t size : {0, 1, 2, 3, 7, 100, 50000}) {
+        rbTree tree = NULL;
+        ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+
+        // the extremes of both signs, and a tree shaped by single insertions
+        std::vector<int> keys = {INT_MIN, INT_MAX, 0, -1};
+        while (keys.size() < size)
+            keys.push_back((int) random());
+        keys.resize(size);
+        for (int key : keys)
+            ASSERT_EQ(rbInsert(tree, rbPair{key, ~key}), RB_SUCCESS);
+
+        for (rbDumpFormat format : FORMATS) {
+            std::string actual = dump(tree, format);
+            ASSERT_EQ(actual, expectedDump(tree, format)) << size << " keys, format " << format;
+            if (format == RB_DUMP_JSON) {
+                EXPECT_TRUE(balanced(actual));
+            }
+        }
+
+        rbDestroy(tree);
+    }
+}
+
+
+TEST(Dump, BPlusNodesHoldEveryPair) {
+
+    std::map<int, int> reference;
+    for (int key = -3000; key < 3000; key += 3)
+        reference[key] = -key;
+    std::vector<rbPair> data = pairsOf(reference);
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreateWithEngine(data.data(), data.size(), RB_ENGINE_BPLUS, &tree),
+              RB_SUCCESS);
+
+    // the leaves of the text dump hold the pairs in key order
+    std::string        text = dump(tree, RB_DUMP_TEXT);
+    std::map<int, int> pairs;
+    std::vector<int>   order;
+    for (size_t at = text.find("[key: "); at != std::string::npos;
+         at = text.find("[key: ", at + 1)) {
+        int key, value;
+        ASSERT_EQ(sscanf(text.c_str() + at, "[key: %d, value: %d]", &key, &value), 2);
+        pairs[key] = value;
+        order.push_back(key);
+    }
+    EXPECT_EQ(pairs, reference);
+    EXPECT_TRUE(std::is_sorted(order.begin(), order.end()));
+    EXPECT_EQ(order.size(), reference.size());
+
+    std::string json = dump(tree, RB_DUMP_JSON);
+    EXPECT_EQ(json.rfind("{\"engine\": \"B+\", \"size\": " + std::to_string(data.size()), 0), 0u);
+    EXPECT_TRUE(balanced(json));
+
+    std::string dot = dump(tree, RB_DUMP_DOT);
+    EXPECT_EQ(dot.rfind("digraph rbTree {\n", 0), 0u);
+    EXPECT_TRUE(balanced(dot));
+
+    rbDestroy(tree);
+}
+
+
+TEST(Dump, FailedOutputAndInvalidArguments) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+    for (int key = 0; key < 100000; ++key)
+        ASSERT_EQ(rbInsert(tree, rbPair{key, key}), RB_SUCCESS);
+
+    // a stream open only for reading takes no output
+    FILE* file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    FILE* readOnly = fopen("/dev/null", "r");
+    if (readOnly != NULL) {
+        for (rbDumpFormat format : FORMATS)
+            EXPECT_EQ(rbDumpTo(tree, readOnly, format), RB_IO_ERROR) << "format " << format;
+        fclose(readOnly);
+    }
+
+    EXPECT_EQ(rbDumpTo(NULL, file, RB_DUMP_TEXT), RB_INVALID_ARGS);
+    EXPECT_EQ(rbDumpTo(tree, NULL, RB_DUMP_TEXT), RB_INVALID_ARGS);
+    EXPECT_EQ(rbDumpTo(tree, file, (rbDumpFormat) 3), RB_INVALID_ARGS);
+
+    fclose(file);
+    rbDestroy(tree);
+}
+
+
+TEST(Dump, WalksAndDestroysLargeTrees) {
+
+    // ascending insertions, single nodes and a pool, then a clear and a second fill
+    for (bool pooled : {false, true}) {
+        rbTree tree = NULL;
+        ASSERT_EQ(pooled ? rbCreateWithPool(NULL, 0, 1, &tree) : rbCreate(NULL, 0, &tree),
+                  RB_SUCCESS);
+
+        for (int round = 0; round < 2; ++round) {
+            const int n = 1 << 20;
+            for (int key = 0; key < n; ++key)
+                ASSERT_EQ(rbInsert(tree, rbPair{key, round}), RB_SUCCESS);
+
+            struct Walk { int next; bool ordered; } walk = {0, true};
+            ASSERT_EQ(rbForeach(tree, [](rbPair* pair, void* data) {
+                Walk* w = (Walk*) data;
+                w->ordered &= pair->key == w->next++;
+            }, &walk), RB_SUCCESS);
+            EXPECT_TRUE(walk.ordered);
+            EXPECT_EQ(walk.next, n);
+            EXPECT_TRUE(isRedBlack(tree));
+
+            if (round == 0) {
+                ASSERT_EQ(rbClear(tree), RB_SUCCESS);
+                EXPECT_EQ(rbSize(tree), 0u);
+                EXPECT_EQ(rbBegin(tree), nullptr);
+            }
+        }
+
+        rbDestroy(tree);
+    }
+}
@@ -0,0 +1,231 @@
+/****************************************************************************************
+ *
+ *   rbtree_file_test.cpp
+ *
+ *   Snapshot files: rbSave of every engine and the concurrent container, restored by
+ *   rbLoad and rbFrozenLoad, for sizes around the chunk of pairs written at once;
+ *   threads saving to one path at once; and files that are truncated, damaged or
+ *   missing, which must be rejected without a container.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+const rbEngine ENGINES[] = {RB_ENGINE_REDBLACK, RB_ENGINE_BPLUS, RB_ENGINE_PERSISTENT};
+
+
+/// A file of the running test, so that ctest -j can run the tests side by side.
+std::string pathOf(const char* name) {
+
+    return ::testing::TempDir() +
+           ::testing::UnitTest::GetInstance()->current_test_info()->name() + "_" + name;
+}
+
+
+std::string readFile(const std::string& path) {
+
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+
+void writeFile(const std::string& path, const std::string& bytes) {
+
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+}
+
+
+/// rbLoad and rbFrozenLoad of the file both fail with the result.
+void expectRejected(const std::string& path, rbResult result) {
+
+    rbTree   tree   = NULL;
+    rbFrozen frozen = NULL;
+    EXPECT_EQ(rbLoad(path.c_str(), &tree), result);
+    EXPECT_EQ(rbFrozenLoad(path.c_str(), &frozen), result);
+    EXPECT_EQ(tree, nullptr);
+    EXPECT_EQ(frozen, nullptr);
+}
+
+} // namespace
+
+
+TEST(File, SavedContainersLoadBack) {
+
+    std::mt19937 random(20);
+    std::string  path = pathOf("rbtree_file_test.rbts");
+
+    for (size_t size : {0, 1, 2, 4095, 4096, 4097, 30000}) {
+        std::map<int, int> reference;
+        while (reference.size() < size)
+            reference[(int) random() % 1000000] = (int) random();
+        std::vector<rbPair> data = pairsOf(reference);
+
+        std::vector<rbTree> trees;
+        for (rbEngine engine : ENGINES) {
+            trees.push_back(NULL);
+            ASSERT_EQ(rbCreateWithEngine(data.data(), size, engine, &trees.back()), RB_SUCCESS);
+        }
+        trees.push_back(NULL);
+        ASSERT_EQ(rbCreateConcurrent(data.data(), size, &trees.back()), RB_SUCCESS);
+
+        for (size_t t = 0; t < trees.size(); ++t) {
+            SCOPED_TRACE(testing::Message() << "container " << t << ", " << size << " pairs");
+            ASSERT_EQ(rbSave(trees[t], path.c_str()), RB_SUCCESS);
+
+            rbTree loaded = NULL;
+            ASSERT_EQ(rbLoad(path.c_str(), &loaded), RB_SUCCESS);
+            EXPECT_EQ(contents(loaded), reference);
+            EXPECT_EQ(rbSize(loaded), size);
+            EXPECT_TRUE(isRedBlack(loaded));
+
+            rbFrozen frozen = NULL;
+            ASSERT_EQ(rbFrozenLoad(path.c_str(), &frozen), RB_SUCCESS);
+            for (int i = 0; i < 2000; ++i) {
+                int key = (int) random() % 1000000;
+                const rbPair* found = rbFrozenFind(frozen, key);
+                auto expected = reference.find(key);
+                ASSERT_EQ(found == NULL, expected == reference.end()) << key;
+                if (found != NULL) {
+                    EXPECT_EQ(found->value, expected->second);
+                }
+            }
+            for (auto& kv : reference)
+                ASSERT_NE(rbFrozenFind(frozen, kv.first), nullptr) << kv.first;
+
+            // the loaded tree changes as any other
+            ASSERT_EQ(rbInsert(loaded, rbPair{-1, -1}), RB_SUCCESS);
+            if (size != 0) {
+                ASSERT_EQ(rbErase(loaded, reference.begin()->first), RB_SUCCESS);
+            }
+            EXPECT_TRUE(isRedBlack(loaded));
+
+            rbFrozenDestroy(frozen);
+            rbDestroy(loaded);
+        }
+
+        for (rbTree tree : trees)
+            rbDestroy(tree);
+    }
+
+    remove(path.c_str());
+}
+
+
+TEST(File, SavesToOnePathAtOnceLeaveOneWholeFile) {
+
+    std::string path = pathOf("rbtree_file_test.rbts");
+
+    // each thread saves a container of its own over and over; every save writes a file
+    // of its own, renamed over the path when it is complete
+    std::vector<std::map<int, int>> references(2);
+    std::vector<rbTree>             trees(2, NULL);
+    for (int t = 0; t < 2; ++t) {
+        for (int key = 0; key < 20000; ++key)
+            references[t][key * (t + 1)] = t;
+        std::vector<rbPair> data = pairsOf(references[t]);
+        ASSERT_EQ(rbCreate(data.data(), data.size(), &trees[t]), RB_SUCCESS);
+    }
+
+    std::vector<std::thread> savers;
+    for (int t = 0; t < 2; ++t)
+        savers.emplace_back([&, t] {
+            for (int i = 0; i < 50; ++i)
+                EXPECT_EQ(rbSave(trees[t], path.c_str()), RB_SUCCESS);
+        });
+    for (auto& saver : savers)
+        saver.join();
+
+    rbTree loaded = NULL;
+    ASSERT_EQ(rbLoad(path.c_str(), &loaded), RB_SUCCESS);
+    std::map<int, int> pairs = contents(loaded);
+    EXPECT_TRUE(pairs == references[0] || pairs == references[1]);
+
+    rbDestroy(loaded);
+    for (rbTree tree : trees)
+        rbDestroy(tree);
+    remove(path.c_str());
+}
+
+
+TEST(File, DamagedFilesAreRejected) {
+
+    std::string path    = pathOf("rbtree_file_test.rbts");
+    std::string damaged = pathOf("rbtree_file_test_damaged.rbts");
+
+    std::vector<rbPair> data;
+    for (int key = 0; key < 1000; ++key)
+        data.push_back(rbPair{key * 2, key});
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(data.data(), data.size(), &tree), RB_SUCCESS);
+    ASSERT_EQ(rbSave(tree, path.c_str()), RB_SUCCESS);
+    rbDestroy(tree);
+
+    const std::string good = readFile(path);
+    ASSERT_GT(good.size(), data.size() * sizeof(rbPair));
+    const size_t header = good.size() - data.size() * sizeof(rbPair);
+
+    // every single byte of the header and a byte of every pair
+    for (size_t offset = 0; offset < good.size(); offset += offset < header ? 1 : 37) {
+        std::string bytes = good;
+        bytes[offset] ^= 0x40;
+        writeFile(damaged, bytes);
+        SCOPED_TRACE(testing::Message() << "byte " << offset << " changed");
+        expectRejected(damaged, RB_BAD_FILE);
+    }
+
+    // cut before the end of the header, inside a pair and at a pair boundary
+    for (size_t length : {(size_t) 0, header - 1, good.size() - 3, good.size() - 8}) {
+        writeFile(damaged, good.substr(0, length));
+        SCOPED_TRACE(testing::Message() << "cut to " << length << " bytes");
+        expectRejected(damaged, RB_BAD_FILE);
+    }
+
+    // a pair more than the header counts
+    writeFile(damaged, good + good.substr(header, sizeof(rbPair)));
+    expectRejected(damaged, RB_BAD_FILE);
+
+    // and the untouched file still loads
+    rbTree loaded = NULL;
+    ASSERT_EQ(rbLoad(path.c_str(), &loaded), RB_SUCCESS);
+    EXPECT_EQ(rbSize(loaded), data.size());
+    rbDestroy(loaded);
+
+    remove(path.c_str());
+    remove(damaged.c_str());
+}
+
+
+TEST(File, MissingFilesAndInvalidArguments) {
+
+    rbTree   tree   = NULL;
+    rbFrozen frozen = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+
+    std::string missing = pathOf("rbtree_file_test_missing/none.rbts");
+    expectRejected(missing, RB_IO_ERROR);
+    EXPECT_EQ(rbSave(tree, missing.c_str()), RB_IO_ERROR);
+
+    EXPECT_EQ(rbSave(NULL, missing.c_str()), RB_INVALID_ARGS);
+    EXPECT_EQ(rbSave(tree, NULL), RB_INVALID_ARGS);
+    EXPECT_EQ(rbLoad(NULL, &tree), RB_INVALID_ARGS);
+    EXPECT_EQ(rbLoad(missing.c_str(), NULL), RB_INVALID_ARGS);
+    EXPECT_EQ(rbFrozenLoad(NULL, &frozen), RB_INVALID_ARGS);
+    EXPECT_EQ(rbFrozenLoad(missing.c_str(), NULL), RB_INVALID_ARGS);
+
+    rbDestroy(tree);
+}
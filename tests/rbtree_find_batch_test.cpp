@@ -0,0 +1,97 @@
+/****************************************************************************************
+ *
+ *   rbtree_find_batch_test.cpp
+ *
+ *   rbFindBatch against a loop of rbFind, for every engine and the concurrent
+ *   container, with batches shorter and longer than a group of interleaved descents,
+ *   repeated keys and missing ones.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+/// The containers rbFindBatch serves, all with the same pairs.
+std::vector<rbTree> containers(const std::vector<rbPair>& data) {
+
+    std::vector<rbTree> trees(5, NULL);
+
+    EXPECT_EQ(rbCreate(data.data(), data.size(), &trees[0]), RB_SUCCESS);
+    EXPECT_EQ(rbCreateWithEngine(data.data(), data.size(), RB_ENGINE_BPLUS, &trees[1]),
+              RB_SUCCESS);
+    EXPECT_EQ(rbCreateWithEngine(data.data(), data.size(), RB_ENGINE_PERSISTENT, &trees[2]),
+              RB_SUCCESS);
+    EXPECT_EQ(rbCreateConcurrent(data.data(), data.size(), &trees[3]), RB_SUCCESS);
+
+    // and a tree of single insertions, whose nodes are scattered over the heap
+    EXPECT_EQ(rbCreateWithPool(NULL, 0, 1, &trees[4]), RB_SUCCESS);
+    for (auto& pair : data)
+        EXPECT_EQ(rbInsert(trees[4], pair), RB_SUCCESS);
+
+    return trees;
+}
+
+} // namespace
+
+
+TEST(FindBatch, MatchesALoopOfRbFind) {
+
+    std::mt19937        random(12);
+    std::vector<rbPair> data;
+    for (int key = 0; key < 20000; key += 2)
+        data.push_back(rbPair{key, (int) random()});
+
+    std::vector<rbTree> trees = containers(data);
+
+    for (size_t n : {0, 1, 15, 16, 17, 33, 1000, 30000}) {
+        std::vector<rb_key_type> keys;
+        for (size_t i = 0; i < n; ++i)
+            keys.push_back((int) (random() % 20010) - 5);
+        if (n > 2)
+            keys[n - 1] = keys[0]; // the same key twice
+
+        for (size_t t = 0; t < trees.size(); ++t) {
+            std::vector<rbPair*> out(n + 1, NULL);
+            out[n] = (rbPair*) &out; // must stay untouched
+
+            ASSERT_EQ(rbFindBatch(trees[t], keys.data(), n, out.data()), RB_SUCCESS);
+
+            for (size_t i = 0; i < n; ++i)
+                ASSERT_EQ(out[i], rbFind(trees[t], keys[i]))
+                    << "container " << t << ", " << n << " keys, key " << keys[i];
+            EXPECT_EQ(out[n], (rbPair*) &out);
+        }
+    }
+
+    for (rbTree tree : trees)
+        rbDestroy(tree);
+}
+
+
+TEST(FindBatch, EmptyContainerAndInvalidArguments) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+
+    rb_key_type keys[3] = {1, 2, 3};
+    rbPair*     out[3]  = {(rbPair*) keys, (rbPair*) keys, (rbPair*) keys};
+
+    ASSERT_EQ(rbFindBatch(tree, keys, 3, out), RB_SUCCESS);
+    EXPECT_EQ(out[0], nullptr);
+    EXPECT_EQ(out[1], nullptr);
+    EXPECT_EQ(out[2], nullptr);
+
+    EXPECT_EQ(rbFindBatch(tree, NULL, 0, NULL), RB_SUCCESS);
+    EXPECT_EQ(rbFindBatch(tree, NULL, 3, out), RB_INVALID_ARGS);
+    EXPECT_EQ(rbFindBatch(tree, keys, 3, NULL), RB_INVALID_ARGS);
+    EXPECT_EQ(rbFindBatch(NULL, keys, 3, out), RB_INVALID_ARGS);
+
+    rbDestroy(tree);
+}
@@ -0,0 +1,142 @@
+/****************************************************************************************
+ *
+ *   rbtree_frozen_test.cpp
+ *
+ *   Frozen snapshots (rbFreeze): every lookup kernel the CPU supports against rbFind of
+ *   the container, for sizes around the block size and its powers, keys at the ends of
+ *   the key range, and one lookup at a time or many at once.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <climits>
+#include <random>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+const rbFrozenKernel KERNELS[] = {RB_FROZEN_SCALAR, RB_FROZEN_SSE2, RB_FROZEN_AVX2};
+
+
+/// Looks up the keys in the snapshot with the kernel, one by one and all at once, and
+/// compares the pairs with those of the container.
+void checkLookups(rbTree tree, rbFrozen frozen, rbFrozenKernel kernel,
+                  const std::vector<int>& keys) {
+
+    std::vector<const rbPair*> many(keys.size());
+    ASSERT_EQ(rbFrozenFindMany(frozen, keys.data(), keys.size(), many.data()), RB_SUCCESS);
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        const rbPair* expected = rbFind(tree, keys[i]);
+        const rbPair* found    = rbFrozenFind(frozen, keys[i]);
+
+        SCOPED_TRACE(testing::Message() << "kernel " << kernel << ", key " << keys[i]);
+        ASSERT_EQ(found == NULL, expected == NULL);
+        ASSERT_EQ(many[i] == NULL, expected == NULL);
+        if (expected != NULL) {
+            EXPECT_EQ(found->key, expected->key);
+            EXPECT_EQ(found->value, expected->value);
+            EXPECT_EQ(many[i], found);
+        }
+    }
+}
+
+} // namespace
+
+
+TEST(Frozen, EveryKernelFindsWhatTheContainerHolds) {
+
+    std::mt19937 random(11);
+
+    for (size_t size : {0, 1, 2, 15, 16, 17, 271, 272, 273, 4913, 5000, 83521, 100000}) {
+        // keys three apart, so that every gap between them is looked up too
+        std::vector<rbPair> data;
+        for (size_t i = 0; i < size; ++i)
+            data.push_back(rbPair{(int) i * 3 - 1000, (int) random()});
+
+        rbTree   tree   = NULL;
+        rbFrozen frozen = NULL;
+        ASSERT_EQ(rbCreate(data.data(), data.size(), &tree), RB_SUCCESS);
+        ASSERT_EQ(rbFreeze(tree, &frozen), RB_SUCCESS);
+
+        std::vector<int> keys = {INT_MIN, INT_MAX, -1001, (int) size * 3 - 1000};
+        for (int key = -1002; key < (int) size * 3 - 998; ++key)
+            keys.push_back(key);
+        std::shuffle(keys.begin(), keys.end(), random);
+
+        for (rbFrozenKernel kernel : KERNELS) {
+            if (rbFrozenUseKernel(frozen, kernel) != RB_SUCCESS)
+                continue;
+            checkLookups(tree, frozen, kernel, keys);
+        }
+
+        rbFrozenDestroy(frozen);
+        rbDestroy(tree);
+    }
+}
+
+
+TEST(Frozen, KeysAtTheEndsOfTheRange) {
+
+    std::vector<rbPair> data = {{INT_MIN, 1}, {INT_MIN + 1, 2}, {-1, 3}, {0, 4},
+                                {INT_MAX - 1, 5}, {INT_MAX, 6}};
+    std::vector<int>    keys = {INT_MIN, INT_MIN + 1, INT_MIN + 2, -2, -1, 0, 1,
+                                INT_MAX - 2, INT_MAX - 1, INT_MAX};
+
+    rbTree   tree   = NULL;
+    rbFrozen frozen = NULL;
+    ASSERT_EQ(rbCreate(data.data(), data.size(), &tree), RB_SUCCESS);
+    ASSERT_EQ(rbFreeze(tree, &frozen), RB_SUCCESS);
+
+    for (rbFrozenKernel kernel : KERNELS)
+        if (rbFrozenUseKernel(frozen, kernel) == RB_SUCCESS)
+            checkLookups(tree, frozen, kernel, keys);
+
+    rbFrozenDestroy(frozen);
+    rbDestroy(tree);
+}
+
+
+TEST(Frozen, IndependentOfTheContainer) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+    for (int key = 0; key < 100; ++key)
+        ASSERT_EQ(rbInsert(tree, rbPair{key, key}), RB_SUCCESS);
+
+    rbFrozen frozen = NULL;
+    ASSERT_EQ(rbFreeze(tree, &frozen), RB_SUCCESS);
+
+    ASSERT_EQ(rbErase(tree, 10), RB_SUCCESS);
+    ASSERT_EQ(rbInsert(tree, rbPair{20, -20}), RB_SUCCESS);
+    ASSERT_EQ(rbInsert(tree, rbPair{500, 500}), RB_SUCCESS);
+    rbDestroy(tree);
+
+    ASSERT_NE(rbFrozenFind(frozen, 10), nullptr);
+    EXPECT_EQ(rbFrozenFind(frozen, 20)->value, 20);
+    EXPECT_EQ(rbFrozenFind(frozen, 500), nullptr);
+
+    rbFrozenDestroy(frozen);
+}
+
+
+TEST(Frozen, ScalarKernelIsAlwaysThere) {
+
+    rbTree   tree   = NULL;
+    rbFrozen frozen = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+    ASSERT_EQ(rbFreeze(tree, &frozen), RB_SUCCESS);
+
+    EXPECT_EQ(rbFrozenUseKernel(frozen, RB_FROZEN_SCALAR), RB_SUCCESS);
+    EXPECT_EQ(rbFrozenUseKernel(NULL, RB_FROZEN_SCALAR), RB_INVALID_ARGS);
+    EXPECT_EQ(rbFrozenUseKernel(frozen, (rbFrozenKernel) 7), RB_INVALID_ARGS);
+    EXPECT_EQ(rbFrozenFind(frozen, 0), nullptr);
+
+    rbFrozenDestroy(frozen);
+    rbDestroy(tree);
+}
@@ -0,0 +1,193 @@
+/****************************************************************************************
+ *
+ *   rbtree_generic_test.cpp
+ *
+ *   Containers generated by RB_DEFINE: 64-bit keys, fixed-size string keys with their
+ *   own comparison and struct values against std::map, with the invariants of the
+ *   red-black tree checked as the containers change.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "RBTree.h"
+#include "RBTreeGeneric.h"
+
+
+typedef struct { char s[24]; } name24;
+
+struct Money {
+    int64_t units;
+    int     cents;
+};
+
+#define NAME_CMP(a, b) strcmp((a).s, (b).s)
+
+RB_DEFINE(rbI64, int64_t, double, RB_CMP_NUMBER)
+RB_DEFINE(rbName, name24, Money, NAME_CMP)
+
+
+namespace {
+
+/// Checks the subtree of a generated node like isRedBlack; returns its black height, or
+/// -1 if an invariant does not hold. Keys are checked by the walks of the tests.
+template <typename Node>
+int blackHeight(const Node* node, const Node* parent, size_t* nodes) {
+
+    if (node == NULL)
+        return 1;
+    if (node->parent != parent || (node->color == RED && parent && parent->color == RED))
+        return -1;
+
+    ++*nodes;
+    int left  = blackHeight(node->left, node, nodes);
+    int right = blackHeight(node->right, node, nodes);
+
+    if (left < 0 || left != right)
+        return -1;
+    return left + (node->color == BLACK);
+}
+
+
+template <typename Tree>
+bool isRedBlackGeneric(Tree tree) {
+
+    size_t nodes = 0;
+
+    if (tree->treeRoot != NULL && tree->treeRoot->color != BLACK)
+        return false;
+    return blackHeight(tree->treeRoot, decltype(tree->treeRoot)(NULL), &nodes) > 0 &&
+           nodes == tree->size;
+}
+
+
+name24 nameOf(const std::string& s) {
+
+    name24 name = {};
+    strncpy(name.s, s.c_str(), sizeof(name.s) - 1);
+    return name;
+}
+
+} // namespace
+
+
+TEST(Generic, WideKeysMatchStdMap) {
+
+    rbI64 tree = NULL;
+    ASSERT_EQ(rbI64Create(&tree), RB_SUCCESS);
+
+    std::map<int64_t, double> reference;
+    std::mt19937_64           random(13);
+
+    for (int i = 0; i < 30000; ++i) {
+        // keys that differ only above the low 32 bits as well
+        int64_t key = (int64_t) (random() % 3000) << 33 | (int64_t) (random() % 2);
+        if (random() % 3 == 0) {
+            ASSERT_EQ(rbI64Erase(tree, key), RB_SUCCESS);
+            reference.erase(key);
+        }
+        else {
+            ASSERT_EQ(rbI64Insert(tree, key, i * 0.5), RB_SUCCESS);
+            reference[key] = i * 0.5;
+        }
+    }
+
+    EXPECT_TRUE(isRedBlackGeneric(tree));
+    ASSERT_EQ(rbI64Size(tree), reference.size());
+
+    std::vector<std::pair<int64_t, double>> forward, expected(reference.begin(), reference.end());
+    for (rbI64Pair* it = rbI64Begin(tree); it != NULL; it = rbI64Next(tree, it))
+        forward.emplace_back(it->key, it->value);
+    EXPECT_EQ(forward, expected);
+
+    std::vector<int64_t> backward;
+    for (rbI64Pair* it = rbI64Last(tree); it != NULL; it = rbI64Prev(tree, it))
+        backward.push_back(it->key);
+    ASSERT_EQ(backward.size(), expected.size());
+    EXPECT_EQ(backward.front(), expected.back().first);
+
+    for (int i = 0; i < 2000; ++i) {
+        int64_t key   = (int64_t) (random() % 3100) << 33;
+        auto    lower = reference.lower_bound(key);
+        auto    upper = reference.upper_bound(key);
+
+        rbI64Pair* lb = rbI64LowerBound(tree, key);
+        rbI64Pair* ub = rbI64UpperBound(tree, key);
+        ASSERT_EQ(lb == NULL, lower == reference.end());
+        ASSERT_EQ(ub == NULL, upper == reference.end());
+        if (lb != NULL) {
+            EXPECT_EQ(lb->key, lower->first);
+        }
+        if (ub != NULL) {
+            EXPECT_EQ(ub->key, upper->first);
+        }
+
+        rbI64Pair* found = rbI64Find(tree, key);
+        EXPECT_EQ(found != NULL, reference.count(key) == 1);
+    }
+
+    ASSERT_EQ(rbI64Clear(tree), RB_SUCCESS);
+    EXPECT_EQ(rbI64Size(tree), 0u);
+    EXPECT_EQ(rbI64Begin(tree), nullptr);
+
+    rbI64Destroy(tree);
+}
+
+
+TEST(Generic, StringKeysAndStructValues) {
+
+    rbName tree = NULL;
+    ASSERT_EQ(rbNameCreate(&tree), RB_SUCCESS);
+
+    std::map<std::string, int64_t> reference;
+    std::mt19937                   random(14);
+
+    for (int i = 0; i < 5000; ++i) {
+        std::string key = "key-" + std::to_string(random() % 700);
+        if (random() % 4 == 0) {
+            ASSERT_EQ(rbNameErase(tree, nameOf(key)), RB_SUCCESS);
+            reference.erase(key);
+        }
+        else {
+            ASSERT_EQ(rbNameInsert(tree, nameOf(key), Money{(int64_t) i << 32, i % 100}),
+                      RB_SUCCESS);
+            reference[key] = (int64_t) i << 32;
+        }
+    }
+
+    EXPECT_TRUE(isRedBlackGeneric(tree));
+
+    std::map<std::string, int64_t> actual;
+    ASSERT_EQ(rbNameForeach(tree, [](rbNamePair* pair, void* data) {
+        (*(std::map<std::string, int64_t>*) data)[pair->key.s] = pair->value.units;
+    }, &actual), RB_SUCCESS);
+    EXPECT_EQ(actual, reference);
+
+    for (auto& kv : reference) {
+        rbNamePair* pair = rbNameFind(tree, nameOf(kv.first));
+        ASSERT_NE(pair, nullptr) << kv.first;
+        EXPECT_STREQ(pair->key.s, kv.first.c_str());
+        EXPECT_EQ(pair->value.units, kv.second);
+        EXPECT_EQ(pair->value.cents, (int) (kv.second >> 32) % 100);
+    }
+    EXPECT_EQ(rbNameFind(tree, nameOf("none")), nullptr);
+
+    rbNameDestroy(tree);
+}
+
+
+TEST(Generic, RejectsInvalidArguments) {
+
+    EXPECT_EQ(rbI64Create(NULL), RB_INVALID_ARGS);
+    EXPECT_EQ(rbI64Insert(NULL, 1, 1.0), RB_INVALID_ARGS);
+    EXPECT_EQ(rbI64Erase(NULL, 1), RB_INVALID_ARGS);
+    EXPECT_EQ(rbI64Find(NULL, 1), nullptr);
+    EXPECT_EQ(rbI64Size(NULL), 0u);
+}
@@ -0,0 +1,137 @@
+/****************************************************************************************
+ *
+ *   rbtree_insert_test.cpp
+ *
+ *   rbInsert and rbErase of the red-black tree: ascending, descending, zigzag and random
+ *   keys against std::map, with the invariants of the tree checked after every change.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+/// Inserts the keys one by one, then erases them in the same order, checking the tree
+/// after every change.
+void insertAndErase(const std::vector<int>& keys) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+    std::map<int, int> reference;
+
+    for (int key : keys) {
+        ASSERT_EQ(rbInsert(tree, rbPair{key, -key}), RB_SUCCESS);
+        reference[key] = -key;
+        ASSERT_TRUE(isRedBlack(tree)) << "after inserting " << key;
+    }
+    EXPECT_EQ(contents(tree), reference);
+
+    for (int key : keys) {
+        rbErase(tree, key);
+        reference.erase(key);
+        ASSERT_TRUE(isRedBlack(tree)) << "after erasing " << key;
+    }
+    EXPECT_EQ(rbSize(tree), 0u);
+
+    rbDestroy(tree);
+}
+
+} // namespace
+
+
+TEST(Insert, AscendingKeys) {
+
+    std::vector<int> keys;
+    for (int key = 0; key < 500; ++key)
+        keys.push_back(key);
+    insertAndErase(keys);
+}
+
+
+TEST(Insert, DescendingKeys) {
+
+    std::vector<int> keys;
+    for (int key = 500; key > 0; --key)
+        keys.push_back(key);
+    insertAndErase(keys);
+}
+
+
+TEST(Insert, ZigzagKeys) {
+
+    std::vector<int> keys;
+    for (int key = 0; key < 250; ++key) {
+        keys.push_back(key);
+        keys.push_back(1000 - key);
+    }
+    insertAndErase(keys);
+}
+
+
+TEST(Insert, RandomKeysMatchStdMap) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+
+    std::map<int, int> reference;
+    std::mt19937       random(2);
+
+    for (int i = 0; i < 50000; ++i) {
+        int key = (int) (random() % 5000) - 2500;
+        if (random() % 4 == 0) {
+            rbErase(tree, key);
+            reference.erase(key);
+        }
+        else {
+            ASSERT_EQ(rbInsert(tree, rbPair{key, i}), RB_SUCCESS);
+            reference[key] = i;
+        }
+    }
+
+    EXPECT_TRUE(isRedBlack(tree));
+    EXPECT_EQ(contents(tree), reference);
+    EXPECT_EQ(rbSize(tree), reference.size());
+
+    for (auto& kv : reference) {
+        rbPair* pair = rbFind(tree, kv.first);
+        ASSERT_NE(pair, nullptr);
+        EXPECT_EQ(pair->value, kv.second);
+    }
+    EXPECT_EQ(rbFind(tree, 3000), nullptr);
+
+    rbDestroy(tree);
+}
+
+
+TEST(Insert, ExistingKeyReplacesTheValueInPlace) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+
+    for (int key = 0; key < 100; ++key)
+        ASSERT_EQ(rbInsert(tree, rbPair{key, key}), RB_SUCCESS);
+    rbPair* pair = rbFind(tree, 42);
+
+    ASSERT_EQ(rbInsert(tree, rbPair{42, 7}), RB_SUCCESS);
+    EXPECT_EQ(rbFind(tree, 42), pair);
+    EXPECT_EQ(pair->value, 7);
+    EXPECT_EQ(rbSize(tree), 100u);
+    EXPECT_TRUE(isRedBlack(tree));
+
+    rbDestroy(tree);
+}
+
+
+TEST(Insert, RejectsInvalidArguments) {
+
+    EXPECT_EQ(rbInsert(NULL, rbPair{1, 1}), RB_INVALID_ARGS);
+    EXPECT_EQ(rbErase(NULL, 1), RB_INVALID_ARGS);
+    EXPECT_EQ(rbFind(NULL, 1), nullptr);
+}
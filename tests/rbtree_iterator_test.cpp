@@ -0,0 +1,166 @@
+/****************************************************************************************
+ *
+ *   rbtree_iterator_test.cpp
+ *
+ *   Iteration in key order: rbBegin, rbLast, rbNext and rbPrev, the bounds and rbRange
+ *   against the iterators of std::map, on empty, small and random trees.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+/// Walks the tree forwards and backwards and looks up the bounds of every key around
+/// the keys of the reference.
+void checkIteration(rbTree tree, const std::map<int, int>& reference) {
+
+    std::vector<int> forward, backward, expected, reversed;
+    for (rbPair* it = rbBegin(tree); it != NULL; it = rbNext(tree, it))
+        forward.push_back(it->key);
+    for (rbPair* it = rbLast(tree); it != NULL; it = rbPrev(tree, it))
+        backward.push_back(it->key);
+    for (auto& kv : reference)
+        expected.push_back(kv.first);
+    reversed.assign(expected.rbegin(), expected.rend());
+
+    EXPECT_EQ(forward, expected);
+    EXPECT_EQ(backward, reversed);
+
+    int lo = reference.empty() ? 0 : reference.begin()->first - 2;
+    int hi = reference.empty() ? 0 : reference.rbegin()->first + 2;
+
+    for (int key = lo; key <= hi; ++key) {
+        auto    lower = reference.lower_bound(key);
+        auto    upper = reference.upper_bound(key);
+        rbPair* lb    = rbLowerBound(tree, key);
+        rbPair* ub    = rbUpperBound(tree, key);
+
+        ASSERT_EQ(lb == NULL, lower == reference.end()) << "lower bound of " << key;
+        ASSERT_EQ(ub == NULL, upper == reference.end()) << "upper bound of " << key;
+        if (lb != NULL) {
+            EXPECT_EQ(lb->key, lower->first) << "lower bound of " << key;
+        }
+        if (ub != NULL) {
+            EXPECT_EQ(ub->key, upper->first) << "upper bound of " << key;
+        }
+    }
+}
+
+
+/// The keys rbRange passes for [lo, hi].
+std::vector<int> range(rbTree tree, int lo, int hi) {
+
+    std::vector<int> keys;
+    EXPECT_EQ(rbRange(tree, lo, hi, [](rbPair* pair, void* data) {
+        ((std::vector<int>*) data)->push_back(pair->key);
+    }, &keys), RB_SUCCESS);
+    return keys;
+}
+
+} // namespace
+
+
+TEST(Iterator, EmptyTree) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+
+    EXPECT_EQ(rbBegin(tree), nullptr);
+    EXPECT_EQ(rbLast(tree), nullptr);
+    EXPECT_EQ(rbLowerBound(tree, 0), nullptr);
+    EXPECT_EQ(rbUpperBound(tree, 0), nullptr);
+    EXPECT_TRUE(range(tree, -10, 10).empty());
+
+    rbDestroy(tree);
+}
+
+
+TEST(Iterator, WalksAndBoundsMatchStdMap) {
+
+    std::mt19937 random(5);
+
+    for (int size : {1, 2, 3, 10, 100, 3000}) {
+        rbTree tree = NULL;
+        ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+
+        std::map<int, int> reference;
+        while ((int) reference.size() < size) {
+            int key = (int) (random() % (size * 4)) * 3;
+            reference[key] = key;
+            ASSERT_EQ(rbInsert(tree, rbPair{key, key}), RB_SUCCESS);
+        }
+
+        checkIteration(tree, reference);
+
+        // and after half of the keys are gone
+        for (auto it = reference.begin(); it != reference.end();) {
+            if (random() % 2) {
+                ASSERT_EQ(rbErase(tree, it->first), RB_SUCCESS);
+                it = reference.erase(it);
+            }
+            else
+                ++it;
+        }
+        checkIteration(tree, reference);
+
+        rbDestroy(tree);
+    }
+}
+
+
+TEST(Iterator, RangeMatchesStdMap) {
+
+    std::map<int, int> reference;
+    for (int key = 0; key < 1000; key += 5)
+        reference[key] = key;
+
+    std::vector<rbPair> data = pairsOf(reference);
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(data.data(), data.size(), &tree), RB_SUCCESS);
+
+    std::mt19937 random(6);
+    for (int i = 0; i < 500; ++i) {
+        int lo = (int) (random() % 1100) - 50;
+        int hi = (int) (random() % 1100) - 50;
+
+        std::vector<int> expected;
+        for (auto it = reference.lower_bound(lo); it != reference.end() && it->first <= hi; ++it)
+            expected.push_back(it->first);
+
+        EXPECT_EQ(range(tree, lo, hi), expected) << "[" << lo << ", " << hi << "]";
+    }
+
+    rbDestroy(tree);
+}
+
+
+TEST(Iterator, SurvivesTheRemovalOfOtherPairs) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+    for (int key = 0; key < 100; ++key)
+        ASSERT_EQ(rbInsert(tree, rbPair{key, key}), RB_SUCCESS);
+
+    // erasing the pair after the iterator each step leaves the even keys
+    std::vector<int> seen;
+    for (rbPair* it = rbBegin(tree); it != NULL; it = rbNext(tree, it)) {
+        seen.push_back(it->key);
+        rbErase(tree, it->key + 1);
+    }
+
+    std::vector<int> even;
+    for (int key = 0; key < 100; key += 2)
+        even.push_back(key);
+    EXPECT_EQ(seen, even);
+    EXPECT_TRUE(isRedBlack(tree));
+
+    rbDestroy(tree);
+}
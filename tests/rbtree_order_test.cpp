@@ -0,0 +1,96 @@
+/****************************************************************************************
+ *
+ *   rbtree_order_test.cpp
+ *
+ *   rbSelect, rbRank and rbSize against the positions of keys in a std::map, while
+ *   the tree changes. Built twice: as the library is (a walk over the tree) and with
+ *   RB_ORDER_STATISTICS (a descent over the subtree sizes, checked by isRedBlack).
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+/// Selects every position and ranks every key around the keys of the reference.
+void checkOrder(rbTree tree, const std::map<int, int>& reference) {
+
+    ASSERT_EQ(rbSize(tree), reference.size());
+
+    size_t k = 0;
+    for (auto& kv : reference) {
+        rbPair* pair = rbSelect(tree, k);
+        ASSERT_NE(pair, nullptr) << "position " << k;
+        EXPECT_EQ(pair->key, kv.first) << "position " << k;
+        ++k;
+    }
+    EXPECT_EQ(rbSelect(tree, k), nullptr);
+    EXPECT_EQ(rbSelect(tree, (size_t) -1), nullptr);
+
+    int lo = reference.empty() ? 0 : reference.begin()->first - 1;
+    int hi = reference.empty() ? 0 : reference.rbegin()->first + 1;
+
+    for (int key = lo; key <= hi; ++key) {
+        size_t rank = (size_t) std::distance(reference.begin(), reference.lower_bound(key));
+        EXPECT_EQ(rbRank(tree, key), rank) << "key " << key;
+    }
+}
+
+} // namespace
+
+
+TEST(Order, SelectAndRankMatchStdMap) {
+
+    std::map<int, int> reference;
+    for (int key = 0; key < 2000; key += 3)
+        reference[key] = key;
+
+    std::vector<rbPair> data = pairsOf(reference);
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(data.data(), data.size(), &tree), RB_SUCCESS);
+    EXPECT_TRUE(isRedBlack(tree));
+    checkOrder(tree, reference);
+
+    std::mt19937 random(7);
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < 400; ++i) {
+            int key = (int) (random() % 2500);
+            if (random() % 2) {
+                rbErase(tree, key);
+                reference.erase(key);
+            }
+            else {
+                ASSERT_EQ(rbInsert(tree, rbPair{key, key}), RB_SUCCESS);
+                reference[key] = key;
+            }
+        }
+        EXPECT_TRUE(isRedBlack(tree));
+        checkOrder(tree, reference);
+    }
+
+    rbDestroy(tree);
+}
+
+
+TEST(Order, EmptyTree) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+
+    EXPECT_EQ(rbSelect(tree, 0), nullptr);
+    EXPECT_EQ(rbRank(tree, 5), 0u);
+    EXPECT_EQ(rbSize(tree), 0u);
+
+    rbDestroy(tree);
+
+    EXPECT_EQ(rbSelect(NULL, 0), nullptr);
+    EXPECT_EQ(rbRank(NULL, 0), 0u);
+    EXPECT_EQ(rbSize(NULL), 0u);
+}
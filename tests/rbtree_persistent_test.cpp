@@ -0,0 +1,236 @@
+/****************************************************************************************
+ *
+ *   rbtree_persistent_test.cpp
+ *
+ *   Versions of RB_ENGINE_PERSISTENT containers: random writes, snapshots and
+ *   destructions over a set of versions, each checked against a std::map of its own, so
+ *   that a write to one version never shows in another; and versions changed by
+ *   different threads at once.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+/// A version with the pairs it must hold.
+struct Version {
+    rbTree             tree;
+    std::map<int, int> reference;
+};
+
+
+/// The pairs of the tree walked from the last to the first.
+std::map<int, int> contentsBackward(rbTree tree) {
+
+    std::map<int, int> pairs;
+    for (rbPair* pair = rbLast(tree); pair != NULL; pair = rbPrev(tree, pair))
+        pairs.emplace_hint(pairs.begin(), pair->key, pair->value);
+    return pairs;
+}
+
+
+/// The pairs rbRange passes for [lo, hi].
+std::map<int, int> range(rbTree tree, int lo, int hi) {
+
+    std::map<int, int> pairs;
+    EXPECT_EQ(rbRange(tree, lo, hi, [](rbPair* pair, void* data) {
+        ((std::map<int, int>*) data)->emplace_hint(((std::map<int, int>*) data)->end(),
+                                                   pair->key, pair->value);
+    }, &pairs), RB_SUCCESS);
+    return pairs;
+}
+
+} // namespace
+
+
+TEST(Persistent, EveryVersionKeepsItsOwnPairs) {
+
+    std::mt19937         random(21);
+    std::vector<Version> versions(1);
+
+    ASSERT_EQ(rbCreateWithEngine(NULL, 0, RB_ENGINE_PERSISTENT, &versions[0].tree),
+              RB_SUCCESS);
+
+    for (int step = 0; step < 60000; ++step) {
+        Version& version = versions[random() % versions.size()];
+        unsigned action  = random() % 100;
+        int      key     = (int) (random() % 3000);
+
+        if (action < 55) {
+            ASSERT_EQ(rbInsert(version.tree, rbPair{key, step}), RB_SUCCESS);
+            version.reference[key] = step;
+        }
+        else if (action < 97) {
+            ASSERT_EQ(rbErase(version.tree, key), RB_SUCCESS);
+            version.reference.erase(key);
+        }
+        else if (action < 99 || versions.size() == 1) {
+            if (versions.size() < 12) {
+                Version copy = {NULL, version.reference};
+                ASSERT_EQ(rbSnapshot(version.tree, &copy.tree), RB_SUCCESS);
+                versions.push_back(copy);
+            }
+        }
+        else {
+            // any version may go first, the original one too
+            size_t victim = random() % versions.size();
+            rbDestroy(versions[victim].tree);
+            versions.erase(versions.begin() + victim);
+        }
+
+        if (step % 5000 == 0)
+            for (size_t v = 0; v < versions.size(); ++v) {
+                ASSERT_EQ(contents(versions[v].tree), versions[v].reference)
+                    << "version " << v << ", step " << step;
+                ASSERT_TRUE(isRedBlack(versions[v].tree)) << "version " << v;
+            }
+    }
+
+    for (size_t v = 0; v < versions.size(); ++v) {
+        EXPECT_EQ(contents(versions[v].tree), versions[v].reference) << "version " << v;
+        EXPECT_EQ(contentsBackward(versions[v].tree), versions[v].reference);
+        EXPECT_EQ(rbSize(versions[v].tree), versions[v].reference.size());
+        EXPECT_TRUE(isRedBlack(versions[v].tree)) << "version " << v;
+
+        for (int key = -1; key < 3001; key += 7) {
+            rbPair* lower    = rbLowerBound(versions[v].tree, key);
+            auto    expected = versions[v].reference.lower_bound(key);
+            ASSERT_EQ(lower == NULL, expected == versions[v].reference.end());
+            if (lower != NULL) {
+                EXPECT_EQ(lower->key, expected->first);
+            }
+        }
+
+        const std::map<int, int>& reference = versions[v].reference;
+        for (int lo = -1; lo < 3001; lo += 433)
+            for (int hi = lo; hi < 3001; hi += 271) {
+                std::map<int, int> expected(reference.lower_bound(lo),
+                                            reference.upper_bound(hi));
+                EXPECT_EQ(range(versions[v].tree, lo, hi), expected)
+                    << "[" << lo << ", " << hi << "]";
+            }
+        EXPECT_TRUE(range(versions[v].tree, 2000, 1000).empty());
+    }
+
+    for (Version& version : versions)
+        rbDestroy(version.tree);
+}
+
+
+TEST(Persistent, SnapshotsOfSnapshots) {
+
+    std::vector<rbPair> data;
+    for (int key = 0; key < 1000; ++key)
+        data.push_back(rbPair{key, key});
+
+    rbTree base = NULL, first = NULL, second = NULL;
+    ASSERT_EQ(rbCreateWithEngine(data.data(), data.size(), RB_ENGINE_PERSISTENT, &base),
+              RB_SUCCESS);
+    std::map<int, int> original = contents(base);
+
+    ASSERT_EQ(rbSnapshot(base, &first), RB_SUCCESS);
+    ASSERT_EQ(rbInsert(first, rbPair{5, -5}), RB_SUCCESS);
+    ASSERT_EQ(rbSnapshot(first, &second), RB_SUCCESS);
+    ASSERT_EQ(rbErase(second, 5), RB_SUCCESS);
+    ASSERT_EQ(rbErase(first, 6), RB_SUCCESS);
+
+    // the pair of the base version is untouched by the write to the first one
+    EXPECT_EQ(rbFind(base, 5)->value, 5);
+    EXPECT_EQ(rbFind(first, 5)->value, -5);
+    EXPECT_EQ(rbFind(second, 5), nullptr);
+    EXPECT_EQ(rbFind(first, 6), nullptr);
+    EXPECT_NE(rbFind(second, 6), nullptr);
+
+    rbDestroy(base);
+    rbDestroy(first);
+    EXPECT_EQ(rbSize(second), 999u);
+    EXPECT_TRUE(isRedBlack(second));
+    original.erase(5);
+    EXPECT_EQ(contents(second), original);
+
+    rbDestroy(second);
+}
+
+
+TEST(Persistent, VersionsChangedByDifferentThreads) {
+
+    std::vector<rbPair> data;
+    for (int key = 0; key < 20000; key += 2)
+        data.push_back(rbPair{key, key});
+
+    rbTree base = NULL;
+    ASSERT_EQ(rbCreateWithEngine(data.data(), data.size(), RB_ENGINE_PERSISTENT, &base),
+              RB_SUCCESS);
+    const std::map<int, int> original = contents(base);
+
+    // every version starts with all nodes shared, so their counts of links are changed
+    // by all threads at once
+    const int                       threads = 4;
+    std::vector<rbTree>             versions(threads, NULL);
+    std::vector<std::map<int, int>> expected(threads, original);
+    std::vector<std::thread>        workers;
+
+    for (int t = 0; t < threads; ++t)
+        ASSERT_EQ(rbSnapshot(base, &versions[t]), RB_SUCCESS);
+
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back([t, &versions, &expected] {
+            std::mt19937 random(22 + t);
+            for (int i = 0; i < 20000; ++i) {
+                int key = (int) (random() % 20000);
+                if (random() % 2) {
+                    rbInsert(versions[t], rbPair{key, t});
+                    expected[t][key] = t;
+                }
+                else {
+                    rbErase(versions[t], key);
+                    expected[t].erase(key);
+                }
+            }
+        });
+    for (auto& worker : workers)
+        worker.join();
+
+    EXPECT_EQ(contents(base), original);
+    for (int t = 0; t < threads; ++t) {
+        EXPECT_EQ(contents(versions[t]), expected[t]) << "thread " << t;
+        EXPECT_TRUE(isRedBlack(versions[t]));
+        rbDestroy(versions[t]);
+    }
+
+    rbDestroy(base);
+}
+
+
+TEST(Persistent, OnlyPersistentContainersHaveSnapshots) {
+
+    rbTree tree = NULL, snapshot = NULL;
+
+    for (rbEngine engine : {RB_ENGINE_REDBLACK, RB_ENGINE_BPLUS}) {
+        ASSERT_EQ(rbCreateWithEngine(NULL, 0, engine, &tree), RB_SUCCESS);
+        EXPECT_EQ(rbSnapshot(tree, &snapshot), RB_INVALID_ARGS);
+        rbDestroy(tree);
+    }
+
+    ASSERT_EQ(rbCreateWithEngine(NULL, 0, RB_ENGINE_PERSISTENT, &tree), RB_SUCCESS);
+    EXPECT_EQ(rbSnapshot(tree, NULL), RB_INVALID_ARGS);
+    EXPECT_EQ(rbSnapshot(NULL, &snapshot), RB_INVALID_ARGS);
+
+    // a snapshot of an empty version
+    ASSERT_EQ(rbSnapshot(tree, &snapshot), RB_SUCCESS);
+    ASSERT_EQ(rbInsert(snapshot, rbPair{1, 1}), RB_SUCCESS);
+    EXPECT_EQ(rbSize(tree), 0u);
+    EXPECT_EQ(rbSize(snapshot), 1u);
+
+    rbDestroy(tree);
+    rbDestroy(snapshot);
+}
@@ -0,0 +1,123 @@
+/****************************************************************************************
+ *
+ *   rbtree_pool_test.cpp
+ *
+ *   Pool-backed red-black trees (rbCreateWithPool): random insertions and removals
+ *   against std::map, the reuse of erased nodes and the growth of the pool in slabs.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+TEST(PoolTree, ChurnMatchesStdMap) {
+
+    for (size_t slabNodes : {0, 1, 16, 1000}) {
+        rbTree tree = NULL;
+        ASSERT_EQ(rbCreateWithPool(NULL, 0, slabNodes, &tree), RB_SUCCESS);
+
+        std::map<int, int> reference;
+        std::mt19937       random(slabNodes);
+
+        for (int i = 0; i < 20000; ++i) {
+            int key = (int) (random() % 2000);
+            if (random() % 3 == 0) {
+                rbErase(tree, key);
+                reference.erase(key);
+            }
+            else {
+                ASSERT_EQ(rbInsert(tree, rbPair{key, i}), RB_SUCCESS);
+                reference[key] = i;
+            }
+        }
+
+        EXPECT_TRUE(isRedBlack(tree)) << "slab of " << slabNodes;
+        EXPECT_EQ(contents(tree), reference) << "slab of " << slabNodes;
+
+        ASSERT_EQ(rbClear(tree), RB_SUCCESS);
+        EXPECT_EQ(rbSize(tree), 0u);
+        EXPECT_EQ(rbBegin(tree), nullptr);
+
+        ASSERT_EQ(rbInsert(tree, rbPair{1, 2}), RB_SUCCESS);
+        EXPECT_EQ(contents(tree), (std::map<int, int>{{1, 2}}));
+
+        rbDestroy(tree);
+    }
+}
+
+
+TEST(PoolTree, ErasedNodesAreReused) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreateWithPool(NULL, 0, 64, &tree), RB_SUCCESS);
+
+    for (int key = 0; key < 1000; ++key)
+        ASSERT_EQ(rbInsert(tree, rbPair{key, key}), RB_SUCCESS);
+    size_t memory = rbMemoryUsage(tree);
+
+    // erased nodes are taken again before a new slab is cut
+    for (int round = 1; round <= 10; ++round) {
+        for (int key = 0; key < 1000; ++key)
+            ASSERT_EQ(rbErase(tree, key + (round - 1) * 1000), RB_SUCCESS);
+        for (int key = 0; key < 1000; ++key)
+            ASSERT_EQ(rbInsert(tree, rbPair{key + round * 1000, key}), RB_SUCCESS);
+    }
+
+    EXPECT_EQ(rbMemoryUsage(tree), memory);
+    EXPECT_EQ(rbSize(tree), 1000u);
+    EXPECT_TRUE(isRedBlack(tree));
+
+    rbDestroy(tree);
+}
+
+
+TEST(PoolTree, GrowsBySlabs) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreateWithPool(NULL, 0, 16, &tree), RB_SUCCESS);
+    EXPECT_EQ(rbMemoryUsage(tree), 0u);
+
+    ASSERT_EQ(rbInsert(tree, rbPair{0, 0}), RB_SUCCESS);
+    EXPECT_EQ(rbMemoryUsage(tree), 16 * sizeof(struct rbNode_t));
+
+    for (int key = 1; key < 17; ++key)
+        ASSERT_EQ(rbInsert(tree, rbPair{key, key}), RB_SUCCESS);
+    EXPECT_EQ(rbMemoryUsage(tree), 32 * sizeof(struct rbNode_t));
+
+    rbDestroy(tree);
+}
+
+
+TEST(PoolTree, PairsStayInPlace) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreateWithPool(NULL, 0, 8, &tree), RB_SUCCESS);
+
+    ASSERT_EQ(rbInsert(tree, rbPair{500, 1}), RB_SUCCESS);
+    rbPair* pair = rbFind(tree, 500);
+
+    for (int key = 0; key < 1000; ++key)
+        if (key != 500) {
+            ASSERT_EQ(rbInsert(tree, rbPair{key, key}), RB_SUCCESS);
+        }
+    for (int key = 0; key < 1000; key += 2)
+        if (key != 500) {
+            ASSERT_EQ(rbErase(tree, key), RB_SUCCESS);
+        }
+
+    EXPECT_EQ(rbFind(tree, 500), pair);
+    EXPECT_EQ(pair->value, 1);
+
+    rbDestroy(tree);
+}
+
+
+TEST(PoolTree, RejectsInvalidArguments) {
+
+    EXPECT_EQ(rbCreateWithPool(NULL, 0, 0, NULL), RB_INVALID_ARGS);
+}
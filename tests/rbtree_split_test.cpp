@@ -0,0 +1,203 @@
+/****************************************************************************************
+ *
+ *   rbtree_split_test.cpp
+ *
+ *   rbSplit, rbJoin and rbUnion against the same operations on std::map: red-black
+ *   trees of many sizes split at every kind of key, joined back and united with
+ *   overlapping trees, small and large enough to be united in parallel; the other
+ *   engines, which copy the pairs; and the arguments that are rejected.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+/// A tree of the engine holding the pairs of the reference.
+rbTree treeOf(const std::map<int, int>& reference, rbEngine engine = RB_ENGINE_REDBLACK) {
+
+    std::vector<rbPair> data = pairsOf(reference);
+    rbTree tree = NULL;
+    EXPECT_EQ(rbCreateWithEngine(data.data(), data.size(), engine, &tree), RB_SUCCESS);
+    return tree;
+}
+
+
+/// Random pairs with keys in [lo, hi).
+std::map<int, int> randomPairs(std::mt19937& random, size_t n, int lo, int hi) {
+
+    std::map<int, int> pairs;
+    for (size_t i = 0; i < n; ++i)
+        pairs[lo + (int) (random() % (unsigned) (hi - lo))] = (int) random();
+    return pairs;
+}
+
+} // namespace
+
+
+TEST(Split, SplitAndJoinMatchStdMap) {
+
+    std::mt19937 random(16);
+
+    for (size_t size : {0, 1, 2, 10, 100, 5000}) {
+        std::map<int, int> reference = randomPairs(random, size, 0, (int) size * 4 + 1);
+
+        for (int key : {-1, 0, 1, (int) size, (int) size * 2, (int) size * 4 + 1}) {
+            rbTree tree = treeOf(reference), left = NULL, right = NULL;
+            // grow the tree once more, so not all of its nodes come from one block
+            ASSERT_EQ(rbInsert(tree, rbPair{(int) size * 3, 3}), RB_SUCCESS);
+            std::map<int, int> all = reference;
+            all[(int) size * 3] = 3;
+
+            ASSERT_EQ(rbSplit(tree, key, &left, &right), RB_SUCCESS);
+
+            std::map<int, int> lower(all.begin(), all.lower_bound(key));
+            std::map<int, int> upper(all.lower_bound(key), all.end());
+            EXPECT_EQ(rbSize(tree), 0u);
+            EXPECT_EQ(contents(left), lower) << size << " split at " << key;
+            EXPECT_EQ(contents(right), upper) << size << " split at " << key;
+            EXPECT_TRUE(isRedBlack(left));
+            EXPECT_TRUE(isRedBlack(right));
+
+            ASSERT_EQ(rbJoin(left, right), RB_SUCCESS);
+            EXPECT_EQ(contents(left), all) << size << " joined at " << key;
+            EXPECT_EQ(rbSize(right), 0u);
+            EXPECT_TRUE(isRedBlack(left));
+
+            // the parts go on as any other tree, the emptied ones too
+            ASSERT_EQ(rbInsert(right, rbPair{7, 7}), RB_SUCCESS);
+            ASSERT_EQ(rbErase(left, (int) size * 3), RB_SUCCESS);
+            EXPECT_TRUE(isRedBlack(left));
+            EXPECT_EQ(contents(right), (std::map<int, int>{{7, 7}}));
+
+            rbDestroy(tree);
+            rbDestroy(left);
+            rbDestroy(right);
+        }
+    }
+}
+
+
+TEST(Split, JoinOfTreesOfVeryDifferentHeights) {
+
+    std::mt19937 random(17);
+
+    for (size_t small : {0, 1, 3, 50}) {
+        std::map<int, int> low    = randomPairs(random, small, 0, 1000);
+        std::map<int, int> middle = randomPairs(random, 20000, 1000, 100000);
+        std::map<int, int> high   = randomPairs(random, small, 100000, 101000);
+
+        // the short tree on either side of the tall one
+        for (auto parts : {std::make_pair(low, middle), std::make_pair(middle, high)}) {
+            rbTree left  = treeOf(parts.first);
+            rbTree right = treeOf(parts.second);
+
+            std::map<int, int> all = parts.first;
+            all.insert(parts.second.begin(), parts.second.end());
+
+            ASSERT_EQ(rbJoin(left, right), RB_SUCCESS);
+            EXPECT_EQ(contents(left), all);
+            EXPECT_TRUE(isRedBlack(left));
+
+            rbDestroy(left);
+            rbDestroy(right);
+        }
+    }
+}
+
+
+TEST(Split, UnionMatchesStdMap) {
+
+    std::mt19937 random(18);
+
+    // the last sizes add up to more than RB_UNION_PARALLEL pairs
+    for (auto sizes : std::vector<std::pair<size_t, size_t>>{
+             {0, 0}, {0, 10}, {10, 0}, {1, 1}, {100, 3}, {3, 100}, {1000, 1000}, {50000, 40000}}) {
+        std::map<int, int> a = randomPairs(random, sizes.first, 0, 150000);
+        std::map<int, int> b = randomPairs(random, sizes.second, 0, 150000);
+
+        rbTree ta = treeOf(a), tb = treeOf(b);
+        rbPair* kept = NULL; // a pair only 'a' has
+        for (auto& kv : a)
+            if (b.count(kv.first) == 0) {
+                kept = rbFind(ta, kv.first);
+                break;
+            }
+
+        std::map<int, int> all = b; // a value of 'b' wins
+        all.insert(a.begin(), a.end());
+
+        ASSERT_EQ(rbUnion(ta, tb), RB_SUCCESS);
+        EXPECT_EQ(contents(ta), all) << sizes.first << " and " << sizes.second;
+        EXPECT_EQ(rbSize(tb), 0u);
+        EXPECT_TRUE(isRedBlack(ta));
+        if (kept != NULL) {
+            EXPECT_EQ(rbFind(ta, kept->key), kept);
+        }
+
+        rbDestroy(ta);
+        rbDestroy(tb);
+    }
+}
+
+
+TEST(Split, OtherEnginesCopyThePairs) {
+
+    std::mt19937 random(19);
+
+    for (rbEngine engine : {RB_ENGINE_BPLUS, RB_ENGINE_PERSISTENT}) {
+        std::map<int, int> reference = randomPairs(random, 3000, 0, 10000);
+        std::map<int, int> other     = randomPairs(random, 1000, 0, 10000);
+
+        std::map<int, int> lower(reference.begin(), reference.lower_bound(5000));
+        std::map<int, int> upper(reference.lower_bound(5000), reference.end());
+
+        rbTree tree = treeOf(reference, engine), left = NULL, right = NULL;
+        ASSERT_EQ(rbSplit(tree, 5000, &left, &right), RB_SUCCESS);
+        EXPECT_EQ(contents(left), lower) << "engine " << engine;
+        EXPECT_EQ(contents(right), upper) << "engine " << engine;
+
+        ASSERT_EQ(rbJoin(left, right), RB_SUCCESS);
+        EXPECT_EQ(contents(left), reference);
+
+        rbTree b = treeOf(other, engine);
+        ASSERT_EQ(rbUnion(left, b), RB_SUCCESS);
+        std::map<int, int> all = other;
+        all.insert(reference.begin(), reference.end());
+        EXPECT_EQ(contents(left), all) << "engine " << engine;
+
+        rbDestroy(tree);
+        rbDestroy(left);
+        rbDestroy(right);
+        rbDestroy(b);
+    }
+}
+
+
+TEST(Split, RejectedArguments) {
+
+    rbTree a = treeOf({{1, 1}, {5, 5}}), b = treeOf({{3, 3}}), c = NULL, left, right;
+    ASSERT_EQ(rbCreateConcurrent(NULL, 0, &c), RB_SUCCESS);
+
+    // overlapping keys
+    EXPECT_EQ(rbJoin(a, b), RB_INVALID_ARGS);
+    EXPECT_EQ(contents(a), (std::map<int, int>{{1, 1}, {5, 5}}));
+    EXPECT_EQ(contents(b), (std::map<int, int>{{3, 3}}));
+
+    EXPECT_EQ(rbUnion(a, a), RB_INVALID_ARGS);
+    EXPECT_EQ(rbUnion(a, c), RB_INVALID_ARGS);
+    EXPECT_EQ(rbJoin(c, a), RB_INVALID_ARGS);
+    EXPECT_EQ(rbSplit(c, 0, &left, &right), RB_INVALID_ARGS);
+    EXPECT_EQ(rbSplit(a, 0, NULL, &right), RB_INVALID_ARGS);
+
+    rbDestroy(a);
+    rbDestroy(b);
+    rbDestroy(c);
+}
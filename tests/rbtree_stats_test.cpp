@@ -0,0 +1,323 @@
+/****************************************************************************************
+ *
+ *   rbtree_stats_test.cpp
+ *
+ *   The counters of rbStats, built three times: without RB_STATS, where they are
+ *   rejected; with RB_STATS, against the lengths of the paths through the tree and the
+ *   rebalancing cases every insertion must end in; and with RB_STATS_LATENCY, whose
+ *   histograms count every timed operation once.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RBTree.h"
+#include "rbtree_test.h"
+
+
+namespace {
+
+bool allZero(const rbCounters& counters) {
+
+    const size_t* words = (const size_t*) &counters;
+    for (size_t i = 0; i < sizeof(counters) / sizeof(size_t); ++i)
+        if (words[i] != 0)
+            return false;
+    return true;
+}
+
+
+#ifdef RB_STATS
+/// The number of nodes a descent to the key compares.
+size_t pathLength(rbTree tree, rb_key_type key) {
+
+    size_t nodes = 0;
+    for (rbNode node = tree->treeRoot; node != NULL;
+         node = node->pair.key > key ? node->left : node->right) {
+        ++nodes;
+        if (node->pair.key == key)
+            break;
+    }
+    return nodes;
+}
+
+
+rbCounters countersOf(rbTree tree) {
+
+    rbCounters counters;
+    EXPECT_EQ(rbStats(tree, &counters), RB_SUCCESS);
+    return counters;
+}
+#endif
+
+} // namespace
+
+
+#ifndef RB_STATS
+
+TEST(Stats, RejectedWithoutRbStats) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+    ASSERT_EQ(rbInsert(tree, rbPair{1, 1}), RB_SUCCESS);
+
+    rbCounters counters;
+    memset(&counters, 0xFF, sizeof(counters));
+    EXPECT_EQ(rbStats(tree, &counters), RB_INVALID_ARGS);
+    EXPECT_TRUE(allZero(counters));
+    EXPECT_EQ(rbStatsReset(tree), RB_INVALID_ARGS);
+
+    rbDestroy(tree);
+}
+
+#else
+
+TEST(Stats, DescentsMatchThePathsThroughTheTree) {
+
+    for (rbEngine engine : {RB_ENGINE_REDBLACK, RB_ENGINE_PERSISTENT}) {
+        rbTree tree = NULL;
+        ASSERT_EQ(rbCreateWithEngine(NULL, 0, engine, &tree), RB_SUCCESS);
+
+        std::mt19937 random(24);
+        for (int i = 0; i < 5000; ++i)
+            ASSERT_EQ(rbInsert(tree, rbPair{(int) (random() % 10000), i}), RB_SUCCESS);
+        ASSERT_EQ(rbStatsReset(tree), RB_SUCCESS);
+        EXPECT_TRUE(allZero(countersOf(tree)));
+
+        std::vector<rb_key_type> keys;
+        size_t                   nodes = 0, deepest = 0;
+        for (int i = 0; i < 3000; ++i) {
+            keys.push_back((int) (random() % 10002) - 1); // present or not
+            size_t length = pathLength(tree, keys.back());
+            nodes += length;
+            deepest = std::max(deepest, length);
+        }
+
+        for (rb_key_type key : keys)
+            rbFind(tree, key);
+
+        rbCounters counters = countersOf(tree);
+        EXPECT_EQ(counters.descents, keys.size()) << "engine " << engine;
+        EXPECT_EQ(counters.comparisons, nodes) << "engine " << engine;
+        EXPECT_EQ(counters.maxDepth, deepest) << "engine " << engine;
+        EXPECT_EQ(counters.rotations + counters.allocations + counters.releases, 0u);
+
+        // the interleaved descents of a batch compare the same nodes
+        if (engine == RB_ENGINE_REDBLACK) {
+            std::vector<rbPair*> out(keys.size());
+            ASSERT_EQ(rbStatsReset(tree), RB_SUCCESS);
+            ASSERT_EQ(rbFindBatch(tree, keys.data(), keys.size(), out.data()), RB_SUCCESS);
+
+            counters = countersOf(tree);
+            EXPECT_EQ(counters.descents, keys.size());
+            EXPECT_EQ(counters.comparisons, nodes);
+            EXPECT_EQ(counters.maxDepth, deepest);
+        }
+
+        rbDestroy(tree);
+    }
+}
+
+
+TEST(Stats, EveryInsertionEndsInOneCase) {
+
+    for (rbEngine engine : {RB_ENGINE_REDBLACK, RB_ENGINE_PERSISTENT}) {
+        rbTree tree = NULL;
+        ASSERT_EQ(rbCreateWithEngine(NULL, 0, engine, &tree), RB_SUCCESS);
+
+        std::mt19937 random(25);
+        std::map<int, int> reference;
+        size_t added = 0, removed = 0;
+
+        for (int i = 0; i < 20000; ++i) {
+            int key = (int) (random() % 5000);
+            added += reference.count(key) == 0;
+            reference[key] = i;
+            ASSERT_EQ(rbInsert(tree, rbPair{key, i}), RB_SUCCESS);
+        }
+
+        // an insertion ends with a black root, a black parent or a rotation of case 5,
+        // preceded by the one of case 4 if the new node is an inner grandchild
+        rbCounters counters = countersOf(tree);
+        const size_t* cases = counters.insertCases;
+        EXPECT_EQ(cases[1] + cases[2] + cases[5], added) << "engine " << engine;
+        EXPECT_LE(cases[4], cases[5]);
+        EXPECT_EQ(counters.rotations, cases[4] + cases[5]) << "engine " << engine;
+        if (engine == RB_ENGINE_REDBLACK) {
+            EXPECT_EQ(counters.allocations, added);
+        }
+
+        for (int i = 0; i < 20000; ++i) {
+            int key = (int) (random() % 5000);
+            removed += reference.erase(key);
+            ASSERT_EQ(rbErase(tree, key), RB_SUCCESS);
+        }
+
+        counters = countersOf(tree);
+        size_t deleteCases = 0;
+        for (size_t c : counters.deleteCases)
+            deleteCases += c;
+        EXPECT_GT(deleteCases, 0u);
+        // a persistent removal looks for the key before it copies the path to it
+        EXPECT_EQ(counters.descents, 40000u + (engine == RB_ENGINE_PERSISTENT ? removed : 0))
+            << "engine " << engine;
+        if (engine == RB_ENGINE_REDBLACK) {
+            EXPECT_EQ(counters.releases, removed);
+        }
+        EXPECT_TRUE(isRedBlack(tree));
+
+        rbDestroy(tree);
+    }
+}
+
+
+TEST(Stats, JoinsCountTheirFixUpsInTheContainer) {
+
+    std::vector<rbPair> small = {{-1, -1}}, large;
+    for (int key = 0; key < 1000; ++key)
+        large.push_back(rbPair{key, key});
+
+    // the single node of the left tree is detached and joined with the right tree on its
+    // left spine, a red node fixed up as after an insertion
+    rbTree left = NULL, right = NULL;
+    ASSERT_EQ(rbCreate(small.data(), small.size(), &left), RB_SUCCESS);
+    ASSERT_EQ(rbCreate(large.data(), large.size(), &right), RB_SUCCESS);
+    ASSERT_EQ(rbStatsReset(left), RB_SUCCESS);
+    ASSERT_EQ(rbJoin(left, right), RB_SUCCESS);
+
+    rbCounters counters = countersOf(left);
+    const size_t* cases = counters.insertCases;
+    EXPECT_EQ(cases[1] + cases[2] + cases[5], 1u);
+    EXPECT_EQ(counters.rotations, cases[4] + cases[5]);
+
+    // a split joins the pieces along the path to the key
+    rbTree lower = NULL, upper = NULL;
+    ASSERT_EQ(rbStatsReset(left), RB_SUCCESS);
+    ASSERT_EQ(rbSplit(left, 333, &lower, &upper), RB_SUCCESS);
+
+    counters = countersOf(left);
+    EXPECT_GT(cases[1] + cases[2] + cases[5], 0u);
+    EXPECT_EQ(counters.rotations, cases[4] + cases[5]);
+    EXPECT_TRUE(isRedBlack(lower));
+    EXPECT_TRUE(isRedBlack(upper));
+
+    rbDestroy(left);
+    rbDestroy(right);
+    rbDestroy(lower);
+    rbDestroy(upper);
+}
+
+
+TEST(Stats, ConcurrentReadersCountEveryDescent) {
+
+    std::vector<rbPair> data;
+    for (int key = 0; key < 10000; ++key)
+        data.push_back(rbPair{key, key});
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreateConcurrent(data.data(), data.size(), &tree), RB_SUCCESS);
+    ASSERT_EQ(rbStatsReset(tree), RB_SUCCESS);
+
+    const int                threads = 4, finds = 20000;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < threads; ++t)
+        readers.emplace_back([tree, t] {
+            for (int i = 0; i < finds; ++i)
+                rbFind(tree, (i * 7 + t) % 10000);
+        });
+    for (auto& reader : readers)
+        reader.join();
+
+    EXPECT_EQ(countersOf(tree).descents, (size_t) threads * finds);
+
+    rbDestroy(tree);
+}
+
+
+TEST(Stats, JsonHoldsTheCounters) {
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+    for (int key = 0; key < 100; ++key)
+        ASSERT_EQ(rbInsert(tree, rbPair{key, key}), RB_SUCCESS);
+    rbCounters counters = countersOf(tree);
+
+    FILE* file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(rbStatsToJson(&counters, file), RB_SUCCESS);
+
+    std::string json;
+    char        buf[4096];
+    rewind(file);
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), file)) != 0;)
+        json.append(buf, n);
+    fclose(file);
+
+    EXPECT_NE(json.find("\"descents\": " + std::to_string(counters.descents) + ","),
+              std::string::npos) << json;
+    EXPECT_NE(json.find("\"allocations\": 100,"), std::string::npos) << json;
+    std::string cases;
+    for (int i = 1; i < 6; ++i)
+        cases += (i > 1 ? ", " : "") + std::to_string(counters.insertCases[i]);
+    EXPECT_NE(json.find("\"insertCases\": [" + cases + "],"), std::string::npos) << json;
+    EXPECT_NE(json.find("\"erase\": ["), std::string::npos) << json;
+
+    EXPECT_EQ(rbStatsToJson(NULL, stdout), RB_INVALID_ARGS);
+    EXPECT_EQ(rbStatsToJson(&counters, NULL), RB_INVALID_ARGS);
+
+    rbDestroy(tree);
+}
+
+
+#ifdef RB_STATS_LATENCY
+TEST(Stats, EveryTimedOperationIsRecordedOnce) {
+
+    for (rbEngine engine : {RB_ENGINE_REDBLACK, RB_ENGINE_BPLUS, RB_ENGINE_PERSISTENT}) {
+        rbTree tree = NULL;
+        ASSERT_EQ(rbCreateWithEngine(NULL, 0, engine, &tree), RB_SUCCESS);
+
+        for (int key = 0; key < 3000; ++key)
+            ASSERT_EQ(rbInsert(tree, rbPair{key, key}), RB_SUCCESS);
+        for (int key = 0; key < 2000; ++key)
+            rbFind(tree, key * 2);
+        for (int key = 0; key < 1000; ++key)
+            ASSERT_EQ(rbErase(tree, key * 3), RB_SUCCESS);
+
+        const size_t expected[RB_STATS_OPS] = {2000, 3000, 1000};
+        rbCounters   counters = countersOf(tree);
+        for (int op = 0; op < RB_STATS_OPS; ++op) {
+            size_t recorded = 0;
+            for (size_t n : counters.latency[op])
+                recorded += n;
+            EXPECT_EQ(recorded, expected[op]) << "engine " << engine << ", operation " << op;
+        }
+
+        rbDestroy(tree);
+    }
+}
+#endif
+
+#endif
+
+
+TEST(Stats, InvalidArguments) {
+
+    rbCounters counters;
+    memset(&counters, 0xFF, sizeof(counters));
+    EXPECT_EQ(rbStats(NULL, &counters), RB_INVALID_ARGS);
+    EXPECT_TRUE(allZero(counters));
+    EXPECT_EQ(rbStatsReset(NULL), RB_INVALID_ARGS);
+
+    rbTree tree = NULL;
+    ASSERT_EQ(rbCreate(NULL, 0, &tree), RB_SUCCESS);
+    EXPECT_EQ(rbStats(tree, NULL), RB_INVALID_ARGS);
+    rbDestroy(tree);
+}
@@ -0,0 +1,100 @@
+/****************************************************************************************
+ *
+ *   rbtree_test.h
+ *
+ *   Helpers shared by the tests of the RBTree container: its contents as a std::map,
+ *   to compare with a reference, and a check of the invariants of a red-black tree.
+ *
+ ***/
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "RBTree.h"
+
+
+/// The pairs of the container in key order, as rbForeach passes them.
+inline std::map<int, int> contents(rbTree tree) {
+
+    std::map<int, int> pairs;
+    rbForeach(tree, [](rbPair* pair, void* data) {
+        (*(std::map<int, int>*) data)[pair->key] = pair->value;
+    }, &pairs);
+    return pairs;
+}
+
+
+/// The pairs of a reference, in key order, for rbCreate and the batches.
+inline std::vector<rbPair> pairsOf(const std::map<int, int>& reference) {
+
+    std::vector<rbPair> pairs;
+    for (auto& kv : reference)
+        pairs.push_back(rbPair{kv.first, kv.second});
+    return pairs;
+}
+
+
+/// Checks the subtree of a node; returns its black height, or -1 after a failure.
+inline int checkNode_(rbNode node, rbNode parent, bool parentLinks, size_t* nodes,
+                      const rb_key_type** last, std::string* failure) {
+
+    if (node == NULL)
+        return 1;
+
+    if (parentLinks && node->parent != parent)
+        return *failure = "wrong parent link of " + std::to_string(node->pair.key), -1;
+    if (node->color == RED && parent != NULL && parent->color == RED)
+        return *failure = "red parent of red " + std::to_string(node->pair.key), -1;
+
+    int left = checkNode_(node->left, node, parentLinks, nodes, last, failure);
+    if (left < 0)
+        return -1;
+
+    if (*last != NULL && **last >= node->pair.key)
+        return *failure = "key " + std::to_string(node->pair.key) + " out of order", -1;
+    *last = &node->pair.key;
+    ++*nodes;
+
+    int right = checkNode_(node->right, node, parentLinks, nodes, last, failure);
+    if (right < 0)
+        return -1;
+    if (left != right)
+        return *failure = "unequal black heights below " + std::to_string(node->pair.key), -1;
+
+#ifdef RB_ORDER_STATISTICS
+    size_t count = 1 + (node->left ? node->left->count : 0) +
+                   (node->right ? node->right->count : 0);
+    if (node->count != count)
+        return *failure = "wrong subtree size of " + std::to_string(node->pair.key), -1;
+#endif
+
+    return left + (node->color == BLACK);
+}
+
+
+/// Checks that a container of RB_ENGINE_REDBLACK or RB_ENGINE_PERSISTENT is a valid
+/// red-black tree: keys in order, a black root, no red node with a red child, the same
+/// number of black nodes on every path, parent links (not for persistent nodes), subtree
+/// sizes with RB_ORDER_STATISTICS and the size of the container.
+inline ::testing::AssertionResult isRedBlack(rbTree tree) {
+
+    std::string        failure;
+    size_t             nodes = 0;
+    const rb_key_type* last = NULL;
+
+    if (tree->treeRoot != NULL && tree->treeRoot->color != BLACK)
+        return ::testing::AssertionFailure() << "red root";
+
+    if (checkNode_(tree->treeRoot, NULL, tree->engine != RB_ENGINE_PERSISTENT, &nodes,
+                   &last, &failure) < 0)
+        return ::testing::AssertionFailure() << failure;
+
+    if (nodes != tree->size)
+        return ::testing::AssertionFailure() << nodes << " nodes, size " << tree->size;
+
+    return ::testing::AssertionSuccess();
+}
@@ -0,0 +1,171 @@
+/****************************************************************************************
+ *
+ *   reduce_test.cpp
+ *
+ *   reduce_sum, reduce_max and reduce_minmax of every element type against plain loops:
+ *   exactly for integers and extremes, within the bound of Reduce.h for float sums; for
+ *   lengths around the vector widths and REDUCE_BLOCK, inputs reduced by a pool of
+ *   threads, every instruction set, and results that must not depend on the number of
+ *   threads.
+ *
+ ***/
+#include <gtest/gtest.h>
+
+#include <math.h>
+#include <string.h>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "Operation.h"
+#include "Reduce.h"
+
+
+namespace {
+
+const OpIsa ISAS[] = {OP_ISA_SCALAR, OP_ISA_SSE2, OP_ISA_AVX2, OP_ISA_AVX512};
+
+/// Around the vector widths, around REDUCE_BLOCK, and above REDUCE_PARALLEL_MIN.
+const size_t LENGTHS[] = {1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 129, 1000,
+                          REDUCE_BLOCK - 1, REDUCE_BLOCK, REDUCE_BLOCK + 1,
+                          REDUCE_PARALLEL_MIN + 17};
+
+
+/// Values of the whole range of an integer type, or in [-1000, 1000] for floats.
+template <typename T>
+std::vector<T> randomValues(std::mt19937_64& random, size_t n) {
+
+    std::vector<T> values(n);
+    for (T& v : values)
+        if (std::numeric_limits<T>::is_integer)
+            v = (T) random();
+        else
+            v = (T) ((double) random() / (double) random.max() * 2000.0 - 1000.0);
+    return values;
+}
+
+
+/// Checks the reductions of the values against plain loops.
+template <typename T>
+void checkReductions(const std::vector<T>& values) {
+
+    size_t      n = values.size();
+    long double sum = 0, sumAbs = 0;
+    uint64_t    wrapped = 0;
+    T           lo = values[0], hi = values[0];
+
+    for (T v : values) {
+        sum += v;
+        sumAbs += fabsl((long double) v);
+        wrapped += (uint64_t) (ReduceSum<T>) v;
+        lo = v < lo ? v : lo;
+        hi = v > hi ? v : hi;
+    }
+
+    ReduceSum<T> result = reduce_sum(values);
+    if (std::numeric_limits<T>::is_integer)
+        ASSERT_EQ((uint64_t) result, wrapped) << n << " elements";
+    else {
+        long double u = std::numeric_limits<T>::epsilon() / 2;
+        long double m = REDUCE_BLOCK + n / REDUCE_BLOCK;
+        ASSERT_LE(fabsl((long double) result - sum), m * u * sumAbs) << n << " elements";
+    }
+
+    T min = 0, max = 0;
+    ASSERT_TRUE(reduce_max(values, &max));
+    ASSERT_EQ(max, hi) << n << " elements";
+
+    max = 0;
+    ASSERT_TRUE(reduce_minmax(values, &min, &max));
+    ASSERT_EQ(min, lo) << n << " elements";
+    ASSERT_EQ(max, hi) << n << " elements";
+}
+
+
+template <typename T>
+class Reduce : public ::testing::Test {};
+
+typedef ::testing::Types<signed char, unsigned char, short, unsigned short, int, unsigned,
+                         long, unsigned long, long long, unsigned long long, float, double>
+    ElementTypes;
+
+} // namespace
+
+
+TYPED_TEST_SUITE(Reduce, ElementTypes);
+
+
+TYPED_TEST(Reduce, MatchesPlainLoops) {
+
+    std::mt19937_64 random(32);
+
+    for (size_t n : LENGTHS) {
+        std::vector<TypeParam> values = randomValues<TypeParam>(random, n);
+        checkReductions(values);
+
+        // the extremes in the first and the last element, where the tails are
+        values.front() = std::numeric_limits<TypeParam>::max();
+        values.back() = std::numeric_limits<TypeParam>::lowest();
+        checkReductions(values);
+        std::swap(values.front(), values.back());
+        checkReductions(values);
+    }
+}
+
+
+TYPED_TEST(Reduce, EveryInstructionSet) {
+
+    std::mt19937_64 random(33);
+    OpIsa           initial = op_isa();
+
+    for (OpIsa isa : ISAS) {
+        if (!op_use_isa(isa))
+            continue;
+        SCOPED_TRACE(testing::Message() << "instruction set " << isa);
+
+        for (size_t n : {1, 5, 33, 1000, REDUCE_BLOCK + 3, 3 * REDUCE_BLOCK})
+            checkReductions(randomValues<TypeParam>(random, n));
+    }
+
+    op_use_isa(initial);
+}
+
+
+TYPED_TEST(Reduce, IndependentOfTheNumberOfThreads) {
+
+    std::mt19937_64        random(34);
+    std::vector<TypeParam> values = randomValues<TypeParam>(random, REDUCE_PARALLEL_MIN * 2 + 5);
+
+    reduce_use_threads(1);
+    ReduceSum<TypeParam> sum = reduce_sum(values);
+    TypeParam            min, max;
+    ASSERT_TRUE(reduce_minmax(values, &min, &max));
+
+    // more threads than CPUs as well, and one per CPU
+    for (unsigned threads : {2, 3, 7, 0}) {
+        reduce_use_threads(threads);
+        TypeParam lo, hi;
+
+        // the same bits, not only within the bound
+        ReduceSum<TypeParam> again = reduce_sum(values);
+        EXPECT_EQ(memcmp(&again, &sum, sizeof(sum)), 0) << threads << " threads";
+        ASSERT_TRUE(reduce_minmax(values, &lo, &hi));
+        EXPECT_EQ(lo, min);
+        EXPECT_EQ(hi, max);
+    }
+
+    reduce_use_threads(0);
+    checkReductions(values);
+}
+
+
+TEST(ReduceEmpty, NothingToReduce) {
+
+    std::vector<int> none;
+    int              min = 5, max = 6;
+
+    EXPECT_EQ(reduce_sum(none), 0);
+    EXPECT_FALSE(reduce_max(none, &max));
+    EXPECT_FALSE(reduce_minmax(none, &min, &max));
+    EXPECT_EQ(reduce_sum((const double*) NULL, 0), 0.0);
+}